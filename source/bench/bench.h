@@ -0,0 +1,136 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus benchmark helpers
+ */
+
+#ifndef MB_BENCH
+#define MB_BENCH
+
+#include "sp_mb.h"
+
+#define BENCH_DFT_PORT   15020
+#define BENCH_DFT_COUNT  2000
+#define BENCH_DFT_NREG   10
+#define BENCH_DFT_WINDOW 16
+#define BENCH_DFT_DEVICE 500
+#define BENCH_SCAN_SIZE  40    /* requests of one scan cycle */
+#define BENCH_URING_DEVICE 16
+#define BENCH_UNIX_PATH  "/tmp/mb_bench.sock"
+
+typedef struct 
+{
+    UINT16_T port;
+    UINT32_T count;
+    UINT16_T n_reg;
+    UINT16_T window;
+    int      devices;
+    char    *serial;    /* RTU slaver of the rtu cases, NULL=a built-in one on a pty */
+} BENCH_CTL_T;
+
+typedef enum
+{
+    BENCH_SYS_SEND = 0,
+    BENCH_SYS_RECV,
+    BENCH_SYS_POLL,
+    BENCH_SYS_GETSOCKOPT,
+    BENCH_SYS_EPOLL_WAIT,
+    BENCH_SYS_SENDMSG,
+    BENCH_SYS_URING_ENTER,
+    BENCH_SYS_NUM
+} BENCH_SYS_T;
+
+typedef struct 
+{
+    UINT32_T  count;
+    UINT64_T *sample;   /* latency of every transaction(us) */
+    UINT64_T  start;
+    UINT64_T  stop;
+} BENCH_STAT_T;
+
+/*
+ * Function  : start a local ModBus TCP slaver thread on 127.0.0.1
+ * port      : listen port
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_slave_start(UINT16_T port);
+
+/*
+ * Function  : start a local ModBus slaver thread on an AF_UNIX path
+ * path      : listen path
+ * sock      : one end of a socketpair served too, -1=NONE
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_slave_start_unix(const char *path, int sock);
+
+/*
+ * Function  : create latency statistics for count samples
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_stat_init(BENCH_STAT_T *stat, UINT32_T count);
+
+/*
+ * Function  : release latency statistics
+ * return    : void
+ */
+void bench_stat_exit(BENCH_STAT_T *stat);
+
+/*
+ * Function  : print throughput, average and percentile latency
+ * name      : name of the benchmark case
+ * return    : void
+ */
+void bench_stat_show(const char *name, BENCH_STAT_T *stat);
+
+/*
+ * Function  : restart syscall counting of the calling thread
+ * return    : void
+ */
+void bench_syscall_reset(void);
+
+/*
+ * Function  : print syscalls per transaction of the calling thread
+ * name      : name of the benchmark case
+ * count     : transaction number
+ * return    : void
+ */
+void bench_syscall_show(const char *name, UINT32_T count);
+
+int bench_tcp_latency(BENCH_CTL_T *ctl);
+
+int bench_tcp_pipeline(BENCH_CTL_T *ctl);
+
+int bench_tcp_scan(BENCH_CTL_T *ctl);
+
+int bench_engine(BENCH_CTL_T *ctl);
+
+int bench_uring(BENCH_CTL_T *ctl);
+
+int bench_server(BENCH_CTL_T *ctl);
+
+int bench_unix(BENCH_CTL_T *ctl);
+
+int bench_crc(BENCH_CTL_T *ctl);
+
+int bench_rtu(BENCH_CTL_T *ctl);
+
+int bench_rtu_bus(BENCH_CTL_T *ctl);
+
+int bench_rtu_broadcast(BENCH_CTL_T *ctl);
+
+int bench_rtu_sniff(BENCH_CTL_T *ctl);
+
+int bench_ascii(BENCH_CTL_T *ctl);
+
+int bench_rtu_tcp(BENCH_CTL_T *ctl);
+
+int bench_info(BENCH_CTL_T *ctl);
+
+int bench_coil(BENCH_CTL_T *ctl);
+
+int bench_reg(BENCH_CTL_T *ctl);
+
+int bench_value(BENCH_CTL_T *ctl);
+
+int bench_prepared(BENCH_CTL_T *ctl);
+
+#endif
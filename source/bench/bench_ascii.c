@@ -0,0 +1,382 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus ASCII, table driven hex codec against sprintf/sscanf and round trips
+ *            against a slaver on a pseudo terminal
+ */
+
+#define _GNU_SOURCE /* ptsname_r */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+
+#include "bench.h"
+#include "mb_slave.h"
+
+#define BENCH_ASCII_FRAME 255        /* address + PDU + LRC, the longest one */
+#define BENCH_ASCII_BYTES (16 << 20) /* bytes of every codec measurement */
+#define BENCH_ASCII_BAUD  19200
+
+typedef struct
+{
+    int            fd;        /* master side of the pty */
+    int            hold_fd;   /* slave side, kept open so closing a context is no hangup */
+    MBSLV_STORE_T *store;
+} BENCH_ASCII_SLAVE_T;
+
+static UINT64_T bench_ascii_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the nibble by nibble way the codec replaces */
+static int bench_sprintf_encode(UINT8_T *dst, const UINT8_T *src, int len)
+{
+    char hex[3];
+    int  i = 0;
+
+    for (i = 0; i < len; ++i)
+    {
+        snprintf(hex, sizeof(hex), "%02X", src[i]);
+        dst[i * 2]       = hex[0];
+        dst[(i * 2) + 1] = hex[1];
+    }
+
+    return len * 2;
+}
+
+static int bench_sscanf_decode(UINT8_T *dst, const UINT8_T *src, int len)
+{
+    char hex[3] = {0};
+    unsigned int byte = 0;
+    int  i = 0;
+
+    for (i = 0; i < len / 2; ++i)
+    {
+        hex[0] = src[i * 2];
+        hex[1] = src[(i * 2) + 1];
+        if (1 != sscanf(hex, "%2x", &byte))
+        {
+            return -1;
+        }
+        dst[i] = (UINT8_T)byte;
+    }
+
+    return len / 2;
+}
+
+/*
+ * Function  : answer every frame at once, the pty has no line speed
+ * return    : NULL
+ */
+static void *bench_ascii_routine(void *arg)
+{
+    BENCH_ASCII_SLAVE_T *slave   = (BENCH_ASCII_SLAVE_T *)arg;
+    MB_DATA_T           *mb_data = mb_data_create(MBRTU_FRAME_SIZE);
+    UINT8_T  rx[MBASCII_FRAME_SIZE];
+    UINT8_T  tx[MBASCII_FRAME_SIZE];
+    int      len    = 0;
+    int      length = 0;
+    int      n      = 0;
+
+    while (mb_data)
+    {
+        length = read(slave->fd, rx + len, sizeof(rx) - len);
+        if (0 >= length)
+        {
+            break;
+        }
+
+        len += length;
+        if (len < 3 || '\n' != rx[len - 1])
+        {
+            len = (len < sizeof(rx)) ? len : 0;
+            continue;
+        }
+
+        /* ':' + hex + CRLF */
+        n   = mb_ascii_hex_decode(mb_data->data, rx + 1, len - 3);
+        len = 0;
+        if (3 > n || mb_ascii_lrc(mb_data->data, n))
+        {
+            continue;
+        }
+
+        mb_data->data_len = n - 1;
+        mb_data->offset   = 1;
+
+        if (0 == mb_slave_handle(slave->store, mb_data) && MBRTU_BROADCAST == mb_data->data[0])
+        {
+            continue;
+        }
+
+        mb_data->data[mb_data->data_len] = mb_ascii_lrc(mb_data->data, mb_data->data_len);
+        mb_data->data_len++;
+
+        n = 0;
+        tx[n++] = MBASCII_START;
+        n += mb_ascii_hex_encode(tx + n, mb_data->data, mb_data->data_len);
+        tx[n++] = '\r';
+        tx[n++] = '\n';
+
+        if (n != write(slave->fd, tx, n))
+        {
+            break;
+        }
+    }
+
+    mb_data_destory(mb_data);
+
+    return NULL;
+}
+
+/*
+ * Function  : start a ModBus ASCII slaver thread on a new pseudo terminal
+ * serial    : path of the slave side, for mb_ascii_init
+ * len       : size of serial
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_ascii_slave_start(char *serial, int len)
+{
+    static MBSLV_CTL_T slv_ctl = {
+        .n_coil    = 0x10000,
+        .n_holding = 0x10000,
+        .n_input   = 0x10000,
+    };
+    BENCH_ASCII_SLAVE_T *slave = NULL;
+    struct termios option;
+    pthread_t pid;
+    UINT32_T  i = 0;
+
+    slave = (BENCH_ASCII_SLAVE_T *)malloc(sizeof(BENCH_ASCII_SLAVE_T));
+    if (!slave)
+    {
+        return -1;
+    }
+
+    slave->fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (0 > slave->fd || 0 > grantpt(slave->fd) || 0 > unlockpt(slave->fd) ||
+        0 != ptsname_r(slave->fd, serial, len))
+    {
+        perror("pseudo terminal error");
+        free(slave);
+        return -1;
+    }
+
+    slave->hold_fd = open(serial, O_RDWR | O_NOCTTY);
+    if (0 > slave->hold_fd)
+    {
+        perror("open error");
+        close(slave->fd);
+        free(slave);
+        return -1;
+    }
+
+    tcgetattr(slave->fd, &option);
+    cfmakeraw(&option);
+    tcsetattr(slave->fd, TCSANOW, &option);
+
+    slave->store = mb_slave_store_create(&slv_ctl);
+    if (!slave->store)
+    {
+        close(slave->hold_fd);
+        close(slave->fd);
+        free(slave);
+        return -1;
+    }
+
+    for (i = 0; i < 0x10000; ++i)
+    {
+        slave->store->holding[i] = i;
+    }
+
+    if (pthread_create(&pid, NULL, bench_ascii_routine, slave))
+    {
+        mb_slave_store_destory(slave->store);
+        close(slave->hold_fd);
+        close(slave->fd);
+        free(slave);
+        return -1;
+    }
+    pthread_detach(pid);
+
+    return 0;
+}
+
+/*
+ * Function  : hex codec of the longest frame, the table against sprintf/sscanf, results
+ *             are checked against each other first
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_ascii_codec(void)
+{
+    static const struct
+    {
+        const char *name;
+        int (*encode)(UINT8_T *dst, const UINT8_T *src, int len);
+        int (*decode)(UINT8_T *dst, const UINT8_T *src, int len);
+    } codec[] = {
+        { "ascii_table",   mb_ascii_hex_encode,  mb_ascii_hex_decode },
+        { "ascii_sprintf", bench_sprintf_encode, bench_sscanf_decode },
+    };
+
+    UINT8_T  frame[BENCH_ASCII_FRAME];
+    UINT8_T  hex[2][BENCH_ASCII_FRAME * 2];
+    UINT8_T  back[BENCH_ASCII_FRAME];
+    UINT64_T loop = BENCH_ASCII_BYTES / BENCH_ASCII_FRAME;
+    UINT64_T n    = 0;
+    UINT64_T enc  = 0;
+    UINT64_T dec  = 0;
+    char name[32] = {0};
+    int  c = 0;
+    int  i = 0;
+
+    for (i = 0; i < sizeof(frame); ++i)
+    {
+        frame[i] = (UINT8_T)(i * 37 + 11);
+    }
+
+    for (c = 0; c < ITEM(codec); ++c)
+    {
+        codec[c].encode(hex[c], frame, sizeof(frame));
+        if (sizeof(frame) != codec[c].decode(back, hex[c], sizeof(hex[c])) || memcmp(back, frame, sizeof(frame)))
+        {
+            printf("%s does not decode its own hex\n", codec[c].name);
+            return -1;
+        }
+    }
+
+    if (memcmp(hex[0], hex[1], sizeof(hex[0])))
+    {
+        printf("hex of the codecs differ\n");
+        return -1;
+    }
+
+    /* a lower case digit is valid, a colon inside the frame is not */
+    hex[0][0] = 'a';
+    hex[0][1] = ':';
+    if (0 <= mb_ascii_hex_decode(back, hex[0], sizeof(hex[0])))
+    {
+        printf("ascii_table took a non hex digit\n");
+        return -1;
+    }
+
+    for (c = 0; c < ITEM(codec); ++c)
+    {
+        /* sprintf/sscanf are slow, a sixteenth of the frames is enough */
+        loop = BENCH_ASCII_BYTES / BENCH_ASCII_FRAME / (c ? 16 : 1);
+
+        enc = bench_ascii_ns();
+        for (n = 0; n < loop; ++n)
+        {
+            frame[0] = (UINT8_T)n;
+            codec[c].encode(hex[c], frame, sizeof(frame));
+        }
+        enc = bench_ascii_ns() - enc;
+
+        dec = bench_ascii_ns();
+        for (n = 0; n < loop; ++n)
+        {
+            hex[c][0] = "0123456789ABCDEF"[n & 0xf];
+            codec[c].decode(back, hex[c], sizeof(hex[c]));
+        }
+        dec = bench_ascii_ns() - dec;
+
+        snprintf(name, sizeof(name), "%s(%d)", codec[c].name, BENCH_ASCII_FRAME);
+        printf("%-24s : encode %8.1f ns/frame %8.1f MB/s  decode %8.1f ns/frame %8.1f MB/s\n", name,
+            (double)enc / loop, (double)loop * sizeof(frame) * 1000 / (enc ? enc : 1),
+            (double)dec / loop, (double)loop * sizeof(frame) * 1000 / (dec ? dec : 1));
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : hex codec speed, then FC03 round trips against an ASCII slaver on a pty,
+ *             the pty does not pace the bytes, so latency is the framing and codec cost
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_ascii(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBRTU_CTL_T rtu_ctl = {
+        .max_data_size = MBRTU_FRAME_SIZE,
+        .slaver_addr   = 1,
+        .baudrate      = BENCH_ASCII_BAUD,
+        .databit       = 8,
+        .stopbit       = 1,
+    };
+    MBASCII_CTX_T *mbascii_ctx = NULL;
+    BENCH_STAT_T   stat;
+    MB_INFO_T      mb_info;
+    UINT64_T       begin = 0;
+    int ret = 0;
+    int i   = 0;
+
+    if (0 > bench_ascii_codec())
+    {
+        return -1;
+    }
+
+    if (0 > bench_ascii_slave_start(rtu_ctl.serial, sizeof(rtu_ctl.serial)) ||
+        !(mbascii_ctx = mb_ascii_init(&rtu_ctl)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, ctl->count))
+    {
+        mb_ascii_close(mbascii_ctx);
+        return -1;
+    }
+
+    stat.start = mb_time_us();
+
+    for (i = 0; i < ctl->count; ++i)
+    {
+        memset(&mb_info, 0, sizeof(mb_info));
+        mb_info.code  = MB_FUNC_03;
+        mb_info.reg   = i % 100;
+        mb_info.n_reg = ctl->n_reg;
+
+        begin = mb_time_us();
+
+        mbasciictx_info_updata(mbascii_ctx, &mb_info);
+        if (0 > mb_ascii_send(mbascii_ctx) || 0 > mb_ascii_recv(mbascii_ctx))
+        {
+            ret = -1;
+            break;
+        }
+
+        stat.sample[stat.count++] = mb_time_us() - begin;
+
+        /* holding registers hold their own address */
+        mbasciictx_info_takeout(mbascii_ctx, &mb_info);
+        if (mb_info.n_byte != ctl->n_reg * 2 || mb_info.value[1] != (UINT8_T)(i % 100))
+        {
+            printf("ascii : wrong response to request %d\n", i);
+            ret = -1;
+            break;
+        }
+    }
+
+    stat.stop = mb_time_us();
+
+    bench_stat_show("ascii(FC03)", &stat);
+
+    bench_stat_exit(&stat);
+    mb_ascii_close(mbascii_ctx);
+
+    return ret;
+}
@@ -0,0 +1,165 @@
+/*
+ * Author   : shawn-tany
+ * Function : coil pack/unpack variants on the full 2000 coil range, a read is packed bytes
+ *            of a response to one byte per coil, a write the other way round
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_COIL_LOOP 1000000
+
+static UINT64_T bench_coil_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Function  : the bit by bit loops coils went through before the bitmap API
+ * return    : void
+ */
+static void bench_coil_bytewise(UINT8_T *packed, UINT8_T *coils, int n, int write)
+{
+    int i = 0;
+
+    if (write)
+    {
+        memset(packed, 0, ALIGNED(n, 8));
+        for (i = 0; i < n; ++i)
+        {
+            packed[i >> 3] |= (!!coils[i]) << (i & 7);
+        }
+    }
+    else
+    {
+        for (i = 0; i < n; ++i)
+        {
+            coils[i] = (packed[i >> 3] >> (i & 7)) & 1;
+        }
+    }
+}
+
+/*
+ * Function  : time BENCH_COIL_LOOP reads and writes, impl < 0 is the bit by bit loop
+ * return    : void
+ */
+static void bench_coil_run(int impl, UINT8_T *packed, UINT8_T *coils, int n)
+{
+    mb_coil_pack_fn_t   pack   = (0 > impl) ? NULL : mb_coil_pack_get(impl);
+    mb_coil_unpack_fn_t unpack = (0 > impl) ? NULL : mb_coil_unpack_get(impl);
+    UINT64_T bitmap[MBCOIL_WORDS(MBCOIL_MAX_NUM)];
+    UINT64_T ns[2] = {0};
+    UINT32_T loop  = 0;
+    char name[32]  = {0};
+    int  write     = 0;
+
+    for (write = 0; write < 2; ++write)
+    {
+        ns[write] = bench_coil_ns();
+
+        for (loop = 0; loop < BENCH_COIL_LOOP; ++loop)
+        {
+            if (0 > impl)
+            {
+                bench_coil_bytewise(packed, coils, n, write);
+            }
+            else if (write)
+            {
+                pack(bitmap, coils, n);
+                mb_coil_store(packed, bitmap, n);
+            }
+            else
+            {
+                mb_coil_load(bitmap, packed, n);
+                unpack(coils, bitmap, n);
+            }
+
+            /* keep the compiler from dropping all but the last round */
+            __asm__ __volatile__("" : : "r"(packed), "r"(coils) : "memory");
+        }
+
+        ns[write] = bench_coil_ns() - ns[write];
+    }
+
+    snprintf(name, sizeof(name), "coil_%s(%d)", (0 > impl) ? "bytewise" : mb_coil_name(impl), n);
+    printf("%-24s : read %8.1f ns, write %8.1f ns\n", name,
+        (double)ns[0] / BENCH_COIL_LOOP, (double)ns[1] / BENCH_COIL_LOOP);
+}
+
+/*
+ * Function  : every variant checked against the bit by bit loop, then timed on
+ *             the longest FC0F write(1968 coils) and FC01 read(2000 coils)
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_coil(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    UINT64_T bitmap[MBCOIL_WORDS(MBCOIL_MAX_NUM)];
+    UINT8_T  coils[MBCOIL_MAX_NUM];
+    UINT8_T  check[MBCOIL_MAX_NUM];
+    UINT8_T  packed[ALIGNED(MBCOIL_MAX_NUM, 8)];
+    UINT8_T  expect[ALIGNED(MBCOIL_MAX_NUM, 8)];
+    UINT32_T seed = 1;
+    int impl = 0;
+    int n    = 0;
+    int i    = 0;
+
+    for (i = 0; i < MBCOIL_MAX_NUM; ++i)
+    {
+        seed     = seed * 1103515245 + 12345;
+        coils[i] = (seed >> 16) & 1;
+    }
+
+    printf("coil variant used        : %s\n", mb_coil_name(mb_coil_impl()));
+
+    for (impl = 0; impl < MBCOIL_IMPL_NUM; ++impl)
+    {
+        if (!mb_coil_pack_get(impl))
+        {
+            printf("coil variant %s is not supported\n", mb_coil_name(impl));
+            continue;
+        }
+
+        for (n = 1; n <= MBCOIL_MAX_NUM; ++n)
+        {
+            bench_coil_bytewise(expect, coils, n, 1);
+            mb_coil_pack_get(impl)(bitmap, coils, n);
+            mb_coil_store(packed, bitmap, n);
+
+            mb_coil_load(bitmap, expect, n);
+            mb_coil_unpack_get(impl)(check, bitmap, n);
+
+            if (memcmp(packed, expect, ALIGNED(n, 8)) || memcmp(check, coils, n))
+            {
+                printf("coil variant %s differs from bytewise, %d coils\n", mb_coil_name(impl), n);
+                return -1;
+            }
+        }
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        n = i ? MBCOIL_MAX_NUM : 1968;
+
+        bench_coil_run(-1, packed, coils, n);
+        for (impl = 0; impl < MBCOIL_IMPL_NUM; ++impl)
+        {
+            if (mb_coil_pack_get(impl))
+            {
+                bench_coil_run(impl, packed, coils, n);
+            }
+        }
+    }
+
+    return 0;
+}
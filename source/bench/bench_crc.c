@@ -0,0 +1,125 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus CRC16 variants, bytes per cycle on frame sized and bulk buffers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "bench.h"
+
+#define BENCH_CRC_BYTES (64 << 20)   /* bytes of every measurement */
+
+static UINT64_T bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Function  : reference counter, TSC ticks at the nominal frequency on x86, ns elsewhere
+ * return    : counter
+ */
+static UINT64_T bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return bench_ns();
+#endif
+}
+
+/*
+ * Function  : every variant on 8(request), 256(max RTU frame) and 4096 byte buffers,
+ *             results are checked against the bitwise variant first
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_crc(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    static const int size[] = { 8, 256, 4096 };
+
+    mb_crc16_fn_t bitwise = mb_crc16_get(MBCRC_BITWISE);
+    mb_crc16_fn_t fn      = NULL;
+    UINT8_T *buf   = NULL;
+    UINT64_T loop  = 0;
+    UINT64_T n     = 0;
+    UINT64_T cycle = 0;
+    UINT64_T ns    = 0;
+    UINT32_T seed  = 1;
+    volatile UINT16_T sink = 0;
+    char name[32] = {0};
+    int  impl = 0;
+    int  i    = 0;
+    int  len  = 0;
+
+    buf = (UINT8_T *)malloc(size[ITEM(size) - 1]);
+    if (!buf)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < size[ITEM(size) - 1]; ++i)
+    {
+        seed   = seed * 1103515245 + 12345;
+        buf[i] = (UINT8_T)(seed >> 16);
+    }
+
+    printf("crc variant used         : %s\n", mb_crc16_name(mb_crc16_impl()));
+
+    for (impl = 0; impl < MBCRC_IMPL_NUM; ++impl)
+    {
+        if (!(fn = mb_crc16_get(impl)))
+        {
+            printf("crc variant %s is not supported\n", mb_crc16_name(impl));
+            continue;
+        }
+
+        for (len = 0; len <= size[ITEM(size) - 1]; ++len)
+        {
+            if (fn(buf, len) != bitwise(buf, len))
+            {
+                printf("crc variant %s differs from bitwise, length %d\n", mb_crc16_name(impl), len);
+                free(buf);
+                return -1;
+            }
+        }
+
+        for (i = 0; i < ITEM(size); ++i)
+        {
+            /* bitwise is slow, an eighth of the bytes is enough */
+            loop = BENCH_CRC_BYTES / size[i] / ((MBCRC_BITWISE == impl) ? 8 : 1);
+
+            ns    = bench_ns();
+            cycle = bench_cycles();
+            for (n = 0; n < loop; ++n)
+            {
+                sink ^= fn(buf, size[i]);
+            }
+            cycle = bench_cycles() - cycle;
+            ns    = bench_ns() - ns;
+
+            snprintf(name, sizeof(name), "crc_%s(%d)", mb_crc16_name(impl), size[i]);
+            printf("%-24s : %8.3f bytes/cycle %10.1f MB/s %8.1f ns/frame\n", name,
+                (double)loop * size[i] / (cycle ? cycle : 1),
+                (double)loop * size[i] * 1000 / (ns ? ns : 1),
+                (double)ns / loop);
+        }
+    }
+
+    (void)sink;
+    free(buf);
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Author   : shawn-tany
+ * Function : epoll engine benchmark, scales the device number against local slavers
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "mb_engine.h"
+
+typedef struct 
+{
+    BENCH_STAT_T *stat;
+    MB_INFO_T    *request;
+    UINT64_T     *sent;
+    UINT32_T      submit;
+    UINT32_T      total;
+    UINT32_T      failed;
+} BENCH_ENGINE_T;
+
+static void bench_engine_cb(MBENG_CTX_T *mbeng_ctx, int id, UINT16_T transaction_code,
+    MB_INFO_T *mb_info, void *arg)
+{
+    BENCH_ENGINE_T *bench = (BENCH_ENGINE_T *)arg;
+    UINT64_T now = mb_time_us();
+
+    if (!mb_info)
+    {
+        bench->failed++;
+    }
+    else
+    {
+        bench->stat->sample[bench->stat->count++] = now - bench->sent[id];
+    }
+
+    /* cyclic scan, the next request of this device */
+    if (bench->submit < bench->total)
+    {
+        bench->sent[id] = now;
+        if (0 == mb_engine_submit(mbeng_ctx, id, &bench->request[id]))
+        {
+            bench->submit++;
+        }
+    }
+}
+
+static int bench_engine_scale(BENCH_CTL_T *ctl, int n_dev)
+{
+    MBTCP_CTL_T tcp_ctl = {
+        .port          = ctl->port + 2,
+        .ip            = "127.0.0.1",
+        .ethdev        = "lo",
+        .max_data_size = 1400,
+        .unitid        = 1,
+        .window        = 1,
+    };
+    MBENG_CTX_T   *mbeng_ctx = NULL;
+    MBTCP_CTX_T  **dev       = NULL;
+    BENCH_STAT_T   stat;
+    BENCH_ENGINE_T bench     = {0};
+    char name[32] = {0};
+    int  ret = 0;
+    int  i   = 0;
+
+    dev           = (MBTCP_CTX_T **)calloc(n_dev, sizeof(MBTCP_CTX_T *));
+    bench.request = (MB_INFO_T *)calloc(n_dev, sizeof(MB_INFO_T));
+    bench.sent    = (UINT64_T *)calloc(n_dev, sizeof(UINT64_T));
+    bench.stat    = &stat;
+    bench.total   = ctl->count;
+    mbeng_ctx     = mb_engine_create(n_dev);
+
+    if (!dev || !bench.request || !bench.sent || !mbeng_ctx || 0 > bench_stat_init(&stat, ctl->count))
+    {
+        ret = -1;
+        goto out;
+    }
+
+    for (i = 0; i < n_dev; ++i)
+    {
+        if (!(dev[i] = mb_tcp_init(&tcp_ctl)) ||
+            0 > mb_engine_add(mbeng_ctx, dev[i], bench_engine_cb, &bench))
+        {
+            ret = -1;
+            goto out;
+        }
+
+        bench.request[i].code  = MB_FUNC_03;
+        bench.request[i].reg   = i % 100;
+        bench.request[i].n_reg = ctl->n_reg;
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    /* one request in flight per device */
+    for (i = 0; i < n_dev && bench.submit < bench.total; ++i)
+    {
+        bench.sent[i] = mb_time_us();
+        if (0 == mb_engine_submit(mbeng_ctx, i, &bench.request[i]))
+        {
+            bench.submit++;
+        }
+    }
+
+    while ((stat.count + bench.failed) < bench.submit)
+    {
+        if (0 > mb_engine_run(mbeng_ctx, 100))
+        {
+            ret = -1;
+            break;
+        }
+    }
+
+    stat.stop = mb_time_us();
+
+    snprintf(name, sizeof(name), "engine(%d dev)", n_dev);
+    bench_stat_show(name, &stat);
+    bench_syscall_show(name, stat.count);
+    if (bench.failed)
+    {
+        printf("%-24s : %u failed\n", name, bench.failed);
+    }
+
+out :
+    for (i = 0; dev && i < n_dev; ++i)
+    {
+        if (dev[i])
+        {
+            mb_tcp_close(dev[i]);
+        }
+    }
+    mb_engine_destory(mbeng_ctx);
+    bench_stat_exit(&stat);
+    free(bench.sent);
+    free(bench.request);
+    free(dev);
+
+    return ret;
+}
+
+/*
+ * Function  : cyclic FC03 scan of 1..ctl->devices devices from one epoll loop
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_engine(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    int n_dev = 0;
+
+    if (0 > bench_slave_start(ctl->port + 2))
+    {
+        return -1;
+    }
+
+    for (n_dev = 1; n_dev < ctl->devices; n_dev *= 10)
+    {
+        if (0 > bench_engine_scale(ctl, n_dev))
+        {
+            return -1;
+        }
+    }
+
+    return bench_engine_scale(ctl, ctl->devices);
+}
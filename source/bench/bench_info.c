@@ -0,0 +1,171 @@
+/*
+ * Author   : shawn-tany
+ * Function : CPU cost of one transaction without I/O, request handed to a context,
+ *            PDU encapped, response decapped and its registers summed, either copied
+ *            out in MB_INFO_T or read in place through a view
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+
+#define BENCH_INFO_LOOP 1000000
+
+static UINT64_T bench_info_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static UINT64_T bench_info_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Function  : FC03 transactions of n_reg registers on a context with no peer
+ * mbtcp_ctx : ModBus TCP context
+ * view      : decap in place, 0=into MB_INFO_T and copied out
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_info_run(MBTCP_CTX_T *mbtcp_ctx, UINT16_T n_reg, int view)
+{
+    MB_DATA_T *mb_data = mbtcp_ctx->mb_tcp_data.mb_data;
+    MB_INFO_T  request;
+    MB_INFO_T  response;
+    MB_VIEW_T  mb_view;
+    UINT8_T    pdu[MBRTU_FRAME_SIZE];
+    UINT64_T   ns     = 0;
+    UINT64_T   cycles = 0;
+    UINT64_T   sum    = 0;
+    UINT32_T   n      = 0;
+    int        len    = 0;
+    int        i      = 0;
+    char       name[32] = {0};
+
+    /* code, byte number, registers holding their own address */
+    pdu[len++] = MB_FUNC_03;
+    pdu[len++] = (UINT8_T)(n_reg * 2);
+    for (i = 0; i < n_reg; ++i)
+    {
+        pdu[len++] = (UINT8_T)(i >> 8);
+        pdu[len++] = (UINT8_T)i;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.code  = MB_FUNC_03;
+    request.n_reg = n_reg;
+
+    ns     = bench_info_ns();
+    cycles = bench_info_cycles();
+
+    for (n = 0; n < BENCH_INFO_LOOP; ++n)
+    {
+        request.reg = (UINT16_T)n;
+
+        mbtcpctx_info_updata(mbtcp_ctx, &request);
+        mb_data_clear(mb_data);
+        mb_data_encap(mb_data);
+
+        /* the response as recv leaves it */
+        memcpy(mb_data->data, pdu, len);
+        mb_data->data_len = len;
+        mb_data->offset   = 0;
+
+        if (view)
+        {
+            if (0 > mb_view_decap(mb_data, &mb_view))
+            {
+                break;
+            }
+
+            for (i = 0; i < MB_VIEW_REG_NUM(&mb_view); ++i)
+            {
+                sum += MB_VIEW_REG(&mb_view, i);
+            }
+        }
+        else
+        {
+            mb_data_decap(mb_data);
+            mbtcpctx_info_takeout(mbtcp_ctx, &response);
+
+            for (i = 0; i < response.n_byte / 2; ++i)
+            {
+                sum += (response.value[i * 2] << 8) | response.value[(i * 2) + 1];
+            }
+        }
+    }
+
+    cycles = bench_info_cycles() - cycles;
+    ns     = bench_info_ns() - ns;
+
+    /* registers hold 0..n_reg-1 */
+    if (n != BENCH_INFO_LOOP || sum != (UINT64_T)BENCH_INFO_LOOP * n_reg * (n_reg - 1) / 2)
+    {
+        printf("info : wrong response decapped\n");
+        return -1;
+    }
+
+    snprintf(name, sizeof(name), "%s(FC03 x %d)", view ? "view" : "info", n_reg);
+    printf("%-24s : %8.1f ns/trans %8.1f cycles/trans, %s %d bytes\n", name,
+        (double)ns / BENCH_INFO_LOOP, (double)cycles / BENCH_INFO_LOOP,
+        view ? "MB_VIEW_T" : "MB_INFO_T", view ? (int)sizeof(MB_VIEW_T) : (int)sizeof(MB_INFO_T));
+
+    return 0;
+}
+
+/*
+ * Function  : request/response handling cost of a short and the longest FC03 read,
+ *             decapped into MB_INFO_T and as a view
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_info(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBTCP_CTL_T  tcp_ctl   = {
+        .max_data_size = MBTCP_FRAME_SIZE,
+        .unitid        = 1,
+    };
+    MBTCP_CTX_T *mbtcp_ctx = NULL;
+    int sv[2];
+    int ret = 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv))
+    {
+        perror("socketpair error");
+        return -1;
+    }
+
+    mbtcp_ctx = mb_tcp_attach(&tcp_ctl, sv[0]);
+    if (!mbtcp_ctx)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+
+    if (0 > bench_info_run(mbtcp_ctx, ctl->n_reg, 0) || 0 > bench_info_run(mbtcp_ctx, ctl->n_reg, 1) ||
+        0 > bench_info_run(mbtcp_ctx, 125, 0) || 0 > bench_info_run(mbtcp_ctx, 125, 1))
+    {
+        ret = -1;
+    }
+
+    mb_tcp_close(mbtcp_ctx);
+    close(sv[1]);
+
+    return ret;
+}
@@ -0,0 +1,212 @@
+/*
+ * Author   : shawn-tany
+ * Function : scan cycles of FC03 polls sent by sp_mb_send against polls prepared once
+ *            and sent by sp_mb_send_prepared, CPU time of the sends only
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+static UINT16_T sent_reg[0x10000];
+
+static UINT64_T bench_prepared_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static SPMB_CTX_T *bench_prepared_connect(UINT16_T port)
+{
+    SPMB_CTL_T mb_ctl = {
+        .mb_type = MB_TYPE_TCP,
+        .mb_conf = "/dev/null",
+
+        .tcp_ctrl = {
+            .port          = port,
+            .ip            = "127.0.0.1",
+            .ethdev        = "lo",
+            .max_data_size = 1400,
+            .unitid        = 1,
+            .window        = BENCH_SCAN_SIZE,
+            .batch         = MBTCP_TXQ_SIZE,    /* sent by sp_mb_flush, never while timed */
+        }
+    };
+
+    return sp_mb_init(&mb_ctl);
+}
+
+/*
+ * Function  : a prepared request goes out as the same bytes as one sp_mb_send encodes,
+ *             but for the transaction code
+ * mb_ctx    : ModBus context with a send queue
+ * n_reg     : registers of the write
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_prepared_check(SPMB_CTX_T *mb_ctx, UINT16_T n_reg)
+{
+    MBTCP_TXQ_T *txq = mb_ctx->ctx.mb_tcp_ctx->mb_tcp_data.txq;
+    MB_PREP_T    prep;
+    MB_INFO_T    mb_info;
+    UINT16_T     tid = 0;
+    int          ret = 0;
+
+    /* an FC10 write holds 123 registers at most, above those the scan cycles poll */
+    memset(&mb_info, 0, sizeof(mb_info));
+    mb_info.code   = MB_FUNC_10;
+    mb_info.reg    = 0xf000;
+    mb_info.n_reg  = (123 < n_reg) ? 123 : n_reg;
+    mb_info.n_byte = mb_info.n_reg * 2;
+    memset(mb_info.value, 0x5a, mb_info.n_byte);
+
+    if (0 > sp_mb_prepare(mb_ctx, &mb_info, &prep) || 0 > sp_mb_send(mb_ctx, &mb_info) ||
+        0 > sp_mb_send_prepared(mb_ctx, &prep) || 2 != txq->num)
+    {
+        printf("prepared : request not queued\n");
+        return -1;
+    }
+
+    tid = MB_HTOLE16(sp_mb_tid_get(mb_ctx, MB_TX));
+    if (txq->len[0] != txq->len[1] || memcmp(txq->frame[1], &tid, sizeof(tid)) ||
+        memcmp(txq->frame[0] + sizeof(tid), txq->frame[1] + sizeof(tid), txq->len[0] - sizeof(tid)))
+    {
+        printf("prepared : frame differs from the encoded one\n");
+        ret = -1;
+    }
+
+    /* both are answered */
+    if (0 > sp_mb_flush(mb_ctx) || 0 > sp_mb_recv(mb_ctx, &mb_info) || 0 > sp_mb_recv(mb_ctx, &mb_info))
+    {
+        printf("prepared : write not answered\n");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/*
+ * Function  : ctl->count FC03 polls in scan cycles of BENCH_SCAN_SIZE, every response
+ *             checked against the register it polled
+ * prepared  : sent by sp_mb_send_prepared, 0=by sp_mb_send
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_prepared_run(BENCH_CTL_T *ctl, SPMB_CTX_T *mb_ctx, int prepared)
+{
+    MB_PREP_T *prep = NULL;
+    MB_INFO_T  poll[BENCH_SCAN_SIZE];
+    MB_INFO_T  mb_info;
+    UINT64_T   ns   = 0;
+    UINT64_T   send = 0;
+    UINT32_T   sent = 0;
+    UINT32_T   recv = 0;
+    UINT32_T   i    = 0;
+    int        ret  = 0;
+
+    /* the scan list, built once */
+    prep = (MB_PREP_T *)calloc(BENCH_SCAN_SIZE, sizeof(MB_PREP_T));
+    if (!prep)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < BENCH_SCAN_SIZE; ++i)
+    {
+        memset(&poll[i], 0, sizeof(poll[i]));
+        poll[i].code  = MB_FUNC_03;
+        poll[i].reg   = i * ctl->n_reg;
+        poll[i].n_reg = ctl->n_reg;
+
+        if (prepared && 0 > sp_mb_prepare(mb_ctx, &poll[i], &prep[i]))
+        {
+            free(prep);
+            return -1;
+        }
+    }
+
+    while (0 == ret && recv < ctl->count)
+    {
+        ns = bench_prepared_ns();
+
+        for (i = 0; i < BENCH_SCAN_SIZE && sent < ctl->count; ++i, ++sent)
+        {
+            if (0 > (prepared ? sp_mb_send_prepared(mb_ctx, &prep[i]) : sp_mb_send(mb_ctx, &poll[i])))
+            {
+                ret = -1;
+                break;
+            }
+
+            sent_reg[sp_mb_tid_get(mb_ctx, MB_TX)] = poll[i].reg;
+        }
+
+        send += bench_prepared_ns() - ns;
+
+        /* end of scan cycle */
+        if (0 > ret || 0 > sp_mb_flush(mb_ctx))
+        {
+            ret = -1;
+            break;
+        }
+
+        for (; recv < sent; ++recv)
+        {
+            /* register value is its address */
+            if (0 > sp_mb_recv(mb_ctx, &mb_info) || mb_info.n_byte != ctl->n_reg * 2 ||
+                ((mb_info.value[0] << 8) | mb_info.value[1]) != sent_reg[sp_mb_tid_get(mb_ctx, MB_RX)])
+            {
+                printf("prepared : wrong response to a poll\n");
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    free(prep);
+
+    if (0 == ret)
+    {
+        printf("%-24s : %8.1f ns/send, %u polls of %d registers\n", prepared ? "tcp_send_prepared" : "tcp_send",
+            (double)send / sent, sent, ctl->n_reg);
+    }
+
+    return ret;
+}
+
+/*
+ * Function  : prepared frames checked against encoded ones, then the same scan cycles
+ *             sent both ways
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_prepared(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    SPMB_CTX_T *mb_ctx = NULL;
+    int ret = 0;
+
+    if (0 > bench_slave_start(ctl->port + 8))
+    {
+        return -1;
+    }
+
+    if (!(mb_ctx = bench_prepared_connect(ctl->port + 8)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_prepared_check(mb_ctx, ctl->n_reg) || 0 > bench_prepared_run(ctl, mb_ctx, 0) ||
+        0 > bench_prepared_run(ctl, mb_ctx, 1))
+    {
+        ret = -1;
+    }
+
+    sp_mb_close(mb_ctx);
+
+    return ret;
+}
@@ -0,0 +1,145 @@
+/*
+ * Author   : shawn-tany
+ * Function : register array conversion between big endian wire bytes and host words,
+ *            a word at a time as the PDU code did before against the block conversion
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_REG_LOOP 1000000
+
+static UINT64_T bench_reg_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Function  : a word at a time, swapped by l2b_endian()/b2l_endian() behind a run time endian flag
+ * return    : void
+ */
+static void bench_reg_wordwise(UINT8_T *wire, UINT16_T *regs, int n, int encode, volatile UINT8_T *swap)
+{
+    UINT16_T word = 0;
+    int i = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+        if (encode)
+        {
+            word = *swap ? l2b_endian(regs[i]) : regs[i];
+            memcpy(wire + (i * 2), &word, 2);
+        }
+        else
+        {
+            memcpy(&word, wire + (i * 2), 2);
+            regs[i] = *swap ? b2l_endian(word) : word;
+        }
+    }
+}
+
+/*
+ * Function  : time BENCH_REG_LOOP decodes and encodes of n registers
+ * return    : void
+ */
+static void bench_reg_run(int block, UINT8_T *wire, UINT16_T *regs, int n)
+{
+    volatile UINT8_T swap = !MB_HOST_BIG_ENDIAN;
+    UINT64_T ns[2] = {0};
+    UINT32_T loop  = 0;
+    char name[32]  = {0};
+    int  encode    = 0;
+
+    for (encode = 0; encode < 2; ++encode)
+    {
+        ns[encode] = bench_reg_ns();
+
+        for (loop = 0; loop < BENCH_REG_LOOP; ++loop)
+        {
+            if (!block)
+            {
+                bench_reg_wordwise(wire, regs, n, encode, &swap);
+            }
+            else if (encode)
+            {
+                mb_reg_encode(wire, regs, n);
+            }
+            else
+            {
+                mb_reg_decode(regs, wire, n);
+            }
+
+            /* keep the compiler from dropping all but the last round */
+            __asm__ __volatile__("" : : "r"(wire), "r"(regs) : "memory");
+        }
+
+        ns[encode] = bench_reg_ns() - ns[encode];
+    }
+
+    snprintf(name, sizeof(name), "reg_%s(%d)", block ? "block" : "wordwise", n);
+    printf("%-24s : decode %8.1f ns, encode %8.1f ns\n", name,
+        (double)ns[0] / BENCH_REG_LOOP, (double)ns[1] / BENCH_REG_LOOP);
+}
+
+/*
+ * Function  : both ways checked against each other on every length, then timed on
+ *             ctl->n_reg registers and the longest FC03/04 read(125 registers)
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_reg(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    volatile UINT8_T swap = !MB_HOST_BIG_ENDIAN;
+    UINT16_T regs[MAX_MBVALUE_SIZE / 2];
+    UINT16_T check[MAX_MBVALUE_SIZE / 2];
+    UINT8_T  wire[MAX_MBVALUE_SIZE];
+    UINT8_T  expect[MAX_MBVALUE_SIZE];
+    int n = 0;
+    int i = 0;
+
+    for (i = 0; i < ITEM(regs); ++i)
+    {
+        regs[i] = (UINT16_T)((i * 0x0101) ^ 0x1234);
+    }
+
+    /* registers go on the wire high byte first */
+    mb_reg_encode(wire, regs, 1);
+    if (wire[0] != (UINT8_T)(regs[0] >> 8) || wire[1] != (UINT8_T)regs[0])
+    {
+        printf("reg : register 0x%04x encoded as %02x %02x\n", regs[0], wire[0], wire[1]);
+        return -1;
+    }
+
+    for (n = 0; n <= ITEM(regs); ++n)
+    {
+        bench_reg_wordwise(expect, regs, n, 1, &swap);
+        mb_reg_encode(wire, regs, n);
+        mb_reg_decode(check, expect, n);
+
+        if (memcmp(wire, expect, n * 2) || memcmp(check, regs, n * 2))
+        {
+            printf("reg : block conversion differs from wordwise, %d registers\n", n);
+            return -1;
+        }
+    }
+
+    for (i = 0; i < 2; ++i)
+    {
+        n = i ? ITEM(regs) : ((ctl->n_reg < ITEM(regs)) ? ctl->n_reg : ITEM(regs));
+
+        bench_reg_run(0, wire, regs, n);
+        bench_reg_run(1, wire, regs, n);
+    }
+
+    return 0;
+}
@@ -0,0 +1,928 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus RTU request latency against a slaver on a pseudo terminal
+ */
+
+#define _GNU_SOURCE /* ptsname_r */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "bench.h"
+#include "mb_slave.h"
+#include "mb_rtu_bus.h"
+#include "mb_rtu_sniff.h"
+
+#define BENCH_RTU_REQ   8     /* FC01-06 request : address + 5 + CRC */
+#define BENCH_BUS_SLAVE 30    /* slaver addresses on one line */
+#define BENCH_BUS_WRITE 10    /* one write every so many transactions */
+#define BENCH_BUS_BAUD  38400
+#define BENCH_BCAST_BAUD  9600
+#define BENCH_BCAST_CYCLE 10    /* output updates of the whole drop */
+#define BENCH_SNIFF_BAUD  921600
+#define BENCH_SNIFF_PACED 500     /* transactions with t3.5 gaps */
+#define BENCH_SNIFF_BURST 20000   /* transactions back to back */
+#define BENCH_SNIFF_LOG   "/tmp/mb_bench.sniff"
+#define BENCH_SNIFF_STALL 20000   /* us, t3.5 of the burst, a writer blocked on a full pty is that late */
+
+typedef struct
+{
+    int            fd;        /* master side of the pty */
+    int            hold_fd;   /* slave side, kept open so closing a context is no hangup */
+    MBSLV_STORE_T *store;
+} BENCH_RTU_SLAVE_T;
+
+/*
+ * Function  : answer fixed size requests at once, the pty has no line speed
+ * return    : NULL
+ */
+static void *bench_rtu_routine(void *arg)
+{
+    BENCH_RTU_SLAVE_T *slave   = (BENCH_RTU_SLAVE_T *)arg;
+    MB_DATA_T         *mb_data = mb_data_create(MBRTU_FRAME_SIZE);
+    UINT8_T  buf[BENCH_RTU_REQ];
+    UINT16_T crc    = 0;
+    int      len    = 0;
+    int      length = 0;
+
+    while (mb_data)
+    {
+        length = read(slave->fd, buf + len, sizeof(buf) - len);
+        if (0 >= length)
+        {
+            break;
+        }
+
+        len += length;
+        if (len < BENCH_RTU_REQ)
+        {
+            continue;
+        }
+        len = 0;
+
+        if (mb_crc16(buf, BENCH_RTU_REQ - 2) != (buf[BENCH_RTU_REQ - 2] | (buf[BENCH_RTU_REQ - 1] << 8)))
+        {
+            continue;
+        }
+
+        /* address + request PDU, a broadcast is applied without response */
+        memcpy(mb_data->data, buf, BENCH_RTU_REQ - 2);
+        mb_data->data_len = BENCH_RTU_REQ - 2;
+        mb_data->offset   = 1;
+
+        if (0 == mb_slave_handle(slave->store, mb_data) && MBRTU_BROADCAST == buf[0])
+        {
+            continue;
+        }
+
+        crc = mb_crc16(mb_data->data, mb_data->data_len);
+        mb_data->data[mb_data->data_len++] = (UINT8_T)crc;
+        mb_data->data[mb_data->data_len++] = (UINT8_T)(crc >> 8);
+
+        if (mb_data->data_len != write(slave->fd, mb_data->data, mb_data->data_len))
+        {
+            break;
+        }
+    }
+
+    mb_data_destory(mb_data);
+
+    return NULL;
+}
+
+/*
+ * Function  : start a ModBus RTU slaver thread on a new pseudo terminal, 
+ *             or use the serial of --serial such as sim/mb_rtu_sim
+ * serial    : path of the slave side, for mb_rtu_init
+ * len       : size of serial
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_rtu_slave_start(BENCH_CTL_T *ctl, char *serial, int len)
+{
+    static MBSLV_CTL_T slv_ctl = {
+        .n_coil    = 0x10000,
+        .n_holding = 0x10000,
+        .n_input   = 0x10000,
+    };
+    BENCH_RTU_SLAVE_T *slave = NULL;
+    struct termios option;
+    pthread_t pid;
+    UINT32_T  i = 0;
+
+    if (ctl->serial)
+    {
+        snprintf(serial, len, "%s", ctl->serial);
+        return 0;
+    }
+
+    slave = (BENCH_RTU_SLAVE_T *)malloc(sizeof(BENCH_RTU_SLAVE_T));
+    if (!slave)
+    {
+        return -1;
+    }
+
+    slave->fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (0 > slave->fd || 0 > grantpt(slave->fd) || 0 > unlockpt(slave->fd) ||
+        0 != ptsname_r(slave->fd, serial, len))
+    {
+        perror("pseudo terminal error");
+        free(slave);
+        return -1;
+    }
+
+    slave->hold_fd = open(serial, O_RDWR | O_NOCTTY);
+    if (0 > slave->hold_fd)
+    {
+        perror("open error");
+        close(slave->fd);
+        free(slave);
+        return -1;
+    }
+
+    /* no echo or line editing on either side */
+    tcgetattr(slave->fd, &option);
+    cfmakeraw(&option);
+    tcsetattr(slave->fd, TCSANOW, &option);
+
+    slave->store = mb_slave_store_create(&slv_ctl);
+    if (!slave->store)
+    {
+        close(slave->hold_fd);
+        close(slave->fd);
+        free(slave);
+        return -1;
+    }
+
+    for (i = 0; i < 0x10000; ++i)
+    {
+        slave->store->holding[i] = i;
+        slave->store->input[i]   = i;
+    }
+
+    if (pthread_create(&pid, NULL, bench_rtu_routine, slave))
+    {
+        mb_slave_store_destory(slave->store);
+        close(slave->hold_fd);
+        close(slave->fd);
+        free(slave);
+        return -1;
+    }
+    pthread_detach(pid);
+
+    return 0;
+}
+
+/*
+ * Function  : FC03 response latency at several baudrates(250000 goes through termios2), 
+ *             the pty does not pace the bytes,
+ *             so it is the frame delimiting cost alone, trans/s includes the t3.5 gap
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_rtu(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    static const UINT32_T baudrate[] = { 9600, 19200, 38400, 57600, 115200, 250000, 921600 };
+
+    MBRTU_CTL_T  rtu_ctl = {
+        .max_data_size = MBRTU_FRAME_SIZE,
+        .slaver_addr   = 1,
+        .databit       = 8,
+        .stopbit       = 1,
+    };
+    MBRTU_CTX_T *mbrtu_ctx = NULL;
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT32_T     count = (ctl->count < 200) ? ctl->count : 200;
+    UINT64_T     begin = 0;
+    char name[32] = {0};
+    int  ret = 0;
+    int  i   = 0;
+    int  b   = 0;
+
+    if (0 > bench_rtu_slave_start(ctl, rtu_ctl.serial, sizeof(rtu_ctl.serial)))
+    {
+        return -1;
+    }
+
+    for (b = 0; 0 == ret && b < ITEM(baudrate); ++b)
+    {
+        rtu_ctl.baudrate = baudrate[b];
+
+        if (!(mbrtu_ctx = mb_rtu_init(&rtu_ctl)))
+        {
+            return -1;
+        }
+
+        if (0 > bench_stat_init(&stat, count))
+        {
+            mb_rtu_close(mbrtu_ctx);
+            return -1;
+        }
+
+        stat.start = mb_time_us();
+
+        for (i = 0; i < count; ++i)
+        {
+            memset(&mb_info, 0, sizeof(mb_info));
+            mb_info.code  = MB_FUNC_03;
+            mb_info.reg   = i % 100;
+            mb_info.n_reg = ctl->n_reg;
+
+            mbrtuctx_info_updata(mbrtu_ctx, &mb_info);
+            if (0 > mb_rtu_send(mbrtu_ctx))
+            {
+                ret = -1;
+                break;
+            }
+
+            /* the t3.5 gap before the request is spent in mb_rtu_send */
+            begin = mb_time_us();
+
+            if (0 > mb_rtu_recv(mbrtu_ctx))
+            {
+                ret = -1;
+                break;
+            }
+
+            stat.sample[stat.count++] = mb_time_us() - begin;
+        }
+
+        stat.stop = mb_time_us();
+
+        snprintf(name, sizeof(name), "rtu(%u baud)", baudrate[b]);
+        bench_stat_show(name, &stat);
+        printf("%-24s : t3.5 %u us\n", name, mbrtu_ctx->mb_rtu_desc.t35);
+
+        bench_stat_exit(&stat);
+        mb_rtu_close(mbrtu_ctx);
+    }
+
+    return ret;
+}
+
+typedef struct
+{
+    BENCH_STAT_T *stat;
+    UINT32_T      max;        /* sample number of stat */
+    MB_INFO_T     write;
+    UINT64_T      submit;     /* time the write was queued, 0=NONE */
+    UINT32_T      polls;
+    UINT32_T      err;
+} BENCH_BUS_T;
+
+/*
+ * Function  : a write answered, its wait behind the poll in progress counts too
+ * return    : void
+ */
+static void bench_bus_write_cb(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info, void *arg)
+{
+    BENCH_BUS_T *bus = (BENCH_BUS_T *)arg;
+
+    if (!mb_info)
+    {
+        bus->err++;
+    }
+
+    if (bus->stat->count < bus->max)
+    {
+        bus->stat->sample[bus->stat->count++] = mb_time_us() - bus->submit;
+    }
+    bus->submit = 0;
+}
+
+/*
+ * Function  : a poll answered, every BENCH_BUS_WRITE of them queue a write
+ * return    : void
+ */
+static void bench_bus_poll_cb(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info, void *arg)
+{
+    BENCH_BUS_T *bus = (BENCH_BUS_T *)arg;
+
+    if (!mb_info)
+    {
+        bus->err++;
+    }
+
+    if (0 == (++bus->polls % BENCH_BUS_WRITE) && !bus->submit)
+    {
+        bus->write.reg      = bus->polls % 100;
+        bus->write.value[1] = (UINT8_T)bus->polls;
+
+        bus->submit = mb_time_us();
+        mb_rtu_bus_submit(mbbus_ctx, bus->polls % BENCH_BUS_SLAVE + 1, &bus->write, 
+            bench_bus_write_cb, bus);
+    }
+}
+
+/*
+ * Function  : BENCH_BUS_SLAVE slavers polled on one line with writes jumping the queue,
+ *             latency is the write from queued to answered, utilization is the line busy time
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_rtu_bus(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBRTU_CTL_T  rtu_ctl = {
+        .max_data_size = MBRTU_FRAME_SIZE,
+        .slaver_addr   = 1,
+        .baudrate      = BENCH_BUS_BAUD,
+        .databit       = 8,
+        .stopbit       = 1,
+    };
+    MBRTU_CTX_T *mbrtu_ctx = NULL;
+    MBBUS_CTX_T *mbbus_ctx = NULL;
+    MBBUS_STAT_T bus_stat;
+    BENCH_STAT_T stat;
+    BENCH_BUS_T  bus;
+    MB_INFO_T    poll[BENCH_BUS_SLAVE];
+    UINT32_T     count = (ctl->count < 2000) ? ctl->count : 2000;
+    int  ret = 0;
+    int  i   = 0;
+
+    memset(&bus, 0, sizeof(bus));
+    memset(poll, 0, sizeof(poll));
+
+    if (0 > bench_rtu_slave_start(ctl, rtu_ctl.serial, sizeof(rtu_ctl.serial)) || 
+        !(mbrtu_ctx = mb_rtu_init(&rtu_ctl)))
+    {
+        return -1;
+    }
+
+    /* a write every BENCH_BUS_WRITE polls */
+    if (0 > bench_stat_init(&stat, ALIGNED(count, BENCH_BUS_WRITE)))
+    {
+        mb_rtu_close(mbrtu_ctx);
+        return -1;
+    }
+
+    mbbus_ctx = mb_rtu_bus_create(mbrtu_ctx, BENCH_BUS_SLAVE);
+    if (!mbbus_ctx)
+    {
+        ret = -1;
+        goto out;
+    }
+
+    bus.stat       = &stat;
+    bus.max        = ALIGNED(count, BENCH_BUS_WRITE);
+    bus.write.code = MB_FUNC_06;
+
+    for (i = 0; i < BENCH_BUS_SLAVE; ++i)
+    {
+        poll[i].code  = MB_FUNC_03;
+        poll[i].reg   = i;
+        poll[i].n_reg = ctl->n_reg;
+
+        if (0 > mb_rtu_bus_poll_add(mbbus_ctx, i + 1, &poll[i], bench_bus_poll_cb, &bus))
+        {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    stat.start = mb_time_us();
+    mb_rtu_bus_run(mbbus_ctx, count);
+    stat.stop = mb_time_us();
+
+    mb_rtu_bus_stat(mbbus_ctx, &bus_stat);
+    if (bus.err || bus_stat.err)
+    {
+        printf("rtu bus : %u failed transactions\n", bus.err);
+        ret = -1;
+    }
+
+    bench_stat_show("rtu_bus(write)", &stat);
+    printf("%-24s : %llu trans  %d slavers  t3.5 %u us  utilization %u.%02u%%\n", "rtu_bus",
+        bus_stat.trans, BENCH_BUS_SLAVE, mbrtu_ctx->mb_rtu_desc.t35, 
+        bus_stat.utilization / 100, bus_stat.utilization % 100);
+
+out :
+    mb_rtu_bus_destory(mbbus_ctx);
+    bench_stat_exit(&stat);
+    mb_rtu_close(mbrtu_ctx);
+
+    return ret;
+}
+
+/*
+ * Function  : one output update of BENCH_BUS_SLAVE slavers, a FC06 write to each of them
+ *             or a single broadcast
+ * turnaround : silence after a broadcast(us), 0=one write per slaver
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_rtu_bcast_cycle(BENCH_CTL_T *ctl, MBRTU_CTL_T *rtu_ctl, UINT32_T turnaround)
+{
+    MBRTU_CTX_T *mbrtu_ctx = NULL;
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT64_T     begin = 0;
+    UINT32_T     count = (ctl->count < BENCH_BCAST_CYCLE) ? ctl->count : BENCH_BCAST_CYCLE;
+    char name[32] = {0};
+    int  first = turnaround ? MBRTU_BROADCAST : 1;
+    int  last  = turnaround ? MBRTU_BROADCAST : BENCH_BUS_SLAVE;
+    int  ret = 0;
+    int  i   = 0;
+    int  s   = 0;
+
+    rtu_ctl->turnaround = turnaround;
+
+    if (!(mbrtu_ctx = mb_rtu_init(rtu_ctl)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, count))
+    {
+        mb_rtu_close(mbrtu_ctx);
+        return -1;
+    }
+
+    memset(&mb_info, 0, sizeof(mb_info));
+    mb_info.code = MB_FUNC_06;
+    mb_info.reg  = 1;
+
+    stat.start = mb_time_us();
+
+    for (i = 0; 0 == ret && i < count; ++i)
+    {
+        begin = mb_time_us();
+        mb_info.value[1] = (UINT8_T)i;
+
+        for (s = first; s <= last; ++s)
+        {
+            mbrtuctx_slaver_set(mbrtu_ctx, s);
+            mbrtuctx_info_updata(mbrtu_ctx, &mb_info);
+            if (0 > mb_rtu_send(mbrtu_ctx) || 0 > mb_rtu_recv(mbrtu_ctx))
+            {
+                ret = -1;
+                break;
+            }
+        }
+
+        stat.sample[stat.count++] = mb_time_us() - begin;
+    }
+
+    stat.stop = mb_time_us();
+
+    if (turnaround)
+    {
+        snprintf(name, sizeof(name), "broadcast(%u ms)", turnaround / 1000);
+    }
+    else
+    {
+        snprintf(name, sizeof(name), "unicast(%d slavers)", BENCH_BUS_SLAVE);
+    }
+    bench_stat_show(name, &stat);
+
+    bench_stat_exit(&stat);
+    mb_rtu_close(mbrtu_ctx);
+
+    return ret;
+}
+
+/*
+ * Function  : update an output of every slaver on a line, one write per slaver against one
+ *             broadcast, latency is one update of the whole drop
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_rtu_broadcast(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBRTU_CTL_T rtu_ctl = {
+        .max_data_size = MBRTU_FRAME_SIZE,
+        .slaver_addr   = 1,
+        .baudrate      = BENCH_BCAST_BAUD,
+        .databit       = 8,
+        .stopbit       = 1,
+    };
+
+    if (0 > bench_rtu_slave_start(ctl, rtu_ctl.serial, sizeof(rtu_ctl.serial)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_rtu_bcast_cycle(ctl, &rtu_ctl, 0) ||
+        0 > bench_rtu_bcast_cycle(ctl, &rtu_ctl, MBRTU_TURNAROUND) ||
+        0 > bench_rtu_bcast_cycle(ctl, &rtu_ctl, MBRTU_TURNAROUND / 10))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+typedef struct
+{
+    int       fd;             /* master side of the pty, the line */
+    UINT8_T  *data;           /* every frame on the line */
+    UINT32_T  len;
+    UINT32_T *end;            /* end offset of every frame */
+    UINT32_T  n_frame;
+    UINT32_T  char_time;      /* us, 0=as fast as the pty takes them */
+    UINT32_T  gap;            /* us between frames */
+    volatile int done;
+
+    /* records the log must hold, in order */
+    UINT8_T  *type;           /* MBSNIFF_REC_TYPE_T */
+    UINT32_T  n_type;
+    UINT8_T   pending;        /* a request waits for its response */
+
+    /* what the sniffer must find */
+    MBSNIFF_STAT_T expect;
+} BENCH_SNIFF_T;
+
+/*
+ * Function  : put a frame with its CRC on the line
+ * type      : record the sniffer logs for it, MBSNIFF_REC_BAD=CRC corrupted
+ * return    : void
+ */
+static void bench_sniff_frame(BENCH_SNIFF_T *line, UINT8_T *frame, UINT32_T len, UINT8_T type)
+{
+    UINT16_T crc = mb_crc16(frame, len);
+
+    frame[len++] = (UINT8_T)crc;
+    frame[len++] = (UINT8_T)(crc >> 8);
+
+    if (MBSNIFF_REC_BAD == type)
+    {
+        frame[len - 1] ^= 0x5a;
+    }
+    else
+    {
+        /* the timeout of an unanswered request is logged before the next valid frame */
+        if (line->pending && MBSNIFF_REC_RESPONSE != type)
+        {
+            line->type[line->n_type++] = MBSNIFF_REC_TIMEOUT;
+        }
+        line->pending = (MBSNIFF_REC_REQUEST == type);
+    }
+    line->type[line->n_type++] = type;
+
+    memcpy(line->data + line->len, frame, len);
+    line->len += len;
+    line->end[line->n_frame++] = line->len;
+}
+
+/*
+ * Function  : build the traffic of n_trans transactions, FC03 polls of BENCH_BUS_SLAVE slavers
+ *             with exceptions, unanswered, retried and corrupted requests and broadcasts among them
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_sniff_traffic(BENCH_SNIFF_T *line, UINT32_T n_trans, UINT16_T n_reg)
+{
+    UINT8_T  frame[MBRTU_FRAME_SIZE];
+    UINT8_T  addr = 0;
+    UINT32_T i = 0;
+    UINT32_T r = 0;
+
+    memset(line, 0, sizeof(BENCH_SNIFF_T));
+
+    line->data = (UINT8_T *)malloc((UINT64_T)n_trans * MBRTU_FRAME_SIZE);
+    line->end  = (UINT32_T *)malloc((UINT64_T)n_trans * 2 * sizeof(UINT32_T));
+    line->type = (UINT8_T *)malloc((UINT64_T)n_trans * 4);
+    if (!line->data || !line->end || !line->type)
+    {
+        free(line->data);
+        free(line->end);
+        free(line->type);
+        return -1;
+    }
+
+    for (i = 0; i < n_trans; ++i)
+    {
+        addr = i % BENCH_BUS_SLAVE + 1;
+
+        frame[0] = addr;
+        frame[1] = MB_FUNC_03;
+        frame[2] = (UINT8_T)(i >> 8);
+        frame[3] = (UINT8_T)i;
+        frame[4] = (UINT8_T)(n_reg >> 8);
+        frame[5] = (UINT8_T)n_reg;
+
+        if (49 == i % 50)
+        {
+            frame[0] = MBRTU_BROADCAST;
+            frame[1] = MB_FUNC_06;
+            bench_sniff_frame(line, frame, 6, MBSNIFF_REC_BROADCAST);
+            line->expect.broadcast++;
+            continue;
+        }
+
+        /* the slaver drops a request with a bad CRC silently */
+        if (39 == i % 40)
+        {
+            bench_sniff_frame(line, frame, 6, MBSNIFF_REC_BAD);
+            line->expect.crc_err++;
+            continue;
+        }
+
+        bench_sniff_frame(line, frame, 6, MBSNIFF_REC_REQUEST);
+        line->expect.request++;
+
+        /* the first try is left unanswered, its retry must not be taken for the response */
+        if (12 == i % 25)
+        {
+            bench_sniff_frame(line, frame, 6, MBSNIFF_REC_REQUEST);
+            line->expect.request++;
+            line->expect.timeout++;
+        }
+
+        /* the last one is answered, its timeout would show up only with the next request */
+        if (24 == i % 25 && i + 1 < n_trans)
+        {
+            line->expect.timeout++;
+            continue;
+        }
+
+        if (15 == i % 16)
+        {
+            frame[1] = MB_FUNC_03 | 0x80;
+            frame[2] = 0x02;
+            bench_sniff_frame(line, frame, 3, MBSNIFF_REC_RESPONSE);
+        }
+        else
+        {
+            frame[2] = n_reg * 2;
+            for (r = 0; r < n_reg; ++r)
+            {
+                frame[3 + (r * 2)] = (UINT8_T)(i >> 8);
+                frame[4 + (r * 2)] = (UINT8_T)r;
+            }
+            bench_sniff_frame(line, frame, 3 + (n_reg * 2), MBSNIFF_REC_RESPONSE);
+        }
+        line->expect.response++;
+    }
+
+    /* logged by mb_rtu_sniff_destory */
+    if (line->pending)
+    {
+        line->type[line->n_type++] = MBSNIFF_REC_TIMEOUT;
+    }
+
+    line->expect.bytes = line->len;
+
+    return 0;
+}
+
+/*
+ * Function  : put the frames on the line, paced as the baudrate would or in large writes
+ * return    : NULL
+ */
+static void *bench_sniff_routine(void *arg)
+{
+    BENCH_SNIFF_T *line = (BENCH_SNIFF_T *)arg;
+    UINT64_T due   = mb_time_us();
+    UINT64_T now   = 0;
+    UINT32_T start = 0;
+    UINT32_T len   = 0;
+    UINT32_T f     = 0;
+    int      length = 0;
+
+    for (f = 0; f < line->n_frame; ++f)
+    {
+        if (!line->char_time)
+        {
+            /* as many frames as fit into one pty write */
+            while (f + 1 < line->n_frame && line->end[f + 1] - start <= 4096)
+            {
+                f++;
+            }
+        }
+        else
+        {
+            /* the last byte of the frame leaves the line at due, a late wake-up catches up */
+            due += line->gap + (line->end[f] - start) * line->char_time;
+            now  = mb_time_us();
+            if (due > now)
+            {
+                usleep(due - now);
+            }
+        }
+
+        for (len = line->end[f]; start < len; start += length)
+        {
+            length = write(line->fd, line->data + start, len - start);
+            if (0 >= length)
+            {
+                perror("pty write error");
+                line->done = 1;
+                return NULL;
+            }
+        }
+    }
+
+    line->done = 1;
+
+    return NULL;
+}
+
+/*
+ * Function  : the records of the log in the order the traffic put them, a request taken
+ *             for the response of another one shifts every pair after it
+ * title     : name of the result
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_sniff_log_check(BENCH_SNIFF_T *line, const char *title)
+{
+    MBSNIFF_LOG_HDR_T hdr;
+    MBSNIFF_REC_T     rec;
+    FILE     *log = fopen(BENCH_SNIFF_LOG, "rb");
+    UINT32_T  n   = 0;
+    int       ret = 0;
+
+    if (!log || 1 != fread(&hdr, sizeof(hdr), 1, log))
+    {
+        printf("%s : log not readable\n", title);
+        ret = -1;
+        goto out;
+    }
+
+    for (n = 0; 1 == fread(&rec, sizeof(rec), 1, log); ++n)
+    {
+        if (n >= line->n_type || rec.type != line->type[n])
+        {
+            printf("%s : record %u is type %u, should be %d\n", title, n, rec.type, 
+                (n < line->n_type) ? line->type[n] : -1);
+            ret = -1;
+            goto out;
+        }
+        fseek(log, rec.len, SEEK_CUR);
+    }
+
+    if (n != line->n_type)
+    {
+        printf("%s : %u records, should be %u\n", title, n, line->n_type);
+        ret = -1;
+    }
+
+out :
+    if (log)
+    {
+        fclose(log);
+    }
+
+    return ret;
+}
+
+/*
+ * Function  : one capture on a new pseudo terminal, the sniffer runs on this thread
+ * title     : name of the result
+ * char_time : us per character the line is paced at, 0=NOT PACED
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_sniff_capture(BENCH_CTL_T *ctl, const char *title, UINT32_T n_trans, UINT32_T char_time)
+{
+    MBRTU_CTL_T rtu_ctl = {
+        .max_data_size = MBRTU_FRAME_SIZE,
+        .slaver_addr   = 1,
+        .baudrate      = BENCH_SNIFF_BAUD,
+        .databit       = 8,
+        .stopbit       = 1,
+        .listen        = 1,
+        /* frames back to back are split by length, only a stall of the writer leaves silence */
+        .t35           = char_time ? 0 : BENCH_SNIFF_STALL,
+    };
+    MBRTU_CTX_T   *mbrtu_ctx   = NULL;
+    MBSNIFF_CTX_T *mbsniff_ctx = NULL;
+    MBSNIFF_STAT_T sniff_stat;
+    BENCH_SNIFF_T  line;
+    struct timespec cpu_start;
+    struct timespec cpu_stop;
+    struct stat     st;
+    pthread_t pid;
+    UINT64_T  begin   = 0;
+    UINT64_T  wall    = 0;
+    UINT64_T  cpu     = 0;
+    UINT64_T  records = 0;
+    UINT64_T  rate    = 0;
+    int       ret     = 0;
+
+    if (0 > bench_sniff_traffic(&line, n_trans, ctl->n_reg))
+    {
+        return -1;
+    }
+
+    line.fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (0 > line.fd || 0 > grantpt(line.fd) || 0 > unlockpt(line.fd) ||
+        0 != ptsname_r(line.fd, rtu_ctl.serial, sizeof(rtu_ctl.serial)))
+    {
+        perror("pseudo terminal error");
+        ret = -1;
+        goto out;
+    }
+
+    if (!(mbrtu_ctx = mb_rtu_init(&rtu_ctl)) ||
+        !(mbsniff_ctx = mb_rtu_sniff_create(mbrtu_ctx, BENCH_SNIFF_LOG)))
+    {
+        ret = -1;
+        goto out;
+    }
+
+    line.char_time = char_time;
+    line.gap       = mbrtu_ctx->mb_rtu_desc.t35;
+
+    if (pthread_create(&pid, NULL, bench_sniff_routine, &line))
+    {
+        ret = -1;
+        goto out;
+    }
+
+    begin = mb_time_us();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+
+    /* until the writer is done and the line is silent again */
+    while (0 <= ret && !(line.done && 0 == ret && !mbsniff_ctx->len))
+    {
+        ret = mb_rtu_sniff_run(mbsniff_ctx, 50);
+    }
+    ret = (0 > ret) ? -1 : 0;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_stop);
+    wall = mb_time_us() - begin;
+    cpu  = ((cpu_stop.tv_sec - cpu_start.tv_sec) * 1000000) + 
+           ((cpu_stop.tv_nsec - cpu_start.tv_nsec) / 1000);
+
+    pthread_join(pid, NULL);
+
+    mb_rtu_sniff_stat(mbsniff_ctx, &sniff_stat);
+    mb_rtu_sniff_destory(mbsniff_ctx);
+    mbsniff_ctx = NULL;
+
+    if (sniff_stat.bytes != line.expect.bytes || sniff_stat.request != line.expect.request || 
+        sniff_stat.response != line.expect.response || sniff_stat.broadcast != line.expect.broadcast || 
+        sniff_stat.timeout != line.expect.timeout || sniff_stat.crc_err != line.expect.crc_err)
+    {
+        printf("%s : found %llu/%llu requests %llu/%llu responses %llu/%llu broadcasts "
+            "%llu/%llu timeouts %llu/%llu bad frames\n", title,
+            sniff_stat.request, line.expect.request, sniff_stat.response, line.expect.response, 
+            sniff_stat.broadcast, line.expect.broadcast, sniff_stat.timeout, line.expect.timeout,
+            sniff_stat.crc_err, line.expect.crc_err);
+        ret = -1;
+    }
+
+    records = sniff_stat.request + sniff_stat.response + sniff_stat.broadcast + sniff_stat.timeout + sniff_stat.crc_err;
+    if (0 > stat(BENCH_SNIFF_LOG, &st) || 
+        st.st_size != sizeof(MBSNIFF_LOG_HDR_T) + (records * sizeof(MBSNIFF_REC_T)) + sniff_stat.bytes)
+    {
+        printf("%s : log size %lld, %llu records\n", title, (long long)st.st_size, records);
+        ret = -1;
+    }
+    else if (0 > bench_sniff_log_check(&line, title))
+    {
+        ret = -1;
+    }
+
+    /* bytes the sniffer handles per second of its own cpu time, against the line speed */
+    rate = cpu ? (sniff_stat.bytes * 1000000 / cpu) : 0;
+    printf("%-24s : %llu frames %llu bytes in %llu ms, cpu %llu us, %llu bytes/s = %llu x %u baud\n",
+        title, records - sniff_stat.timeout, sniff_stat.bytes, wall / 1000, cpu, rate, 
+        rate * mbrtu_ctx->mb_rtu_desc.char_time / 1000000, BENCH_SNIFF_BAUD);
+
+out :
+    mb_rtu_sniff_destory(mbsniff_ctx);
+    mb_rtu_close(mbrtu_ctx);
+    if (0 <= line.fd)
+    {
+        close(line.fd);
+    }
+    free(line.data);
+    free(line.end);
+    free(line.type);
+
+    return ret;
+}
+
+/*
+ * Function  : passive capture of a loaded 921600 baud line, paced frames with t3.5 gaps and
+ *             frames back to back in large writes(split by their predicted length),
+ *             the counters and the log must match the traffic, it needs no --serial
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_rtu_sniff(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    /* 11 bits a character */
+    UINT32_T char_time = ALIGNED(11 * 1000000, BENCH_SNIFF_BAUD);
+
+    if (0 > bench_sniff_capture(ctl, "rtu_sniff(paced)", BENCH_SNIFF_PACED, char_time) ||
+        0 > bench_sniff_capture(ctl, "rtu_sniff(burst)", BENCH_SNIFF_BURST, 0))
+    {
+        return -1;
+    }
+
+    return 0;
+}
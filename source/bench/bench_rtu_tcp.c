@@ -0,0 +1,294 @@
+/*
+ * Author   : shawn-tany
+ * Function : RTU over TCP against a local serial device server, which forwards responses
+ *            in several segments and now and then cut short like a noisy line does
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "bench.h"
+#include "mb_slave.h"
+
+#define BENCH_RTU_TCP_SPLIT 8     /* every 8th response in two segments */
+#define BENCH_RTU_TCP_PAUSE 1000  /* us between the segments, below the silence gap */
+#define BENCH_RTU_TCP_CUT   100   /* every 100th response loses its CRC high byte */
+
+typedef struct
+{
+    int            listen_fd;
+    MBSLV_STORE_T *store;
+} BENCH_RTU_TCP_SLAVE_T;
+
+/*
+ * Function  : answer the RTU frames of one connection, a request is framed by its length
+ * return    : NULL
+ */
+static void *bench_rtu_tcp_routine(void *arg)
+{
+    BENCH_RTU_TCP_SLAVE_T *slave   = (BENCH_RTU_TCP_SLAVE_T *)arg;
+    MB_DATA_T             *mb_data = mb_data_create(MBRTU_FRAME_SIZE);
+    UINT8_T  buf[MBRTU_FRAME_SIZE];
+    UINT32_T n      = 0;
+    UINT16_T crc    = 0;
+    int      sock   = accept(slave->listen_fd, NULL, NULL);
+    int      len    = 0;
+    int      length = 0;
+    int      frame  = 0;
+    int      half   = 0;
+    int      opt    = 1;
+
+    /* a segment waiting for the ack of the one before would look like the end of the frame */
+    if (0 <= sock)
+    {
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+
+    while (mb_data && 0 <= sock)
+    {
+        length = read(sock, buf + len, sizeof(buf) - len);
+        if (0 >= length)
+        {
+            break;
+        }
+        len += length;
+
+        /* address + request PDU + CRC */
+        frame = (2 > len) ? 0 : mb_request_pdu_len(buf + 1, len - 1);
+        if (0 > frame)
+        {
+            len = 0;
+            continue;
+        }
+        else if (!frame || len < frame + 3)
+        {
+            continue;
+        }
+        frame += 3;
+        len    = 0;
+
+        if (mb_crc16(buf, frame - 2) != (buf[frame - 2] | (buf[frame - 1] << 8)))
+        {
+            continue;
+        }
+
+        memcpy(mb_data->data, buf, frame - 2);
+        mb_data->data_len = frame - 2;
+        mb_data->offset   = 1;
+
+        if (0 == mb_slave_handle(slave->store, mb_data) && MBRTU_BROADCAST == buf[0])
+        {
+            continue;
+        }
+
+        crc = mb_crc16(mb_data->data, mb_data->data_len);
+        mb_data->data[mb_data->data_len++] = (UINT8_T)crc;
+        mb_data->data[mb_data->data_len++] = (UINT8_T)(crc >> 8);
+
+        if (!(++n % BENCH_RTU_TCP_CUT))
+        {
+            mb_data->data_len--;
+        }
+
+        /* the device server sends what its serial side has got so far */
+        half = (n % BENCH_RTU_TCP_SPLIT) ? 0 : (mb_data->data_len / 2);
+        if (half)
+        {
+            if (half != write(sock, mb_data->data, half))
+            {
+                break;
+            }
+            usleep(BENCH_RTU_TCP_PAUSE);
+        }
+
+        if (mb_data->data_len - half != write(sock, mb_data->data + half, mb_data->data_len - half))
+        {
+            break;
+        }
+    }
+
+    if (0 <= sock)
+    {
+        close(sock);
+    }
+    mb_data_destory(mb_data);
+
+    return NULL;
+}
+
+/*
+ * Function  : start a device server thread on 127.0.0.1 taking one connection
+ * port      : listen port
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_rtu_tcp_slave_start(UINT16_T port)
+{
+    static MBSLV_CTL_T slv_ctl = {
+        .n_holding = 0x10000,
+    };
+    BENCH_RTU_TCP_SLAVE_T *slave = NULL;
+    struct sockaddr_in addr;
+    pthread_t pid;
+    UINT32_T  i   = 0;
+    int       opt = 1;
+
+    slave = (BENCH_RTU_TCP_SLAVE_T *)malloc(sizeof(BENCH_RTU_TCP_SLAVE_T));
+    if (!slave)
+    {
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    slave->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (0 > slave->listen_fd)
+    {
+        perror("socket error");
+        free(slave);
+        return -1;
+    }
+    setsockopt(slave->listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (0 > bind(slave->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) || 0 > listen(slave->listen_fd, 1))
+    {
+        perror("listen error");
+        close(slave->listen_fd);
+        free(slave);
+        return -1;
+    }
+
+    slave->store = mb_slave_store_create(&slv_ctl);
+    if (!slave->store)
+    {
+        close(slave->listen_fd);
+        free(slave);
+        return -1;
+    }
+
+    for (i = 0; i < 0x10000; ++i)
+    {
+        slave->store->holding[i] = i;
+    }
+
+    if (pthread_create(&pid, NULL, bench_rtu_tcp_routine, slave))
+    {
+        mb_slave_store_destory(slave->store);
+        close(slave->listen_fd);
+        free(slave);
+        return -1;
+    }
+    pthread_detach(pid);
+
+    return 0;
+}
+
+/*
+ * Function  : FC03 round trips of RTU over TCP, split responses are joined by the predicted
+ *             length, a cut one is ended by the silence gap and fails its CRC check,
+ *             the following transactions must not be disturbed by it
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_rtu_tcp(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    SPMB_CTL_T mb_ctl = {
+        .mb_type = MB_TYPE_RTU_TCP,
+        .mb_conf = "/dev/null",
+
+        .tcp_ctrl = {
+            .port          = ctl->port + 7,
+            .ip            = "127.0.0.1",
+            .ethdev        = "lo",
+            .max_data_size = MBRTU_FRAME_SIZE,
+            .unitid        = 1,
+        }
+    };
+    SPMB_CTX_T  *mb_ctx = NULL;
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT64_T     begin  = 0;
+    UINT32_T     cut    = 0;
+    UINT32_T     i      = 0;
+    int          ret    = 0;
+
+    if (0 > bench_rtu_tcp_slave_start(mb_ctl.tcp_ctrl.port) || !(mb_ctx = sp_mb_init(&mb_ctl)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, ctl->count))
+    {
+        sp_mb_close(mb_ctx);
+        return -1;
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    for (i = 0; i < ctl->count; ++i)
+    {
+        memset(&mb_info, 0, sizeof(mb_info));
+        mb_info.code  = MB_FUNC_03;
+        mb_info.reg   = i % 100;
+        mb_info.n_reg = ctl->n_reg;
+
+        begin = mb_time_us();
+
+        if (0 > sp_mb_send(mb_ctx, &mb_info))
+        {
+            ret = -1;
+            break;
+        }
+
+        if (0 > sp_mb_recv(mb_ctx, &mb_info))
+        {
+            /* only the cut responses may fail */
+            if (++cut > (i + 1) / BENCH_RTU_TCP_CUT)
+            {
+                printf("rtu_tcp : request %d failed\n", i);
+                ret = -1;
+                break;
+            }
+            continue;
+        }
+
+        stat.sample[stat.count++] = mb_time_us() - begin;
+
+        /* holding registers hold their own address */
+        if (mb_info.n_byte != ctl->n_reg * 2 || mb_info.value[1] != (UINT8_T)(i % 100))
+        {
+            printf("rtu_tcp : wrong response to request %d\n", i);
+            ret = -1;
+            break;
+        }
+    }
+
+    stat.stop = mb_time_us();
+
+    if (!ret && cut != ctl->count / BENCH_RTU_TCP_CUT)
+    {
+        printf("rtu_tcp : %u cut responses taken for whole ones\n", ctl->count / BENCH_RTU_TCP_CUT - cut);
+        ret = -1;
+    }
+
+    printf("rtu_tcp : %u split responses joined, %u cut responses rejected\n", ctl->count / BENCH_RTU_TCP_SPLIT, cut);
+    bench_stat_show("rtu_tcp(FC03)", &stat);
+    bench_syscall_show("rtu_tcp(FC03)", stat.count);
+
+    bench_stat_exit(&stat);
+    sp_mb_close(mb_ctx);
+
+    return ret;
+}
@@ -0,0 +1,173 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus TCP server throughput, raw clients keep it saturated with pipelined requests
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "bench.h"
+
+#define BENCH_SERVER_CLIENT 4
+#define BENCH_SERVER_BURST  64
+#define BENCH_SERVER_REQ    12      /* FC03 request frame */
+
+static int bench_server_connect(UINT16_T port)
+{
+    struct sockaddr_in addr = {0};
+    int sock = 0;
+    int one  = 1;
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (0 > sock)
+    {
+        perror("socket error");
+        return -1;
+    }
+
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (0 > connect(sock, (struct sockaddr *)&addr, sizeof(addr)))
+    {
+        perror("connect error");
+        close(sock);
+        return -1;
+    }
+
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    return sock;
+}
+
+/*
+ * Function  : BENCH_SERVER_CLIENT clients each keep BENCH_SERVER_BURST FC03 reads in flight
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_server(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    static UINT8_T burst[BENCH_SERVER_BURST * BENCH_SERVER_REQ];
+    static UINT8_T rsp[BENCH_SERVER_BURST * MBTCP_FRAME_SIZE];
+
+    int      sock[BENCH_SERVER_CLIENT];
+    UINT32_T left[BENCH_SERVER_CLIENT];
+    UINT32_T rsp_len = 9 + ctl->n_reg * 2;
+    UINT64_T total   = (UINT64_T)ctl->count * 50;
+    UINT64_T done    = 0;
+    UINT64_T start   = 0;
+    UINT64_T stop    = 0;
+    UINT8_T *req     = NULL;
+    struct pollfd pfd[BENCH_SERVER_CLIENT];
+    int ret = 0;
+    int len = 0;
+    int i   = 0;
+
+    if (0 > bench_slave_start(ctl->port + 5))
+    {
+        return -1;
+    }
+
+    /* pre-encoded burst of pipelined reads */
+    for (i = 0; i < BENCH_SERVER_BURST; ++i)
+    {
+        req = burst + (i * BENCH_SERVER_REQ);
+        req[0]  = (UINT8_T)(i >> 8);
+        req[1]  = (UINT8_T)i;
+        req[2]  = 0;
+        req[3]  = 0;
+        req[4]  = 0;
+        req[5]  = 6;
+        req[6]  = 1;
+        req[7]  = MB_FUNC_03;
+        req[8]  = 0;
+        req[9]  = (UINT8_T)i;
+        req[10] = (UINT8_T)(ctl->n_reg >> 8);
+        req[11] = (UINT8_T)ctl->n_reg;
+    }
+
+    for (i = 0; i < BENCH_SERVER_CLIENT; ++i)
+    {
+        sock[i] = bench_server_connect(ctl->port + 5);
+        if (0 > sock[i])
+        {
+            while (i--)
+            {
+                close(sock[i]);
+            }
+            return -1;
+        }
+        pfd[i].fd     = sock[i];
+        pfd[i].events = POLLIN;
+        left[i]       = 0;
+    }
+
+    start = mb_time_us();
+
+    while (0 == ret && done < total)
+    {
+        /* every drained client sends its next burst */
+        for (i = 0; i < BENCH_SERVER_CLIENT; ++i)
+        {
+            if (!left[i])
+            {
+                if (sizeof(burst) != send(sock[i], burst, sizeof(burst), MSG_NOSIGNAL))
+                {
+                    ret = -1;
+                    break;
+                }
+                left[i] = BENCH_SERVER_BURST * rsp_len;
+            }
+        }
+
+        if (0 > ret || 0 > poll(pfd, BENCH_SERVER_CLIENT, 1000))
+        {
+            ret = -1;
+            break;
+        }
+
+        for (i = 0; i < BENCH_SERVER_CLIENT; ++i)
+        {
+            if (!(pfd[i].revents & POLLIN))
+            {
+                continue;
+            }
+
+            len = recv(sock[i], rsp, (left[i] < sizeof(rsp)) ? left[i] : sizeof(rsp), MSG_DONTWAIT);
+            if (0 >= len)
+            {
+                ret = -1;
+                break;
+            }
+
+            left[i] -= len;
+            if (!left[i])
+            {
+                done += BENCH_SERVER_BURST;
+            }
+        }
+    }
+
+    stop = mb_time_us();
+
+    for (i = 0; i < BENCH_SERVER_CLIENT; ++i)
+    {
+        close(sock[i]);
+    }
+
+    printf("%-24s : %8llu reqs %10.0f reqs/s  (%d clients x %d in flight, clients share the core)\n",
+        "server", done, (stop > start) ? (double)done * 1000000 / (stop - start) : 0.0, 
+        BENCH_SERVER_CLIENT, BENCH_SERVER_BURST);
+
+    return ret;
+}
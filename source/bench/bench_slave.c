@@ -0,0 +1,112 @@
+/*
+ * Author   : shawn-tany
+ * Function : local ModBus TCP slaver used as benchmark target, served by mb_tcp_srv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bench.h"
+#include "mb_tcp_srv.h"
+
+static void *slave_routine(void *arg)
+{
+    MBSRV_CTX_T *mbsrv_ctx = (MBSRV_CTX_T *)arg;
+
+    while (0 <= mb_tcp_srv_run(mbsrv_ctx, -1))
+    {
+        ;
+    }
+
+    return NULL;
+}
+
+/*
+ * Function  : start a slaver thread serving its listener and an optional connected socket
+ * srv_ctl   : listen address of the slaver
+ * sock      : connected socket served too, -1=NONE
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_slave_run(MBSRV_CTL_T *srv_ctl, int sock)
+{
+    MBSLV_CTL_T slv_ctl = {
+        .n_coil     = 0x10000,
+        .n_discrete = 0x10000,
+        .n_holding  = 0x10000,
+        .n_input    = 0x10000,
+    };
+    MBSRV_CTX_T *mbsrv_ctx = NULL;
+    pthread_t pid;
+    UINT32_T  i = 0;
+
+    srv_ctl->store = mb_slave_store_create(&slv_ctl);
+    if (!srv_ctl->store)
+    {
+        return -1;
+    }
+
+    /* register value is its address, every other coil is on */
+    for (i = 0; i < 0x10000; ++i)
+    {
+        srv_ctl->store->holding[i]  = i;
+        srv_ctl->store->input[i]    = i;
+        srv_ctl->store->coil[i]     = !(i & 1);
+        srv_ctl->store->discrete[i] = !(i & 1);
+    }
+
+    mbsrv_ctx = mb_tcp_srv_create(srv_ctl);
+    if (!mbsrv_ctx)
+    {
+        mb_slave_store_destory(srv_ctl->store);
+        return -1;
+    }
+
+    if (0 <= sock && 0 > mb_tcp_srv_attach(mbsrv_ctx, sock))
+    {
+        mb_tcp_srv_destory(mbsrv_ctx);
+        mb_slave_store_destory(srv_ctl->store);
+        return -1;
+    }
+
+    if (pthread_create(&pid, NULL, slave_routine, mbsrv_ctx))
+    {
+        mb_tcp_srv_destory(mbsrv_ctx);
+        mb_slave_store_destory(srv_ctl->store);
+        return -1;
+    }
+    pthread_detach(pid);
+
+    return 0;
+}
+
+/*
+ * Function  : start a local ModBus TCP slaver thread on 127.0.0.1
+ * port      : listen port
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_slave_start(UINT16_T port)
+{
+    MBSRV_CTL_T srv_ctl = {
+        .port = port,
+        .ip   = "127.0.0.1",
+    };
+
+    return bench_slave_run(&srv_ctl, -1);
+}
+
+/*
+ * Function  : start a local ModBus slaver thread on an AF_UNIX path
+ * path      : listen path
+ * sock      : one end of a socketpair served too, -1=NONE
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_slave_start_unix(const char *path, int sock)
+{
+    MBSRV_CTL_T srv_ctl = {0};
+
+    snprintf(srv_ctl.path, sizeof(srv_ctl.path), "%s", path);
+
+    return bench_slave_run(&srv_ctl, sock);
+}
@@ -0,0 +1,132 @@
+/*
+ * Author   : shawn-tany
+ * Function : count socket syscalls issued by the ModBus library(linked with --wrap)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "bench.h"
+
+/* the benchmark thread only, the local slaver runs in other threads */
+static __thread UINT64_T syscall_cnt[BENCH_SYS_NUM];
+
+static const char *syscall_name[BENCH_SYS_NUM] = {
+    [BENCH_SYS_SEND]       = "send",
+    [BENCH_SYS_RECV]       = "recv",
+    [BENCH_SYS_POLL]       = "poll",
+    [BENCH_SYS_GETSOCKOPT] = "getsockopt",
+    [BENCH_SYS_EPOLL_WAIT] = "epoll_wait",
+    [BENCH_SYS_SENDMSG]    = "sendmsg",
+    [BENCH_SYS_URING_ENTER] = "io_uring_enter",
+};
+
+ssize_t __real_send(int sock, const void *buf, size_t len, int flags);
+ssize_t __real_recv(int sock, void *buf, size_t len, int flags);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int __real_getsockopt(int sock, int level, int name, void *val, socklen_t *len);
+int __real_epoll_wait(int epfd, struct epoll_event *events, int max, int timeout);
+ssize_t __real_sendmsg(int sock, const struct msghdr *msg, int flags);
+long __real_syscall(long number, ...);
+
+ssize_t __wrap_send(int sock, const void *buf, size_t len, int flags)
+{
+    syscall_cnt[BENCH_SYS_SEND]++;
+    return __real_send(sock, buf, len, flags);
+}
+
+ssize_t __wrap_recv(int sock, void *buf, size_t len, int flags)
+{
+    syscall_cnt[BENCH_SYS_RECV]++;
+    return __real_recv(sock, buf, len, flags);
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    syscall_cnt[BENCH_SYS_POLL]++;
+    return __real_poll(fds, nfds, timeout);
+}
+
+int __wrap_getsockopt(int sock, int level, int name, void *val, socklen_t *len)
+{
+    syscall_cnt[BENCH_SYS_GETSOCKOPT]++;
+    return __real_getsockopt(sock, level, name, val, len);
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int max, int timeout)
+{
+    syscall_cnt[BENCH_SYS_EPOLL_WAIT]++;
+    return __real_epoll_wait(epfd, events, max, timeout);
+}
+
+ssize_t __wrap_sendmsg(int sock, const struct msghdr *msg, int flags)
+{
+    syscall_cnt[BENCH_SYS_SENDMSG]++;
+    return __real_sendmsg(sock, msg, flags);
+}
+
+/* io_uring has no libc wrapper, x86_64/arm64 syscall arguments are all longs */
+long __wrap_syscall(long number, ...)
+{
+    long    arg[6];
+    int     i = 0;
+    va_list ap;
+
+    va_start(ap, number);
+    for (i = 0; i < ITEM(arg); ++i)
+    {
+        arg[i] = va_arg(ap, long);
+    }
+    va_end(ap);
+
+    if (__NR_io_uring_enter == number)
+    {
+        syscall_cnt[BENCH_SYS_URING_ENTER]++;
+    }
+
+    return __real_syscall(number, arg[0], arg[1], arg[2], arg[3], arg[4], arg[5]);
+}
+
+/*
+ * Function  : restart syscall counting of the calling thread
+ * return    : void
+ */
+void bench_syscall_reset(void)
+{
+    memset(syscall_cnt, 0, sizeof(syscall_cnt));
+}
+
+/*
+ * Function  : print syscalls per transaction of the calling thread
+ * name      : name of the benchmark case
+ * count     : transaction number
+ * return    : void
+ */
+void bench_syscall_show(const char *name, UINT32_T count)
+{
+    int i = 0;
+    UINT64_T total = 0;
+
+    if (!count)
+    {
+        return ;
+    }
+
+    printf("%-24s : syscalls/trans", name);
+    for (i = 0; i < BENCH_SYS_NUM; ++i)
+    {
+        total += syscall_cnt[i];
+        if (syscall_cnt[i])
+        {
+            printf("  %s %.2f", syscall_name[i], (double)syscall_cnt[i] / count);
+        }
+    }
+    printf("  total %.2f\n", (double)total / count);
+}
@@ -0,0 +1,278 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus TCP transaction benchmark
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+static UINT64_T sent_time[0x10000];
+
+static SPMB_CTX_T *bench_tcp_connect(UINT16_T port, UINT16_T window, UINT16_T batch)
+{
+    SPMB_CTL_T mb_ctl = {
+        .mb_type = MB_TYPE_TCP,
+        .mb_conf = "/dev/null",
+
+        .tcp_ctrl = {
+            .port          = port,
+            .ip            = "127.0.0.1",
+            .ethdev        = "lo",
+            .max_data_size = 1400,
+            .unitid        = 1,
+            .window        = window,
+            .batch         = batch,
+        }
+    };
+
+    return sp_mb_init(&mb_ctl);
+}
+
+/*
+ * Function  : request/response latency of FC03 reads against a local slaver
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_tcp_latency(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    SPMB_CTX_T  *mb_ctx = NULL;
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT64_T     begin = 0;
+    UINT32_T     i     = 0;
+    int          ret   = 0;
+
+    if (0 > bench_slave_start(ctl->port))
+    {
+        return -1;
+    }
+
+    if (!(mb_ctx = bench_tcp_connect(ctl->port, 1, 0)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, ctl->count))
+    {
+        sp_mb_close(mb_ctx);
+        return -1;
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    for (i = 0; i < ctl->count; ++i)
+    {
+        memset(&mb_info, 0, sizeof(mb_info));
+        mb_info.code  = MB_FUNC_03;
+        mb_info.reg   = i % 100;
+        mb_info.n_reg = ctl->n_reg;
+
+        begin = mb_time_us();
+
+        if (0 > sp_mb_send(mb_ctx, &mb_info) || 0 > sp_mb_recv(mb_ctx, &mb_info))
+        {
+            ret = -1;
+            break;
+        }
+
+        stat.sample[stat.count++] = mb_time_us() - begin;
+    }
+
+    stat.stop = mb_time_us();
+
+    bench_stat_show("tcp_latency", &stat);
+    bench_syscall_show("tcp_latency", stat.count);
+
+    bench_stat_exit(&stat);
+    sp_mb_close(mb_ctx);
+
+    return ret;
+}
+
+/*
+ * Function  : FC03 reads with up to ctl->window requests in flight on one connection
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_tcp_pipeline(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    SPMB_CTX_T  *mb_ctx = NULL;
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT32_T     sent  = 0;
+    UINT16_T     tid   = 0;
+    UINT64_T     begin = 0;
+    int          ret   = 0;
+
+    if (0 > bench_slave_start(ctl->port + 1))
+    {
+        return -1;
+    }
+
+    if (!(mb_ctx = bench_tcp_connect(ctl->port + 1, ctl->window, 0)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, ctl->count))
+    {
+        sp_mb_close(mb_ctx);
+        return -1;
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    while (stat.count < ctl->count)
+    {
+        /* fill the transaction window */
+        while (sent < ctl->count && mb_tcp_pending(mb_ctx->ctx.mb_tcp_ctx) < ctl->window)
+        {
+            memset(&mb_info, 0, sizeof(mb_info));
+            mb_info.code  = MB_FUNC_03;
+            mb_info.reg   = sent % 100;
+            mb_info.n_reg = ctl->n_reg;
+
+            begin = mb_time_us();
+
+            if (0 > sp_mb_send(mb_ctx, &mb_info))
+            {
+                ret = -1;
+                break;
+            }
+
+            sent_time[sp_mb_tid_get(mb_ctx, MB_TX)] = begin;
+            sent++;
+        }
+
+        if (0 > ret || 0 > sp_mb_recv(mb_ctx, &mb_info))
+        {
+            ret = -1;
+            break;
+        }
+
+        tid = sp_mb_tid_get(mb_ctx, MB_RX);
+        stat.sample[stat.count++] = mb_time_us() - sent_time[tid];
+    }
+
+    stat.stop = mb_time_us();
+
+    bench_stat_show("tcp_pipeline", &stat);
+    bench_syscall_show("tcp_pipeline", stat.count);
+
+    bench_stat_exit(&stat);
+    sp_mb_close(mb_ctx);
+
+    return ret;
+}
+
+/*
+ * Function  : scan cycles of BENCH_SCAN_SIZE FC03 reads, all requests of a cycle are 
+ *             sent before the responses are read
+ * port      : local slaver port
+ * batch     : requests gathered in one write, 0=one write per request
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_tcp_scan_run(BENCH_CTL_T *ctl, UINT16_T port, UINT16_T batch, const char *name)
+{
+    SPMB_CTX_T  *mb_ctx = NULL;
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT32_T     sent  = 0;
+    UINT32_T     i     = 0;
+    UINT16_T     tid   = 0;
+    int          ret   = 0;
+
+    if (!(mb_ctx = bench_tcp_connect(port, BENCH_SCAN_SIZE, batch)))
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, ctl->count))
+    {
+        sp_mb_close(mb_ctx);
+        return -1;
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    while (0 == ret && stat.count < ctl->count)
+    {
+        for (i = 0; i < BENCH_SCAN_SIZE && sent < ctl->count; ++i, ++sent)
+        {
+            memset(&mb_info, 0, sizeof(mb_info));
+            mb_info.code  = MB_FUNC_03;
+            mb_info.reg   = i;
+            mb_info.n_reg = ctl->n_reg;
+
+            if (0 > sp_mb_send(mb_ctx, &mb_info))
+            {
+                ret = -1;
+                break;
+            }
+
+            sent_time[sp_mb_tid_get(mb_ctx, MB_TX)] = mb_time_us();
+        }
+
+        /* end of scan cycle */
+        if (0 > ret || 0 > sp_mb_flush(mb_ctx))
+        {
+            ret = -1;
+            break;
+        }
+
+        while (stat.count < sent)
+        {
+            if (0 > sp_mb_recv(mb_ctx, &mb_info))
+            {
+                ret = -1;
+                break;
+            }
+
+            tid = sp_mb_tid_get(mb_ctx, MB_RX);
+            stat.sample[stat.count++] = mb_time_us() - sent_time[tid];
+        }
+    }
+
+    stat.stop = mb_time_us();
+
+    bench_stat_show(name, &stat);
+    bench_syscall_show(name, stat.count);
+
+    bench_stat_exit(&stat);
+    sp_mb_close(mb_ctx);
+
+    return ret;
+}
+
+/*
+ * Function  : scan cycles sent one write per request, then gathered in one write
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_tcp_scan(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    if (0 > bench_slave_start(ctl->port + 3))
+    {
+        return -1;
+    }
+
+    if (0 > bench_tcp_scan_run(ctl, ctl->port + 3, 0, "tcp_scan") ||
+        0 > bench_tcp_scan_run(ctl, ctl->port + 3, BENCH_SCAN_SIZE, "tcp_scan_batch"))
+    {
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus request latency over loopback TCP, AF_UNIX path and socketpair
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "bench.h"
+
+/*
+ * Function  : FC03 request/response latency on one context
+ * name      : name of the benchmark case
+ * mbtcp_ctx : ModBus TCP context, closed here
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_unix_latency(BENCH_CTL_T *ctl, const char *name, MBTCP_CTX_T *mbtcp_ctx)
+{
+    BENCH_STAT_T stat;
+    MB_INFO_T    mb_info;
+    UINT64_T     begin = 0;
+    UINT32_T     i     = 0;
+    int          ret   = 0;
+
+    if (!mbtcp_ctx)
+    {
+        return -1;
+    }
+
+    if (0 > bench_stat_init(&stat, ctl->count))
+    {
+        mb_tcp_close(mbtcp_ctx);
+        return -1;
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    for (i = 0; i < ctl->count; ++i)
+    {
+        memset(&mb_info, 0, sizeof(mb_info));
+        mb_info.code  = MB_FUNC_03;
+        mb_info.reg   = i % 100;
+        mb_info.n_reg = ctl->n_reg;
+
+        begin = mb_time_us();
+
+        mbtcpctx_info_updata(mbtcp_ctx, &mb_info);
+        if (0 > mb_tcp_send(mbtcp_ctx) || 0 > mb_tcp_recv(mbtcp_ctx))
+        {
+            ret = -1;
+            break;
+        }
+
+        stat.sample[stat.count++] = mb_time_us() - begin;
+    }
+
+    stat.stop = mb_time_us();
+
+    bench_stat_show(name, &stat);
+    bench_syscall_show(name, stat.count);
+
+    bench_stat_exit(&stat);
+    mb_tcp_close(mbtcp_ctx);
+
+    return ret;
+}
+
+/*
+ * Function  : the same transactions over each local transport, no NIC and no root needed
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_unix(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBTCP_CTL_T tcp_ctl = {
+        .port          = ctl->port + 6,
+        .ip            = "127.0.0.1",
+        .ethdev        = "lo",
+        .max_data_size = 1400,
+        .unitid        = 1,
+    };
+    int sv[2] = {-1, -1};
+
+    if (0 > socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv))
+    {
+        perror("socketpair error");
+        return -1;
+    }
+
+    if (0 > bench_slave_start(ctl->port + 6) ||
+        0 > bench_slave_start_unix(BENCH_UNIX_PATH, sv[1]))
+    {
+        close(sv[0]);
+        return -1;
+    }
+
+    if (0 > bench_unix_latency(ctl, "tcp(loopback)", mb_tcp_init(&tcp_ctl)))
+    {
+        close(sv[0]);
+        return -1;
+    }
+
+    snprintf(tcp_ctl.path, sizeof(tcp_ctl.path), "%s", BENCH_UNIX_PATH);
+    if (0 > bench_unix_latency(ctl, "unix(path)", mb_tcp_init(&tcp_ctl)))
+    {
+        close(sv[0]);
+        return -1;
+    }
+
+    return bench_unix_latency(ctl, "unix(socketpair)", mb_tcp_attach(&tcp_ctl, sv[0]));
+}
@@ -0,0 +1,150 @@
+/*
+ * Author   : shawn-tany
+ * Function : poll backend against io_uring backend, cyclic scan of local slaver devices
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+/*
+ * Function  : every cycle sends one FC03 read to each device, then reads the responses
+ * n_dev     : device number
+ * mburing   : io_uring ring, NULL=poll backend
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_uring_scan(BENCH_CTL_T *ctl, int n_dev, MBURING_T *mburing)
+{
+    MBTCP_CTL_T tcp_ctl = {
+        .port          = ctl->port + 4,
+        .ip            = "127.0.0.1",
+        .ethdev        = "lo",
+        .max_data_size = 1400,
+        .unitid        = 1,
+        .window        = 1,
+        .uring         = mburing,
+    };
+    MBTCP_CTX_T **dev   = NULL;
+    BENCH_STAT_T  stat;
+    MB_INFO_T     mb_info;
+    UINT64_T      begin = 0;
+    char name[32] = {0};
+    int  ret = 0;
+    int  i   = 0;
+
+    memset(&stat, 0, sizeof(stat));
+
+    dev = (MBTCP_CTX_T **)calloc(n_dev, sizeof(MBTCP_CTX_T *));
+    if (!dev || 0 > bench_stat_init(&stat, ctl->count))
+    {
+        ret = -1;
+        goto out;
+    }
+
+    for (i = 0; i < n_dev; ++i)
+    {
+        if (!(dev[i] = mb_tcp_init(&tcp_ctl)))
+        {
+            ret = -1;
+            goto out;
+        }
+    }
+
+    bench_syscall_reset();
+    stat.start = mb_time_us();
+
+    while (0 == ret && stat.count < ctl->count)
+    {
+        begin = mb_time_us();
+
+        for (i = 0; i < n_dev; ++i)
+        {
+            memset(&mb_info, 0, sizeof(mb_info));
+            mb_info.code  = MB_FUNC_03;
+            mb_info.reg   = i % 100;
+            mb_info.n_reg = ctl->n_reg;
+
+            mbtcpctx_info_updata(dev[i], &mb_info);
+            if (0 > mb_tcp_send(dev[i]))
+            {
+                ret = -1;
+                break;
+            }
+        }
+
+        for (i = 0; 0 == ret && i < n_dev; ++i)
+        {
+            if (0 > mb_tcp_recv(dev[i]))
+            {
+                ret = -1;
+                break;
+            }
+
+            if (stat.count < ctl->count)
+            {
+                stat.sample[stat.count++] = mb_time_us() - begin;
+            }
+        }
+    }
+
+    stat.stop = mb_time_us();
+
+    snprintf(name, sizeof(name), "%s(%d dev)", mburing ? "uring" : "poll", n_dev);
+    bench_stat_show(name, &stat);
+    bench_syscall_show(name, stat.count);
+
+out :
+    for (i = 0; dev && i < n_dev; ++i)
+    {
+        if (dev[i])
+        {
+            mb_tcp_close(dev[i]);
+        }
+    }
+    bench_stat_exit(&stat);
+    free(dev);
+
+    return ret;
+}
+
+/*
+ * Function  : the same scans on the poll backend and on the io_uring backend
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_uring(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBURING_T *mburing = NULL;
+    int n_dev = 0;
+    int ret   = 0;
+
+    if (0 > bench_slave_start(ctl->port + 4))
+    {
+        return -1;
+    }
+
+    /* make uring=yes */
+    mburing = mb_uring_create(0);
+    if (!mburing)
+    {
+        printf("benchmark uring skipped\n");
+        return 0;
+    }
+
+    for (n_dev = 1; n_dev <= BENCH_URING_DEVICE && 0 == ret; n_dev *= 4)
+    {
+        if (0 > bench_uring_scan(ctl, n_dev, NULL) ||
+            0 > bench_uring_scan(ctl, n_dev, mburing))
+        {
+            ret = -1;
+        }
+    }
+
+    mb_uring_destory(mburing);
+
+    return ret;
+}
@@ -0,0 +1,234 @@
+/*
+ * Author   : shawn-tany
+ * Function : typed register values, a block of float32 as integrators decoded it by hand
+ *            against the descriptor decode, and a mixed meter block both ways
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_VALUE_LOOP  1000000
+#define BENCH_VALUE_FLOAT 62        /* 124 registers, near the longest FC03/04 read */
+
+/* what a power meter gives in one read */
+typedef struct
+{
+    float    voltage[3];
+    float    current[3];
+    INT64_T  energy;
+    double   frequency;
+    int      power;
+    short    temperature;
+    UINT16_T status;
+    char     serial[17];
+} BENCH_METER_T;
+
+static const MBVAL_DESC_T bench_meter_desc[] = {
+    MBVAL_DESC(0,  MBVAL_FLOAT32, MBVAL_ORDER_CDAB, 3,  offsetof(BENCH_METER_T, voltage)),
+    MBVAL_DESC(6,  MBVAL_FLOAT32, MBVAL_ORDER_CDAB, 3,  offsetof(BENCH_METER_T, current)),
+    MBVAL_DESC(12, MBVAL_INT64,   MBVAL_ORDER_ABCD, 1,  offsetof(BENCH_METER_T, energy)),
+    MBVAL_DESC(16, MBVAL_FLOAT64, MBVAL_ORDER_DCBA, 1,  offsetof(BENCH_METER_T, frequency)),
+    MBVAL_DESC(20, MBVAL_INT32,   MBVAL_ORDER_BADC, 1,  offsetof(BENCH_METER_T, power)),
+    MBVAL_DESC(22, MBVAL_INT16,   MBVAL_ORDER_ABCD, 1,  offsetof(BENCH_METER_T, temperature)),
+    MBVAL_DESC(23, MBVAL_UINT16,  MBVAL_ORDER_ABCD, 1,  offsetof(BENCH_METER_T, status)),
+    MBVAL_DESC(24, MBVAL_STRING,  MBVAL_ORDER_ABCD, 16, offsetof(BENCH_METER_T, serial)),
+};
+
+static UINT64_T bench_value_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (UINT64_T)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Function  : float32 of CDAB registers the way it is written by hand on MB_INFO_T::value
+ * return    : void
+ */
+static void bench_value_by_hand(float *value, const UINT8_T *wire, int n)
+{
+    UINT32_T word = 0;
+    int i = 0;
+
+    for (i = 0; i < n; ++i)
+    {
+        word = ((UINT32_T)wire[(i * 4) + 2] << 24) | ((UINT32_T)wire[(i * 4) + 3] << 16) |
+               ((UINT32_T)wire[i * 4] << 8)        | wire[(i * 4) + 1];
+        memcpy(&value[i], &word, sizeof(word));
+    }
+}
+
+/*
+ * Function  : known wire bytes of every order and type decode to the expected value
+ *             and encode back to the same bytes
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int bench_value_check(void)
+{
+    /* 123.456f is 0x42f6e979, 0x1122334455667788 */
+    static const struct
+    {
+        UINT8_T type;
+        UINT8_T order;
+        UINT8_T wire[8];
+    } known[] = {
+        { MBVAL_FLOAT32, MBVAL_ORDER_ABCD, { 0x42, 0xf6, 0xe9, 0x79 } },
+        { MBVAL_FLOAT32, MBVAL_ORDER_CDAB, { 0xe9, 0x79, 0x42, 0xf6 } },
+        { MBVAL_FLOAT32, MBVAL_ORDER_BADC, { 0xf6, 0x42, 0x79, 0xe9 } },
+        { MBVAL_FLOAT32, MBVAL_ORDER_DCBA, { 0x79, 0xe9, 0xf6, 0x42 } },
+        { MBVAL_UINT64,  MBVAL_ORDER_ABCD, { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 } },
+        { MBVAL_UINT64,  MBVAL_ORDER_CDAB, { 0x77, 0x88, 0x55, 0x66, 0x33, 0x44, 0x11, 0x22 } },
+        { MBVAL_UINT64,  MBVAL_ORDER_BADC, { 0x22, 0x11, 0x44, 0x33, 0x66, 0x55, 0x88, 0x77 } },
+        { MBVAL_UINT64,  MBVAL_ORDER_DCBA, { 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11 } },
+    };
+    MBVAL_DESC_T  desc = MBVAL_DESC(0, 0, 0, 1, 0);
+    BENCH_METER_T meter;
+    BENCH_METER_T check;
+    MB_INFO_T     mb_info;
+    UINT8_T  wire[8]  = {0};
+    UINT64_T value    = 0;
+    float    value_f  = 0;
+    int      i        = 0;
+
+    for (i = 0; i < ITEM(known); ++i)
+    {
+        desc.type  = known[i].type;
+        desc.order = known[i].order;
+
+        if (0 > mb_value_decode(&desc, 1, known[i].wire, 4, &value) ||
+            0 > mb_value_encode(&desc, 1, &value, wire, 4))
+        {
+            return -1;
+        }
+
+        memcpy(&value_f, &value, sizeof(value_f));
+        if ((MBVAL_FLOAT32 == desc.type) ? (123.456f != value_f) : (0x1122334455667788ULL != value) ||
+            memcmp(wire, known[i].wire, mb_value_regs(&desc) * 2))
+        {
+            printf("value : type %d order %d decoded wrong\n", desc.type, desc.order);
+            return -1;
+        }
+    }
+
+    memset(&meter, 0, sizeof(meter));
+    meter.voltage[0]  = 230.5f;
+    meter.voltage[1]  = 229.75f;
+    meter.voltage[2]  = 231.25f;
+    meter.current[0]  = 12.5f;
+    meter.current[1]  = -0.125f;
+    meter.current[2]  = 3.0f;
+    meter.energy      = -1234567890123LL;
+    meter.frequency   = 49.987;
+    meter.power       = -7654321;
+    meter.temperature = -40;
+    meter.status      = 0xbeef;
+    strcpy(meter.serial, "SN-0123456789ABC");
+
+    memset(&check, 0, sizeof(check));
+    memset(&mb_info, 0, sizeof(mb_info));
+
+    if (0 > mb_info_value_set(&mb_info, bench_meter_desc, ITEM(bench_meter_desc), &meter) ||
+        0 > mb_info_value_get(&mb_info, bench_meter_desc, ITEM(bench_meter_desc), &check) ||
+        memcmp(&meter, &check, sizeof(meter)))
+    {
+        printf("value : meter block does not come back the same\n");
+        return -1;
+    }
+
+    /* the serial number reads as text on the wire */
+    if (memcmp(mb_info.value + 48, "SN-0123456789ABC", 16) || 32 != mb_info.n_reg)
+    {
+        printf("value : serial number encoded wrong\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : decode checks, then BENCH_VALUE_LOOP rounds of each way
+ * ctl       : benchmark parameters
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int bench_value(BENCH_CTL_T *ctl)
+{
+    PTR_CHECK_N1(ctl);
+
+    MBVAL_DESC_T  desc = MBVAL_DESC(0, MBVAL_FLOAT32, MBVAL_ORDER_CDAB, BENCH_VALUE_FLOAT, 0);
+    BENCH_METER_T meter;
+    MB_INFO_T     mb_info;
+    UINT8_T  wire[BENCH_VALUE_FLOAT * 4];
+    float    by_hand[BENCH_VALUE_FLOAT];
+    float    value[BENCH_VALUE_FLOAT];
+    UINT64_T ns   = 0;
+    UINT32_T loop = 0;
+    int      i    = 0;
+
+    if (0 > bench_value_check())
+    {
+        return -1;
+    }
+
+    for (i = 0; i < BENCH_VALUE_FLOAT; ++i)
+    {
+        value[i] = (float)i * 1.5f - 20.0f;
+    }
+    mb_value_encode(&desc, 1, value, wire, ITEM(wire) / 2);
+
+    bench_value_by_hand(by_hand, wire, BENCH_VALUE_FLOAT);
+    memset(value, 0, sizeof(value));
+    mb_value_decode(&desc, 1, wire, ITEM(wire) / 2, value);
+    if (memcmp(by_hand, value, sizeof(value)))
+    {
+        printf("value : float32 block differs from the hand written decode\n");
+        return -1;
+    }
+
+    ns = bench_value_ns();
+    for (loop = 0; loop < BENCH_VALUE_LOOP; ++loop)
+    {
+        bench_value_by_hand(by_hand, wire, BENCH_VALUE_FLOAT);
+        __asm__ __volatile__("" : : "r"(by_hand), "r"(wire) : "memory");
+    }
+    ns = bench_value_ns() - ns;
+    printf("%-24s : %8.1f ns/block\n", "value_by_hand(62 x f32)", (double)ns / BENCH_VALUE_LOOP);
+
+    ns = bench_value_ns();
+    for (loop = 0; loop < BENCH_VALUE_LOOP; ++loop)
+    {
+        mb_value_decode(&desc, 1, wire, ITEM(wire) / 2, value);
+        __asm__ __volatile__("" : : "r"(value), "r"(wire) : "memory");
+    }
+    ns = bench_value_ns() - ns;
+    printf("%-24s : %8.1f ns/block\n", "value_desc(62 x f32)", (double)ns / BENCH_VALUE_LOOP);
+
+    memset(&meter, 0, sizeof(meter));
+    memset(&mb_info, 0, sizeof(mb_info));
+
+    ns = bench_value_ns();
+    for (loop = 0; loop < BENCH_VALUE_LOOP; ++loop)
+    {
+        mb_info_value_set(&mb_info, bench_meter_desc, ITEM(bench_meter_desc), &meter);
+        __asm__ __volatile__("" : : "r"(&mb_info), "r"(&meter) : "memory");
+    }
+    ns = bench_value_ns() - ns;
+    printf("%-24s : %8.1f ns/block\n", "value_meter(encode)", (double)ns / BENCH_VALUE_LOOP);
+
+    ns = bench_value_ns();
+    for (loop = 0; loop < BENCH_VALUE_LOOP; ++loop)
+    {
+        mb_info_value_get(&mb_info, bench_meter_desc, ITEM(bench_meter_desc), &meter);
+        __asm__ __volatile__("" : : "r"(&mb_info), "r"(&meter) : "memory");
+    }
+    ns = bench_value_ns() - ns;
+    printf("%-24s : %8.1f ns/block\n", "value_meter(decode)", (double)ns / BENCH_VALUE_LOOP);
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * Author   : shawn-tany
+ * Function : ModBus benchmark entrance
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+static struct 
+{
+    char *name;
+    int (*func)(BENCH_CTL_T *ctl);
+} bench_case_map[] = {
+    { "tcp_latency",   bench_tcp_latency   },
+    { "tcp_pipeline",  bench_tcp_pipeline  },
+    { "tcp_scan",      bench_tcp_scan      },
+    { "engine",        bench_engine        },
+    { "uring",         bench_uring         },
+    { "server",        bench_server        },
+    { "unix",          bench_unix          },
+    { "crc",           bench_crc           },
+    { "rtu",           bench_rtu           },
+    { "rtu_bus",       bench_rtu_bus       },
+    { "rtu_broadcast", bench_rtu_broadcast },
+    { "rtu_sniff",     bench_rtu_sniff     },
+    { "ascii",         bench_ascii         },
+    { "rtu_tcp",       bench_rtu_tcp       },
+    { "info",          bench_info          },
+    { "coil",          bench_coil          },
+    { "reg",           bench_reg           },
+    { "value",         bench_value         },
+    { "prepared",      bench_prepared      }
+};
+
+enum
+{
+    BENCH_OPT_CASE = 1001,
+    BENCH_OPT_PORT,
+    BENCH_OPT_COUNT,
+    BENCH_OPT_NREG,
+    BENCH_OPT_WINDOW,
+    BENCH_OPT_DEVICES,
+    BENCH_OPT_SERIAL,
+    BENCH_OPT_HELP
+};
+
+static struct option long_options[] = {
+    { "case",   1, 0, BENCH_OPT_CASE  },
+    { "port",   1, 0, BENCH_OPT_PORT  },
+    { "count",  1, 0, BENCH_OPT_COUNT },
+    { "n_reg",  1, 0, BENCH_OPT_NREG  },
+    { "window", 1, 0, BENCH_OPT_WINDOW },
+    { "devices", 1, 0, BENCH_OPT_DEVICES },
+    { "serial", 1, 0, BENCH_OPT_SERIAL },
+    { "help",   0, 0, BENCH_OPT_HELP  },
+    { 0,        0, 0, 0               }
+};
+
+static void help(void)
+{
+    int i = 0;
+
+    printf( "\nOPTIONS :\n"
+            "   --case,            Benchmark case [all]\n"
+            "   --port,            Local slaver port [%d]\n"
+            "   --count,           Transaction number [%d]\n"
+            "   --n_reg,           Register number per request [%d]\n"
+            "   --window,          Outstanding ModBus TCP transactions [%d]\n"
+            "   --devices,         Max device number of the engine case [%d]\n"
+            "   --serial,          RTU slaver of the rtu cases, such as sim/mb_rtu_sim [built-in]\n"
+            "   --help,            Show ModBus benchmark options\n\n"
+            "CASES :\n", BENCH_DFT_PORT, BENCH_DFT_COUNT, BENCH_DFT_NREG, BENCH_DFT_WINDOW, BENCH_DFT_DEVICE);
+
+    for (i = 0; i < ITEM(bench_case_map); ++i)
+    {
+        printf("   %s\n", bench_case_map[i].name);
+    }
+    printf("\n");
+}
+
+static int stat_cmp(const void *a, const void *b)
+{
+    UINT64_T x = *(const UINT64_T *)a;
+    UINT64_T y = *(const UINT64_T *)b;
+
+    return (x > y) - (x < y);
+}
+
+int bench_stat_init(BENCH_STAT_T *stat, UINT32_T count)
+{
+    PTR_CHECK_N1(stat);
+
+    memset(stat, 0, sizeof(*stat));
+
+    stat->sample = (UINT64_T *)calloc(count ? count : 1, sizeof(UINT64_T));
+    if (!stat->sample)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+void bench_stat_exit(BENCH_STAT_T *stat)
+{
+    PTR_CHECK_VOID(stat);
+
+    free(stat->sample);
+    stat->sample = NULL;
+}
+
+void bench_stat_show(const char *name, BENCH_STAT_T *stat)
+{
+    PTR_CHECK_VOID(stat);
+
+    UINT32_T i   = 0;
+    UINT64_T sum = 0;
+    UINT64_T elapsed = stat->stop - stat->start;
+
+    if (!stat->count)
+    {
+        printf("%-24s : no sample\n", name);
+        return ;
+    }
+
+    qsort(stat->sample, stat->count, sizeof(UINT64_T), stat_cmp);
+
+    for (i = 0; i < stat->count; ++i)
+    {
+        sum += stat->sample[i];
+    }
+
+    printf("%-24s : %8u trans %10.0f trans/s  avg %8.1f us  p50 %6llu us  p99 %6llu us  max %6llu us\n",
+           name, stat->count, elapsed ? (stat->count * 1000000.0 / elapsed) : 0.0,
+           (double)sum / stat->count,
+           stat->sample[stat->count / 2],
+           stat->sample[(stat->count * 99) / 100],
+           stat->sample[stat->count - 1]);
+}
+
+int main(int argc, char *argv[ ])
+{
+    BENCH_CTL_T ctl = {
+        .port  = BENCH_DFT_PORT,
+        .count = BENCH_DFT_COUNT,
+        .n_reg  = BENCH_DFT_NREG,
+        .window  = BENCH_DFT_WINDOW,
+        .devices = BENCH_DFT_DEVICE
+    };
+    char *name = NULL;
+    int   opt  = 0;
+    int   idx  = 0;
+    int   i    = 0;
+    int   ret  = 0;
+
+    while (-1 != (opt = getopt_long(argc, argv, "", long_options, &idx)))
+    {
+        switch (opt)
+        {
+            case BENCH_OPT_CASE :
+                name = optarg;
+                break;
+
+            case BENCH_OPT_PORT :
+                ctl.port = strtol(optarg, NULL, 0);
+                break;
+
+            case BENCH_OPT_COUNT :
+                ctl.count = strtol(optarg, NULL, 0);
+                break;
+
+            case BENCH_OPT_NREG :
+                ctl.n_reg = strtol(optarg, NULL, 0);
+                break;
+
+            case BENCH_OPT_WINDOW :
+                ctl.window = strtol(optarg, NULL, 0);
+                break;
+
+            case BENCH_OPT_DEVICES :
+                ctl.devices = strtol(optarg, NULL, 0);
+                break;
+
+            case BENCH_OPT_SERIAL :
+                ctl.serial = optarg;
+                break;
+
+            case BENCH_OPT_HELP :
+                help();
+                return 0;
+
+            default :
+                help();
+                return 2;
+        }
+    }
+
+    for (i = 0; i < ITEM(bench_case_map); ++i)
+    {
+        if (name && strcmp(name, "all") && strcmp(name, bench_case_map[i].name))
+        {
+            continue;
+        }
+
+        if (0 > bench_case_map[i].func(&ctl))
+        {
+            printf("benchmark %s failed\n", bench_case_map[i].name);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
@@ -12,6 +12,7 @@
 #include <pthread.h>
 
 #include "sp_mb.h"
+#include "mb_rtu_sniff.h"
 #include "mask_rule.h"
 
 #define LOCK(lock)  pthread_mutex_lock(lock)
@@ -30,6 +31,7 @@ enum
 
 static SPMB_CTX_T *mb_ctx  = NULL; 
 static MASK_RULE_T  *ruleset = NULL;
+static char         *sniff_log = NULL;
 
 static SPMB_CTL_T default_ctl = {
     .mb_type = MB_TYPE_TCP,
@@ -40,6 +42,7 @@ static SPMB_CTL_T default_ctl = {
         .ethdev        = "enp1s0",
         .max_data_size = 1400,
         .unitid        = 1,
+        .path          = "/tmp/modbus.sock",
     },
 
     .rtu_ctrl = {
@@ -91,6 +94,7 @@ enum
     SPMB_OPT_IP,
     SPMB_OPT_PORT,
     SPMB_OPT_ETHDEV,
+    SPMB_OPT_PATH,
     SPMB_OPT_BAUDRATE,
     SPMB_OPT_DATABIT,
     SPMB_OPT_STOPBIT,
@@ -98,6 +102,8 @@ enum
     SPMB_OPT_FLOWCTL,
     SPMB_OPT_PARITY,
     SPMB_OPT_SLAVER,
+    SPMB_OPT_TIMEOUT,
+    SPMB_OPT_SNIFF,
     SPMB_OPT_HELP
 };
 
@@ -107,6 +113,7 @@ static struct option long_options[] = {
     { "ip",               1, 0, SPMB_OPT_IP               },
     { "port",             1, 0, SPMB_OPT_PORT             },
     { "ethdev",           1, 0, SPMB_OPT_ETHDEV           },
+    { "path",             1, 0, SPMB_OPT_PATH             },
     { "baudrate",         1, 0, SPMB_OPT_BAUDRATE         },
     { "databit",          1, 0, SPMB_OPT_DATABIT          },
     { "stopbit",          1, 0, SPMB_OPT_STOPBIT          },
@@ -114,6 +121,8 @@ static struct option long_options[] = {
     { "flowctl",          1, 0, SPMB_OPT_FLOWCTL          },
     { "parity",           1, 0, SPMB_OPT_PARITY           },
     { "slaver",           1, 0, SPMB_OPT_SLAVER           },
+    { "timeout",          1, 0, SPMB_OPT_TIMEOUT          },
+    { "sniff",            1, 0, SPMB_OPT_SNIFF            },
     { "help",             0, 0, SPMB_OPT_HELP             }
 };
 
@@ -133,11 +142,12 @@ static void signal_handle(int arg)
 static void help(void)
 {
     printf( "\nOPTIONS :\n"
-            "   --type,            Select ModBus protocol type [tcp|rtu]\n"
+            "   --type,            Select ModBus protocol type [tcp|rtu|unix|ascii|rtu_tcp]\n"
             "   --max_data_size,   Limit ModBus transform data cache size [1400]\n"
             "   --ip,              ModBus TCP server ip [192.168.1.12]\n"
             "   --port,            ModBus TCP server port [502]\n"
             "   --ethdev,          ModBus TCP ethernet device for transform [eth0]\n"
+            "   --path,            ModBus unix socket path of a local slaver [/tmp/modbus.sock]\n"
             "   --serial,          Select ModBus RTU serial [/dev/ttyUSB0]\n"
             "   --buadrate,        Set ModBus RTU baudrate [9600]\n"
             "   --databit,         Set ModBus RTU data bit [8]\n"
@@ -145,6 +155,8 @@ static void help(void)
             "   --flowctl,         Set ModBus RTU flow control [0]\n"
             "   --parity,          Set ModBus RTU parity [0]\n"
             "   --slaver,          Set ModBus RTU slaver address [1]\n"
+            "   --timeout,         Set ModBus TCP response timeout(ms) [3000]\n"
+            "   --sniff,           Listen to a ModBus RTU line and log its frames to the file\n"
             "   --help,            Show SP ModBus demo options\n\n");
 }
 
@@ -175,6 +187,18 @@ static int arg_parse(int argc, char *argv[ ], SPMB_CTL_T *ctl)
                 {
                     ctl->mb_type = MB_TYPE_TCP;
                 }
+                else if (!strcasecmp(optarg, "unix"))
+                {
+                    ctl->mb_type = MB_TYPE_UNIX;
+                }
+                else if (!strcasecmp(optarg, "ascii"))
+                {
+                    ctl->mb_type = MB_TYPE_ASCII;
+                }
+                else if (!strcasecmp(optarg, "rtu_tcp"))
+                {
+                    ctl->mb_type = MB_TYPE_RTU_TCP;
+                }
                 else
                 {
                     printf("invalid modbus protocol type %s\n", optarg);
@@ -190,6 +214,10 @@ static int arg_parse(int argc, char *argv[ ], SPMB_CTL_T *ctl)
                 ctl->tcp_ctrl.unitid = ctl->rtu_ctrl.slaver_addr = strtol(optarg, NULL, 0);
                 break;
 
+            case SPMB_OPT_TIMEOUT :
+                ctl->tcp_ctrl.timeout = strtol(optarg, NULL, 0);
+                break;
+
             case SPMB_OPT_IP :
                 snprintf(ctl->tcp_ctrl.ip, sizeof(ctl->tcp_ctrl.ip), "%s", optarg);
                 break;
@@ -202,6 +230,10 @@ static int arg_parse(int argc, char *argv[ ], SPMB_CTL_T *ctl)
                 snprintf(ctl->tcp_ctrl.ethdev, sizeof(ctl->tcp_ctrl.ethdev), "%s", optarg);
                 break;
 
+            case SPMB_OPT_PATH :
+                snprintf(ctl->tcp_ctrl.path, sizeof(ctl->tcp_ctrl.path), "%s", optarg);
+                break;
+
             case SPMB_OPT_HELP :
                 help();
                 exit(0);
@@ -230,6 +262,12 @@ static int arg_parse(int argc, char *argv[ ], SPMB_CTL_T *ctl)
                 ctl->rtu_ctrl.parity = strtol(optarg, NULL, 0);
                 break;
 
+            case SPMB_OPT_SNIFF :
+                ctl->mb_type         = MB_TYPE_RTU;
+                ctl->rtu_ctrl.listen = 1;
+                sniff_log            = optarg;
+                break;
+
             default :
                 printf("invalid param %s\n", argv[idx]);
                 help();
@@ -256,6 +294,8 @@ static int command_funccode_handle(UINT8_T code, MB_INFO_T *mb_info)
 
     int i   = 0;
     char command[32] = {0};
+    UINT64_T coils[MBCOIL_WORDS(MBCOIL_MAX_NUM)] = {0};
+    UINT16_T regs[MAX_MBVALUE_SIZE / 2] = {0};
 
     switch (code)
     {
@@ -280,7 +320,8 @@ static int command_funccode_handle(UINT8_T code, MB_INFO_T *mb_info)
 
             printf("Please input hexadecimal register value\n");
             fgets(command, sizeof(command), stdin);
-            *((UINT16_T *)(&mb_info->value[0])) = strtol(command, NULL, 0);
+            regs[0] = strtol(command, NULL, 0);
+            mb_reg_encode(mb_info->value, regs, 1);
             break;
             
         case MB_FUNC_0f : 
@@ -292,12 +333,19 @@ static int command_funccode_handle(UINT8_T code, MB_INFO_T *mb_info)
             fgets(command, sizeof(command), stdin);
             mb_info->n_reg = strtol(command, NULL, 0);
 
+            if (MB_WRITE_COIL_MAX_NUM < mb_info->n_reg)
+            {
+                printf("At most %d coils\n", MB_WRITE_COIL_MAX_NUM);
+                return -1;
+            }
+
             for (i = 0; i < mb_info->n_reg; ++i)
             {
                 printf("Please input %dth coil value\n", i + 1);
                 fgets(command, sizeof(command), stdin);
-                mb_info->value[i] = strtol(command, NULL, 0);
+                MBCOIL_SET(coils, i, strtol(command, NULL, 0));
             }
+            mb_info_coil_set(mb_info, coils, mb_info->n_reg);
             break;
             
         case MB_FUNC_10 : 
@@ -309,12 +357,19 @@ static int command_funccode_handle(UINT8_T code, MB_INFO_T *mb_info)
             fgets(command, sizeof(command), stdin);
             mb_info->n_reg = strtol(command, NULL, 0);
 
+            if (MB_WRITE_REG_MAX_NUM < mb_info->n_reg)
+            {
+                printf("At most %d registers\n", MB_WRITE_REG_MAX_NUM);
+                return -1;
+            }
+
             for (i = 0; i < mb_info->n_reg; ++i)
             {
                 printf("Please input %dth hexadecimal register value\n", i + 1);
                 fgets(command, sizeof(command), stdin);
-                *((UINT16_T *)(&mb_info->value[i * 2])) = strtol(command, NULL, 0);
+                regs[i] = strtol(command, NULL, 0);
             }
+            mb_info_reg_set(mb_info, regs, mb_info->n_reg);
             break;
     }
 
@@ -759,10 +814,10 @@ static int work(SPMB_CTX_T *mb_ctx)
             }
 
             /* Show response status */
-            sp_mb_status_show(mb_info);
+            sp_mb_status_show(&mb_info);
 
             /* Show response data */
-            sp_mb_data_show(mb_info);
+            sp_mb_data_show(&mb_info);
         } while (0);
 
         ULOCK(&resource.lock);
@@ -771,6 +826,45 @@ static int work(SPMB_CTX_T *mb_ctx)
     return 0;
 }
 
+/*
+ * Function : log the frames of a ModBus RTU line until SIGINT, nothing is transmitted
+ * mb_ctx   : ModBus RTU context opened with rtu_ctrl.listen
+ * return   : 0=SUCCESS -1=ERROR
+ */
+static int sniff_work(SPMB_CTX_T *mb_ctx)
+{
+    PTR_CHECK_N1(mb_ctx);
+
+    MBSNIFF_CTX_T *mbsniff_ctx = NULL;
+    MBSNIFF_STAT_T stat;
+    int ret = 0;
+
+    mbsniff_ctx = mb_rtu_sniff_create(mb_ctx->ctx.mb_rtu_ctx, sniff_log);
+    if (!mbsniff_ctx)
+    {
+        printf("Can not create modbus sniffer\n");
+        return -1;
+    }
+
+    printf("Sniffing ModBus RTU frames into %s, Ctrl+C to stop\n", sniff_log);
+
+    while (resource.running && 0 <= ret)
+    {
+        ret = mb_rtu_sniff_run(mbsniff_ctx, 1000);
+    }
+
+    mb_rtu_sniff_stat(mbsniff_ctx, &stat);
+    mb_rtu_sniff_destory(mbsniff_ctx);
+
+    printf("bytes %llu request %llu response %llu broadcast %llu timeout %llu crc error %llu overrun %llu\n",
+        (unsigned long long)stat.bytes, (unsigned long long)stat.request, 
+        (unsigned long long)stat.response, (unsigned long long)stat.broadcast, 
+        (unsigned long long)stat.timeout, (unsigned long long)stat.crc_err, 
+        (unsigned long long)stat.overrun);
+
+    return (0 > ret) ? -1 : 0;
+}
+
 static void *stay_connected_routine(void *arg)
 {
     MB_INFO_T mb_info = {
@@ -815,8 +909,7 @@ static void *stay_connected_routine(void *arg)
 
 static int io_rely_handle(MASK_RULE_CONTENT_T *content, void *)
 {
-    int i = 0;
-    int j = 0;
+    UINT64_T coils = 0;
 
     MB_INFO_T get_mb_info = {
         .code  = MB_FUNC_01,
@@ -844,22 +937,10 @@ static int io_rely_handle(MASK_RULE_CONTENT_T *content, void *)
         return -1;
     }
 
-    for (i = 0; i < get_mb_info.n_byte; ++i)
-    {
-        for (j = 0; j < 8; ++j)
-        {
-            set_mb_info.value[(i * 8) + j] = (!!(get_mb_info.value[i] & (1 << j))) |
-                 (!!(content->omask.up & (1 << ((8 * i) + j))));
-        }
-    }
-
-    for (i = 0; i < get_mb_info.n_byte; ++i)
-    {
-        for (j = 0; j < 8; ++j)
-        {
-            set_mb_info.value[(i * 8) + j] &= (!!((~content->omask.down) & (1 << ((8 * i) + j))));
-        }
-    }
+    /* the masks cover 64 coils, one bitmap word */
+    mb_info_coil_get(&get_mb_info, &coils);
+    coils = (coils | content->omask.up) & ~content->omask.down;
+    mb_info_coil_set(&set_mb_info, &coils, set_mb_info.n_reg);
 
     /* send a modbsu request */
     if (0 > sp_mb_send(mb_ctx, &set_mb_info))
@@ -884,7 +965,6 @@ static void *io_rely_routine(void *arg)
 
     SPMB_CTX_T *mb_ctx = (SPMB_CTX_T *)arg;
 
-    int i = 0;
     UINT64_T imask = 0;
 
     MB_INFO_T mb_info = {
@@ -921,11 +1001,7 @@ static void *io_rely_routine(void *arg)
             }
 
             imask = 0;
-
-            for (i = 0; i < mb_info.n_byte; ++i)
-            {
-                imask |= mb_info.value[i] << (i * 8);
-            }
+            mb_info_coil_get(&mb_info, &imask);
 
             mask_rule_macth(ruleset, imask, io_rely_handle, NULL);
         } while (0);
@@ -987,6 +1063,13 @@ int main(int argc, char *argv[ ])
         return -1;
     }
 
+    if (sniff_log)
+    {
+        sniff_work(mb_ctx);
+        sp_mb_close(mb_ctx);
+        return 0;
+    }
+
     ruleset = mask_rule_init(MAX_MASK_RULE_NUM);
     if (!ruleset)
     {
@@ -0,0 +1,518 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus RTU slaver on a pseudo terminal, mb_rtu_init() opens the other end
+ *            2. Pace the responses at line speed and inject delays between their bytes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <pty.h>
+#include <time.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <asm/ioctls.h>
+
+#include "mb_slave.h"
+#include "mb_rtu.h"
+
+#define SIM_REG_NUM   0x10000
+#define SIM_SERIAL_LEN 64
+
+/* rate and frame bits the master set on the pty, c_cflag alone has no room for 250000 */
+struct termios2
+{
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t     c_line;
+    cc_t     c_cc[19];
+    speed_t  c_ispeed;
+    speed_t  c_ospeed;
+};
+
+typedef struct
+{
+    char       *link;           /* symlink to the slave side, NULL=NONE */
+    UINT8_T     slaver_addr;    /* 0=answer every address */
+    UINT32_T    baudrate;       /* 0=the rate the master set on the pty */
+    UINT8_T     pace;           /* the bytes take as long as on a real line */
+    UINT32_T    byte_delay;     /* us added between response bytes */
+    UINT32_T    resp_delay;     /* us before a response */
+    MBSLV_CTL_T slv_ctl;
+} SIM_CTL_T;
+
+typedef struct
+{
+    UINT64_T request;
+    UINT64_T response;
+    UINT64_T broadcast;
+    UINT64_T crc_err;
+    UINT64_T other;             /* frames for other slavers */
+} SIM_STAT_T;
+
+enum
+{
+    SIM_OPT_SLAVER = 1001,
+    SIM_OPT_BAUDRATE,
+    SIM_OPT_PACE,
+    SIM_OPT_BYTE_DELAY,
+    SIM_OPT_RESP_DELAY,
+    SIM_OPT_LINK,
+    SIM_OPT_COIL,
+    SIM_OPT_DISCRETE,
+    SIM_OPT_HOLDING,
+    SIM_OPT_INPUT,
+    SIM_OPT_HELP
+};
+
+static struct option long_options[] = {
+    { "slaver",     1, 0, SIM_OPT_SLAVER     },
+    { "baudrate",   1, 0, SIM_OPT_BAUDRATE   },
+    { "pace",       0, 0, SIM_OPT_PACE       },
+    { "byte_delay", 1, 0, SIM_OPT_BYTE_DELAY },
+    { "resp_delay", 1, 0, SIM_OPT_RESP_DELAY },
+    { "link",       1, 0, SIM_OPT_LINK       },
+    { "coil",       1, 0, SIM_OPT_COIL       },
+    { "discrete",   1, 0, SIM_OPT_DISCRETE   },
+    { "holding",    1, 0, SIM_OPT_HOLDING    },
+    { "input",      1, 0, SIM_OPT_INPUT      },
+    { "help",       0, 0, SIM_OPT_HELP       },
+    { 0,            0, 0, 0                  }
+};
+
+static volatile int running = 1;
+
+static void signal_handle(int arg)
+{
+    running = 0;
+}
+
+static void help(void)
+{
+    printf( "\nOPTIONS :\n"
+            "   --slaver,          Slaver address to answer, 0=every address [0]\n"
+            "   --baudrate,        Line rate of pacing, 0=the rate the master set [0]\n"
+            "   --pace,            Requests and responses take as long as on the line\n"
+            "   --byte_delay,      Extra silence between response bytes(us) [0]\n"
+            "   --resp_delay,      Silence before a response(us) [0]\n"
+            "   --link,            Symlink to the serial for --serial of the master\n"
+            "   --coil,            Coil number [%d]\n"
+            "   --discrete,        Discrete input number [%d]\n"
+            "   --holding,         Holding register number, register N holds N [%d]\n"
+            "   --input,           Input register number, register N holds N [%d]\n"
+            "   --help,            Show ModBus RTU simulator options\n\n",
+            SIM_REG_NUM, SIM_REG_NUM, SIM_REG_NUM, SIM_REG_NUM);
+}
+
+/*
+ * Function  : length of a request frame from its first bytes
+ * buf       : received bytes
+ * len       : received length
+ * return    : frame length, 0=NEED MORE BYTES -1=UNKNOWN(ends with t3.5)
+ */
+static int sim_request_len(UINT8_T *buf, int len)
+{
+    int pdu = 0;
+
+    if (2 > len)
+    {
+        return 0;
+    }
+
+    /* address + PDU + CRC */
+    pdu = mb_request_pdu_len(buf + 1, len - 1);
+
+    return (0 < pdu) ? (pdu + 3) : pdu;
+}
+
+/*
+ * Function  : one character on the line, from the rate and frame bits the master set
+ *             or --baudrate
+ * fd        : master side of the pty
+ * t35       : filled with the silence ending a frame(us)
+ * return    : character time(us)
+ */
+static UINT32_T sim_char_time(int fd, SIM_CTL_T *ctl, UINT32_T *t35)
+{
+    struct termios2 option;
+    UINT32_T baudrate = ctl->baudrate;
+    UINT32_T bits     = 10;
+
+    if (0 == ioctl(fd, TCGETS2, &option))
+    {
+        bits  = 1 + ((CS5 == (option.c_cflag & CSIZE)) ? 5 :
+                     (CS6 == (option.c_cflag & CSIZE)) ? 6 :
+                     (CS7 == (option.c_cflag & CSIZE)) ? 7 : 8);
+        bits += (option.c_cflag & PARENB) ? 1 : 0;
+        bits += (option.c_cflag & CSTOPB) ? 2 : 1;
+
+        if (!baudrate)
+        {
+            baudrate = option.c_ospeed;
+        }
+    }
+
+    baudrate = baudrate ? baudrate : 9600;
+    *t35 = ALIGNED(ALIGNED(bits * 1000000, baudrate) * 7, 2);
+
+    return ALIGNED(bits * 1000000, baudrate);
+}
+
+/*
+ * Function  : sleep until a monotonic time
+ * return    : void
+ */
+static void sim_sleep_until(UINT64_T until)
+{
+    struct timespec ts = {
+        .tv_sec  = until / 1000000,
+        .tv_nsec = (until % 1000000) * 1000
+    };
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) && running);
+}
+
+/*
+ * Function  : write a response, byte by byte when paced or delayed
+ * begin     : time the response may start
+ * char_time : one character(us)
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int sim_response_send(int fd, SIM_CTL_T *ctl, MB_DATA_T *mb_data, UINT64_T begin, UINT32_T char_time)
+{
+    UINT32_T gap = (ctl->pace ? char_time : 0) + ctl->byte_delay;
+    int i = 0;
+    int n = 0;
+
+    sim_sleep_until(begin);
+
+    if (!gap)
+    {
+        return (mb_data->data_len == write(fd, mb_data->data, mb_data->data_len)) ? 0 : -1;
+    }
+
+    /* bytes are written once the line would have carried them, all of them due at a late wake up */
+    while (i < mb_data->data_len)
+    {
+        sim_sleep_until(begin + (UINT64_T)(i + 1) * gap);
+
+        n = (mb_time_us() - begin) / gap;
+        n = (n <= i) ? (i + 1) : ((n > mb_data->data_len) ? mb_data->data_len : n);
+
+        if (n - i != write(fd, mb_data->data + i, n - i))
+        {
+            return -1;
+        }
+        i = n;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : serve one request frame
+ * buf       : request frame
+ * len       : request length
+ * first     : time its first byte came in
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int sim_request_serve(int fd, SIM_CTL_T *ctl, SIM_STAT_T *stat, MBSLV_STORE_T *store,
+    MB_DATA_T *mb_data, UINT8_T *buf, int len, UINT64_T first)
+{
+    UINT32_T t35       = 0;
+    UINT32_T char_time = sim_char_time(fd, ctl, &t35);
+    UINT64_T begin     = mb_time_us();
+    UINT16_T crc       = 0;
+
+    stat->request++;
+
+    if (4 > len || mb_crc16(buf, len - 2) != (buf[len - 2] | (buf[len - 1] << 8)))
+    {
+        stat->crc_err++;
+        return 0;
+    }
+
+    if (ctl->slaver_addr && MBRTU_BROADCAST != buf[0] && ctl->slaver_addr != buf[0])
+    {
+        stat->other++;
+        return 0;
+    }
+
+    /* address + request PDU */
+    memcpy(mb_data->data, buf, len - 2);
+    mb_data->data_len = len - 2;
+    mb_data->offset   = 1;
+
+    if (0 == mb_slave_handle(store, mb_data) && MBRTU_BROADCAST == buf[0])
+    {
+        stat->broadcast++;
+        return 0;
+    }
+
+    crc = mb_crc16(mb_data->data, mb_data->data_len);
+    mb_data->data[mb_data->data_len++] = (UINT8_T)crc;
+    mb_data->data[mb_data->data_len++] = (UINT8_T)(crc >> 8);
+
+    /* the request is still on the line */
+    if (ctl->pace)
+    {
+        begin = first + (UINT64_T)len * char_time;
+    }
+
+    stat->response++;
+
+    return sim_response_send(fd, ctl, mb_data, begin + ctl->resp_delay, char_time);
+}
+
+/*
+ * Function  : split the byte stream into requests and serve them until SIGINT/SIGTERM
+ * fd        : master side of the pty
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int sim_run(int fd, SIM_CTL_T *ctl, SIM_STAT_T *stat, MBSLV_STORE_T *store)
+{
+    MB_DATA_T *mb_data = mb_data_create(MBRTU_FRAME_SIZE);
+    UINT8_T    buf[MBRTU_FRAME_SIZE];
+    UINT64_T   first  = 0;
+    UINT32_T   t35    = 0;
+    struct timeval tv;
+    fd_set     rset;
+    int        len    = 0;
+    int        length = 0;
+    int        expect = 0;
+    int        ret    = 0;
+
+    PTR_CHECK_N1(mb_data);
+
+    while (running)
+    {
+        /* a frame ends with its predicted length, otherwise with t3.5 of silence */
+        sim_char_time(fd, ctl, &t35);
+        tv.tv_sec  = len ? 0 : 1;
+        tv.tv_usec = len ? t35 : 0;
+
+        FD_ZERO(&rset);
+        FD_SET(fd, &rset);
+
+        length = select(fd + 1, &rset, NULL, NULL, &tv);
+        if (0 > length)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            perror("select error");
+            ret = -1;
+            break;
+        }
+
+        if (length)
+        {
+            length = read(fd, buf + len, sizeof(buf) - len);
+            if (0 > length)
+            {
+                /* nobody has the slave side open */
+                if (EIO == errno || EAGAIN == errno)
+                {
+                    usleep(t35);
+                    continue;
+                }
+
+                perror("read error");
+                ret = -1;
+                break;
+            }
+
+            if (!len)
+            {
+                first = mb_time_us();
+            }
+            len += length;
+        }
+        else if (len)
+        {
+            /* silence, the frame is whatever came in */
+            expect = len;
+        }
+
+        while (len)
+        {
+            if (length)
+            {
+                expect = sim_request_len(buf, len);
+            }
+
+            if (0 >= expect || expect > len)
+            {
+                /* a frame longer than the cache is garbage */
+                len = (sizeof(buf) == len) ? 0 : len;
+                break;
+            }
+
+            if (0 > sim_request_serve(fd, ctl, stat, store, mb_data, buf, expect, first))
+            {
+                perror("write error");
+            }
+
+            len -= expect;
+            memmove(buf, buf + expect, len);
+            first  = mb_time_us();
+            expect = 0;
+        }
+    }
+
+    mb_data_destory(mb_data);
+
+    return ret;
+}
+
+int main(int argc, char *argv[ ])
+{
+    SIM_CTL_T ctl = {
+        .slv_ctl = {
+            .n_coil     = SIM_REG_NUM,
+            .n_discrete = SIM_REG_NUM,
+            .n_holding  = SIM_REG_NUM,
+            .n_input    = SIM_REG_NUM,
+        },
+    };
+    SIM_STAT_T     stat;
+    MBSLV_STORE_T *store = NULL;
+    struct termios option;
+    char serial[SIM_SERIAL_LEN] = {0};
+    int  master = -1;
+    int  slave  = -1;
+    int  opt    = 0;
+    int  idx    = 0;
+    int  ret    = 0;
+    UINT32_T i  = 0;
+
+    while (-1 != (opt = getopt_long(argc, argv, "", long_options, &idx)))
+    {
+        switch (opt)
+        {
+            case SIM_OPT_SLAVER :
+                ctl.slaver_addr = strtol(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_BAUDRATE :
+                ctl.baudrate = strtoul(optarg, NULL, 10);
+                break;
+
+            case SIM_OPT_PACE :
+                ctl.pace = 1;
+                break;
+
+            case SIM_OPT_BYTE_DELAY :
+                ctl.byte_delay = strtoul(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_RESP_DELAY :
+                ctl.resp_delay = strtoul(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_LINK :
+                ctl.link = optarg;
+                break;
+
+            case SIM_OPT_COIL :
+                ctl.slv_ctl.n_coil = strtoul(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_DISCRETE :
+                ctl.slv_ctl.n_discrete = strtoul(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_HOLDING :
+                ctl.slv_ctl.n_holding = strtoul(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_INPUT :
+                ctl.slv_ctl.n_input = strtoul(optarg, NULL, 0);
+                break;
+
+            case SIM_OPT_HELP :
+                help();
+                return 0;
+
+            default :
+                help();
+                return 2;
+        }
+    }
+
+    memset(&stat, 0, sizeof(stat));
+
+    store = mb_slave_store_create(&ctl.slv_ctl);
+    if (!store)
+    {
+        return 1;
+    }
+
+    for (i = 0; i < store->n_holding; ++i)
+    {
+        store->holding[i] = i;
+    }
+
+    for (i = 0; i < store->n_input; ++i)
+    {
+        store->input[i] = i;
+    }
+
+    /* the slave side stays open here too, the master closing it is no hangup */
+    if (0 > openpty(&master, &slave, serial, NULL, NULL))
+    {
+        perror("openpty error");
+        mb_slave_store_destory(store);
+        return 1;
+    }
+
+    tcgetattr(slave, &option);
+    cfmakeraw(&option);
+    tcsetattr(slave, TCSANOW, &option);
+
+    if (ctl.link)
+    {
+        unlink(ctl.link);
+        if (0 > symlink(serial, ctl.link))
+        {
+            perror("symlink error");
+            ret = 1;
+            goto out;
+        }
+    }
+
+    signal(SIGINT, signal_handle);
+    signal(SIGTERM, signal_handle);
+
+    printf("mb_rtu_sim : slaver %u on %s\n", ctl.slaver_addr, ctl.link ? ctl.link : serial);
+    fflush(stdout);
+
+    if (0 > sim_run(master, &ctl, &stat, store))
+    {
+        ret = 1;
+    }
+
+    printf("mb_rtu_sim : %llu requests  %llu responses  %llu broadcasts  %llu crc errors  %llu other slavers\n",
+           stat.request, stat.response, stat.broadcast, stat.crc_err, stat.other);
+
+    if (ctl.link)
+    {
+        unlink(ctl.link);
+    }
+
+out :
+    close(slave);
+    close(master);
+    mb_slave_store_destory(store);
+
+    return ret;
+}
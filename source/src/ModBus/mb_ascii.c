@@ -0,0 +1,540 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus ASCII on a serial line, ':' + hex(address, PDU, LRC) + CRLF
+ *            2. Table driven hex codec of whole frames
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/select.h>
+
+#include "mb_ascii.h"
+
+/* hex characters of every byte value, two a byte */
+#define MBASCII_HEX_ROW(h) \
+    h "0" h "1" h "2" h "3" h "4" h "5" h "6" h "7" h "8" h "9" h "A" h "B" h "C" h "D" h "E" h "F"
+
+static const char mbascii_hex[] = 
+    MBASCII_HEX_ROW("0") MBASCII_HEX_ROW("1") MBASCII_HEX_ROW("2") MBASCII_HEX_ROW("3")
+    MBASCII_HEX_ROW("4") MBASCII_HEX_ROW("5") MBASCII_HEX_ROW("6") MBASCII_HEX_ROW("7")
+    MBASCII_HEX_ROW("8") MBASCII_HEX_ROW("9") MBASCII_HEX_ROW("A") MBASCII_HEX_ROW("B")
+    MBASCII_HEX_ROW("C") MBASCII_HEX_ROW("D") MBASCII_HEX_ROW("E") MBASCII_HEX_ROW("F");
+
+/* nibble of every character | 0x10, 0=NOT A HEX DIGIT */
+static const UINT8_T mbascii_nibble[256] = {
+    ['0'] = 0x10, ['1'] = 0x11, ['2'] = 0x12, ['3'] = 0x13, ['4'] = 0x14,
+    ['5'] = 0x15, ['6'] = 0x16, ['7'] = 0x17, ['8'] = 0x18, ['9'] = 0x19,
+    ['A'] = 0x1a, ['B'] = 0x1b, ['C'] = 0x1c, ['D'] = 0x1d, ['E'] = 0x1e, ['F'] = 0x1f,
+    ['a'] = 0x1a, ['b'] = 0x1b, ['c'] = 0x1c, ['d'] = 0x1d, ['e'] = 0x1e, ['f'] = 0x1f,
+};
+
+UINT8_T mb_ascii_lrc(const UINT8_T *data, int len)
+{
+    UINT8_T sum = 0;
+    int i = 0;
+
+    for (i = 0; i < len; ++i)
+    {
+        sum += data[i];
+    }
+
+    return (UINT8_T)(-sum);
+}
+
+int mb_ascii_hex_encode(UINT8_T *dst, const UINT8_T *src, int len)
+{
+    int i = 0;
+
+    for (i = 0; i < len; ++i)
+    {
+        memcpy(dst + (i * 2), mbascii_hex + (src[i] * 2), 2);
+    }
+
+    return len * 2;
+}
+
+int mb_ascii_hex_decode(UINT8_T *dst, const UINT8_T *src, int len)
+{
+    UINT8_T valid = 0x10;
+    UINT8_T high  = 0;
+    UINT8_T low   = 0;
+    int i = 0;
+
+    if (len & 1)
+    {
+        return -1;
+    }
+
+    /* one check for the whole frame, dst may be src */
+    for (i = 0; i < len / 2; ++i)
+    {
+        high   = mbascii_nibble[src[i * 2]];
+        low    = mbascii_nibble[src[(i * 2) + 1]];
+        valid &= high & low;
+        dst[i] = (UINT8_T)((high << 4) | (low & 0x0f));
+    }
+
+    return valid ? (len / 2) : -1;
+}
+
+static int mbascii_slaveaddr_decap_check(MBASCII_DATA_T *mb_ascii_data)
+{
+    PTR_CHECK_N1(mb_ascii_data);
+
+    MB_DATA_T      *mb_data       = mb_ascii_data->mb_data;
+    MBASCII_INFO_T *rx_ascii_info = &mb_ascii_data->ascii_info[MB_RX];
+    MBASCII_INFO_T *tx_ascii_info = &mb_ascii_data->ascii_info[MB_TX];
+
+    MBDATA_BYTE_GET(mb_data, rx_ascii_info->slaver_addr);
+
+    if (rx_ascii_info->slaver_addr != tx_ascii_info->slaver_addr)
+    {
+        printf("Invalid slaver address(0x%02x)\n", rx_ascii_info->slaver_addr);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int mbascii_lrc_decap_check(MBASCII_DATA_T *mb_ascii_data)
+{
+    PTR_CHECK_N1(mb_ascii_data);
+
+    MB_DATA_T *mb_data = mb_ascii_data->mb_data;
+    UINT8_T    lrc     = 0;
+
+    mb_data->data_len -= 1;
+    mb_ascii_data->ascii_info[MB_RX].lrc = mb_data->data[mb_data->data_len];
+
+    lrc = mb_ascii_lrc(mb_data->data, mb_data->data_len);
+    if (lrc != mb_ascii_data->ascii_info[MB_RX].lrc)
+    {
+        printf("Invalid LRC checksum(0x%02x), should be 0x%02x\n", mb_ascii_data->ascii_info[MB_RX].lrc, lrc);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : recv one frame, characters before ':' are dropped, a ':' inside the frame
+ *             starts it again, CRLF ends it
+ * mb_ascii_desc : ModBus ASCII descriptor
+ * return    : characters between ':' and CRLF=SUCCESS -1=ERROR
+ */
+static int com_ascii_recv(MBASCII_DESC_T *mb_ascii_desc)
+{
+    PTR_CHECK_N1(mb_ascii_desc);
+
+    UINT8_T  chunk[MBASCII_FRAME_SIZE];
+    UINT8_T  c       = 0;
+    int      comfd   = mb_ascii_desc->com_fd;
+    int      started = 0;
+    int      length  = 0;
+    int      ready   = 0;
+    int      i       = 0;
+    UINT32_T wait    = MBRTU_RESP_TIMEOUT * 1000;
+
+    fd_set readset;
+    struct timeval tv;
+
+    mb_ascii_desc->rx_len = 0;
+
+    while (1)
+    {
+        length = read(comfd, chunk, sizeof(chunk));
+        if (0 < length)
+        {
+            for (i = 0; i < length; ++i)
+            {
+                c = chunk[i];
+
+                if (MBASCII_START == c)
+                {
+                    started = 1;
+                    mb_ascii_desc->rx_len = 0;
+                }
+                else if (!started)
+                {
+                    continue;
+                }
+                else if ('\n' == c && mb_ascii_desc->rx_len && '\r' == mb_ascii_desc->rx_buf[mb_ascii_desc->rx_len - 1])
+                {
+                    return --mb_ascii_desc->rx_len;
+                }
+                else if (mb_ascii_desc->rx_len < sizeof(mb_ascii_desc->rx_buf))
+                {
+                    mb_ascii_desc->rx_buf[mb_ascii_desc->rx_len++] = c;
+                }
+                else
+                {
+                    /* no end of frame, wait for the next ':' */
+                    started = 0;
+                }
+            }
+
+            if (started)
+            {
+                wait = MBASCII_CHAR_TIMEOUT * 1000;
+            }
+            continue;
+        }
+
+        if (0 > length && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+        {
+            perror("read error");
+            return -1;
+        }
+
+        tv.tv_sec  = wait / 1000000;
+        tv.tv_usec = wait % 1000000;
+
+        FD_ZERO(&readset);
+        FD_SET(comfd, &readset);
+
+        ready = select(comfd + 1, &readset, NULL, NULL, &tv);
+        if (0 > ready)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            perror("select error");
+            return -1;
+        }
+        else if (0 == ready)
+        {
+            printf("select timeout\n");
+            return -1;
+        }
+    }
+}
+
+static int com_ascii_send(MBASCII_DESC_T *mb_ascii_desc, const UINT8_T *frame, int len)
+{
+    PTR_CHECK_N1(mb_ascii_desc);
+    PTR_CHECK_N1(frame);
+
+    int length = 0;
+    int comfd  = mb_ascii_desc->com_fd;
+
+    length = mb_rtu_com_write(comfd, frame, len);
+    if (0 > length)
+    {
+        /* clear file cache */
+        tcflush(comfd, TCIOFLUSH);
+        return -1;
+    }
+
+    /* nobody answers a broadcast, the slavers act on it meanwhile */
+    if (mb_ascii_desc->broadcast)
+    {
+        tcdrain(comfd);
+        usleep(mb_ascii_desc->turnaround);
+    }
+
+    return length;
+}
+
+MBASCII_CTX_T *mb_ascii_init(MBRTU_CTL_T *rtu_ctl)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(rtu_ctl);
+
+    MBASCII_CTX_T *mbascii_ctx = NULL;
+
+    /* Create a ModBus ASCII context */
+    mbascii_ctx = (MBASCII_CTX_T *)malloc(sizeof(MBASCII_CTX_T));
+    if (!mbascii_ctx)
+    {
+        printf("Can not Create a ModBus ASCII context\n");
+        return NULL;
+    }
+    memset(mbascii_ctx, 0, sizeof(*mbascii_ctx));
+
+    mbascii_ctx->mb_ascii_data.ascii_info[MB_TX].slaver_addr = rtu_ctl->slaver_addr;
+
+    /* Create a ModBus ASCII data, it holds the frame decoded from hex */
+    mbascii_ctx->mb_ascii_data.mb_data = mb_data_create(rtu_ctl->max_data_size);
+    if (!mbascii_ctx->mb_ascii_data.mb_data)
+    {
+        printf("Can not Create a ModBus ASCII data\n");
+        free(mbascii_ctx);
+        return NULL;
+    }
+
+    mbascii_ctx->mb_ascii_desc.com_fd = mb_rtu_com_open(rtu_ctl);
+    if (0 > mbascii_ctx->mb_ascii_desc.com_fd)
+    {
+        mb_data_destory(mbascii_ctx->mb_ascii_data.mb_data);
+        free(mbascii_ctx);
+        return NULL;
+    }
+
+    mbascii_ctx->mb_ascii_desc.turnaround = rtu_ctl->turnaround ? rtu_ctl->turnaround : MBRTU_TURNAROUND;
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbascii_ctx;
+}
+
+void mb_ascii_close(MBASCII_CTX_T *mbascii_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mbascii_ctx);
+
+    close(mbascii_ctx->mb_ascii_desc.com_fd);
+
+    mb_data_destory(mbascii_ctx->mb_ascii_data.mb_data);
+
+    free(mbascii_ctx);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+/*
+ * Function  : encap slaver address + PDU + LRC of the request in mb_info into the cache,
+ *             then the whole frame to hex at once
+ * mb_ascii_data : ModBus ASCII data, the cache is cleared first
+ * frame     : hex frame, MBASCII_FRAME_SIZE bytes
+ * return    : frame length=SUCCESS -1=ERROR
+ */
+static int mbascii_frame_encap(MBASCII_DATA_T *mb_ascii_data, UINT8_T *frame)
+{
+    MB_DATA_T *mb_data = mb_ascii_data->mb_data;
+    UINT8_T lrc = 0;
+    int     len = 0;
+
+    /* clear data cache */
+    mb_data_clear(mb_data);
+
+    /* encap slaver address */
+    MBDATA_BYTE_SET(mb_data, mb_ascii_data->ascii_info[MB_TX].slaver_addr);
+
+    /* encap PDU */
+    mb_data_encap(mb_data);
+
+    /* encap LRC */
+    lrc = mb_ascii_lrc(mb_data->data, mb_data->data_len);
+    MBDATA_BYTE_SET(mb_data, lrc);
+    mb_ascii_data->ascii_info[MB_TX].lrc = lrc;
+
+    if (MBRTU_FRAME_SIZE < mb_data->data_len)
+    {
+        printf("ModBus ASCII frame too long(%d)\n", mb_data->data_len);
+        return -1;
+    }
+
+#ifdef MB_DEBUG
+    MB_PRINT("SEND\n");
+    mb_cache_show(mb_data);
+#endif
+
+    /* the whole frame to hex at once */
+    frame[len++] = MBASCII_START;
+    len += mb_ascii_hex_encode(frame + len, mb_data->data, mb_data->data_len);
+    frame[len++] = '\r';
+    frame[len++] = '\n';
+
+    return len;
+}
+
+int mb_ascii_send(MBASCII_CTX_T *mbascii_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_N1(mbascii_ctx);
+
+    MBASCII_DESC_T *desc          = &mbascii_ctx->mb_ascii_desc;
+    MBASCII_DATA_T *mb_ascii_data = &mbascii_ctx->mb_ascii_data;
+    int len = 0;
+
+    desc->broadcast = (MBRTU_BROADCAST == mb_ascii_data->ascii_info[MB_TX].slaver_addr);
+    if (desc->broadcast && 0 > mb_rtu_broadcast_check(&mb_ascii_data->mb_data->mb_info))
+    {
+        return -1;
+    }
+
+    len = mbascii_frame_encap(mb_ascii_data, desc->tx_buf);
+    if (0 > len)
+    {
+        return -1;
+    }
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return com_ascii_send(desc, desc->tx_buf, len);
+}
+
+int mb_ascii_prepare(MBASCII_CTX_T *mbascii_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep)
+{
+    PTR_CHECK_N1(mbascii_ctx);
+    PTR_CHECK_N1(mb_info);
+    PTR_CHECK_N1(prep);
+
+    MBASCII_DATA_T ascii_data = mbascii_ctx->mb_ascii_data;
+    UINT8_T  scratch[MB_DATA_BUF_SIZE(MBRTU_FRAME_SIZE)];
+    UINT8_T  frame[MBASCII_FRAME_SIZE];
+    UINT16_T size = 0;
+    int      len  = 0;
+
+    if (MBRTU_BROADCAST == ascii_data.ascii_info[MB_TX].slaver_addr && 0 > mb_rtu_broadcast_check(mb_info))
+    {
+        return -1;
+    }
+
+    /* binary frame in a scratch cache on the stack, hex into frame */
+    size = (ascii_data.mb_data->max_data_len < MBRTU_FRAME_SIZE) ? ascii_data.mb_data->max_data_len : MBRTU_FRAME_SIZE;
+    ascii_data.mb_data = mb_data_init(scratch, size);
+
+    mb_info_copy(&ascii_data.mb_data->mb_info, mb_info);
+
+    len = mbascii_frame_encap(&ascii_data, frame);
+    if (0 > len)
+    {
+        return -1;
+    }
+
+    prep->slaver_addr = ascii_data.ascii_info[MB_TX].slaver_addr;
+    prep->check       = ascii_data.ascii_info[MB_TX].lrc;
+
+    return mb_prep_save(prep, mbascii_ctx, mb_info, frame, len);
+}
+
+int mb_ascii_send_prepared(MBASCII_CTX_T *mbascii_ctx, const MB_PREP_T *prep)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_N1(mbascii_ctx);
+
+    MBASCII_DESC_T *desc          = &mbascii_ctx->mb_ascii_desc;
+    MBASCII_DATA_T *mb_ascii_data = &mbascii_ctx->mb_ascii_data;
+
+    /* the response is checked against the request header */
+    if (0 > mb_prep_load(prep, mbascii_ctx, mb_ascii_data->mb_data))
+    {
+        return -1;
+    }
+
+    mb_ascii_data->ascii_info[MB_TX].slaver_addr = prep->slaver_addr;
+    mb_ascii_data->ascii_info[MB_TX].lrc         = prep->check;
+    desc->broadcast = (MBRTU_BROADCAST == prep->slaver_addr);
+
+    /* the hex frame goes out as it is, straight from the prepared bytes */
+    return com_ascii_send(desc, prep->frame, prep->len);
+}
+
+/*
+ * Function  : recv a response, decapped into mb_info or in place
+ * mbascii_ctx : ModBus ASCII context
+ * view      : the response, NULL=into mb_info
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+static int mbascii_recv(MBASCII_CTX_T *mbascii_ctx, MB_VIEW_T *view)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    MBASCII_DESC_T *desc          = &mbascii_ctx->mb_ascii_desc;
+    MBASCII_DATA_T *mb_ascii_data = &mbascii_ctx->mb_ascii_data;
+    MB_DATA_T      *mb_data       = mb_ascii_data->mb_data;
+    int length = 0;
+    int n_byte = 0;
+
+    /* nothing to wait for, mb_info still holds the request */
+    if (desc->broadcast)
+    {
+        return 0;
+    }
+
+    /* clear data cache */
+    mb_data_clear(mb_data);
+
+    length = com_ascii_recv(desc);
+    if (0 > length)
+    {
+        return -1;
+    }
+
+    /* address + code + LRC at least */
+    n_byte = (length / 2 <= mb_data->max_data_len) ? mb_ascii_hex_decode(mb_data->data, desc->rx_buf, length) : -1;
+    if (3 > n_byte)
+    {
+        printf("Invalid ModBus ASCII frame(%d characters)\n", length);
+        return -1;
+    }
+    mb_data->data_len = n_byte;
+
+#ifdef MB_DEBUG
+    MB_PRINT("RECV %d bytes\n", n_byte);
+    mb_cache_show(mb_data);
+#endif
+
+    /* decap LRC */
+    if (0 > mbascii_lrc_decap_check(mb_ascii_data))
+    {
+        return -1;
+    }
+
+    /* decap slaver address */
+    if (0 > mbascii_slaveaddr_decap_check(mb_ascii_data))
+    {
+        return -1;
+    }
+
+    /* decap PDU */
+    if (0 > mb_response_decap(mb_data, view))
+    {
+        printf("Invalid ModBus ASCII response PDU\n");
+        return -1;
+    }
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    /* ':' + hex + CRLF */
+    return length + 3;
+}
+
+int mb_ascii_recv(MBASCII_CTX_T *mbascii_ctx)
+{
+    PTR_CHECK_N1(mbascii_ctx);
+
+    return mbascii_recv(mbascii_ctx, NULL);
+}
+
+int mb_ascii_recv_view(MBASCII_CTX_T *mbascii_ctx, MB_VIEW_T *view)
+{
+    PTR_CHECK_N1(mbascii_ctx);
+    PTR_CHECK_N1(view);
+
+    return mbascii_recv(mbascii_ctx, view);
+}
+
+void mbasciictx_info_updata(MBASCII_CTX_T *mbascii_ctx, MB_INFO_T *mb_info)
+{
+    PTR_CHECK_VOID(mbascii_ctx);
+    PTR_CHECK_VOID(mb_info);
+    
+    mb_info_copy(&mbascii_ctx->mb_ascii_data.mb_data->mb_info, mb_info);
+}
+
+void mbasciictx_info_takeout(MBASCII_CTX_T *mbascii_ctx, MB_INFO_T *mb_info)
+{
+    PTR_CHECK_VOID(mbascii_ctx);
+    PTR_CHECK_VOID(mb_info);
+    
+    mb_info_copy(mb_info, &mbascii_ctx->mb_ascii_data.mb_data->mb_info);
+}
+
+void mbasciictx_slaver_set(MBASCII_CTX_T *mbascii_ctx, UINT8_T slaver_addr)
+{
+    PTR_CHECK_VOID(mbascii_ctx);
+
+    mbascii_ctx->mb_ascii_data.ascii_info[MB_TX].slaver_addr = slaver_addr;
+}
@@ -0,0 +1,139 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus ASCII on a serial line, ':' + hex(address, PDU, LRC) + CRLF
+ *            2. Table driven hex codec of whole frames
+ */
+
+#ifndef MB_ASCII
+#define MB_ASCII
+
+#include "mb_rtu.h"
+
+#define MBASCII_START        ':'
+#define MBASCII_FRAME_SIZE   (1 + (MBRTU_FRAME_SIZE * 2) + 2)   /* ':' + hex + CRLF */
+#define MBASCII_CHAR_TIMEOUT 1000   /* ms, max silence inside a frame */
+
+typedef struct
+{
+    int      com_fd;
+    UINT32_T turnaround;        /* silence after a broadcast(us) */
+    UINT8_T  broadcast;         /* the last request was a broadcast, no response to it */
+    UINT16_T rx_len;            /* characters of the frame in progress, ':' excluded */
+    UINT8_T  rx_buf[MBASCII_FRAME_SIZE];
+    UINT8_T  tx_buf[MBASCII_FRAME_SIZE];
+} MBASCII_DESC_T;
+
+typedef struct 
+{
+    UINT16_T slaver_addr;
+    UINT8_T  lrc;
+} __attribute__((packed)) MBASCII_INFO_T;
+
+typedef struct
+{
+    MBASCII_INFO_T ascii_info[MB_DIRECT_NUM];
+    MB_DATA_T     *mb_data;
+} __attribute__((packed)) MBASCII_DATA_T;
+
+typedef struct 
+{
+    MBASCII_DESC_T mb_ascii_desc;
+    MBASCII_DATA_T mb_ascii_data;
+} MBASCII_CTX_T;
+
+/*
+ * Function  : LRC of a frame, the two's complement of the byte sum
+ * data      : address + PDU
+ * len       : length of data
+ * return    : LRC, the sum of data and LRC is 0
+ */
+UINT8_T mb_ascii_lrc(const UINT8_T *data, int len);
+
+/*
+ * Function  : bytes to upper case hex characters, two a byte
+ * dst       : at least len * 2 characters
+ * src       : bytes
+ * len       : byte number
+ * return    : character number
+ */
+int mb_ascii_hex_encode(UINT8_T *dst, const UINT8_T *src, int len);
+
+/*
+ * Function  : hex characters(either case) to bytes
+ * dst       : at least len / 2 bytes
+ * src       : characters
+ * len       : character number, even
+ * return    : byte number=SUCCESS -1=ERROR(odd length or not a hex digit)
+ */
+int mb_ascii_hex_decode(UINT8_T *dst, const UINT8_T *src, int len);
+
+/*
+ * Function  : Create a ModBus ASCII context
+ * rtu_ctl   : serial line settings, the same as ModBus RTU(7E1 or 8N1 as the slaver speaks)
+ * return    : (MBASCII_CTX_T *)=SUCCESS NULL=ERRROR
+ */
+MBASCII_CTX_T *mb_ascii_init(MBRTU_CTL_T *rtu_ctl);
+
+/*
+ * Function  : close a ModBus ASCII context
+ * mbascii_ctx : the ModBus ASCII context you want to close
+ * return    : void
+ */
+void mb_ascii_close(MBASCII_CTX_T *mbascii_ctx);
+
+/*
+ * Function  : send ModBus ASCII data from ModBus cache to slaver, a broadcast(MBRTU_BROADCAST)
+ *             returns once the frame is on the line and the turnaround delay is over
+ * mbascii_ctx : ModBus ASCII context
+ * return    : length=SUCCESS -1=ERROR
+ */
+int mb_ascii_send(MBASCII_CTX_T *mbascii_ctx);
+
+/*
+ * Function  : encode a request once for mb_ascii_send_prepared, the whole hex frame
+ *             to the slaver the context addresses now, the context itself is left alone
+ * mbascii_ctx : ModBus ASCII context the request is sent on
+ * mb_info   : the request
+ * prep      : prepared request
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_ascii_prepare(MBASCII_CTX_T *mbascii_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep);
+
+/*
+ * Function  : send a prepared request like mb_ascii_send, neither encoded nor turned to hex,
+ *             the context addresses the slaver of the request from then on
+ * mbascii_ctx : ModBus ASCII context of mb_ascii_prepare
+ * prep      : prepared request
+ * return    : length=SUCCESS -1=ERROR
+ */
+int mb_ascii_send_prepared(MBASCII_CTX_T *mbascii_ctx, const MB_PREP_T *prep);
+
+/*
+ * Function  : recv ModBus ASCII data from slaver to ModBus cache
+ * mbascii_ctx : ModBus ASCII context
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_ascii_recv(MBASCII_CTX_T *mbascii_ctx);
+
+/*
+ * Function  : recv ModBus ASCII data from slaver, the response is decapped in place
+ *             from the hex-decoded cache, mb_info keeps the request
+ * mbascii_ctx : ModBus ASCII context
+ * view      : the response, valid until the next send/recv
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_ascii_recv_view(MBASCII_CTX_T *mbascii_ctx, MB_VIEW_T *view);
+
+void mbasciictx_info_updata(MBASCII_CTX_T *mbascii_ctx, MB_INFO_T *mb_info);
+
+void mbasciictx_info_takeout(MBASCII_CTX_T *mbascii_ctx, MB_INFO_T *mb_info);
+
+/*
+ * Function  : address the next request to another slaver on the same line
+ * mbascii_ctx : ModBus ASCII context
+ * slaver_addr : slaver address, 1-247
+ * return    : void
+ */
+void mbasciictx_slaver_set(MBASCII_CTX_T *mbascii_ctx, UINT8_T slaver_addr);
+
+#endif
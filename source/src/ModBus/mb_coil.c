@@ -0,0 +1,448 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Coils as bitmaps of 64 bit words, coil i is bit i%64 of word i/64,
+ *               the same order as the packed bytes of FC01/02/0F
+ *            2. Scalar, SSE2 and AVX2 pack/unpack between bitmaps and one byte per coil
+ *               arrays, the widest one verified against scalar is chosen at run time
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MBCOIL_HAVE_SIMD
+#endif
+
+#include "mb_coil.h"
+
+#define MBCOIL_CHECK_NUM 300   /* coil numbers 0..MBCOIL_CHECK_NUM and MBCOIL_MAX_NUM are verified */
+
+/* bit j of every byte j of a word */
+#define MBCOIL_BIT_SELECT 0x8040201008040201ULL
+
+static pthread_once_t coil_once = PTHREAD_ONCE_INIT;
+
+/* the last one passing verification in this order is used */
+static mb_coil_pack_fn_t   coil_pack_fn[MBCOIL_IMPL_NUM];
+static mb_coil_unpack_fn_t coil_unpack_fn[MBCOIL_IMPL_NUM];
+static MBCOIL_IMPL_T       coil_impl = MBCOIL_SCALAR;
+
+static const char *coil_name[MBCOIL_IMPL_NUM] = {
+    [MBCOIL_SCALAR] = "scalar",
+    [MBCOIL_SSE2]   = "sse2",
+    [MBCOIL_AVX2]   = "avx2",
+};
+
+/*
+ * Function  : pack coils from i on, word holds the coils from the last word boundary to i
+ * return    : void
+ */
+static void coil_pack_rest(UINT64_T *bitmap, const UINT8_T *coils, int i, int n, UINT64_T word)
+{
+    for (; i < n; ++i)
+    {
+        word |= (UINT64_T)(!!coils[i]) << (i & 63);
+
+        if (63 == (i & 63))
+        {
+            bitmap[i >> 6] = word;
+            word = 0;
+        }
+    }
+
+    if (n & 63)
+    {
+        bitmap[n >> 6] = word;
+    }
+}
+
+static void coil_unpack_rest(UINT8_T *coils, const UINT64_T *bitmap, int i, int n)
+{
+    for (; i < n; ++i)
+    {
+        coils[i] = MBCOIL_GET(bitmap, i);
+    }
+}
+
+static void coil_pack_scalar(UINT64_T *bitmap, const UINT8_T *coils, int n)
+{
+    coil_pack_rest(bitmap, coils, 0, n, 0);
+}
+
+static void coil_unpack_scalar(UINT8_T *coils, const UINT64_T *bitmap, int n)
+{
+    coil_unpack_rest(coils, bitmap, 0, n);
+}
+
+#ifdef MBCOIL_HAVE_SIMD
+/*
+ * Function  : 16 coils per step, bytes equal to 0 give the inverted movemask
+ * return    : void
+ */
+__attribute__((target("sse2")))
+static void coil_pack_sse2(UINT64_T *bitmap, const UINT8_T *coils, int n)
+{
+    __m128i  zero = _mm_setzero_si128();
+    UINT64_T word = 0;
+    UINT32_T mask = 0;
+    int i = 0;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        mask  = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(coils + i)), zero));
+        word |= (UINT64_T)(~mask & 0xffff) << (i & 63);
+
+        if (48 == (i & 63))
+        {
+            bitmap[i >> 6] = word;
+            word = 0;
+        }
+    }
+
+    coil_pack_rest(bitmap, coils, i, n, word);
+}
+
+/*
+ * Function  : 16 coils per step, the 2 bitmap bytes are spread over 8 lanes each
+ *             by unpacking with themselves, and every lane keeps its own bit
+ * return    : void
+ */
+__attribute__((target("sse2")))
+static void coil_unpack_sse2(UINT8_T *coils, const UINT64_T *bitmap, int n)
+{
+    __m128i  bit = _mm_set1_epi64x((long long)MBCOIL_BIT_SELECT);
+    __m128i  one = _mm_set1_epi8(1);
+    __m128i  v;
+    int i = 0;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        v = _mm_cvtsi32_si128((int)(bitmap[i >> 6] >> (i & 63)));
+        v = _mm_unpacklo_epi8(v, v);
+        v = _mm_unpacklo_epi16(v, v);
+        v = _mm_unpacklo_epi32(v, v);
+        v = _mm_cmpeq_epi8(_mm_and_si128(v, bit), bit);
+        _mm_storeu_si128((__m128i *)(coils + i), _mm_and_si128(v, one));
+    }
+
+    coil_unpack_rest(coils, bitmap, i, n);
+}
+
+__attribute__((target("avx2")))
+static void coil_pack_avx2(UINT64_T *bitmap, const UINT8_T *coils, int n)
+{
+    __m256i  zero = _mm256_setzero_si256();
+    UINT64_T word = 0;
+    UINT32_T mask = 0;
+    int i = 0;
+
+    for (i = 0; i + 32 <= n; i += 32)
+    {
+        mask  = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(coils + i)), zero));
+        word |= (UINT64_T)(~mask) << (i & 63);
+
+        if (32 == (i & 63))
+        {
+            bitmap[i >> 6] = word;
+            word = 0;
+        }
+    }
+
+    coil_pack_rest(bitmap, coils, i, n, word);
+}
+
+/*
+ * Function  : a bitmap word per step in 2 halves of 32 coils, the shuffle stays in its
+ *             128 bit lane, so the 4 bitmap bytes of a half are broadcast to both lanes first
+ * return    : void
+ */
+__attribute__((target("avx2")))
+static void coil_unpack_avx2(UINT8_T *coils, const UINT64_T *bitmap, int n)
+{
+    __m256i  spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                       2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    __m256i  bit    = _mm256_set1_epi64x((long long)MBCOIL_BIT_SELECT);
+    __m256i  one    = _mm256_set1_epi8(1);
+    __m256i  lo, hi;
+    UINT64_T word = 0;
+    int i = 0;
+
+    for (i = 0; i + 64 <= n; i += 64)
+    {
+        word = bitmap[i >> 6];
+        lo   = _mm256_shuffle_epi8(_mm256_set1_epi32((int)word), spread);
+        hi   = _mm256_shuffle_epi8(_mm256_set1_epi32((int)(word >> 32)), spread);
+        lo   = _mm256_cmpeq_epi8(_mm256_and_si256(lo, bit), bit);
+        hi   = _mm256_cmpeq_epi8(_mm256_and_si256(hi, bit), bit);
+        _mm256_storeu_si256((__m256i *)(coils + i), _mm256_and_si256(lo, one));
+        _mm256_storeu_si256((__m256i *)(coils + i + 32), _mm256_and_si256(hi, one));
+    }
+
+    if (i + 32 <= n)
+    {
+        lo = _mm256_shuffle_epi8(_mm256_set1_epi32((int)bitmap[i >> 6]), spread);
+        lo = _mm256_cmpeq_epi8(_mm256_and_si256(lo, bit), bit);
+        _mm256_storeu_si256((__m256i *)(coils + i), _mm256_and_si256(lo, one));
+        i += 32;
+    }
+
+    coil_unpack_rest(coils, bitmap, i, n);
+}
+#endif
+
+/*
+ * Function  : check a variant against scalar for n coils, unpack must not write past n
+ * return    : 0=SAME -1=DIFFERENT
+ */
+static int coil_verify_num(MBCOIL_IMPL_T impl, const UINT8_T *coils, int n)
+{
+    UINT64_T expect[MBCOIL_WORDS(MBCOIL_MAX_NUM)];
+    UINT64_T bitmap[MBCOIL_WORDS(MBCOIL_MAX_NUM)];
+    UINT8_T  unpack[MBCOIL_MAX_NUM + 1];
+    int i = 0;
+
+    coil_pack_scalar(expect, coils, n);
+    coil_pack_fn[impl](bitmap, coils, n);
+
+    if (memcmp(expect, bitmap, MBCOIL_WORDS(n) * sizeof(UINT64_T)))
+    {
+        return -1;
+    }
+
+    unpack[n] = 0xa5;
+    coil_unpack_fn[impl](unpack, expect, n);
+
+    for (i = 0; i < n; ++i)
+    {
+        if (unpack[i] != !!coils[i])
+        {
+            return -1;
+        }
+    }
+
+    return (0xa5 == unpack[n]) ? 0 : -1;
+}
+
+static int coil_verify(MBCOIL_IMPL_T impl, const UINT8_T *coils)
+{
+    int n = 0;
+
+    for (n = 0; n <= MBCOIL_CHECK_NUM; ++n)
+    {
+        if (0 > coil_verify_num(impl, coils, n))
+        {
+            return -1;
+        }
+    }
+
+    return coil_verify_num(impl, coils, MBCOIL_MAX_NUM);
+}
+
+static void coil_setup(void)
+{
+    UINT8_T  coils[MBCOIL_MAX_NUM];
+    UINT32_T seed = 0x12345678;
+    int i = 0;
+
+    /* on is any non zero byte, not only 1 */
+    for (i = 0; i < (int)sizeof(coils); ++i)
+    {
+        seed     = seed * 1103515245 + 12345;
+        coils[i] = (seed >> 16) & 0x8000 ? (UINT8_T)(seed >> 24) : 0;
+    }
+
+    coil_pack_fn[MBCOIL_SCALAR]   = coil_pack_scalar;
+    coil_unpack_fn[MBCOIL_SCALAR] = coil_unpack_scalar;
+
+#ifdef MBCOIL_HAVE_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        coil_pack_fn[MBCOIL_SSE2]   = coil_pack_sse2;
+        coil_unpack_fn[MBCOIL_SSE2] = coil_unpack_sse2;
+    }
+
+    if (__builtin_cpu_supports("avx2"))
+    {
+        coil_pack_fn[MBCOIL_AVX2]   = coil_pack_avx2;
+        coil_unpack_fn[MBCOIL_AVX2] = coil_unpack_avx2;
+    }
+#endif
+
+    for (i = MBCOIL_SSE2; i < MBCOIL_IMPL_NUM; ++i)
+    {
+        if (!coil_pack_fn[i])
+        {
+            continue;
+        }
+
+        if (0 > coil_verify(i, coils))
+        {
+            printf("Coil variant %s differs from scalar, not used\n", coil_name[i]);
+            coil_pack_fn[i]   = NULL;
+            coil_unpack_fn[i] = NULL;
+            continue;
+        }
+
+        coil_impl = i;
+    }
+}
+
+void mb_coil_load(UINT64_T *bitmap, const UINT8_T *packed, int n)
+{
+    PTR_CHECK_VOID(bitmap);
+    PTR_CHECK_VOID(packed);
+
+    if (0 >= n)
+    {
+        return ;
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    /* packed bytes are the bitmap words already */
+    bitmap[MBCOIL_WORDS(n) - 1] = 0;
+    memcpy(bitmap, packed, ALIGNED(n, 8));
+#else
+    int i = 0;
+
+    memset(bitmap, 0, MBCOIL_WORDS(n) * sizeof(UINT64_T));
+    for (i = 0; i < ALIGNED(n, 8); ++i)
+    {
+        bitmap[i >> 3] |= (UINT64_T)packed[i] << ((i & 7) * 8);
+    }
+#endif
+
+    if (n & 63)
+    {
+        bitmap[n >> 6] &= (1ULL << (n & 63)) - 1;
+    }
+}
+
+void mb_coil_store(UINT8_T *packed, const UINT64_T *bitmap, int n)
+{
+    PTR_CHECK_VOID(packed);
+    PTR_CHECK_VOID(bitmap);
+
+    if (0 >= n)
+    {
+        return ;
+    }
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(packed, bitmap, ALIGNED(n, 8));
+#else
+    int i = 0;
+
+    for (i = 0; i < ALIGNED(n, 8); ++i)
+    {
+        packed[i] = (UINT8_T)(bitmap[i >> 3] >> ((i & 7) * 8));
+    }
+#endif
+
+    if (n & 7)
+    {
+        packed[n >> 3] &= (1 << (n & 7)) - 1;
+    }
+}
+
+void mb_coil_pack(UINT64_T *bitmap, const UINT8_T *coils, int n)
+{
+    PTR_CHECK_VOID(bitmap);
+    PTR_CHECK_VOID(coils);
+
+    pthread_once(&coil_once, coil_setup);
+
+    coil_pack_fn[coil_impl](bitmap, coils, n);
+}
+
+void mb_coil_unpack(UINT8_T *coils, const UINT64_T *bitmap, int n)
+{
+    PTR_CHECK_VOID(coils);
+    PTR_CHECK_VOID(bitmap);
+
+    pthread_once(&coil_once, coil_setup);
+
+    coil_unpack_fn[coil_impl](coils, bitmap, n);
+}
+
+int mb_info_coil_get(const MB_INFO_T *mb_info, UINT64_T *bitmap)
+{
+    PTR_CHECK_0(mb_info);
+    PTR_CHECK_0(bitmap);
+
+    /* a short response gives only the coils it has */
+    int n = (mb_info->n_reg < mb_info->n_byte * 8) ? mb_info->n_reg : (mb_info->n_byte * 8);
+
+    mb_coil_load(bitmap, mb_info->value, n);
+
+    return n;
+}
+
+int mb_info_coil_set(MB_INFO_T *mb_info, const UINT64_T *bitmap, UINT16_T n)
+{
+    PTR_CHECK_N1(mb_info);
+    PTR_CHECK_N1(bitmap);
+
+    if (MB_WRITE_COIL_MAX_NUM < n)
+    {
+        printf("Too many coils(%d) for a ModBus request\n", n);
+        return -1;
+    }
+
+    mb_info->n_reg  = n;
+    mb_info->n_byte = ALIGNED(n, 8);
+    mb_coil_store(mb_info->value, bitmap, n);
+
+    return 0;
+}
+
+int mb_view_coil_get(const MB_VIEW_T *view, UINT64_T *bitmap)
+{
+    PTR_CHECK_0(view);
+    PTR_CHECK_0(bitmap);
+
+    int n = (view->n_reg < view->len * 8) ? view->n_reg : (view->len * 8);
+
+    mb_coil_load(bitmap, view->payload, n);
+
+    return n;
+}
+
+mb_coil_pack_fn_t mb_coil_pack_get(MBCOIL_IMPL_T impl)
+{
+    if (MBCOIL_IMPL_NUM <= impl)
+    {
+        return NULL;
+    }
+
+    pthread_once(&coil_once, coil_setup);
+
+    return coil_pack_fn[impl];
+}
+
+mb_coil_unpack_fn_t mb_coil_unpack_get(MBCOIL_IMPL_T impl)
+{
+    if (MBCOIL_IMPL_NUM <= impl)
+    {
+        return NULL;
+    }
+
+    pthread_once(&coil_once, coil_setup);
+
+    return coil_unpack_fn[impl];
+}
+
+MBCOIL_IMPL_T mb_coil_impl(void)
+{
+    pthread_once(&coil_once, coil_setup);
+
+    return coil_impl;
+}
+
+const char *mb_coil_name(MBCOIL_IMPL_T impl)
+{
+    return (MBCOIL_IMPL_NUM > impl) ? coil_name[impl] : "unknown";
+}
@@ -0,0 +1,126 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Coils as bitmaps of 64 bit words, coil i is bit i%64 of word i/64,
+ *               the same order as the packed bytes of FC01/02/0F
+ *            2. Scalar, SSE2 and AVX2 pack/unpack between bitmaps and one byte per coil
+ *               arrays, the widest one verified against scalar is chosen at run time
+ */
+
+#ifndef MB_COIL
+#define MB_COIL
+
+#include "mb_common.h"
+
+#define MBCOIL_MAX_NUM  2000    /* coils of the longest FC01/02 read */
+
+/* bitmap words holding n coils */
+#define MBCOIL_WORDS(n) ALIGNED((n), 64)
+
+/* coil i of a bitmap */
+#define MBCOIL_GET(bitmap, i) (((bitmap)[(i) >> 6] >> ((i) & 63)) & 1)
+
+/* turn coil i of a bitmap on(on != 0) or off */
+#define MBCOIL_SET(bitmap, i, on)                                                       \
+    ((bitmap)[(i) >> 6] = ((bitmap)[(i) >> 6] & ~(1ULL << ((i) & 63))) |                \
+                          ((UINT64_T)!!(on) << ((i) & 63)))
+
+typedef enum
+{
+    MBCOIL_SCALAR = 0,          /* reference, 1 coil per step */
+    MBCOIL_SSE2,                /* 16 coils per step, x86 only */
+    MBCOIL_AVX2,                /* 32 coils per step, x86 only */
+    MBCOIL_IMPL_NUM
+} MBCOIL_IMPL_T;
+
+typedef void (*mb_coil_pack_fn_t)(UINT64_T *bitmap, const UINT8_T *coils, int n);
+typedef void (*mb_coil_unpack_fn_t)(UINT8_T *coils, const UINT64_T *bitmap, int n);
+
+/*
+ * Function  : packed coil bytes of the wire into a bitmap, bits past n are cleared
+ * bitmap    : MBCOIL_WORDS(n) words
+ * packed    : ALIGNED(n, 8) bytes
+ * n         : coil number
+ * return    : void
+ */
+void mb_coil_load(UINT64_T *bitmap, const UINT8_T *packed, int n);
+
+/*
+ * Function  : a bitmap into packed coil bytes of the wire, bits past n are cleared
+ * packed    : ALIGNED(n, 8) bytes
+ * bitmap    : MBCOIL_WORDS(n) words
+ * n         : coil number
+ * return    : void
+ */
+void mb_coil_store(UINT8_T *packed, const UINT64_T *bitmap, int n);
+
+/*
+ * Function  : one byte per coil into a bitmap with the chosen variant, a non zero byte is on
+ * bitmap    : MBCOIL_WORDS(n) words, bits past n are cleared
+ * coils     : n bytes
+ * n         : coil number
+ * return    : void
+ */
+void mb_coil_pack(UINT64_T *bitmap, const UINT8_T *coils, int n);
+
+/*
+ * Function  : a bitmap into one byte per coil with the chosen variant, 1=on 0=off
+ * coils     : n bytes
+ * bitmap    : MBCOIL_WORDS(n) words
+ * n         : coil number
+ * return    : void
+ */
+void mb_coil_unpack(UINT8_T *coils, const UINT64_T *bitmap, int n);
+
+/*
+ * Function  : coils of an FC01/02 response into a bitmap
+ * mb_info   : response, n_reg of the request
+ * bitmap    : MBCOIL_WORDS(mb_info->n_reg) words
+ * return    : coil number
+ */
+int mb_info_coil_get(const MB_INFO_T *mb_info, UINT64_T *bitmap);
+
+/*
+ * Function  : coils of an FC0F request from a bitmap, sets n_reg, n_byte and value
+ * mb_info   : request
+ * bitmap    : MBCOIL_WORDS(n) words
+ * n         : coil number, at most MB_WRITE_COIL_MAX_NUM
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_info_coil_set(MB_INFO_T *mb_info, const UINT64_T *bitmap, UINT16_T n);
+
+/*
+ * Function  : coils of an FC01/02 view into a bitmap
+ * view      : response view
+ * bitmap    : MBCOIL_WORDS(view->n_reg) words
+ * return    : coil number
+ */
+int mb_view_coil_get(const MB_VIEW_T *view, UINT64_T *bitmap);
+
+/*
+ * Function  : get one variant of pack
+ * impl      : variant
+ * return    : (mb_coil_pack_fn_t)=SUCCESS NULL=NOT SUPPORTED BY THE CPU OR FAILED VERIFICATION
+ */
+mb_coil_pack_fn_t mb_coil_pack_get(MBCOIL_IMPL_T impl);
+
+/*
+ * Function  : get one variant of unpack
+ * impl      : variant
+ * return    : (mb_coil_unpack_fn_t)=SUCCESS NULL=NOT SUPPORTED BY THE CPU OR FAILED VERIFICATION
+ */
+mb_coil_unpack_fn_t mb_coil_unpack_get(MBCOIL_IMPL_T impl);
+
+/*
+ * Function  : variant used by mb_coil_pack and mb_coil_unpack
+ * return    : variant
+ */
+MBCOIL_IMPL_T mb_coil_impl(void);
+
+/*
+ * Function  : name of a variant
+ * impl      : variant
+ * return    : name
+ */
+const char *mb_coil_name(MBCOIL_IMPL_T impl);
+
+#endif
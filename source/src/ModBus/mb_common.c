@@ -6,26 +6,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#include "mb_common.h"
-
-/*
- * Function  : endian check
- * parameter : void
- * return    : 0=(little endian) -1=(big endian)
- */
-static UINT8_T is_big_endian(void)
-{
-    union
-    {
-        UINT16_T word;
-        UINT8_T  byte;
-    } endian_test;
-    
-    endian_test.word = 0x00ff;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-    return (endian_test.byte == 0xff);
-}
+#include "mb_common.h"
 
 /*
  * Function  : little endian to big endian for word
@@ -65,6 +52,86 @@ UINT16_T b2l_endian(UINT16_T value)
     return word2.W1;
 }
 
+/*
+ * Function  : swap the bytes of n words, 8 words per step with SSE2(every x86_64 has it),
+ *             dst may be src
+ * return    : void
+ */
+static void mb_reg_swap(UINT8_T *dst, const UINT8_T *src, int n)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    __m128i v;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(dst + i * 2), v);
+    }
+#endif
+
+    for (; i < n; ++i)
+    {
+        UINT8_T high = src[i * 2];
+
+        dst[i * 2]       = src[(i * 2) + 1];
+        dst[(i * 2) + 1] = high;
+    }
+}
+
+/*
+ * Function  : big endian register bytes into host words, in place if regs is wire
+ * regs      : n words
+ * wire      : n * 2 bytes
+ * n         : register number
+ * return    : void
+ */
+void mb_reg_decode(UINT16_T *regs, const UINT8_T *wire, int n)
+{
+    PTR_CHECK_VOID(regs);
+    PTR_CHECK_VOID(wire);
+
+#if MB_HOST_BIG_ENDIAN
+    memmove(regs, wire, n * 2);
+#else
+    mb_reg_swap((UINT8_T *)regs, wire, n);
+#endif
+}
+
+/*
+ * Function  : host words into big endian register bytes, in place if wire is regs
+ * wire      : n * 2 bytes
+ * regs      : n words
+ * n         : register number
+ * return    : void
+ */
+void mb_reg_encode(UINT8_T *wire, const UINT16_T *regs, int n)
+{
+    PTR_CHECK_VOID(wire);
+    PTR_CHECK_VOID(regs);
+
+#if MB_HOST_BIG_ENDIAN
+    memmove(wire, regs, n * 2);
+#else
+    mb_reg_swap(wire, (const UINT8_T *)regs, n);
+#endif
+}
+
+/*
+ * Function  : monotonic clock in microseconds, used for I/O deadlines
+ * return    : current time(us)
+ */
+UINT64_T mb_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((UINT64_T)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
 /*
  * Function      : Create a cache for ModBus data transmission and reception
  * max_data_size : size of cache
@@ -77,18 +144,32 @@ MB_DATA_T *mb_data_create(UINT32_T max_data_size)
     MB_DATA_T *mb_data = NULL;
 
     /* create sp modbus data cache */
-    mb_data = (MB_DATA_T *)malloc(sizeof(MB_DATA_T) + max_data_size);
+    mb_data = (MB_DATA_T *)malloc(MB_DATA_BUF_SIZE(max_data_size));
     if (!mb_data)
     {
         return NULL;
     }
-    memset(mb_data, 0, (sizeof(MB_DATA_T) + max_data_size));
-
-    mb_data->max_data_len  = max_data_size;
-    mb_data->is_big_endian = is_big_endian();
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
+    return mb_data_init(mb_data, max_data_size);
+}
+
+/*
+ * Function      : init a cache in a buffer of the caller, such as one on the stack
+ * buf           : buffer, MB_DATA_BUF_SIZE(max_data_size) bytes
+ * max_data_size : size of cache
+ * return        : (MB_DATA_T *)=SUCCESS NULL=ERROR
+ */
+MB_DATA_T *mb_data_init(void *buf, UINT32_T max_data_size)
+{
+    PTR_CHECK_NULL(buf);
+
+    MB_DATA_T *mb_data = (MB_DATA_T *)buf;
+
+    memset(mb_data, 0, MB_DATA_BUF_SIZE(max_data_size));
+    mb_data->max_data_len = max_data_size;
+
     return mb_data;
 }
 
@@ -127,6 +208,163 @@ void mb_data_clear(MB_DATA_T *mb_data)
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 }
 
+/*
+ * Function : value bytes a request or response uses, the rest of value is not looked at
+ * mb_info  : request or response
+ * return   : length
+ */
+UINT16_T mb_info_value_len(MB_INFO_T *mb_info)
+{
+    PTR_CHECK_0(mb_info);
+
+    UINT16_T len = 0;
+
+    if (0x80 < mb_info->code)
+    {
+        return 0;
+    }
+
+    switch (mb_info->code)
+    {
+        /* response values */
+        case MB_FUNC_01 : 
+        case MB_FUNC_02 : 
+        case MB_FUNC_03 :
+        case MB_FUNC_04 :
+            len = mb_info->n_byte;
+            break;
+
+        case MB_FUNC_05 :
+        case MB_FUNC_06 : 
+            len = 2;
+            break;
+
+        /* request values */
+        case MB_FUNC_0f : 
+            len = ALIGNED(mb_info->n_reg, 8);
+            break;
+
+        case MB_FUNC_10 : 
+            len = mb_info->n_reg * 2;
+            break;
+
+        default :
+            break;
+    }
+
+    return (MAX_MBVALUE_SIZE < len) ? MAX_MBVALUE_SIZE : len;
+}
+
+/*
+ * Function : copy a request or response, its header and only the value bytes it uses
+ * dst      : destination
+ * src      : source
+ * return   : void
+ */
+void mb_info_copy(MB_INFO_T *dst, MB_INFO_T *src)
+{
+    PTR_CHECK_VOID(dst);
+    PTR_CHECK_VOID(src);
+
+    memcpy(dst, src, MB_INFO_HEAD_LEN);
+    memcpy(dst->value, src->value, mb_info_value_len(src));
+}
+
+/*
+ * Function : registers of an FC03/04 response into host words
+ * mb_info  : response
+ * regs     : n_byte / 2 words
+ * return   : register number
+ */
+int mb_info_reg_get(const MB_INFO_T *mb_info, UINT16_T *regs)
+{
+    PTR_CHECK_0(mb_info);
+    PTR_CHECK_0(regs);
+
+    int n = ((MAX_MBVALUE_SIZE < mb_info->n_byte) ? MAX_MBVALUE_SIZE : mb_info->n_byte) / 2;
+
+    mb_reg_decode(regs, mb_info->value, n);
+
+    return n;
+}
+
+/*
+ * Function : registers of an FC10 request from host words, sets n_reg, n_byte and value
+ * mb_info  : request
+ * regs     : n words
+ * n        : register number, at most MB_WRITE_REG_MAX_NUM
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int mb_info_reg_set(MB_INFO_T *mb_info, const UINT16_T *regs, UINT16_T n)
+{
+    PTR_CHECK_N1(mb_info);
+    PTR_CHECK_N1(regs);
+
+    if (MB_WRITE_REG_MAX_NUM < n)
+    {
+        printf("Too many registers(%d) for a ModBus request\n", n);
+        return -1;
+    }
+
+    mb_info->n_reg  = n;
+    mb_info->n_byte = n * 2;
+    mb_reg_encode(mb_info->value, regs, n);
+
+    return 0;
+}
+
+/*
+ * Function : registers of an FC03/04 view into host words
+ * view     : response view
+ * regs     : MB_VIEW_REG_NUM(view) words
+ * return   : register number
+ */
+int mb_view_reg_get(const MB_VIEW_T *view, UINT16_T *regs)
+{
+    PTR_CHECK_0(view);
+    PTR_CHECK_0(regs);
+
+    int n = MB_VIEW_REG_NUM(view);
+
+    mb_reg_decode(regs, view->payload, n);
+
+    return n;
+}
+
+/*
+ * Function : append value bytes as they are
+ * mb_data  : ModBus cache
+ * return   : void
+ */
+static void mb_data_value_set(MB_DATA_T *mb_data, UINT8_T *value, UINT16_T len)
+{
+    if ((mb_data->data_len + len) <= mb_data->max_data_len)
+    {
+        memcpy(mb_data->data + mb_data->data_len, value, len);
+        mb_data->data_len += len;
+    }
+    mb_data->operate_data_len += len;
+}
+
+/*
+ * Function : take value bytes as they are, as many as the cache has
+ * mb_data  : ModBus cache
+ * return   : void
+ */
+static void mb_data_value_get(MB_DATA_T *mb_data, UINT8_T *value, UINT16_T len)
+{
+    UINT16_T avail = (mb_data->offset < mb_data->data_len) ? (mb_data->data_len - mb_data->offset) : 0;
+
+    if (avail > len)
+    {
+        avail = len;
+    }
+
+    memcpy(value, mb_data->data + mb_data->offset, avail);
+    mb_data->offset           += avail;
+    mb_data->operate_data_len += len;
+}
+
 /*
  * Function : encap the Modbus PDU
  * mb_data  : ModBus cache
@@ -138,91 +376,49 @@ void mb_data_encap(MB_DATA_T *mb_data)
 
     PTR_CHECK_VOID(mb_data);
 
-    int i = 0;
-    int j = 0;
-    UINT8_T  byte = 0;
-    UINT16_T word = 0;
-    MB_INFO_T mb_info = mb_data->mb_info;
+    UINT8_T    n_byte  = 0;
+    UINT16_T   word    = 0;
+    MB_INFO_T *mb_info = &(mb_data->mb_info);
 
     /* common */
     {
         /* function code */
-        MBDATA_BYTE_SET(mb_data, mb_info.code);
+        MBDATA_BYTE_SET(mb_data, mb_info->code);
 
         /* register address */
-        if (mb_data->is_big_endian)
-        {
-            mb_info.reg = l2b_endian(mb_info.reg);
-        }
-        MBDATA_WORD_SET(mb_data, mb_info.reg);
+        word = MB_HTOBE16(mb_info->reg);
+        MBDATA_WORD_SET(mb_data, word);
     }
 
-    switch (mb_info.code)
+    switch (mb_info->code)
     {
         case MB_FUNC_01 : 
         case MB_FUNC_02 : 
         case MB_FUNC_03 :
         case MB_FUNC_04 :
             /* register number */
-            if (mb_data->is_big_endian)
-            {
-                mb_info.n_reg = l2b_endian(mb_info.n_reg);
-            }
-            MBDATA_WORD_SET(mb_data, mb_info.n_reg);
+            word = MB_HTOBE16(mb_info->n_reg);
+            MBDATA_WORD_SET(mb_data, word);
             break;
             
         case MB_FUNC_05 :
         case MB_FUNC_06 : 
-            /* register value */
-            word = *(UINT16_T *)(&mb_info.value[0]);
-            if (!mb_data->is_big_endian)
-            {
-                word = l2b_endian(word);
-            }
-            MBDATA_WORD_SET(mb_data, word);
+            /* register value, as on the wire */
+            mb_data_value_set(mb_data, mb_info->value, 2);
             break;
             
         case MB_FUNC_0f : 
-            /* register number */
-            if (mb_data->is_big_endian)
-            {
-                mb_info.n_reg = l2b_endian(mb_info.n_reg);
-            }
-            MBDATA_WORD_SET(mb_data, mb_info.n_reg);
-            
-            /* value byte number */
-            mb_info.n_byte = ALIGNED(mb_data->mb_info.n_reg, 8);
-            MBDATA_BYTE_SET(mb_data, mb_info.n_byte);
-            
-            /* value */
-            for (i  = 0; i < mb_info.n_byte && i < ITEM(mb_info.value); ++i)
-            {
-                byte = 0;
-                for (j = 0; j < 8; j++)
-                {
-                    byte |= (!!mb_info.value[(i * 8) + j]) << j;
-                }
-                MBDATA_BYTE_SET(mb_data, byte); 
-            }
-            break;
-        
         case MB_FUNC_10 : 
             /* register number */
-            if (mb_data->is_big_endian)
-            {
-                mb_info.n_reg = l2b_endian(mb_info.n_reg);
-            }
-            MBDATA_WORD_SET(mb_data, mb_info.n_reg);
+            word = MB_HTOBE16(mb_info->n_reg);
+            MBDATA_WORD_SET(mb_data, word);
             
-            /* value byte number */
-            mb_info.n_byte = mb_data->mb_info.n_reg * 2;
-            MBDATA_BYTE_SET(mb_data, mb_info.n_byte);
+            /* value byte number, coils are packed already */
+            n_byte = (UINT8_T)mb_info_value_len(mb_info);
+            MBDATA_BYTE_SET(mb_data, n_byte);
             
             /* value */
-            for (i  = 0; i < mb_info.n_byte && i < ITEM(mb_info.value); ++i)
-            {
-                MBDATA_BYTE_SET(mb_data, mb_info.value[i]); 
-            }   
+            mb_data_value_set(mb_data, mb_info->value, n_byte);
             break;
             
         default :
@@ -243,7 +439,6 @@ void mb_data_decap(MB_DATA_T *mb_data)
 
     PTR_CHECK_VOID(mb_data);
 
-    int i = 0;
     MB_INFO_T *mb_info = &(mb_data->mb_info);
 
     /* common */
@@ -263,36 +458,21 @@ void mb_data_decap(MB_DATA_T *mb_data)
     {
         case MB_FUNC_01 : 
         case MB_FUNC_02 : 
-            /* value byte number */
-            MBDATA_BYTE_GET(mb_data, mb_info->n_byte);
-            
-            /* value */
-            for (i = 0; i < mb_info->n_byte; i++)
-            {
-                MBDATA_BYTE_GET(mb_data, mb_info->value[i]);
-            }
-            break;
-
         case MB_FUNC_03 : 
         case MB_FUNC_04 : 
             /* value byte number */
             MBDATA_BYTE_GET(mb_data, mb_info->n_byte);
             
-            /* value */
-            for (i = 0; i < mb_info->n_byte; i += 2)
-            {
-                MBDATA_WORD_GET(mb_data, *(UINT16_T *)(&mb_info->value[i]));
-            }
+            /* value, registers stay big endian, mb_info_reg_get() converts them */
+            mb_data_value_get(mb_data, mb_info->value,
+                (MAX_MBVALUE_SIZE < mb_info->n_byte) ? MAX_MBVALUE_SIZE : mb_info->n_byte);
             break;
             
         case MB_FUNC_05 : 
         case MB_FUNC_06 : 
             /* register address */
             MBDATA_WORD_GET(mb_data, mb_info->reg);
-            if (mb_data->is_big_endian)
-            {
-                mb_info->reg = b2l_endian(mb_info->reg);
-            }
+            mb_info->reg = MB_BE16TOH(mb_info->reg);
         
             /* register value */
             MBDATA_BYTE_GET(mb_data, mb_info->value[0]);
@@ -303,17 +483,11 @@ void mb_data_decap(MB_DATA_T *mb_data)
         case MB_FUNC_10 : 
             /* register address */
             MBDATA_WORD_GET(mb_data, mb_info->reg);
-            if (mb_data->is_big_endian)
-            {
-                mb_info->reg = b2l_endian(mb_info->reg);
-            }
+            mb_info->reg = MB_BE16TOH(mb_info->reg);
         
             /* register number */
             MBDATA_WORD_GET(mb_data, mb_info->n_reg);
-            if (mb_data->is_big_endian)
-            {
-                mb_info->n_reg = b2l_endian(mb_info->n_reg);
-            }
+            mb_info->n_reg = MB_BE16TOH(mb_info->n_reg);
             break;
             
         default :
@@ -323,6 +497,387 @@ void mb_data_decap(MB_DATA_T *mb_data)
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 }
 
+/*
+ * Function : decap a response PDU in place, nothing is copied, mb_info still holds the request
+ *            and gives start address and quantity of reads, the PDU length is checked
+ * mb_data  : ModBus cache, the PDU starts at offset, which is moved behind it
+ * view     : the response
+ * return   : 0=SUCCESS -1=ERROR(truncated PDU or unknown function code)
+ */
+int mb_view_decap(MB_DATA_T *mb_data, MB_VIEW_T *view)
+{
+    PTR_CHECK_N1(mb_data);
+    PTR_CHECK_N1(view);
+
+    UINT8_T  *pdu = mb_data->data + mb_data->offset;
+    UINT16_T  len = (mb_data->offset < mb_data->data_len) ? (mb_data->data_len - mb_data->offset) : 0;
+    UINT16_T  use = 0;
+
+    if (!len)
+    {
+        return -1;
+    }
+
+    view->code    = pdu[0];
+    view->err     = 0;
+    view->reg     = mb_data->mb_info.reg;
+    view->n_reg   = mb_data->mb_info.n_reg;
+    view->len     = 0;
+    view->payload = pdu + 1;
+
+    if (0x80 < view->code)
+    {
+        /* code, exception code */
+        use       = MB_EXCEPTION_PDU_LEN;
+        view->err = (use <= len) ? pdu[1] : 0;
+    }
+    else
+    {
+        switch (view->code)
+        {
+            case MB_FUNC_01 : 
+            case MB_FUNC_02 : 
+            case MB_FUNC_03 : 
+            case MB_FUNC_04 : 
+                /* code, value byte number, value */
+                view->len     = (2 <= len) ? pdu[1] : 0;
+                view->payload = pdu + 2;
+                use           = 2 + view->len;
+                break;
+
+            case MB_FUNC_05 : 
+            case MB_FUNC_06 : 
+                /* code, register address, register value */
+                use = 5;
+                if (use <= len)
+                {
+                    view->reg     = (pdu[1] << 8) | pdu[2];
+                    view->len     = 2;
+                    view->payload = pdu + 3;
+                }
+                break;
+
+            case MB_FUNC_0f : 
+            case MB_FUNC_10 : 
+                /* code, register address, register number */
+                use = 5;
+                if (use <= len)
+                {
+                    view->reg   = (pdu[1] << 8) | pdu[2];
+                    view->n_reg = (pdu[3] << 8) | pdu[4];
+                }
+                break;
+
+            default :
+                return -1;
+        }
+    }
+
+    mb_data->operate_data_len += use;
+    if (use > len)
+    {
+        view->len = 0;
+        return -1;
+    }
+    mb_data->offset += use;
+
+    return 0;
+}
+
+/*
+ * Function : decap a response PDU into mb_info, or in place when a view is given
+ * mb_data  : ModBus cache
+ * view     : the response, NULL=into mb_info
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int mb_response_decap(MB_DATA_T *mb_data, MB_VIEW_T *view)
+{
+    PTR_CHECK_N1(mb_data);
+
+    if (view)
+    {
+        return mb_view_decap(mb_data, view);
+    }
+
+    mb_data_decap(mb_data);
+
+    return 0;
+}
+
+/*
+ * Function : decap a ModBus request PDU on the slaver side, 
+ *            FC05/06 value and FC0F/10 values are kept as on the wire
+ * mb_data  : ModBus cache, the PDU starts at offset
+ * return   : 0=SUCCESS -1=ERROR(mb_info.err holds the exception code)
+ */
+int mb_request_decap(MB_DATA_T *mb_data)
+{
+    PTR_CHECK_N1(mb_data);
+
+    MB_INFO_T *mb_info = &(mb_data->mb_info);
+
+    mb_data->operate_data_len = mb_data->offset;
+    mb_info->err    = 0;
+    mb_info->n_reg  = 0;
+    mb_info->n_byte = 0;
+
+    /* function code, register address */
+    MBDATA_BYTE_GET(mb_data, mb_info->code);
+    MBDATA_WORD_GET(mb_data, mb_info->reg);
+    mb_info->reg = MB_BE16TOH(mb_info->reg);
+
+    switch (mb_info->code)
+    {
+        case MB_FUNC_01 : 
+        case MB_FUNC_02 : 
+        case MB_FUNC_03 : 
+        case MB_FUNC_04 : 
+            /* register number */
+            MBDATA_WORD_GET(mb_data, mb_info->n_reg);
+            mb_info->n_reg = MB_BE16TOH(mb_info->n_reg);
+            break;
+
+        case MB_FUNC_05 : 
+        case MB_FUNC_06 : 
+            /* register value */
+            MBDATA_BYTE_GET(mb_data, mb_info->value[0]);
+            MBDATA_BYTE_GET(mb_data, mb_info->value[1]);
+            mb_info->n_reg = 1;
+            break;
+
+        case MB_FUNC_0f : 
+        case MB_FUNC_10 : 
+            /* register number */
+            MBDATA_WORD_GET(mb_data, mb_info->n_reg);
+            mb_info->n_reg = MB_BE16TOH(mb_info->n_reg);
+
+            /* value byte number */
+            MBDATA_BYTE_GET(mb_data, mb_info->n_byte);
+
+            /* value */
+            mb_data_value_get(mb_data, mb_info->value,
+                (MAX_MBVALUE_SIZE < mb_info->n_byte) ? MAX_MBVALUE_SIZE : mb_info->n_byte);
+            break;
+
+        default :
+            mb_info->err = MB_ERR_FUNC;
+            return -1;
+    }
+
+    /* truncated PDU */
+    if (mb_data->operate_data_len > mb_data->data_len)
+    {
+        mb_info->err = MB_ERR_DATA;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function : encap a ModBus response PDU on the slaver side, mb_info.err != 0 
+ *            makes an exception response
+ * mb_data  : ModBus cache, the PDU is appended at data_len
+ * return   : void
+ */
+void mb_response_encap(MB_DATA_T *mb_data)
+{
+    PTR_CHECK_VOID(mb_data);
+
+    UINT16_T   word    = 0;
+    MB_INFO_T *mb_info = &(mb_data->mb_info);
+
+    if (mb_info->err)
+    {
+        /* exception code */
+        MBDATA_BYTE_SET(mb_data, (mb_info->code | 0x80));
+        MBDATA_BYTE_SET(mb_data, mb_info->err);
+        return ;
+    }
+
+    /* function code */
+    MBDATA_BYTE_SET(mb_data, mb_info->code);
+
+    switch (mb_info->code)
+    {
+        case MB_FUNC_01 : 
+        case MB_FUNC_02 : 
+        case MB_FUNC_03 : 
+        case MB_FUNC_04 : 
+            /* value byte number, value */
+            MBDATA_BYTE_SET(mb_data, mb_info->n_byte);
+            if ((mb_data->data_len + mb_info->n_byte) <= mb_data->max_data_len)
+            {
+                memcpy(mb_data->data + mb_data->data_len, mb_info->value, mb_info->n_byte);
+                mb_data->data_len += mb_info->n_byte;
+            }
+            mb_data->operate_data_len += mb_info->n_byte;
+            break;
+
+        case MB_FUNC_05 : 
+        case MB_FUNC_06 : 
+            /* register address, register value */
+            word = MB_HTOBE16(mb_info->reg);
+            MBDATA_WORD_SET(mb_data, word);
+            MBDATA_BYTE_SET(mb_data, mb_info->value[0]);
+            MBDATA_BYTE_SET(mb_data, mb_info->value[1]);
+            break;
+
+        case MB_FUNC_0f : 
+        case MB_FUNC_10 : 
+            /* register address, register number */
+            word = MB_HTOBE16(mb_info->reg);
+            MBDATA_WORD_SET(mb_data, word);
+            word = MB_HTOBE16(mb_info->n_reg);
+            MBDATA_WORD_SET(mb_data, word);
+            break;
+
+        default :
+            break;
+    }
+}
+
+/*
+ * Function : length of the normal response PDU to a request
+ * mb_info  : request
+ * return   : length, 0=UNKNOWN FUNCTION CODE
+ */
+UINT16_T mb_response_pdu_len(MB_INFO_T *mb_info)
+{
+    PTR_CHECK_0(mb_info);
+
+    switch (mb_info->code)
+    {
+        /* code, byte number, values */
+        case MB_FUNC_01 :
+        case MB_FUNC_02 :
+            return 2 + ALIGNED(mb_info->n_reg, 8);
+
+        case MB_FUNC_03 :
+        case MB_FUNC_04 :
+            return 2 + (mb_info->n_reg * 2);
+
+        /* code, address, value or number */
+        case MB_FUNC_05 :
+        case MB_FUNC_06 :
+        case MB_FUNC_0f :
+        case MB_FUNC_10 :
+            return 5;
+
+        default :
+            return 0;
+    }
+}
+
+/*
+ * Function : length of a request PDU from its first bytes
+ * pdu      : received PDU bytes, function code first
+ * len      : received length
+ * return   : length, 0=NEED MORE BYTES -1=UNKNOWN FUNCTION CODE
+ */
+int mb_request_pdu_len(UINT8_T *pdu, UINT16_T len)
+{
+    PTR_CHECK_N1(pdu);
+
+    if (!len)
+    {
+        return 0;
+    }
+
+    switch (pdu[0])
+    {
+        /* code, address, number or value */
+        case MB_FUNC_01 :
+        case MB_FUNC_02 :
+        case MB_FUNC_03 :
+        case MB_FUNC_04 :
+        case MB_FUNC_05 :
+        case MB_FUNC_06 :
+            return 5;
+
+        /* code, address, number, byte number, values */
+        case MB_FUNC_0f :
+        case MB_FUNC_10 :
+            return (6 > len) ? 0 : (6 + pdu[5]);
+
+        default :
+            return -1;
+    }
+}
+
+/*
+ * Function : keep an encoded frame as a prepared request
+ * prep     : prepared request
+ * owner    : context the frame is encoded for
+ * mb_info  : the request
+ * frame    : the frame
+ * len      : frame length
+ * return   : 0=SUCCESS -1=ERROR(frame too long)
+ */
+int mb_prep_save(MB_PREP_T *prep, const void *owner, const MB_INFO_T *mb_info, const UINT8_T *frame, UINT16_T len)
+{
+    PTR_CHECK_N1(prep);
+    PTR_CHECK_N1(owner);
+    PTR_CHECK_N1(mb_info);
+    PTR_CHECK_N1(frame);
+
+    if (MB_PREP_FRAME_SIZE < len)
+    {
+        printf("ModBus frame too long(%d) to prepare\n", len);
+        return -1;
+    }
+
+    memset(&prep->mb_info, 0, sizeof(prep->mb_info));
+    memcpy(&prep->mb_info, mb_info, MB_INFO_HEAD_LEN);
+    memcpy(prep->frame, frame, len);
+    prep->len   = len;
+    prep->owner = owner;
+
+    return 0;
+}
+
+/*
+ * Function : check a prepared request can be sent on a context
+ * prep     : prepared request
+ * owner    : context to send it on
+ * return   : 0=SUCCESS -1=ERROR(not prepared or prepared for another context)
+ */
+int mb_prep_check(const MB_PREP_T *prep, const void *owner)
+{
+    PTR_CHECK_N1(prep);
+
+    if (!prep->len || owner != prep->owner)
+    {
+        printf("ModBus request not prepared for this context\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function : put the request header of a prepared request into mb_info of the cache,
+ *            the response is checked against it, the frame is sent from prep as it is
+ * prep     : prepared request
+ * owner    : context to send it on
+ * mb_data  : ModBus cache of the context
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int mb_prep_load(const MB_PREP_T *prep, const void *owner, MB_DATA_T *mb_data)
+{
+    PTR_CHECK_N1(mb_data);
+
+    if (0 > mb_prep_check(prep, owner))
+    {
+        return -1;
+    }
+
+    /* the response is checked against the request header only */
+    memcpy(&mb_data->mb_info, &prep->mb_info, MB_INFO_HEAD_LEN);
+
+    return 0;
+}
+
 /*
  * Function  : show ModBus data in cache
  * mb_data   : ModBus data cache
@@ -11,6 +11,7 @@ typedef unsigned char       UINT8_T;
 typedef unsigned short      UINT16_T;
 typedef unsigned int        UINT32_T;
 typedef unsigned long long  UINT64_T;
+typedef long long           INT64_T;
 
 /* point check */
 #define PTR_CHECK_VOID(p)   \
@@ -45,6 +46,20 @@ typedef unsigned long long  UINT64_T;
 /* alignment X */
 #define ALIGNED(value, align) ((value + align - 1) / align)
 
+/* host byte order is fixed at compile time, the wire is big endian but for the RTU CRC and the MBAP transaction code(MB_HTOLE16) */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #define MB_HOST_BIG_ENDIAN 1
+    #define MB_HTOBE16(word)   ((UINT16_T)(word))
+    #define MB_HTOLE16(word)   __builtin_bswap16(word)
+#else
+    #define MB_HOST_BIG_ENDIAN 0
+    #define MB_HTOBE16(word)   __builtin_bswap16(word)
+    #define MB_HTOLE16(word)   ((UINT16_T)(word))
+#endif
+
+#define MB_BE16TOH(word) MB_HTOBE16(word)
+#define MB_LE16TOH(word) MB_HTOLE16(word)
+
 /* insert a byte to modbus data */
 #define MBDATA_BYTE_SET(mb_data, byte)                              \
 {                                                                   \
@@ -123,7 +138,10 @@ typedef enum
 typedef enum
 {
     MB_TYPE_TCP = 0,
-    MB_TYPE_RTU
+    MB_TYPE_RTU,
+    MB_TYPE_UNIX,               /* MBAP over AF_UNIX stream socket(tcp_ctrl.path) */
+    MB_TYPE_ASCII,              /* ModBus ASCII on the serial line of rtu_ctrl */
+    MB_TYPE_RTU_TCP             /* RTU frames over TCP to a serial device server, tcp_ctrl.unitid addresses the slaver */
 } MB_TYPE_T;
 
 typedef union
@@ -137,23 +155,46 @@ typedef union
     UINT16_T W1;
 } __attribute__((packed)) MB_WORD_T;
 
-#define MAX_MBVALUE_SIZE 2000 /* byte */
+#define MAX_MBVALUE_SIZE 250  /* byte, 125 registers or 2000 coils, the most a PDU holds */
+#define MB_EXCEPTION_PDU_LEN 2 /* code | 0x80, exception code */
+#define MB_WRITE_REG_MAX_NUM  123   /* registers of the longest FC10 write, 6 + 246 byte PDU */
+#define MB_WRITE_COIL_MAX_NUM 1968  /* coils of the longest FC0F write, 6 + 246 byte PDU */
 
 typedef struct 
 {
-    MB_CODE_T code;
-    MB_ERR_T  err;
+    UINT8_T   code;             /* MB_CODE_T */
+    UINT8_T   err;              /* MB_ERR_T */
     UINT16_T  reg;
     UINT16_T  n_reg;
     UINT8_T   n_byte;
-    UINT8_T   value[MAX_MBVALUE_SIZE];
+    UINT8_T   value[MAX_MBVALUE_SIZE]; /* FC01/02/0F coils 8 per byte, the first one in bit 0 */
 } __attribute__((packed)) MB_INFO_T;
 
+/* code, err, reg, n_reg, n_byte */
+#define MB_INFO_HEAD_LEN (sizeof(MB_INFO_T) - MAX_MBVALUE_SIZE)
+
+/* a response decapped in place, payload points into the cache and is valid until it is reused */
+typedef struct 
+{
+    UINT8_T        code;        /* function code of the response, 0x80 set for an exception */
+    UINT8_T        err;         /* exception code, 0=NONE */
+    UINT16_T       reg;         /* start address, echoed by FC05/06/0F/10, of the request otherwise */
+    UINT16_T       n_reg;       /* quantity, echoed by FC0F/10, of the request otherwise */
+    UINT16_T       len;         /* payload bytes */
+    const UINT8_T *payload;     /* FC01/02 coils 8 per byte, FC03/04 big endian registers, FC05/06 value */
+} MB_VIEW_T;
+
+/* registers of an FC03/04 view */
+#define MB_VIEW_REG_NUM(view) ((view)->len / 2)
+
+/* register i of an FC03/04 view, read from the wire bytes */
+#define MB_VIEW_REG(view, i)  ((UINT16_T)(((view)->payload[(i) * 2] << 8) | (view)->payload[((i) * 2) + 1]))
+
+/* coil i of an FC01/02 view */
+#define MB_VIEW_COIL(view, i) (((view)->payload[(i) >> 3] >> ((i) & 7)) & 1)
+
 typedef struct 
 {
-    /* data endian */
-    UINT8_T is_big_endian;
-    
     /* modbus info */
     MB_INFO_T mb_info;
 
@@ -165,6 +206,21 @@ typedef struct
     UINT8_T   data[0];
 } __attribute__((packed)) MB_DATA_T;
 
+#define MB_DATA_BUF_SIZE(size) (sizeof(MB_DATA_T) + (size))  /* byte, buffer of a cache with size bytes of data */
+
+#define MB_PREP_FRAME_SIZE 515  /* byte, the longest frame of any protocol, ':' + hex of 256 bytes + CRLF of ASCII */
+
+/* a request encoded once by a *_prepare() and sent as it is, such as a poll of every scan cycle */
+typedef struct 
+{
+    const void *owner;          /* context it was encoded for, it is sent on no other one */
+    MB_INFO_T   mb_info;        /* the request, only the header is kept, the response is checked against it */
+    UINT16_T    slaver_addr;    /* RTU/ASCII slaver address */
+    UINT16_T    check;          /* RTU CRC, ASCII LRC */
+    UINT16_T    len;            /* frame bytes */
+    UINT8_T     frame[MB_PREP_FRAME_SIZE]; /* MBAP(transaction code patched on send) or address + PDU + CRC/LRC */
+} MB_PREP_T;
+
 /*
  * Function  : little endian to big endian for word
  * value     : value to be converted
@@ -179,6 +235,30 @@ UINT16_T l2b_endian(UINT16_T value);
  */
 UINT16_T b2l_endian(UINT16_T value);
 
+/*
+ * Function  : big endian register bytes into host words, in place if regs is wire
+ * regs      : n words
+ * wire      : n * 2 bytes
+ * n         : register number
+ * return    : void
+ */
+void mb_reg_decode(UINT16_T *regs, const UINT8_T *wire, int n);
+
+/*
+ * Function  : host words into big endian register bytes, in place if wire is regs
+ * wire      : n * 2 bytes
+ * regs      : n words
+ * n         : register number
+ * return    : void
+ */
+void mb_reg_encode(UINT8_T *wire, const UINT16_T *regs, int n);
+
+/*
+ * Function  : monotonic clock in microseconds, used for I/O deadlines
+ * return    : current time(us)
+ */
+UINT64_T mb_time_us(void);
+
 /*
  * Function      : Create a cache for ModBus data transmission and reception
  * max_data_size : size of cache
@@ -186,6 +266,14 @@ UINT16_T b2l_endian(UINT16_T value);
  */
 MB_DATA_T *mb_data_create(UINT32_T max_data_size);
 
+/*
+ * Function      : init a cache in a buffer of the caller, such as one on the stack
+ * buf           : buffer, MB_DATA_BUF_SIZE(max_data_size) bytes
+ * max_data_size : size of cache
+ * return        : (MB_DATA_T *)=SUCCESS NULL=ERROR
+ */
+MB_DATA_T *mb_data_init(void *buf, UINT32_T max_data_size);
+
 /*
  * Function : destory the ModBus cache
  * mb_data  : the ModBus cache you want to destory
@@ -200,6 +288,46 @@ void mb_data_destory(MB_DATA_T *mb_data);
  */
 void mb_data_clear(MB_DATA_T *mb_data);
 
+/*
+ * Function : value bytes a request or response uses, the rest of value is not looked at
+ * mb_info  : request or response
+ * return   : length
+ */
+UINT16_T mb_info_value_len(MB_INFO_T *mb_info);
+
+/*
+ * Function : copy a request or response, its header and only the value bytes it uses
+ * dst      : destination
+ * src      : source
+ * return   : void
+ */
+void mb_info_copy(MB_INFO_T *dst, MB_INFO_T *src);
+
+/*
+ * Function : registers of an FC03/04 response into host words
+ * mb_info  : response
+ * regs     : n_byte / 2 words
+ * return   : register number
+ */
+int mb_info_reg_get(const MB_INFO_T *mb_info, UINT16_T *regs);
+
+/*
+ * Function : registers of an FC10 request from host words, sets n_reg, n_byte and value
+ * mb_info  : request
+ * regs     : n words
+ * n        : register number, at most MB_WRITE_REG_MAX_NUM
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int mb_info_reg_set(MB_INFO_T *mb_info, const UINT16_T *regs, UINT16_T n);
+
+/*
+ * Function : registers of an FC03/04 view into host words
+ * view     : response view
+ * regs     : MB_VIEW_REG_NUM(view) words
+ * return   : register number
+ */
+int mb_view_reg_get(const MB_VIEW_T *view, UINT16_T *regs);
+
 /*
  * Function : encap the Modbus PDU
  * mb_data  : ModBus cache
@@ -214,6 +342,84 @@ void mb_data_encap(MB_DATA_T *mb_data);
  */
 void mb_data_decap(MB_DATA_T *mb_data);
 
+/*
+ * Function : decap a response PDU in place, nothing is copied, mb_info still holds the request
+ *            and gives start address and quantity of reads, the PDU length is checked
+ * mb_data  : ModBus cache, the PDU starts at offset, which is moved behind it
+ * view     : the response
+ * return   : 0=SUCCESS -1=ERROR(truncated PDU or unknown function code)
+ */
+int mb_view_decap(MB_DATA_T *mb_data, MB_VIEW_T *view);
+
+/*
+ * Function : decap a response PDU into mb_info, or in place when a view is given
+ * mb_data  : ModBus cache
+ * view     : the response, NULL=into mb_info
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int mb_response_decap(MB_DATA_T *mb_data, MB_VIEW_T *view);
+
+/*
+ * Function : decap a ModBus request PDU on the slaver side, 
+ *            FC05/06 value and FC0F/10 values are kept as on the wire
+ * mb_data  : ModBus cache, the PDU starts at offset
+ * return   : 0=SUCCESS -1=ERROR(mb_info.err holds the exception code)
+ */
+int mb_request_decap(MB_DATA_T *mb_data);
+
+/*
+ * Function : encap a ModBus response PDU on the slaver side, mb_info.err != 0 
+ *            makes an exception response
+ * mb_data  : ModBus cache, the PDU is appended at data_len
+ * return   : void
+ */
+void mb_response_encap(MB_DATA_T *mb_data);
+
+/*
+ * Function : length of the normal response PDU to a request, 
+ *            an exception response PDU is always MB_EXCEPTION_PDU_LEN
+ * mb_info  : request
+ * return   : length, 0=UNKNOWN FUNCTION CODE
+ */
+UINT16_T mb_response_pdu_len(MB_INFO_T *mb_info);
+
+/*
+ * Function : length of a request PDU from its first bytes
+ * pdu      : received PDU bytes, function code first
+ * len      : received length
+ * return   : length, 0=NEED MORE BYTES -1=UNKNOWN FUNCTION CODE
+ */
+int mb_request_pdu_len(UINT8_T *pdu, UINT16_T len);
+
+/*
+ * Function : keep an encoded frame as a prepared request
+ * prep     : prepared request
+ * owner    : context the frame is encoded for
+ * mb_info  : the request
+ * frame    : the frame
+ * len      : frame length
+ * return   : 0=SUCCESS -1=ERROR(frame too long)
+ */
+int mb_prep_save(MB_PREP_T *prep, const void *owner, const MB_INFO_T *mb_info, const UINT8_T *frame, UINT16_T len);
+
+/*
+ * Function : check a prepared request can be sent on a context
+ * prep     : prepared request
+ * owner    : context to send it on
+ * return   : 0=SUCCESS -1=ERROR(not prepared or prepared for another context)
+ */
+int mb_prep_check(const MB_PREP_T *prep, const void *owner);
+
+/*
+ * Function : put the request header of a prepared request into mb_info of the cache,
+ *            the response is checked against it, the frame is sent from prep as it is
+ * prep     : prepared request
+ * owner    : context to send it on
+ * mb_data  : ModBus cache of the context
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int mb_prep_load(const MB_PREP_T *prep, const void *owner, MB_DATA_T *mb_data);
+
 /*
  * Function  : show ModBus data in cache
  * mb_data   : ModBus data cache
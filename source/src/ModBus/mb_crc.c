@@ -0,0 +1,342 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus CRC16(poly 0xA001 reflected, init 0xffff)
+ *            2. Bitwise, table, slicing-by-8 and PCLMULQDQ folding variants,
+ *               the fastest one verified against bitwise is chosen at run time
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MBCRC_HAVE_CLMUL
+#endif
+
+#include "mb_crc.h"
+
+#define MBCRC_CHECK_LEN 512   /* lengths 0..MBCRC_CHECK_LEN are verified */
+
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static UINT16_T crc_table[8][256];
+
+/* the last one passing verification in this order is used */
+static mb_crc16_fn_t crc_fn[MBCRC_IMPL_NUM];
+static MBCRC_IMPL_T  crc_impl = MBCRC_BITWISE;
+
+static const char *crc_name[MBCRC_IMPL_NUM] = {
+    [MBCRC_BITWISE] = "bitwise",
+    [MBCRC_TABLE]   = "table",
+    [MBCRC_SLICE8]  = "slice8",
+    [MBCRC_CLMUL]   = "clmul",
+};
+
+#ifdef MBCRC_HAVE_CLMUL
+/* fold constants, x^n mod P stored as 64 bit reflected values */
+static __m128i crc_fold_16;    /* 16 bytes forward */
+static __m128i crc_fold_64;    /* 64 bytes forward */
+#endif
+
+static UINT16_T crc16_bitwise(const UINT8_T *data, int data_len)
+{
+    int i   = 0;
+    int j   = 0;
+    int crc = MBCRC_INIT;
+
+    /* every byte */
+    for (i = 0; i < data_len; ++i)
+    {
+        crc ^= data[i];
+
+        /* every bit */
+        for (j = 0; j < 8; j++)
+        {
+            if (crc & 0x0001)
+            {
+                crc = (crc >> 1) ^ MBCRC_POLY;
+            }
+            else
+            {
+                crc = (crc >> 1);
+            }
+        }
+    }
+
+    return crc;
+}
+
+static UINT16_T crc16_table_update(UINT16_T crc, const UINT8_T *data, int data_len)
+{
+    int i = 0;
+
+    for (i = 0; i < data_len; ++i)
+    {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ data[i]) & 0xff];
+    }
+
+    return crc;
+}
+
+static UINT16_T crc16_table(const UINT8_T *data, int data_len)
+{
+    return crc16_table_update(MBCRC_INIT, data, data_len);
+}
+
+static UINT16_T crc16_slice8(const UINT8_T *data, int data_len)
+{
+    UINT16_T crc = MBCRC_INIT;
+    UINT16_T low = 0;
+
+    /* the 16 bit state is folded into the first 2 bytes of every 8 */
+    while (data_len >= 8)
+    {
+        low = crc ^ (data[0] | (data[1] << 8));
+        crc = crc_table[7][low & 0xff] ^ crc_table[6][low >> 8] ^
+              crc_table[5][data[2]]    ^ crc_table[4][data[3]] ^
+              crc_table[3][data[4]]    ^ crc_table[2][data[5]] ^
+              crc_table[1][data[6]]    ^ crc_table[0][data[7]];
+
+        data     += 8;
+        data_len -= 8;
+    }
+
+    return crc16_table_update(crc, data, data_len);
+}
+
+#ifdef MBCRC_HAVE_CLMUL
+/*
+ * Function  : x^n mod P(x), P(x) = x^16 + x^15 + x^2 + 1
+ * return    : remainder, bit i is the coefficient of x^i
+ */
+static UINT32_T crc_xpow_mod(int n)
+{
+    UINT32_T r = 1;
+
+    while (n--)
+    {
+        r <<= 1;
+        if (r & 0x10000)
+        {
+            r ^= 0x18005;
+        }
+    }
+
+    return r;
+}
+
+/*
+ * Function  : a remainder as the reflected 64 bit multiplier of PCLMULQDQ,
+ *             the coefficient of x^i goes to bit 63-i
+ * return    : multiplier
+ */
+static UINT64_T crc_reflect64(UINT32_T r)
+{
+    UINT64_T k = 0;
+    int i = 0;
+
+    for (i = 0; i < 16; ++i)
+    {
+        if (r & (1 << i))
+        {
+            k |= 1ULL << (63 - i);
+        }
+    }
+
+    return k;
+}
+
+/*
+ * Function  : fold a 128 bit remainder forward, the low qword holds the higher
+ *             degrees in reflected order, so it needs x^(64+n-1) and the high qword x^(n-1),
+ *             the extra -1 makes up for the reflected product being one bit short
+ * n         : fold distance in bits
+ * return    : constants, low qword for the low qword
+ */
+static __m128i crc_fold_const(int n)
+{
+    return _mm_set_epi64x((long long)crc_reflect64(crc_xpow_mod(n - 1)),
+                          (long long)crc_reflect64(crc_xpow_mod(n + 63)));
+}
+
+__attribute__((target("pclmul,sse2")))
+static inline __m128i crc_fold(__m128i x, __m128i k, __m128i next)
+{
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+
+    return _mm_xor_si128(_mm_xor_si128(lo, hi), next);
+}
+
+/*
+ * Function  : fold 64 bytes per step in 4 lanes, then the lanes into one, and 16 bytes per step,
+ *             the folded 16 bytes have the CRC of the message, finished by the table
+ * return    : checksum
+ */
+__attribute__((target("pclmul,sse2")))
+static UINT16_T crc16_clmul(const UINT8_T *data, int data_len)
+{
+    __m128i  x0, x1, x2, x3;
+    UINT8_T  rest[16];
+    UINT16_T crc = 0;
+
+    /* not worth a fold */
+    if (data_len < 64)
+    {
+        return crc16_slice8(data, data_len);
+    }
+
+    /* init value goes into the first 2 bytes, the CRC register is 0 from now on */
+    x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), _mm_cvtsi32_si128(MBCRC_INIT));
+    x1 = _mm_loadu_si128((const __m128i *)(data + 16));
+    x2 = _mm_loadu_si128((const __m128i *)(data + 32));
+    x3 = _mm_loadu_si128((const __m128i *)(data + 48));
+    data     += 64;
+    data_len -= 64;
+
+    while (data_len >= 64)
+    {
+        x0 = crc_fold(x0, crc_fold_64, _mm_loadu_si128((const __m128i *)data));
+        x1 = crc_fold(x1, crc_fold_64, _mm_loadu_si128((const __m128i *)(data + 16)));
+        x2 = crc_fold(x2, crc_fold_64, _mm_loadu_si128((const __m128i *)(data + 32)));
+        x3 = crc_fold(x3, crc_fold_64, _mm_loadu_si128((const __m128i *)(data + 48)));
+        data     += 64;
+        data_len -= 64;
+    }
+
+    x0 = crc_fold(x0, crc_fold_16, x1);
+    x0 = crc_fold(x0, crc_fold_16, x2);
+    x0 = crc_fold(x0, crc_fold_16, x3);
+
+    while (data_len >= 16)
+    {
+        x0 = crc_fold(x0, crc_fold_16, _mm_loadu_si128((const __m128i *)data));
+        data     += 16;
+        data_len -= 16;
+    }
+
+    _mm_storeu_si128((__m128i *)rest, x0);
+    crc = crc16_table_update(0, rest, sizeof(rest));
+
+    return crc16_table_update(crc, data, data_len);
+}
+#endif
+
+/*
+ * Function  : check a variant against bitwise on every length up to MBCRC_CHECK_LEN
+ * return    : 0=SAME -1=DIFFERENT
+ */
+static int crc_verify(mb_crc16_fn_t fn, const UINT8_T *buf)
+{
+    int len = 0;
+
+    for (len = 0; len <= MBCRC_CHECK_LEN; ++len)
+    {
+        if (fn(buf, len) != crc16_bitwise(buf, len) ||
+            fn(buf + 1, len) != crc16_bitwise(buf + 1, len))
+        {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void crc_setup(void)
+{
+    UINT8_T  buf[MBCRC_CHECK_LEN + 1];
+    UINT32_T seed = 0x12345678;
+    UINT16_T crc  = 0;
+    int i = 0;
+    int j = 0;
+    int k = 0;
+
+    /* CRC of byte i, then of byte i followed by k zero bytes */
+    for (i = 0; i < 256; ++i)
+    {
+        crc = i;
+        for (j = 0; j < 8; ++j)
+        {
+            crc = (crc & 0x0001) ? ((crc >> 1) ^ MBCRC_POLY) : (crc >> 1);
+        }
+        crc_table[0][i] = crc;
+    }
+
+    for (k = 1; k < 8; ++k)
+    {
+        for (i = 0; i < 256; ++i)
+        {
+            crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^ crc_table[0][crc_table[k - 1][i] & 0xff];
+        }
+    }
+
+    for (i = 0; i < (int)sizeof(buf); ++i)
+    {
+        seed   = seed * 1103515245 + 12345;
+        buf[i] = (UINT8_T)(seed >> 16);
+    }
+
+    crc_fn[MBCRC_BITWISE] = crc16_bitwise;
+    crc_fn[MBCRC_TABLE]   = crc16_table;
+    crc_fn[MBCRC_SLICE8]  = crc16_slice8;
+
+#ifdef MBCRC_HAVE_CLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul"))
+    {
+        crc_fold_16 = crc_fold_const(128);
+        crc_fold_64 = crc_fold_const(512);
+        crc_fn[MBCRC_CLMUL] = crc16_clmul;
+    }
+#endif
+
+    for (i = MBCRC_TABLE; i < MBCRC_IMPL_NUM; ++i)
+    {
+        if (!crc_fn[i])
+        {
+            continue;
+        }
+
+        if (0 > crc_verify(crc_fn[i], buf))
+        {
+            printf("CRC variant %s differs from bitwise, not used\n", crc_name[i]);
+            crc_fn[i] = NULL;
+            continue;
+        }
+
+        crc_impl = i;
+    }
+}
+
+UINT16_T mb_crc16(const UINT8_T *data, int data_len)
+{
+    pthread_once(&crc_once, crc_setup);
+
+    return crc_fn[crc_impl](data, data_len);
+}
+
+mb_crc16_fn_t mb_crc16_get(MBCRC_IMPL_T impl)
+{
+    if (MBCRC_IMPL_NUM <= impl)
+    {
+        return NULL;
+    }
+
+    pthread_once(&crc_once, crc_setup);
+
+    return crc_fn[impl];
+}
+
+MBCRC_IMPL_T mb_crc16_impl(void)
+{
+    pthread_once(&crc_once, crc_setup);
+
+    return crc_impl;
+}
+
+const char *mb_crc16_name(MBCRC_IMPL_T impl)
+{
+    return (MBCRC_IMPL_NUM > impl) ? crc_name[impl] : "unknown";
+}
@@ -0,0 +1,55 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus CRC16(poly 0xA001 reflected, init 0xffff)
+ *            2. Bitwise, table, slicing-by-8 and PCLMULQDQ folding variants,
+ *               the fastest one verified against bitwise is chosen at run time
+ */
+
+#ifndef MB_CRC
+#define MB_CRC
+
+#include "mb_common.h"
+
+#define MBCRC_INIT  0xffff
+#define MBCRC_POLY  0xA001    /* x^16 + x^15 + x^2 + 1, reflected */
+
+typedef enum
+{
+    MBCRC_BITWISE = 0,        /* reference, 8 iterations per byte */
+    MBCRC_TABLE,              /* 256 entry table, 1 byte per step */
+    MBCRC_SLICE8,             /* 8 tables of 256 entries, 8 bytes per step */
+    MBCRC_CLMUL,              /* PCLMULQDQ folding, 64 bytes per step, x86 only */
+    MBCRC_IMPL_NUM
+} MBCRC_IMPL_T;
+
+typedef UINT16_T (*mb_crc16_fn_t)(const UINT8_T *data, int data_len);
+
+/*
+ * Function  : calculate the ModBus CRC checksum with the chosen variant
+ * data      : data used to calculate checksum
+ * data_len  : data length used to calculate checksum
+ * return    : checksum
+ */
+UINT16_T mb_crc16(const UINT8_T *data, int data_len);
+
+/*
+ * Function  : get one variant of the CRC calculation
+ * impl      : variant
+ * return    : (mb_crc16_fn_t)=SUCCESS NULL=NOT SUPPORTED BY THE CPU OR FAILED VERIFICATION
+ */
+mb_crc16_fn_t mb_crc16_get(MBCRC_IMPL_T impl);
+
+/*
+ * Function  : variant used by mb_crc16
+ * return    : variant
+ */
+MBCRC_IMPL_T mb_crc16_impl(void);
+
+/*
+ * Function  : name of a variant
+ * impl      : variant
+ * return    : name
+ */
+const char *mb_crc16_name(MBCRC_IMPL_T impl);
+
+#endif
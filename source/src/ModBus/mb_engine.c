@@ -0,0 +1,425 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Drive many ModBus TCP connections from one epoll loop
+ *            2. Hand responses of every connection to callbacks
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "mb_engine.h"
+
+/*
+ * Function  : keep the connection socket registered, it changes after a re-connect
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int mbeng_conn_watch(MBENG_CTX_T *mbeng_ctx, int id)
+{
+    MBENG_CONN_T *conn = &mbeng_ctx->conn[id];
+    MBTCP_DESC_T *desc = &conn->mbtcp_ctx->mb_tcp_desc;
+    struct epoll_event event = {0};
+    int sock = desc->socket;
+
+    /* a re-connected socket may reuse the number of the closed one */
+    if (0 <= conn->fd && conn->link_seq == desc->link_seq)
+    {
+        return 0;
+    }
+
+    if (0 <= conn->fd)
+    {
+        epoll_ctl(mbeng_ctx->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    }
+
+    event.events   = EPOLLIN;
+    event.data.u32 = id;
+
+    if (0 > epoll_ctl(mbeng_ctx->epfd, EPOLL_CTL_ADD, sock, &event))
+    {
+        perror("epoll_ctl error");
+        conn->fd = -1;
+        return -1;
+    }
+
+    conn->fd       = sock;
+    conn->link_seq = desc->link_seq;
+
+    return 0;
+}
+
+/*
+ * Function  : stop watching a broken connection, level triggered epoll would spin on it
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : void
+ */
+static void mbeng_conn_unwatch(MBENG_CTX_T *mbeng_ctx, int id)
+{
+    MBENG_CONN_T *conn = &mbeng_ctx->conn[id];
+
+    if (0 <= conn->fd)
+    {
+        epoll_ctl(mbeng_ctx->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+        conn->fd = -1;
+    }
+}
+
+typedef struct 
+{
+    MBENG_CTX_T *mbeng_ctx;
+    int          id;
+} MBENG_DROP_T;
+
+/*
+ * Function  : report a dropped transaction to the connection callback
+ * return    : void
+ */
+static void mbeng_trans_drop(MBTCP_CTX_T *mbtcp_ctx, UINT16_T transaction_code, void *arg)
+{
+    MBENG_DROP_T *drop = (MBENG_DROP_T *)arg;
+    MBENG_CONN_T *conn = &drop->mbeng_ctx->conn[drop->id];
+
+    conn->cb(drop->mbeng_ctx, drop->id, transaction_code, NULL, conn->arg);
+}
+
+/*
+ * Function  : drop outstanding transactions of a connection and report them
+ * now       : current time(us), MBTCP_TIME_ALL=drop all of them
+ * return    : void
+ */
+static void mbeng_conn_expire(MBENG_CTX_T *mbeng_ctx, int id, UINT64_T now)
+{
+    MBENG_DROP_T drop = {
+        .mbeng_ctx = mbeng_ctx,
+        .id        = id
+    };
+
+    mb_tcp_expire(mbeng_ctx->conn[id].mbtcp_ctx, now, mbeng_trans_drop, &drop);
+}
+
+/*
+ * Function  : send one request on a connection
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int mbeng_conn_send(MBENG_CTX_T *mbeng_ctx, int id, MB_INFO_T *mb_info)
+{
+    MBENG_CONN_T *conn = &mbeng_ctx->conn[id];
+
+    mbtcpctx_info_updata(conn->mbtcp_ctx, mb_info);
+
+    if (0 >= mb_tcp_send(conn->mbtcp_ctx))
+    {
+        /* link down or re-connecting, it fails fast until the link is up again */
+        if (MBTCP_LINK_UP != conn->mbtcp_ctx->mb_tcp_desc.link)
+        {
+            mbeng_conn_unwatch(mbeng_ctx, id);
+        }
+        return -1;
+    }
+
+    return mbeng_conn_watch(mbeng_ctx, id);
+}
+
+/*
+ * Function  : whether a request can go out now, a partial response shares the cache with it
+ * return    : 1=YES 0=NO
+ */
+static int mbeng_conn_ready(MBENG_CONN_T *conn)
+{
+    MBTCP_DATA_T *mbtcp_data = &conn->mbtcp_ctx->mb_tcp_data;
+
+    return (!mbtcp_data->rx_len && mbtcp_data->pending < mbtcp_data->window);
+}
+
+/*
+ * Function  : send queued requests while the transaction window has room
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : void
+ */
+static void mbeng_queue_flush(MBENG_CTX_T *mbeng_ctx, int id)
+{
+    MBENG_CONN_T *conn    = &mbeng_ctx->conn[id];
+    MB_INFO_T    *mb_info = NULL;
+
+    while (conn->q_num && mbeng_conn_ready(conn))
+    {
+        mb_info = conn->queue[conn->q_head];
+        conn->q_head = (conn->q_head + 1) % MBENG_QUEUE_SIZE;
+        conn->q_num--;
+
+        if (0 > mbeng_conn_send(mbeng_ctx, id, mb_info))
+        {
+            conn->cb(mbeng_ctx, id, 0, NULL, conn->arg);
+        }
+    }
+}
+
+/*
+ * Function  : read every complete response buffered on a connection
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : number of responses dispatched
+ */
+static int mbeng_conn_recv(MBENG_CTX_T *mbeng_ctx, int id)
+{
+    MBENG_CONN_T *conn = &mbeng_ctx->conn[id];
+    MBTCP_CTX_T  *mbtcp_ctx = conn->mbtcp_ctx;
+    int ret  = 0;
+    int done = 0;
+
+    while (0 != (ret = mb_tcp_recv_nb(mbtcp_ctx)))
+    {
+        if (0 < ret)
+        {
+            conn->cb(mbeng_ctx, id, mbtcpctx_tid_get(mbtcp_ctx, MB_RX),
+                &mbtcp_ctx->mb_tcp_data.mb_data->mb_info, conn->arg);
+            done++;
+        }
+        else if (EBADMSG == errno)
+        {
+            /* a bad response is consumed, the stream goes on */
+            conn->cb(mbeng_ctx, id, mbtcpctx_tid_get(mbtcp_ctx, MB_RX), NULL, conn->arg);
+        }
+        else
+        {
+            /* a broken stream loses every response still in flight */
+            mbeng_conn_unwatch(mbeng_ctx, id);
+            mbeng_conn_expire(mbeng_ctx, id, MBTCP_TIME_ALL);
+            mbeng_queue_flush(mbeng_ctx, id);
+            break;
+        }
+
+        mbeng_queue_flush(mbeng_ctx, id);
+    }
+
+    return done;
+}
+
+/*
+ * Function  : Create a ModBus engine, one engine belongs to one thread,
+ *             run one engine per core to spread connections over cores
+ * max_conn  : max connection number
+ * return    : (MBENG_CTX_T *)=SUCCESS NULL=ERROR
+ */
+MBENG_CTX_T *mb_engine_create(int max_conn)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    MBENG_CTX_T *mbeng_ctx = NULL;
+
+    if (0 >= max_conn)
+    {
+        return NULL;
+    }
+
+    mbeng_ctx = (MBENG_CTX_T *)malloc(sizeof(MBENG_CTX_T));
+    if (!mbeng_ctx)
+    {
+        printf("Can not create a modbus engine\n");
+        return NULL;
+    }
+    memset(mbeng_ctx, 0, sizeof(MBENG_CTX_T));
+
+    mbeng_ctx->conn   = (MBENG_CONN_T *)calloc(max_conn, sizeof(MBENG_CONN_T));
+    mbeng_ctx->events = (struct epoll_event *)calloc(MBENG_EVENT_NUM, sizeof(struct epoll_event));
+    mbeng_ctx->epfd   = epoll_create1(EPOLL_CLOEXEC);
+
+    if (!mbeng_ctx->conn || !mbeng_ctx->events || 0 > mbeng_ctx->epfd)
+    {
+        printf("Can not create a modbus engine\n");
+        mb_engine_destory(mbeng_ctx);
+        return NULL;
+    }
+
+    mbeng_ctx->max_conn = max_conn;
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbeng_ctx;
+}
+
+/*
+ * Function  : destory a ModBus engine, connections are not closed
+ * mbeng_ctx : ModBus engine
+ * return    : void
+ */
+void mb_engine_destory(MBENG_CTX_T *mbeng_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mbeng_ctx);
+
+    if (0 <= mbeng_ctx->epfd)
+    {
+        close(mbeng_ctx->epfd);
+    }
+
+    free(mbeng_ctx->events);
+    free(mbeng_ctx->conn);
+    free(mbeng_ctx);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+/*
+ * Function  : hand a connected ModBus TCP context to the engine
+ * mbeng_ctx : ModBus engine
+ * mbtcp_ctx : ModBus TCP context, owned by caller
+ * cb        : result callback of every request on this connection
+ * return    : connection id=SUCCESS -1=ERROR
+ */
+int mb_engine_add(MBENG_CTX_T *mbeng_ctx, MBTCP_CTX_T *mbtcp_ctx, mbeng_cb_t cb, void *arg)
+{
+    PTR_CHECK_N1(mbeng_ctx);
+    PTR_CHECK_N1(mbtcp_ctx);
+    PTR_CHECK_N1(cb);
+
+    int id = mbeng_ctx->n_conn;
+
+    /* epoll and io_uring can not share a socket */
+    if (mbtcp_ctx->mb_tcp_desc.uring)
+    {
+        printf("modbus engine drives poll backend connections only\n");
+        return -1;
+    }
+
+    if (id >= mbeng_ctx->max_conn)
+    {
+        printf("modbus engine is full(%d)\n", mbeng_ctx->max_conn);
+        return -1;
+    }
+
+    memset(&mbeng_ctx->conn[id], 0, sizeof(MBENG_CONN_T));
+    mbeng_ctx->conn[id].mbtcp_ctx = mbtcp_ctx;
+    mbeng_ctx->conn[id].cb        = cb;
+    mbeng_ctx->conn[id].arg       = arg;
+    mbeng_ctx->conn[id].fd        = -1;
+
+    if (0 > mbeng_conn_watch(mbeng_ctx, id))
+    {
+        return -1;
+    }
+
+    if (mbtcp_ctx->mb_tcp_data.txq)
+    {
+        mbeng_ctx->n_batch++;
+    }
+
+    return mbeng_ctx->n_conn++;
+}
+
+/*
+ * Function  : send a request on a connection, it is queued while the transaction window is full,
+ *             mb_info must stay valid until it has been sent
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_engine_submit(MBENG_CTX_T *mbeng_ctx, int id, MB_INFO_T *mb_info)
+{
+    PTR_CHECK_N1(mbeng_ctx);
+    PTR_CHECK_N1(mb_info);
+
+    MBENG_CONN_T *conn = NULL;
+
+    if (0 > id || id >= mbeng_ctx->n_conn)
+    {
+        return -1;
+    }
+    conn = &mbeng_ctx->conn[id];
+
+    if (!conn->q_num && mbeng_conn_ready(conn))
+    {
+        return mbeng_conn_send(mbeng_ctx, id, mb_info);
+    }
+
+    if (MBENG_QUEUE_SIZE <= conn->q_num)
+    {
+        return -1;
+    }
+
+    conn->queue[(conn->q_head + conn->q_num) % MBENG_QUEUE_SIZE] = mb_info;
+    conn->q_num++;
+
+    return 0;
+}
+
+/*
+ * Function  : send the gathered requests, then wait for responses once and 
+ *             dispatch them to callbacks
+ * mbeng_ctx : ModBus engine
+ * timeout   : max wait time(ms), -1=until an event
+ * return    : number of responses dispatched, -1=ERROR
+ */
+int mb_engine_run(MBENG_CTX_T *mbeng_ctx, int timeout)
+{
+    PTR_CHECK_N1(mbeng_ctx);
+
+    int i     = 0;
+    int ready = 0;
+    int done  = 0;
+    UINT64_T now  = 0;
+    INT64_T  wait = 0;
+
+    /* wake up in time to expire lost responses */
+    wait = ALIGNED((INT64_T)(mbeng_ctx->next_expire - mb_time_us()), 1000);
+    if (0 > wait)
+    {
+        wait = 0;
+    }
+    if (0 > timeout || timeout > wait)
+    {
+        timeout = wait;
+    }
+
+    /* end of the scan cycle, every gathered request goes out */
+    for (i = 0; mbeng_ctx->n_batch && i < mbeng_ctx->n_conn; ++i)
+    {
+        if (0 > mb_tcp_flush(mbeng_ctx->conn[i].mbtcp_ctx))
+        {
+            mbeng_conn_unwatch(mbeng_ctx, i);
+            mbeng_conn_expire(mbeng_ctx, i, MBTCP_TIME_ALL);
+        }
+    }
+
+    ready = epoll_wait(mbeng_ctx->epfd, mbeng_ctx->events, MBENG_EVENT_NUM, timeout);
+    if (0 > ready)
+    {
+        if (EINTR == errno)
+        {
+            return 0;
+        }
+
+        perror("epoll_wait error");
+        return -1;
+    }
+
+    for (i = 0; i < ready; ++i)
+    {
+        done += mbeng_conn_recv(mbeng_ctx, mbeng_ctx->events[i].data.u32);
+    }
+
+    now = mb_time_us();
+    if (now >= mbeng_ctx->next_expire)
+    {
+        for (i = 0; i < mbeng_ctx->n_conn; ++i)
+        {
+            if (mbeng_ctx->conn[i].mbtcp_ctx->mb_tcp_data.pending)
+            {
+                mbeng_conn_expire(mbeng_ctx, i, now);
+                mbeng_queue_flush(mbeng_ctx, i);
+            }
+        }
+        mbeng_ctx->next_expire = now + MBENG_EXPIRE_INTERVAL;
+    }
+
+    return done;
+}
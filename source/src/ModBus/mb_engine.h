@@ -0,0 +1,96 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Drive many ModBus TCP connections from one epoll loop
+ *            2. Hand responses of every connection to callbacks
+ */
+
+#ifndef MB_ENGINE
+#define MB_ENGINE
+
+#include <sys/epoll.h>
+
+#include "mb_tcp.h"
+
+#define MBENG_EVENT_NUM       256
+#define MBENG_QUEUE_SIZE      64
+#define MBENG_EXPIRE_INTERVAL 10000 /* us */
+
+typedef struct mbeng_ctx MBENG_CTX_T;
+
+/*
+ * Function  : result of one request
+ * id        : connection id returned by mb_engine_add
+ * transaction_code : transaction code of the request
+ * mb_info   : decapped response, valid only during the call, NULL=TIMEOUT/ERROR
+ */
+typedef void (*mbeng_cb_t)(MBENG_CTX_T *mbeng_ctx, int id, UINT16_T transaction_code, 
+    MB_INFO_T *mb_info, void *arg);
+
+typedef struct 
+{
+    MBTCP_CTX_T *mbtcp_ctx;
+    mbeng_cb_t   cb;
+    void        *arg;
+    int          fd;            /* socket registered in epoll, -1=NOT REGISTERED */
+    UINT32_T     link_seq;      /* connection the registered socket belongs to */
+
+    /* requests waiting for the transaction window */
+    MB_INFO_T   *queue[MBENG_QUEUE_SIZE];
+    UINT16_T     q_head;
+    UINT16_T     q_num;
+} MBENG_CONN_T;
+
+struct mbeng_ctx
+{
+    int           epfd;
+    int           n_conn;
+    int           max_conn;
+    int           n_batch;      /* connections gathering requests in a send queue */
+    UINT64_T      next_expire;
+    MBENG_CONN_T *conn;
+    struct epoll_event *events;
+};
+
+/*
+ * Function  : Create a ModBus engine, one engine belongs to one thread,
+ *             run one engine per core to spread connections over cores
+ * max_conn  : max connection number
+ * return    : (MBENG_CTX_T *)=SUCCESS NULL=ERROR
+ */
+MBENG_CTX_T *mb_engine_create(int max_conn);
+
+/*
+ * Function  : destory a ModBus engine, connections are not closed
+ * mbeng_ctx : ModBus engine
+ * return    : void
+ */
+void mb_engine_destory(MBENG_CTX_T *mbeng_ctx);
+
+/*
+ * Function  : hand a connected ModBus TCP context to the engine
+ * mbeng_ctx : ModBus engine
+ * mbtcp_ctx : ModBus TCP context, owned by caller
+ * cb        : result callback of every request on this connection
+ * return    : connection id=SUCCESS -1=ERROR
+ */
+int mb_engine_add(MBENG_CTX_T *mbeng_ctx, MBTCP_CTX_T *mbtcp_ctx, mbeng_cb_t cb, void *arg);
+
+/*
+ * Function  : send a request on a connection, it is queued while the transaction window is full,
+ *             mb_info must stay valid until it has been sent
+ * mbeng_ctx : ModBus engine
+ * id        : connection id
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_engine_submit(MBENG_CTX_T *mbeng_ctx, int id, MB_INFO_T *mb_info);
+
+/*
+ * Function  : send the gathered requests, then wait for responses once and 
+ *             dispatch them to callbacks
+ * mbeng_ctx : ModBus engine
+ * timeout   : max wait time(ms), -1=until an event
+ * return    : number of responses dispatched, -1=ERROR
+ */
+int mb_engine_run(MBENG_CTX_T *mbeng_ctx, int timeout);
+
+#endif
@@ -7,9 +7,32 @@
 #include <termios.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <asm/ioctls.h>
 
 #include "mb_rtu.h"
 
+/* struct termios2 of asm/termbits.h, that header clashes with termios.h */
+struct termios2
+{
+    tcflag_t c_iflag;
+    tcflag_t c_oflag;
+    tcflag_t c_cflag;
+    tcflag_t c_lflag;
+    cc_t     c_line;
+    cc_t     c_cc[19];
+    speed_t  c_ispeed;
+    speed_t  c_ospeed;
+};
+
+#ifndef BOTHER
+#define BOTHER CBAUDEX
+#endif
+
+/* input rate bits, 0=same as output */
+#ifndef IBSHIFT
+#define IBSHIFT 16
+#endif
+
 static void mbrtu_slaveaddr_encap(MBRTU_DATA_T *mb_rtu_data)
 {
     PTR_CHECK_VOID(mb_rtu_data);
@@ -38,51 +61,12 @@ static int mbrtu_slaveaddr_decap_check(MBRTU_DATA_T *mb_rtu_data)
     return 0;
 }
 
-/*
- * Function  : calculate CRC checksum
- * data      : data used to calculate checksum
- * mb_data   : data length used to calculate checksum
- * return    : checksum
- */
-static UINT16_T crc_calc(UINT8_T *data, int data_len)
-{
-    int i   = 0;
-    int j   = 0;
-    int crc = 0xffff;
-
-    /* every byte */
-    for (i = 0; i < data_len; ++i)
-    {
-        crc ^= data[i];
-
-        /* every bit */
-        for (j = 0; j < 8; j++)
-        {
-            if (crc & 0x0001)
-            {
-                crc = (crc >> 1) ^ 0xA001;
-            }
-            else
-            {
-                crc = (crc >> 1);
-            }
-        }
-    }
-
-    return crc;
-}
-
 static void mbrtu_crc_encap(MBRTU_DATA_T *mb_rtu_data)
 {
     PTR_CHECK_VOID(mb_rtu_data);
 
     MB_DATA_T *mb_data = mb_rtu_data->mb_data;
-    UINT16_T crc = crc_calc(mb_data->data, mb_data->data_len);
-
-    if (!mb_data->is_big_endian)
-    {
-        crc = b2l_endian(crc);
-    }
+    UINT16_T crc = MB_HTOLE16(mb_crc16(mb_data->data, mb_data->data_len));
 
     MBDATA_WORD_SET(mb_data, crc);
 
@@ -96,17 +80,13 @@ static int mbrtu_crc_decap_check(MBRTU_DATA_T *mb_rtu_data)
     MB_DATA_T *mb_data = mb_rtu_data->mb_data;
     UINT16_T crc = 0;
 
-    MBDATA_WORD_GET(mb_data, crc);
-
-    if (!mb_data->is_big_endian)
-    {
-        crc = b2l_endian(crc);
-    }
+    /* the last two bytes, low byte first */
+    mb_data->data_len -= sizeof(UINT16_T);
+    crc = mb_data->data[mb_data->data_len] | (mb_data->data[mb_data->data_len + 1] << 8);
 
     mb_rtu_data->rtu_info[MB_RX].crc_checksum = crc;
-    mb_data->data_len -= sizeof(UINT16_T);
 
-    crc = crc_calc(mb_data->data, mb_data->data_len);
+    crc = mb_crc16(mb_data->data, mb_data->data_len);
 
     if (crc != mb_rtu_data->rtu_info[MB_RX].crc_checksum)
     {
@@ -117,89 +97,429 @@ static int mbrtu_crc_decap_check(MBRTU_DATA_T *mb_rtu_data)
     return 0;
 }
 
-static int com_recv(MBRTU_DESC_T *mb_rtu_desc, MB_DATA_T *mb_data)
+/*
+ * Function  : frame timing from the line settings, a character is start + data + parity + stop bits,
+ *             t1.5/t3.5 are 1.5/3.5 characters unless given by rtu_ctl
+ * mb_rtu_desc : ModBus RTU descriptor
+ * rtu_ctl   : configure parameters of ModBus RTU
+ * baudrate  : baudrate the line runs at
+ * return    : void
+ */
+static void com_timing_config(MBRTU_DESC_T *mb_rtu_desc, MBRTU_CTL_T *rtu_ctl, UINT32_T baudrate)
 {
-    PTR_CHECK_N1(mb_rtu_desc);
-    PTR_CHECK_N1(mb_data);
+    UINT32_T bits = 1;
 
-    int length  = 0;
-    int timeout = 0;
-    int comfd   = mb_rtu_desc->com_fd;
-    int ready   = 0;
+    bits += (5 <= rtu_ctl->databit && rtu_ctl->databit <= 7) ? rtu_ctl->databit : 8;
+    bits += (1 == rtu_ctl->parity || 2 == rtu_ctl->parity) ? 1 : 0;
+    bits += (2 == rtu_ctl->stopbit) ? 2 : 1;
 
-    fd_set readset;
-    struct timeval tv;
+    /* rounded up, a frame is never cut short */
+    mb_rtu_desc->char_time = ALIGNED(bits * 1000000, baudrate);
+    mb_rtu_desc->t15 = rtu_ctl->t15 ? rtu_ctl->t15 : ALIGNED(mb_rtu_desc->char_time * 3, 2);
+    mb_rtu_desc->t35 = rtu_ctl->t35 ? rtu_ctl->t35 : ALIGNED(mb_rtu_desc->char_time * 7, 2);
 
-    tv.tv_sec  = 3;
-    tv.tv_usec = 0;
+    mb_rtu_desc->turnaround = rtu_ctl->turnaround ? rtu_ctl->turnaround : MBRTU_TURNAROUND;
+    if (mb_rtu_desc->turnaround < mb_rtu_desc->t35)
+    {
+        mb_rtu_desc->turnaround = mb_rtu_desc->t35;
+    }
+}
 
-    FD_ZERO(&readset);
-    FD_SET(comfd, &readset);
+/*
+ * Function  : wait until the line has been silent for t3.5 since the last frame
+ * mb_rtu_desc : ModBus RTU descriptor
+ * return    : void
+ */
+static void com_idle_wait(MBRTU_DESC_T *mb_rtu_desc)
+{
+    UINT64_T now = mb_time_us();
 
-    ready = select(comfd + 1, &readset, NULL, NULL, &tv);
-    if (0 > ready)
+    if (now < mb_rtu_desc->idle_time)
     {
-        perror("select error");
-        return -1;
+        usleep(mb_rtu_desc->idle_time - now);
     }
-    else if (0 == ready)
+}
+
+/*
+ * Function  : the response is in once as many bytes as predicted from the request
+ *             or a whole exception frame are received, the CRC check tells the rest
+ * mb_data   : ModBus cache
+ * expect    : frame length of a normal response, 0=UNKNOWN
+ * return    : 1=COMPLETE 0=NOT YET
+ */
+int mb_rtu_frame_done(MB_DATA_T *mb_data, UINT16_T expect)
+{
+    if (2 <= mb_data->data_len && (mb_data->data[1] & 0x80))
     {
-        printf("select timeout\n");
-        return -1;
+        return MBRTU_EXCEPTION_LEN <= mb_data->data_len;
     }
 
+    return expect && expect <= mb_data->data_len;
+}
+
+/*
+ * Function  : recv one frame, it is complete as soon as the predicted length is in,
+ *             otherwise once the line is silent for t3.5, silences between t1.5 and 
+ *             t3.5 are not told apart, serial drivers and USB adapters deliver bytes 
+ *             in bursts far longer than t1.5
+ * mb_rtu_desc : ModBus RTU descriptor
+ * mb_data   : ModBus cache
+ * expect    : frame length of a normal response, 0=UNKNOWN
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int com_recv(MBRTU_DESC_T *mb_rtu_desc, MB_DATA_T *mb_data, UINT16_T expect)
+{
+    PTR_CHECK_N1(mb_rtu_desc);
+    PTR_CHECK_N1(mb_data);
+
+    int      length = 0;
+    int      comfd  = mb_rtu_desc->com_fd;
+    int      ready  = 0;
+    UINT32_T wait   = MBRTU_RESP_TIMEOUT * 1000;
+
+    fd_set readset;
+    struct timeval tv;
+
     mb_data->data_len = 0;
 
-    while ((timeout++ <= MBRTU_RECV_TIMEOUT))
+    while (mb_data->data_len < mb_data->max_data_len)
     {
         length = read(comfd, (mb_data->data + mb_data->data_len), (mb_data->max_data_len - mb_data->data_len));
-        if(0 > length)
+        if (0 < length)
         {
-            if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            mb_data->data_len += length;
+
+            /* the silence after it is still to come */
+            if (mb_rtu_frame_done(mb_data, expect))
             {
-                usleep(MBRTU_RECV_DELAY);
+                mb_rtu_desc->idle_time = mb_time_us() + mb_rtu_desc->t35;
+                return mb_data->data_len;
             }
-            else
+
+            /* from now on the frame ends with t3.5 of silence */
+            wait = mb_rtu_desc->t35;
+            continue;
+        }
+
+        if (0 > length && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+        {
+            perror("read error");
+            return -1;
+        }
+
+        /* nothing buffered, wait for the next byte */
+        tv.tv_sec  = wait / 1000000;
+        tv.tv_usec = wait % 1000000;
+
+        FD_ZERO(&readset);
+        FD_SET(comfd, &readset);
+
+        ready = select(comfd + 1, &readset, NULL, NULL, &tv);
+        if (0 > ready)
+        {
+            if (EINTR == errno)
             {
-                perror("read error");
-                return -1;
+                continue;
             }
+
+            perror("select error");
+            return -1;
         }
-        else if(length == 0)
+        else if (0 == ready)
         {
-            usleep(MBRTU_RECV_DELAY);
+            if (mb_data->data_len)
+            {
+                break;
+            }
+
+            printf("select timeout\n");
+            return -1;
         }
-        else
+    }
+
+    /* the silence already passed is part of the gap before the next request */
+    mb_rtu_desc->idle_time = mb_time_us();
+
+    return mb_data->data_len;
+}
+
+/*
+ * Function  : write a whole frame to a non-blocking serial line, a full output buffer
+ *             is waited for, shared with ModBus ASCII
+ * comfd     : serial line
+ * frame     : the frame
+ * len       : frame length
+ * return    : length=SUCCESS -1=ERROR
+ */
+int mb_rtu_com_write(int comfd, const UINT8_T *frame, UINT16_T len)
+{
+    PTR_CHECK_N1(frame);
+
+    int      length = 0;
+    int      ready  = 0;
+    UINT16_T total  = 0;
+
+    fd_set writeset;
+    struct timeval tv;
+
+    while (total < len)
+    {
+        length = write(comfd, frame + total, len - total);
+        if (0 < length)
         {
-            mb_data->data_len += length;
-            timeout = 0;
+            total += length;
             continue;
         }
+
+        if (0 > length && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+        {
+            perror("write error");
+            return -1;
+        }
+
+        /* output buffer full, the rest of the frame follows once the line drains */
+        tv.tv_sec  = MBRTU_RESP_TIMEOUT / 1000;
+        tv.tv_usec = (MBRTU_RESP_TIMEOUT % 1000) * 1000;
+
+        FD_ZERO(&writeset);
+        FD_SET(comfd, &writeset);
+
+        ready = select(comfd + 1, NULL, &writeset, NULL, &tv);
+        if (0 > ready && EINTR != errno)
+        {
+            perror("select error");
+            return -1;
+        }
+        else if (0 == ready)
+        {
+            printf("write timeout\n");
+            return -1;
+        }
     }
 
-    return mb_data->data_len;
+    return total;
 }
 
-static int com_send(MBRTU_DESC_T *mb_rtu_desc, MB_DATA_T *mb_data)
+static int com_send(MBRTU_DESC_T *mb_rtu_desc, const UINT8_T *frame, UINT16_T len)
 {
     PTR_CHECK_N1(mb_rtu_desc);
-    PTR_CHECK_N1(mb_data);
+    PTR_CHECK_N1(frame);
 
     int length  = 0;
     int comfd   = mb_rtu_desc->com_fd;
 
-    length = write(comfd, mb_data->data, mb_data->data_len);
+    com_idle_wait(mb_rtu_desc);
+
+    length = mb_rtu_com_write(comfd, frame, len);
     if (0 > length)
     {
-        perror("write error");
-        
         /* clear file cache */
         tcflush(comfd, TCIFLUSH);
+        return length;
     }
 
+    /* the frame is still on the line, then t3.5 of silence */
+    mb_rtu_desc->idle_time = mb_time_us() + ((UINT64_T)length * mb_rtu_desc->char_time) + mb_rtu_desc->t35;
+
     return length;
 }
 
+/*
+ * Function  : look at the completion of the request write
+ * mb_rtu_desc : ModBus RTU descriptor
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int com_uring_tx_done(MBRTU_DESC_T *mb_rtu_desc)
+{
+    MBRTU_URING_T *uring = mb_rtu_desc->uring;
+    int ret = 0;
+
+    if (MBURING_OP_IDLE != uring->tx.state)
+    {
+        mb_uring_cancel(uring->ring, &uring->tx);
+    }
+
+    if (uring->tx_len && 0 > uring->tx.res)
+    {
+        errno = -uring->tx.res;
+        perror("write error");
+
+        /* clear file cache */
+        tcflush(mb_rtu_desc->com_fd, TCIFLUSH);
+        ret = -1;
+    }
+
+    uring->tx_len = 0;
+
+    return ret;
+}
+
+/*
+ * Function  : queue the request write on the io_uring backend, it is submitted 
+ *             together with the response read
+ * mb_rtu_desc : ModBus RTU descriptor
+ * frame     : the frame
+ * len       : frame length
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int com_uring_send(MBRTU_DESC_T *mb_rtu_desc, const UINT8_T *frame, UINT16_T len)
+{
+    MBRTU_URING_T *uring = mb_rtu_desc->uring;
+
+    com_idle_wait(mb_rtu_desc);
+
+    /* a request without response read, it goes out first */
+    if (uring->tx_len)
+    {
+        mb_uring_wait(uring->ring, &uring->tx, mb_time_us() + ((UINT64_T)MBRTU_RESP_TIMEOUT * 1000));
+        com_uring_tx_done(mb_rtu_desc);
+    }
+
+    if (MBRTU_FRAME_SIZE < len)
+    {
+        return -1;
+    }
+
+    memcpy(uring->tx_buf, frame, len);
+    uring->tx_len = len;
+    mb_rtu_desc->idle_time = mb_time_us() + ((UINT64_T)uring->tx_len * mb_rtu_desc->char_time) + mb_rtu_desc->t35;
+
+    if (0 > mb_uring_prep(uring->ring, &uring->tx, MBURING_IO_WRITE, mb_rtu_desc->com_fd,
+        uring->tx_buf, uring->tx_len))
+    {
+        uring->tx_len = 0;
+        return -1;
+    }
+
+    return len;
+}
+
+/*
+ * Function  : recv a response on the io_uring backend, it ends with the predicted length
+ *             or t3.5 of silence like the select backend
+ * mb_rtu_desc : ModBus RTU descriptor
+ * mb_data   : ModBus cache
+ * expect    : frame length of a normal response, 0=UNKNOWN
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int com_uring_recv(MBRTU_DESC_T *mb_rtu_desc, MB_DATA_T *mb_data, UINT16_T expect)
+{
+    MBRTU_URING_T *uring    = mb_rtu_desc->uring;
+    UINT64_T       deadline = mb_time_us() + ((UINT64_T)MBRTU_RESP_TIMEOUT * 1000);
+
+    mb_data->data_len = 0;
+
+    /* the read starts once the write is done, one syscall for both */
+    if (uring->tx_len && 0 > mb_uring_link(uring->ring, &uring->tx))
+    {
+        mb_uring_wait(uring->ring, &uring->tx, deadline);
+    }
+
+    while (mb_data->data_len < mb_data->max_data_len)
+    {
+        if (0 > mb_uring_prep(uring->ring, &uring->rx, MBURING_IO_READ, mb_rtu_desc->com_fd, 
+            (mb_data->data + mb_data->data_len), (mb_data->max_data_len - mb_data->data_len)))
+        {
+            com_uring_tx_done(mb_rtu_desc);
+            return -1;
+        }
+
+        if (0 > mb_uring_wait(uring->ring, &uring->rx, deadline))
+        {
+            mb_uring_cancel(uring->ring, &uring->rx);
+            if (ETIMEDOUT != errno)
+            {
+                com_uring_tx_done(mb_rtu_desc);
+                return -1;
+            }
+
+            /* silence after the frame */
+            if (mb_data->data_len)
+            {
+                break;
+            }
+
+            printf("recv timeout\n");
+            com_uring_tx_done(mb_rtu_desc);
+            return -1;
+        }
+
+        if (0 > com_uring_tx_done(mb_rtu_desc))
+        {
+            return -1;
+        }
+
+        if (0 > uring->rx.res)
+        {
+            errno = -uring->rx.res;
+            perror("read error");
+            return -1;
+        }
+
+        mb_data->data_len += uring->rx.res;
+        if (mb_rtu_frame_done(mb_data, expect))
+        {
+            mb_rtu_desc->idle_time = mb_time_us() + mb_rtu_desc->t35;
+            return mb_data->data_len;
+        }
+
+        if (uring->rx.res)
+        {
+            deadline = mb_time_us() + mb_rtu_desc->t35;
+        }
+    }
+
+    mb_rtu_desc->idle_time = mb_time_us();
+
+    return mb_data->data_len;
+}
+
+/*
+ * Function  : nobody answers a broadcast, wait until the frame is on the line, 
+ *             then the turnaround delay takes the place of t3.5
+ * mb_rtu_desc : ModBus RTU descriptor
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int com_broadcast_wait(MBRTU_DESC_T *mb_rtu_desc)
+{
+    MBRTU_URING_T *uring = mb_rtu_desc->uring;
+
+    if (uring && uring->tx_len)
+    {
+        mb_uring_wait(uring->ring, &uring->tx, mb_time_us() + ((UINT64_T)MBRTU_RESP_TIMEOUT * 1000));
+        if (0 > com_uring_tx_done(mb_rtu_desc))
+        {
+            return -1;
+        }
+    }
+
+    mb_rtu_desc->idle_time += mb_rtu_desc->turnaround - mb_rtu_desc->t35;
+    com_idle_wait(mb_rtu_desc);
+
+    return 0;
+}
+
+/*
+ * Function  : only writes may be broadcast, nobody would answer a read, shared with ModBus ASCII
+ * mb_info   : request
+ * return    : 0=VALID -1=INVALID
+ */
+int mb_rtu_broadcast_check(MB_INFO_T *mb_info)
+{
+    switch (mb_info->code)
+    {
+        case MB_FUNC_05 :
+        case MB_FUNC_06 :
+        case MB_FUNC_0f :
+        case MB_FUNC_10 :
+            return 0;
+
+        default :
+            printf("Function code 0x%02x can not be broadcast\n", mb_info->code);
+            return -1;
+    }
+}
+
 static UINT32_T baudrate_convert(UINT32_T baudrate)
 {
     struct baudrate_map
@@ -224,7 +544,19 @@ static UINT32_T baudrate_convert(UINT32_T baudrate)
         { 38400,  B38400  },
         { 57600,  B57600  },
         { 115200, B115200 },
-        { 921600, B921600 }
+        { 230400, B230400 },
+        { 460800, B460800 },
+        { 500000, B500000 },
+        { 576000, B576000 },
+        { 921600, B921600 },
+        { 1000000, B1000000 },
+        { 1152000, B1152000 },
+        { 1500000, B1500000 },
+        { 2000000, B2000000 },
+        { 2500000, B2500000 },
+        { 3000000, B3000000 },
+        { 3500000, B3500000 },
+        { 4000000, B4000000 }
     };
 
     int i = 0;
@@ -237,7 +569,66 @@ static UINT32_T baudrate_convert(UINT32_T baudrate)
         }
     }
 
-    return B9600;
+    /* no Bxxx constant, set through termios2 */
+    return B0;
+}
+
+/*
+ * Function  : set a rate without Bxxx constant, such as 250000
+ * fd        : file discriptor for serial communication
+ * baudrate  : baudrate
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int com_baudrate_other(int fd, UINT32_T baudrate)
+{
+    struct termios2 option;
+
+    if (0 > ioctl(fd, TCGETS2, &option))
+    {
+        perror("TCGETS2 error");
+        return -1;
+    }
+
+    option.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    option.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    option.c_ispeed = baudrate;
+    option.c_ospeed = baudrate;
+
+    if (0 > ioctl(fd, TCSETS2, &option))
+    {
+        printf("Baudrate %u refused by the serial driver : %s\n", baudrate, strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : the driver takes any rate without error and runs at the nearest one it has,
+ *             read it back
+ * fd        : file discriptor for serial communication
+ * baudrate  : baudrate asked for
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int com_baudrate_check(int fd, UINT32_T baudrate)
+{
+    struct termios2 option;
+    UINT64_T diff = 0;
+
+    if (0 > ioctl(fd, TCGETS2, &option))
+    {
+        perror("TCGETS2 error");
+        return -1;
+    }
+
+    diff = (option.c_ospeed > baudrate) ? (option.c_ospeed - baudrate) : (baudrate - option.c_ospeed);
+    if (diff * 100 > (UINT64_T)baudrate * MBRTU_BAUD_TOLERANCE)
+    {
+        printf("Baudrate %u refused by the serial driver, it runs at %u\n", baudrate, option.c_ospeed);
+        return -1;
+    }
+
+    return 0;
 }
 
 /*
@@ -251,6 +642,7 @@ static int com_config(int fd, MBRTU_CTL_T *rtu_ctl)
     PTR_CHECK_N1(rtu_ctl);
 
     int read_cache_size = 4096;
+    speed_t speed = 0;
     struct termios option;
 
     /* termios original mode */
@@ -264,10 +656,16 @@ static int com_config(int fd, MBRTU_CTL_T *rtu_ctl)
         return -1;
     }
 
-    /* baudrate configure */
-    rtu_ctl->baudrate = baudrate_convert(rtu_ctl->baudrate);
-    if (0 != cfsetispeed(&option, rtu_ctl->baudrate) ||
-        0 != cfsetospeed(&option, rtu_ctl->baudrate))
+    /* baudrate configure, B0 would hang up the line */
+    if (!rtu_ctl->baudrate)
+    {
+        printf("Invalid baudrate %u\n", rtu_ctl->baudrate);
+        return -1;
+    }
+
+    speed = baudrate_convert(rtu_ctl->baudrate);
+    if (B0 != speed && 
+        (0 != cfsetispeed(&option, speed) || 0 != cfsetospeed(&option, speed)))
     {
         perror("failed to set buadrate");
         return -1;
@@ -326,11 +724,11 @@ static int com_config(int fd, MBRTU_CTL_T *rtu_ctl)
             break;
     }
     
-    /* flow control */
+    /* flow control, IXOFF shares its bit with CBAUDEX, so the software flags are c_iflag ones */
     switch (rtu_ctl->flowctl)
     {
         case 0 :
-            option.c_cflag &= ~(IXON | IXOFF | IXANY);
+            option.c_iflag &= ~(IXON | IXOFF | IXANY);
             option.c_cflag &= ~(CRTSCTS);
             break;
 
@@ -339,15 +737,16 @@ static int com_config(int fd, MBRTU_CTL_T *rtu_ctl)
             break;
 
         case 2 :
-            option.c_cflag |= (IXON | IXOFF | IXANY);
+            option.c_iflag |= (IXON | IXOFF | IXANY);
     }
 
-    /* raw mode */
-    option.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
+    /* raw mode, no CR/NL translation or stripping of the received bytes */
+    option.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+    option.c_lflag &= ~(ICANON | ECHO | ECHOE | ECHONL | ISIG | IEXTEN);
     option.c_oflag &= ~(OPOST);
 
-    /* timeout & min byte */
-    option.c_cc[VTIME] = 5;
+    /* reads never block, frames are delimited by t3.5 in com_recv */
+    option.c_cc[VTIME] = 0;
     option.c_cc[VMIN ] = 0;
 
     /* read cache */
@@ -364,9 +763,103 @@ static int com_config(int fd, MBRTU_CTL_T *rtu_ctl)
         return -1;
     }
 
+    if (B0 == speed && 0 > com_baudrate_other(fd, rtu_ctl->baudrate))
+    {
+        return -1;
+    }
+
+    return com_baudrate_check(fd, rtu_ctl->baudrate);
+}
+
+UINT16_T mb_rtu_frame_len(MB_INFO_T *mb_info)
+{
+    PTR_CHECK_0(mb_info);
+
+    UINT16_T expect = mb_response_pdu_len(mb_info);
+
+    /* address + PDU + CRC */
+    return expect ? expect + 1 + sizeof(UINT16_T) : 0;
+}
+
+void mb_rtu_frame_encap(MBRTU_DATA_T *mb_rtu_data)
+{
+    PTR_CHECK_VOID(mb_rtu_data);
+
+    /* encap slaver address */
+    mbrtu_slaveaddr_encap(mb_rtu_data);
+
+    /* encap PDU */
+    mb_data_encap(mb_rtu_data->mb_data);
+
+    /* encap CRC */
+    mbrtu_crc_encap(mb_rtu_data);
+}
+
+int mb_rtu_frame_decap(MBRTU_DATA_T *mb_rtu_data, MB_VIEW_T *view)
+{
+    PTR_CHECK_N1(mb_rtu_data);
+
+    /* address + code + CRC at least, RTU over TCP takes any length from the peer */
+    if (4 > mb_rtu_data->mb_data->data_len)
+    {
+        printf("Invalid ModBus RTU frame(%d bytes)\n", mb_rtu_data->mb_data->data_len);
+        return -1;
+    }
+
+    /* decap CRC, nothing of a corrupted frame reaches mb_info */
+    if (0 > mbrtu_crc_decap_check(mb_rtu_data))
+    {
+        return -1;
+    }
+
+    /* decap slaver address */
+    if (0 > mbrtu_slaveaddr_decap_check(mb_rtu_data))
+    {
+        return -1;
+    }
+
+    /* decap PDU */
+    if (0 > mb_response_decap(mb_rtu_data->mb_data, view))
+    {
+        printf("Invalid ModBus RTU response PDU\n");
+        return -1;
+    }
+
     return 0;
 }
 
+int mb_rtu_com_open(MBRTU_CTL_T *rtu_ctl)
+{
+    PTR_CHECK_N1(rtu_ctl);
+
+    int fd   = -1;
+    int flag = 0;
+
+    /* Open serial port, a receive only one can not be written at all */
+    fd = open(rtu_ctl->serial, (rtu_ctl->listen ? O_RDONLY : O_RDWR) | O_NOCTTY);
+    if (0 > fd)
+    {
+        perror("open error");
+        return -1;
+    }
+    /* no block */
+    flag = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
+
+    /* com configure */
+    if (com_config(fd, rtu_ctl))
+    {
+        printf("com configure error\n");
+        close(fd);
+        return -1;
+    }
+
+    /* clear file cache */
+    tcflush(fd, TCIFLUSH);
+
+    return fd;
+}
+
 /*
  * Function  : Create a ModBus RTU context
  * rtu_ctl   : configure parameters of ModBus RTU
@@ -380,7 +873,6 @@ MBRTU_CTX_T *mb_rtu_init(MBRTU_CTL_T *rtu_ctl)
 
     MBRTU_CTX_T *mbrtu_ctx = NULL;
     int fd   = -1;
-    int flag = 0;
 
     /* Create a ModBus RTU context */
     mbrtu_ctx = (MBRTU_CTX_T *)malloc(sizeof(MBRTU_CTX_T));
@@ -402,33 +894,33 @@ MBRTU_CTX_T *mb_rtu_init(MBRTU_CTL_T *rtu_ctl)
         return NULL;
     }
 
-    /* Open serial port */
-    fd = open(rtu_ctl->serial, O_RDWR | O_NOCTTY);
+    fd = mb_rtu_com_open(rtu_ctl);
     if (0 > fd)
     {
-        perror("open error");
         mb_data_destory(mbrtu_ctx->mb_rtu_data.mb_data);
         free(mbrtu_ctx);
         return NULL;
     }
-    /* no block */
-    flag = fcntl(fd, F_GETFL, 0);
-    fcntl(fd, F_SETFL, flag | O_NONBLOCK);
 
-    /* com configure */
-    if (com_config(fd, rtu_ctl))
+    if (rtu_ctl->uring)
     {
-        printf("com configure error\n");
-        mb_data_destory(mbrtu_ctx->mb_rtu_data.mb_data);
-        free(mbrtu_ctx);
-        close(fd);
-        return NULL;
+        mbrtu_ctx->mb_rtu_desc.uring = (MBRTU_URING_T *)malloc(sizeof(MBRTU_URING_T));
+        if (!mbrtu_ctx->mb_rtu_desc.uring)
+        {
+            printf("Can not create a ModBus RTU io_uring backend\n");
+            mb_data_destory(mbrtu_ctx->mb_rtu_data.mb_data);
+            free(mbrtu_ctx);
+            close(fd);
+            return NULL;
+        }
+        memset(mbrtu_ctx->mb_rtu_desc.uring, 0, sizeof(MBRTU_URING_T));
+        mbrtu_ctx->mb_rtu_desc.uring->ring = rtu_ctl->uring;
     }
 
-    /* clear file cache */
-    tcflush(fd, TCIFLUSH);
-
     mbrtu_ctx->mb_rtu_desc.com_fd = fd;
+    mbrtu_ctx->mb_rtu_desc.listen = rtu_ctl->listen;
+
+    com_timing_config(&mbrtu_ctx->mb_rtu_desc, rtu_ctl, rtu_ctl->baudrate);
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
@@ -446,6 +938,12 @@ void mb_rtu_close(MBRTU_CTX_T *mbrtu_ctx)
 
     PTR_CHECK_VOID(mbrtu_ctx);
 
+    if (mbrtu_ctx->mb_rtu_desc.uring)
+    {
+        com_uring_tx_done(&mbrtu_ctx->mb_rtu_desc);
+        free(mbrtu_ctx->mb_rtu_desc.uring);
+    }
+
     close(mbrtu_ctx->mb_rtu_desc.com_fd);
 
     mb_data_destory(mbrtu_ctx->mb_rtu_data.mb_data);
@@ -456,7 +954,35 @@ void mb_rtu_close(MBRTU_CTX_T *mbrtu_ctx)
 }
 
 /*
- * Function  : send ModBus RTU data from ModBus cache to slaver
+ * Function  : send a frame, a broadcast waits out the turnaround delay
+ * mbrtu_ctx : ModBus RTU context
+ * frame     : the frame, in cache or prepared
+ * len       : frame length
+ * return    : 0=CLOSE length=SUCCESS -1=ERROR
+ */
+static int mbrtu_send_frame(MBRTU_CTX_T *mbrtu_ctx, const UINT8_T *frame, UINT16_T len)
+{
+    int length = 0;
+
+#ifdef MB_DEBUG
+    MB_PRINT("SEND %d bytes\n", len);
+#endif
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    length = mbrtu_ctx->mb_rtu_desc.uring ? com_uring_send(&mbrtu_ctx->mb_rtu_desc, frame, len) :
+                                            com_send(&mbrtu_ctx->mb_rtu_desc, frame, len);
+    if (0 < length && mbrtu_ctx->mb_rtu_desc.broadcast && 0 > com_broadcast_wait(&mbrtu_ctx->mb_rtu_desc))
+    {
+        return -1;
+    }
+
+    return length;
+}
+
+/*
+ * Function  : send ModBus RTU data from ModBus cache to slaver, a broadcast(MBRTU_BROADCAST)
+ *             returns once the frame is on the line and the turnaround delay is over
  * mbrtu_ctx : ModBus RTU context
  * return    : 0=CLOSE length=SUCCESS -1=ERROR
  */
@@ -469,48 +995,128 @@ int mb_rtu_send(MBRTU_CTX_T *mbrtu_ctx)
     MBRTU_DATA_T *mb_rtu_data = &mbrtu_ctx->mb_rtu_data;
     MB_DATA_T    *mb_data     = mbrtu_ctx->mb_rtu_data.mb_data;
 
+    if (mbrtu_ctx->mb_rtu_desc.listen)
+    {
+        printf("ModBus RTU context is receive only\n");
+        return -1;
+    }
+
+    mbrtu_ctx->mb_rtu_desc.broadcast = (MBRTU_BROADCAST == mb_rtu_data->rtu_info[MB_TX].slaver_addr);
+    if (mbrtu_ctx->mb_rtu_desc.broadcast && 0 > mb_rtu_broadcast_check(&mb_data->mb_info))
+    {
+        return -1;
+    }
+
     /* clear data cache */
     mb_data_clear(mb_data);
 
-    /* encap slaver address */
-    mbrtu_slaveaddr_encap(mb_rtu_data);
+    /* encap slaver address + PDU + CRC */
+    mb_rtu_frame_encap(mb_rtu_data);
 
-    /* encap PDU */
-    mb_data_encap(mb_data);
+    return mbrtu_send_frame(mbrtu_ctx, mb_data->data, mb_data->data_len);
+}
 
-    /* encap CRC */
-    mbrtu_crc_encap(mb_rtu_data);
+/*
+ * Function  : encode a request once for mb_rtu_send_prepared
+ * mbrtu_ctx : ModBus RTU context
+ * mb_info   : the request
+ * prep      : prepared request
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_rtu_prepare(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep)
+{
+    PTR_CHECK_N1(mbrtu_ctx);
+    PTR_CHECK_N1(mb_info);
+    PTR_CHECK_N1(prep);
 
-#ifdef MB_DEBUG
-    MB_PRINT("SEND\n");
-    mb_cache_show(mb_data);
-#endif
+    MBRTU_DATA_T rtu_data = mbrtu_ctx->mb_rtu_data;
+    UINT8_T      scratch[MB_DATA_BUF_SIZE(MBRTU_FRAME_SIZE)];
+    UINT16_T     size     = 0;
+    int          ret      = 0;
 
-    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+    if (MBRTU_BROADCAST == rtu_data.rtu_info[MB_TX].slaver_addr && 0 > mb_rtu_broadcast_check(mb_info))
+    {
+        return -1;
+    }
+
+    /* a scratch cache on the stack, mb_info of the context still belongs to the request awaiting its response */
+    size = (rtu_data.mb_data->max_data_len < MBRTU_FRAME_SIZE) ? rtu_data.mb_data->max_data_len : MBRTU_FRAME_SIZE;
+    rtu_data.mb_data = mb_data_init(scratch, size);
+
+    mb_info_copy(&rtu_data.mb_data->mb_info, mb_info);
+    mb_rtu_frame_encap(&rtu_data);
 
-    return com_send(&mbrtu_ctx->mb_rtu_desc, mb_data);
+    ret = mb_prep_save(prep, mbrtu_ctx, &rtu_data.mb_data->mb_info, rtu_data.mb_data->data, rtu_data.mb_data->data_len);
+    prep->slaver_addr = rtu_data.rtu_info[MB_TX].slaver_addr;
+    prep->check       = rtu_data.rtu_info[MB_TX].crc_checksum;
+
+    return ret;
 }
 
 /*
- * Function  : recv ModBus RTU data from slaver to ModBus cache
+ * Function  : send a prepared request, its CRC was computed by mb_rtu_prepare
  * mbrtu_ctx : ModBus RTU context
+ * prep      : prepared request
  * return    : 0=CLOSE length=SUCCESS -1=ERROR
  */
-int mb_rtu_recv(MBRTU_CTX_T *mbrtu_ctx)
+int mb_rtu_send_prepared(MBRTU_CTX_T *mbrtu_ctx, const MB_PREP_T *prep)
 {
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
     PTR_CHECK_N1(mbrtu_ctx);
 
+    MBRTU_INFO_T *tx_rtu_info = &mbrtu_ctx->mb_rtu_data.rtu_info[MB_TX];
+
+    if (mbrtu_ctx->mb_rtu_desc.listen)
+    {
+        printf("ModBus RTU context is receive only\n");
+        return -1;
+    }
+
+    if (0 > mb_prep_load(prep, mbrtu_ctx, mbrtu_ctx->mb_rtu_data.mb_data))
+    {
+        return -1;
+    }
+
+    /* the response comes from the slaver the frame is addressed to */
+    tx_rtu_info->slaver_addr  = prep->slaver_addr;
+    tx_rtu_info->crc_checksum = prep->check;
+    mbrtu_ctx->mb_rtu_desc.broadcast = (MBRTU_BROADCAST == prep->slaver_addr);
+
+    /* straight from the prepared bytes */
+    return mbrtu_send_frame(mbrtu_ctx, prep->frame, prep->len);
+}
+
+/*
+ * Function  : recv a response, decapped into mb_info or in place
+ * mbrtu_ctx : ModBus RTU context
+ * view      : the response, NULL=into mb_info
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+static int mbrtu_recv(MBRTU_CTX_T *mbrtu_ctx, MB_VIEW_T *view)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
     int length = 0;
+    UINT16_T      expect      = 0;
     MBRTU_DATA_T *mb_rtu_data = &mbrtu_ctx->mb_rtu_data;
     MB_DATA_T    *mb_data     = mbrtu_ctx->mb_rtu_data.mb_data;
 
+    /* nothing to wait for, mb_info still holds the request */
+    if (mbrtu_ctx->mb_rtu_desc.broadcast)
+    {
+        return 0;
+    }
+
     /* clear data cache */
     mb_data_clear(mb_data);
 
+    /* mb_info still holds the request */
+    expect = mb_rtu_frame_len(&mb_data->mb_info);
+
     /* recv data from ModBus slaver */
-    length = com_recv(&mbrtu_ctx->mb_rtu_desc, mb_data);
+    length = mbrtu_ctx->mb_rtu_desc.uring ? com_uring_recv(&mbrtu_ctx->mb_rtu_desc, mb_data, expect) : 
+                                            com_recv(&mbrtu_ctx->mb_rtu_desc, mb_data, expect);
     if (0 > length)
     {
         return -1;
@@ -521,17 +1127,8 @@ int mb_rtu_recv(MBRTU_CTX_T *mbrtu_ctx)
     mb_cache_show(mb_data);
 #endif
 
-    /* decap slaver address */
-    if (0 > mbrtu_slaveaddr_decap_check(mb_rtu_data))
-    {
-        return -1;
-    }
-
-    /* decap PDU */
-    mb_data_decap(mb_data);
-
-    /* decap CRC */
-    if (mbrtu_crc_decap_check(mb_rtu_data))
+    /* decap slaver address + PDU + CRC */
+    if (0 > mb_rtu_frame_decap(mb_rtu_data, view))
     {
         return -1;
     }
@@ -541,6 +1138,32 @@ int mb_rtu_recv(MBRTU_CTX_T *mbrtu_ctx)
     return length;
 }
 
+/*
+ * Function  : recv ModBus RTU data from slaver to ModBus cache
+ * mbrtu_ctx : ModBus RTU context
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_rtu_recv(MBRTU_CTX_T *mbrtu_ctx)
+{
+    PTR_CHECK_N1(mbrtu_ctx);
+
+    return mbrtu_recv(mbrtu_ctx, NULL);
+}
+
+/*
+ * Function  : recv ModBus RTU data from slaver, the response is decapped in place
+ * mbrtu_ctx : ModBus RTU context
+ * view      : the response, valid until the next send/recv
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_rtu_recv_view(MBRTU_CTX_T *mbrtu_ctx, MB_VIEW_T *view)
+{
+    PTR_CHECK_N1(mbrtu_ctx);
+    PTR_CHECK_N1(view);
+
+    return mbrtu_recv(mbrtu_ctx, view);
+}
+
 void mbrtuctx_info_updata(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info)
 {
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
@@ -548,7 +1171,7 @@ void mbrtuctx_info_updata(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info)
     PTR_CHECK_VOID(mbrtu_ctx);
     PTR_CHECK_VOID(mb_info);
     
-    mbrtu_ctx->mb_rtu_data.mb_data->mb_info = *mb_info;
+    mb_info_copy(&mbrtu_ctx->mb_rtu_data.mb_data->mb_info, mb_info);
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 }
@@ -560,7 +1183,14 @@ void mbrtuctx_info_takeout(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info)
     PTR_CHECK_VOID(mbrtu_ctx);
     PTR_CHECK_VOID(mb_info);
     
-    *mb_info = mbrtu_ctx->mb_rtu_data.mb_data->mb_info;
+    mb_info_copy(mb_info, &mbrtu_ctx->mb_rtu_data.mb_data->mb_info);
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 }
+
+void mbrtuctx_slaver_set(MBRTU_CTX_T *mbrtu_ctx, UINT8_T slaver_addr)
+{
+    PTR_CHECK_VOID(mbrtu_ctx);
+
+    mbrtu_ctx->mb_rtu_data.rtu_info[MB_TX].slaver_addr = slaver_addr;
+}
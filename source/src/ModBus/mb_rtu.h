@@ -2,27 +2,60 @@
 #define MB_RTU
 
 #include "mb_common.h"
+#include "mb_uring.h"
+#include "mb_crc.h"
 
-#define MBRTU_RECV_DELAY    200
-#define MBRTU_RECV_TIMEOUT  100
 #define MBRTU_SERIAL_SIZE   32
+#define MBRTU_RESP_TIMEOUT  3000  /* ms, wait for the first response byte */
+#define MBRTU_FRAME_SIZE    256
+#define MBRTU_EXCEPTION_LEN 5     /* address + exception PDU + CRC */
+#define MBRTU_BROADCAST     0     /* slaver address of a broadcast, write function codes only */
+#define MBRTU_TURNAROUND    100000 /* us, the slavers act on a broadcast meanwhile */
+#define MBRTU_BAUD_TOLERANCE 2    /* %, a driver rounds the rate to its clock divider */
 
 typedef struct 
 {
     UINT16_T max_data_size;
 
     UINT16_T slaver_addr;
-    UINT16_T baudrate;
+    UINT32_T baudrate;          /* any rate the serial driver takes, not only Bxxx ones */
     UINT16_T databit;
     UINT16_T stopbit;
     UINT16_T flowctl;
     UINT16_T parity;
     char     serial[MBRTU_SERIAL_SIZE];
+    MBURING_T *uring;           /* io_uring backend, NULL=select backend */
+
+    /* frame timing(us), 0=computed from the line settings */
+    UINT32_T t15;               /* max silence inside a frame, 1.5 characters */
+    UINT32_T t35;               /* min silence between frames, 3.5 characters */
+    UINT32_T turnaround;        /* silence after a broadcast, 0=MBRTU_TURNAROUND */
+    UINT8_T  listen;            /* receive only, such as a sniffer, mb_rtu_send always fails */
 } MBRTU_CTL_T;
 
+/* io_uring backend, the response read is linked behind the request write */
+typedef struct
+{
+    MBURING_T   *ring;
+    MBURING_OP_T tx;
+    MBURING_OP_T rx;
+    UINT16_T     tx_len;        /* bytes of the write, 0=NO WRITE */
+    UINT8_T      tx_buf[MBRTU_FRAME_SIZE];
+} MBRTU_URING_T;
+
 typedef struct
 {
     int com_fd;
+    MBRTU_URING_T *uring;       /* NULL=select backend */
+
+    /* frame timing(us) */
+    UINT32_T char_time;         /* one character on the line, start + data + parity + stop bits */
+    UINT32_T t15;
+    UINT32_T t35;               /* a frame ends after this much silence */
+    UINT32_T turnaround;        /* silence after a broadcast, at least t3.5 */
+    UINT64_T idle_time;         /* the line is free for the next frame from then on */
+    UINT8_T  broadcast;         /* the last request was a broadcast, no response to it */
+    UINT8_T  listen;            /* receive only, nothing is ever transmitted */
 } __attribute__((packed)) MBRTU_DESC_T;
 
 typedef struct 
@@ -43,6 +76,62 @@ typedef struct
     MBRTU_DATA_T mb_rtu_data;
 } __attribute__((packed)) MBRTU_CTX_T;
 
+/*
+ * Function  : length of the RTU response frame to the request in mb_info
+ * mb_info   : the request
+ * return    : address + PDU + CRC bytes, 0=UNKNOWN
+ */
+UINT16_T mb_rtu_frame_len(MB_INFO_T *mb_info);
+
+/*
+ * Function  : the response is in once as many bytes as predicted from the request
+ *             or a whole exception frame are received, the CRC check tells the rest
+ * mb_data   : ModBus cache
+ * expect    : frame length of a normal response, 0=UNKNOWN
+ * return    : 1=COMPLETE 0=NOT YET
+ */
+int mb_rtu_frame_done(MB_DATA_T *mb_data, UINT16_T expect);
+
+/*
+ * Function  : encap slaver address + PDU + CRC of the request into a cleared cache,
+ *             shared by the serial line and RTU over TCP
+ * mb_rtu_data : ModBus RTU data
+ * return    : void
+ */
+void mb_rtu_frame_encap(MBRTU_DATA_T *mb_rtu_data);
+
+/*
+ * Function  : check slaver address and CRC of a received frame, decap its PDU
+ * mb_rtu_data : ModBus RTU data
+ * view      : the response, NULL=into mb_info
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_rtu_frame_decap(MBRTU_DATA_T *mb_rtu_data, MB_VIEW_T *view);
+
+/*
+ * Function  : open and configure a serial line, non-blocking, shared with ModBus ASCII
+ * rtu_ctl   : configure parameters of the line
+ * return    : file discriptor=SUCCESS -1=ERROR
+ */
+int mb_rtu_com_open(MBRTU_CTL_T *rtu_ctl);
+
+/*
+ * Function  : write a whole frame to a non-blocking serial line, a full output buffer
+ *             is waited for, shared with ModBus ASCII
+ * comfd     : serial line
+ * frame     : the frame
+ * len       : frame length
+ * return    : length=SUCCESS -1=ERROR
+ */
+int mb_rtu_com_write(int comfd, const UINT8_T *frame, UINT16_T len);
+
+/*
+ * Function  : only writes may be broadcast, nobody would answer a read, shared with ModBus ASCII
+ * mb_info   : request
+ * return    : 0=VALID -1=INVALID
+ */
+int mb_rtu_broadcast_check(MB_INFO_T *mb_info);
+
 /*
  * Function  : Create a ModBus RTU context
  * rtu_ctl   : configure parameters of ModBus RTU
@@ -58,21 +147,58 @@ MBRTU_CTX_T *mb_rtu_init(MBRTU_CTL_T *rtu_ctl);
 void mb_rtu_close(MBRTU_CTX_T *mbrtu_ctx);
 
 /*
- * Function  : send ModBus RTU data from ModBus cache to slaver
+ * Function  : send ModBus RTU data from ModBus cache to slaver, a broadcast(MBRTU_BROADCAST)
+ *             returns once the frame is on the line and the turnaround delay is over
  * mbrtu_ctx : ModBus RTU context
  * return    : 0=CLOSE length=SUCCESS -1=ERROR
  */
 int mb_rtu_send(MBRTU_CTX_T *mbrtu_ctx);
 
+/*
+ * Function  : encode a request once for mb_rtu_send_prepared, slaver address + PDU + CRC
+ *             to the slaver the context addresses now, the context itself is left alone
+ * mbrtu_ctx : ModBus RTU context the request is sent on
+ * mb_info   : the request
+ * prep      : prepared request
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_rtu_prepare(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep);
+
+/*
+ * Function  : send a prepared request like mb_rtu_send, nothing is encoded and the CRC is not
+ *             computed again, the context addresses the slaver of the request from then on
+ * mbrtu_ctx : ModBus RTU context of mb_rtu_prepare
+ * prep      : prepared request
+ * return    : 0=CLOSE length=SUCCESS -1=ERROR
+ */
+int mb_rtu_send_prepared(MBRTU_CTX_T *mbrtu_ctx, const MB_PREP_T *prep);
+
 /*
  * Function  : recv ModBus RTU data from slaver to ModBus cache
  * mbrtu_ctx : ModBus RTU context
- * return    : 0=CLOSE length=SUCCESS -1=ERROR
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
  */
 int mb_rtu_recv(MBRTU_CTX_T *mbrtu_ctx);
 
+/*
+ * Function  : recv ModBus RTU data from slaver, the response is decapped in place,
+ *             no value byte is copied and mb_info keeps the request
+ * mbrtu_ctx : ModBus RTU context
+ * view      : the response, valid until the next send/recv
+ * return    : 0=NO RESPONSE(broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_rtu_recv_view(MBRTU_CTX_T *mbrtu_ctx, MB_VIEW_T *view);
+
 void mbrtuctx_info_updata(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info);
 
 void mbrtuctx_info_takeout(MBRTU_CTX_T *mbrtu_ctx, MB_INFO_T *mb_info);
 
+/*
+ * Function  : address the next request to another slaver on the same line
+ * mbrtu_ctx : ModBus RTU context
+ * slaver_addr : slaver address, 1-247
+ * return    : void
+ */
+void mbrtuctx_slaver_set(MBRTU_CTX_T *mbrtu_ctx, UINT8_T slaver_addr);
+
 #endif
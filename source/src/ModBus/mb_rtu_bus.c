@@ -0,0 +1,220 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Share one ModBus RTU line among many slaver addresses
+ *            2. Round-robin cyclic polls, one-shot requests(writes) jump ahead of them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mb_rtu_bus.h"
+
+/*
+ * Function  : next request for the line, the one-shot queue first, then the next poll
+ * mbbus_ctx : bus scheduler
+ * req       : the request
+ * return    : 0=SUCCESS -1=NOTHING TO DO
+ */
+static int mbbus_req_next(MBBUS_CTX_T *mbbus_ctx, MBBUS_REQ_T *req)
+{
+    if (mbbus_ctx->q_num)
+    {
+        *req = mbbus_ctx->queue[mbbus_ctx->q_head];
+        mbbus_ctx->q_head = (mbbus_ctx->q_head + 1) % MBBUS_QUEUE_SIZE;
+        mbbus_ctx->q_num--;
+        return 0;
+    }
+
+    if (mbbus_ctx->n_poll)
+    {
+        *req = mbbus_ctx->poll[mbbus_ctx->next_poll];
+        mbbus_ctx->next_poll = (mbbus_ctx->next_poll + 1) % mbbus_ctx->n_poll;
+        return 0;
+    }
+
+    return -1;
+}
+
+/*
+ * Function  : one request and its response on the line
+ * mbbus_ctx : bus scheduler
+ * req       : the request
+ * return    : void
+ */
+static void mbbus_trans(MBBUS_CTX_T *mbbus_ctx, MBBUS_REQ_T *req)
+{
+    MBRTU_CTX_T *mbrtu_ctx = mbbus_ctx->mbrtu_ctx;
+    UINT64_T     begin     = mb_time_us();
+    MB_INFO_T   *mb_info   = NULL;
+
+    /* the line is busy from the end of the t3.5 gap on */
+    if (begin < mbrtu_ctx->mb_rtu_desc.idle_time)
+    {
+        begin = mbrtu_ctx->mb_rtu_desc.idle_time;
+    }
+
+    if (!mbbus_ctx->start)
+    {
+        mbbus_ctx->start = begin;
+    }
+
+    mbrtuctx_slaver_set(mbrtu_ctx, req->slaver_addr);
+    mbrtuctx_info_updata(mbrtu_ctx, req->mb_info);
+
+    /* a broadcast has no response, the request is handed back */
+    if (0 < mb_rtu_send(mbrtu_ctx) && 0 <= mb_rtu_recv(mbrtu_ctx))
+    {
+        mbrtuctx_info_takeout(mbrtu_ctx, &mbbus_ctx->resp);
+        mb_info = &mbbus_ctx->resp;
+    }
+    else
+    {
+        mbbus_ctx->err++;
+    }
+
+    mbbus_ctx->busy_time += mb_time_us() - begin;
+    mbbus_ctx->trans++;
+
+    if (req->cb)
+    {
+        req->cb(mbbus_ctx, req->slaver_addr, mb_info, req->arg);
+    }
+}
+
+MBBUS_CTX_T *mb_rtu_bus_create(MBRTU_CTX_T *mbrtu_ctx, int max_poll)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(mbrtu_ctx);
+
+    MBBUS_CTX_T *mbbus_ctx = NULL;
+
+    if (0 > max_poll)
+    {
+        printf("Invalid poll number of modbus bus\n");
+        return NULL;
+    }
+
+    mbbus_ctx = (MBBUS_CTX_T *)malloc(sizeof(MBBUS_CTX_T));
+    if (!mbbus_ctx)
+    {
+        printf("Can not create a modbus bus scheduler\n");
+        return NULL;
+    }
+    memset(mbbus_ctx, 0, sizeof(MBBUS_CTX_T));
+
+    /* one extra element, calloc(0) may return NULL */
+    mbbus_ctx->poll = (MBBUS_REQ_T *)calloc(max_poll + 1, sizeof(MBBUS_REQ_T));
+    if (!mbbus_ctx->poll)
+    {
+        printf("Can not create a modbus bus scheduler\n");
+        free(mbbus_ctx);
+        return NULL;
+    }
+
+    mbbus_ctx->mbrtu_ctx = mbrtu_ctx;
+    mbbus_ctx->max_poll  = max_poll;
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbbus_ctx;
+}
+
+void mb_rtu_bus_destory(MBBUS_CTX_T *mbbus_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mbbus_ctx);
+
+    free(mbbus_ctx->poll);
+    free(mbbus_ctx);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+int mb_rtu_bus_poll_add(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info,
+    mbbus_cb_t cb, void *arg)
+{
+    PTR_CHECK_N1(mbbus_ctx);
+    PTR_CHECK_N1(mb_info);
+
+    MBBUS_REQ_T *req = NULL;
+
+    if (mbbus_ctx->n_poll >= mbbus_ctx->max_poll)
+    {
+        printf("Too many polls on modbus bus\n");
+        return -1;
+    }
+
+    req = &mbbus_ctx->poll[mbbus_ctx->n_poll];
+    req->slaver_addr = slaver_addr;
+    req->mb_info     = mb_info;
+    req->cb          = cb;
+    req->arg         = arg;
+
+    return mbbus_ctx->n_poll++;
+}
+
+int mb_rtu_bus_submit(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info,
+    mbbus_cb_t cb, void *arg)
+{
+    PTR_CHECK_N1(mbbus_ctx);
+    PTR_CHECK_N1(mb_info);
+
+    MBBUS_REQ_T *req = NULL;
+
+    if (MBBUS_QUEUE_SIZE <= mbbus_ctx->q_num)
+    {
+        return -1;
+    }
+
+    req = &mbbus_ctx->queue[(mbbus_ctx->q_head + mbbus_ctx->q_num) % MBBUS_QUEUE_SIZE];
+    req->slaver_addr = slaver_addr;
+    req->mb_info     = mb_info;
+    req->cb          = cb;
+    req->arg         = arg;
+
+    mbbus_ctx->q_num++;
+
+    return 0;
+}
+
+int mb_rtu_bus_run(MBBUS_CTX_T *mbbus_ctx, int n_trans)
+{
+    PTR_CHECK_N1(mbbus_ctx);
+
+    MBBUS_REQ_T req;
+    int n = 0;
+
+    /* a callback may submit the next one-shot request, it is picked up at once */
+    while (n < n_trans && 0 == mbbus_req_next(mbbus_ctx, &req))
+    {
+        mbbus_trans(mbbus_ctx, &req);
+        n++;
+    }
+
+    return n;
+}
+
+void mb_rtu_bus_stat(MBBUS_CTX_T *mbbus_ctx, MBBUS_STAT_T *stat)
+{
+    PTR_CHECK_VOID(mbbus_ctx);
+    PTR_CHECK_VOID(stat);
+
+    memset(stat, 0, sizeof(MBBUS_STAT_T));
+
+    stat->trans     = mbbus_ctx->trans;
+    stat->err       = mbbus_ctx->err;
+    stat->busy_time = mbbus_ctx->busy_time;
+
+    if (mbbus_ctx->start)
+    {
+        stat->wall_time = mb_time_us() - mbbus_ctx->start;
+    }
+
+    if (stat->wall_time)
+    {
+        stat->utilization = (UINT32_T)(stat->busy_time * 10000 / stat->wall_time);
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Share one ModBus RTU line among many slaver addresses
+ *            2. Round-robin cyclic polls, one-shot requests(writes) jump ahead of them
+ */
+
+#ifndef MB_RTU_BUS
+#define MB_RTU_BUS
+
+#include "mb_rtu.h"
+
+#define MBBUS_QUEUE_SIZE 64
+
+typedef struct mbbus_ctx MBBUS_CTX_T;
+
+/*
+ * Function  : result of one request
+ * slaver_addr : slaver address of the request
+ * mb_info   : decapped response(the request of a broadcast), valid only during the call, 
+ *             NULL=TIMEOUT/ERROR
+ */
+typedef void (*mbbus_cb_t)(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info,
+    void *arg);
+
+typedef struct
+{
+    UINT8_T    slaver_addr;
+    MB_INFO_T *mb_info;         /* request, owned by caller */
+    mbbus_cb_t cb;
+    void      *arg;
+} MBBUS_REQ_T;
+
+typedef struct
+{
+    UINT64_T trans;             /* transactions done */
+    UINT64_T err;               /* transactions without a valid response */
+    UINT64_T busy_time;         /* us the line carried a request or waited for its response */
+    UINT64_T wall_time;         /* us since the first transaction */
+    UINT32_T utilization;       /* busy_time / wall_time, in 0.01% */
+} MBBUS_STAT_T;
+
+struct mbbus_ctx
+{
+    MBRTU_CTX_T *mbrtu_ctx;
+
+    /* cyclic polls, served in turn */
+    MBBUS_REQ_T *poll;
+    int          n_poll;
+    int          max_poll;
+    int          next_poll;
+
+    /* one-shot requests, served before the next poll */
+    MBBUS_REQ_T  queue[MBBUS_QUEUE_SIZE];
+    UINT16_T     q_head;
+    UINT16_T     q_num;
+
+    UINT64_T     start;
+    UINT64_T     trans;
+    UINT64_T     err;
+    UINT64_T     busy_time;
+    MB_INFO_T    resp;
+};
+
+/*
+ * Function  : Create a bus scheduler on one serial line, one scheduler belongs to one thread
+ * mbrtu_ctx : ModBus RTU context of the line, owned by caller
+ * max_poll  : max cyclic poll number
+ * return    : (MBBUS_CTX_T *)=SUCCESS NULL=ERROR
+ */
+MBBUS_CTX_T *mb_rtu_bus_create(MBRTU_CTX_T *mbrtu_ctx, int max_poll);
+
+/*
+ * Function  : destory a bus scheduler, the RTU context is not closed
+ * mbbus_ctx : bus scheduler
+ * return    : void
+ */
+void mb_rtu_bus_destory(MBBUS_CTX_T *mbbus_ctx);
+
+/*
+ * Function  : add a request polled once per cycle, mb_info must stay valid
+ * mbbus_ctx : bus scheduler
+ * slaver_addr : slaver address, 1-247
+ * cb        : result callback of every poll
+ * return    : poll id=SUCCESS -1=ERROR
+ */
+int mb_rtu_bus_poll_add(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info,
+    mbbus_cb_t cb, void *arg);
+
+/*
+ * Function  : queue a one-shot request such as a write, it goes out before the next poll,
+ *             mb_info must stay valid until the callback
+ * mbbus_ctx : bus scheduler
+ * slaver_addr : slaver address, 1-247, MBRTU_BROADCAST=every slaver(writes only)
+ * cb        : result callback
+ * return    : 0=SUCCESS -1=ERROR(queue full)
+ */
+int mb_rtu_bus_submit(MBBUS_CTX_T *mbbus_ctx, UINT8_T slaver_addr, MB_INFO_T *mb_info,
+    mbbus_cb_t cb, void *arg);
+
+/*
+ * Function  : run transactions back to back, the line rests for t3.5 between them only
+ * mbbus_ctx : bus scheduler
+ * n_trans   : max transaction number
+ * return    : number of transactions done, -1=ERROR
+ */
+int mb_rtu_bus_run(MBBUS_CTX_T *mbbus_ctx, int n_trans);
+
+/*
+ * Function  : transaction counters and bus utilization
+ * mbbus_ctx : bus scheduler
+ * stat      : filled with the counters
+ * return    : void
+ */
+void mb_rtu_bus_stat(MBBUS_CTX_T *mbbus_ctx, MBBUS_STAT_T *stat);
+
+#endif
@@ -0,0 +1,492 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Passive ModBus RTU bus sniffer, frames split by silence and predicted length
+ *            2. Pair requests with responses, log them in a compact binary file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <linux/serial.h>
+
+#include "mb_rtu_sniff.h"
+
+/*
+ * Function  : bytes lost by the serial driver, UART overruns and full flip buffers
+ * fd        : file discriptor for serial communication
+ * return    : byte number, 0=UNKNOWN(pty, USB adapters)
+ */
+static UINT32_T sniff_overrun(int fd)
+{
+    struct serial_icounter_struct icount;
+
+    if (0 > ioctl(fd, TIOCGICOUNT, &icount))
+    {
+        return 0;
+    }
+
+    return icount.overrun + icount.buf_overrun;
+}
+
+static int sniff_crc_check(UINT8_T *data, UINT32_T len)
+{
+    return (4 <= len) && (mb_crc16(data, len - 2) == (data[len - 2] | (data[len - 1] << 8)));
+}
+
+static void sniff_rec_write(MBSNIFF_CTX_T *mbsniff_ctx, MBSNIFF_REC_T *rec, UINT8_T *data)
+{
+    if (!mbsniff_ctx->log)
+    {
+        return ;
+    }
+
+    fwrite(rec, sizeof(MBSNIFF_REC_T), 1, mbsniff_ctx->log);
+    if (rec->len)
+    {
+        fwrite(data, rec->len, 1, mbsniff_ctx->log);
+    }
+}
+
+/*
+ * Function  : the pending request got no response
+ * return    : void
+ */
+static void sniff_timeout(MBSNIFF_CTX_T *mbsniff_ctx)
+{
+    MBSNIFF_REC_T rec = mbsniff_ctx->req;
+
+    if (!mbsniff_ctx->pending)
+    {
+        return ;
+    }
+
+    rec.type = MBSNIFF_REC_TIMEOUT;
+    rec.len  = 0;
+    sniff_rec_write(mbsniff_ctx, &rec, NULL);
+
+    mbsniff_ctx->stat.timeout++;
+    mbsniff_ctx->pending = 0;
+}
+
+/*
+ * Function  : a frame may answer the pending request when the address and function code match,
+ *             it does only at the length of a response
+ * data      : the frame, address and function code at least
+ * return    : frame length of the response, 0=UNKNOWN -1=NO RESPONSE
+ */
+static int sniff_response_len(MBSNIFF_CTX_T *mbsniff_ctx, UINT8_T *data)
+{
+    if (!mbsniff_ctx->pending || data[0] != mbsniff_ctx->req.slaver_addr || 
+        (data[1] & 0x7f) != mbsniff_ctx->req.code)
+    {
+        return -1;
+    }
+
+    return (data[1] & 0x80) ? MBRTU_EXCEPTION_LEN : mbsniff_ctx->resp_len;
+}
+
+/*
+ * Function  : decap, pair and log one frame
+ * data      : the frame, address to CRC
+ * len       : frame length
+ * first     : time its first byte was on the line
+ * return    : void
+ */
+static void sniff_frame(MBSNIFF_CTX_T *mbsniff_ctx, UINT8_T *data, UINT32_T len, UINT64_T first)
+{
+    MB_DATA_T    *mb_data   = mbsniff_ctx->mb_data;
+    MB_INFO_T    *mb_info   = &mb_data->mb_info;
+    MBRTU_DESC_T *desc      = &mbsniff_ctx->mbrtu_ctx->mb_rtu_desc;
+    MBSNIFF_REC_T rec;
+    UINT16_T      resp_len  = 0;
+    int           expect    = 0;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.time        = first + mbsniff_ctx->clock_offset;
+    rec.len         = len;
+    rec.slaver_addr = data[0];
+    rec.code        = (2 <= len) ? data[1] : 0;
+
+    /* nothing longer than an RTU frame is copied to the cache, whatever its CRC */
+    if (MBRTU_FRAME_SIZE < len || !sniff_crc_check(data, len))
+    {
+        rec.type = MBSNIFF_REC_BAD;
+        sniff_rec_write(mbsniff_ctx, &rec, data);
+        mbsniff_ctx->stat.crc_err++;
+        return ;
+    }
+
+    /* address + PDU, without CRC */
+    memcpy(mb_data->data, data, len - 2);
+    mb_data->data_len         = len - 2;
+    mb_data->offset           = 1;
+    mb_data->operate_data_len = 0;
+
+    /* a retry of the request to a silent slaver has the same address and function code */
+    expect = sniff_response_len(mbsniff_ctx, data);
+    if (0 == expect || len == (UINT32_T)expect)
+    {
+        mb_info->err = 0;
+        mb_data_decap(mb_data);
+
+        rec.type    = MBSNIFF_REC_RESPONSE;
+        rec.err     = (data[1] & 0x80) ? mb_info->err : 0;
+        rec.reg     = mbsniff_ctx->req.reg;
+        rec.n_reg   = mbsniff_ctx->req.n_reg;
+        rec.latency = (first > mbsniff_ctx->req_end) ? (first - mbsniff_ctx->req_end) : 0;
+        sniff_rec_write(mbsniff_ctx, &rec, data);
+
+        mbsniff_ctx->stat.response++;
+        mbsniff_ctx->pending = 0;
+        return ;
+    }
+
+    sniff_timeout(mbsniff_ctx);
+
+    mb_request_decap(mb_data);
+    rec.reg   = mb_info->reg;
+    rec.n_reg = mb_info->n_reg;
+
+    if (MBRTU_BROADCAST == data[0])
+    {
+        rec.type = MBSNIFF_REC_BROADCAST;
+        sniff_rec_write(mbsniff_ctx, &rec, data);
+        mbsniff_ctx->stat.broadcast++;
+        return ;
+    }
+
+    rec.type = MBSNIFF_REC_REQUEST;
+    sniff_rec_write(mbsniff_ctx, &rec, data);
+    mbsniff_ctx->stat.request++;
+
+    /* address + PDU + CRC, a response longer than an RTU frame is ended by silence */
+    resp_len = mb_response_pdu_len(mb_info);
+    if (resp_len + 1 + sizeof(UINT16_T) > MBRTU_FRAME_SIZE)
+    {
+        resp_len = 0;
+    }
+
+    mbsniff_ctx->req      = rec;
+    mbsniff_ctx->pending  = 1;
+    mbsniff_ctx->resp_len = resp_len ? (resp_len + 1 + sizeof(UINT16_T)) : 0;
+    mbsniff_ctx->req_end  = first + (UINT64_T)len * desc->char_time;
+}
+
+/*
+ * Function  : length of a frame, from the function code and the pending request, 
+ *             confirmed by its CRC
+ * buf       : bytes starting with the frame
+ * len       : number of bytes
+ * return    : length, 0=NOT COMPLETE -1=NO VALID FRAME
+ */
+static int sniff_frame_len(MBSNIFF_CTX_T *mbsniff_ctx, UINT8_T *buf, UINT32_T len)
+{
+    int total = 0;
+    int pdu   = 0;
+    int wait  = 0;
+
+    if (2 > len)
+    {
+        return 0;
+    }
+
+    total = sniff_response_len(mbsniff_ctx, buf);
+    if (0 <= total)
+    {
+        if (!total || (UINT32_T)total > len)
+        {
+            wait = 1;
+        }
+        else if (sniff_crc_check(buf, total))
+        {
+            return total;
+        }
+    }
+
+    pdu = mb_request_pdu_len(buf + 1, len - 1);
+    if (0 < pdu && pdu + 3 > MBRTU_FRAME_SIZE)
+    {
+        /* a byte count no RTU frame can hold */
+        return wait ? 0 : -1;
+    }
+    else if (0 == pdu || (0 < pdu && pdu + 3 > len))
+    {
+        return 0;
+    }
+    else if (0 < pdu && sniff_crc_check(buf, pdu + 3))
+    {
+        return pdu + 3;
+    }
+
+    return wait ? 0 : -1;
+}
+
+/*
+ * Function  : find the next valid frame after a corrupted one, without a silence between them
+ * return    : offset of the frame, 0=NOT FOUND
+ */
+static UINT32_T sniff_resync(MBSNIFF_CTX_T *mbsniff_ctx)
+{
+    UINT32_T k = 0;
+
+    for (k = 1; k + 4 <= mbsniff_ctx->len; ++k)
+    {
+        if (0 < sniff_frame_len(mbsniff_ctx, mbsniff_ctx->buf + k, mbsniff_ctx->len - k))
+        {
+            return k;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : cut the received bytes into frames
+ * silence   : the line has been silent for t3.5, the bytes left are one frame
+ * return    : number of frames
+ */
+static int sniff_split(MBSNIFF_CTX_T *mbsniff_ctx, int silence)
+{
+    UINT32_T char_time = mbsniff_ctx->mbrtu_ctx->mb_rtu_desc.char_time;
+    int n = 0;
+    int frames = 0;
+
+    while (mbsniff_ctx->len)
+    {
+        n = sniff_frame_len(mbsniff_ctx, mbsniff_ctx->buf, mbsniff_ctx->len);
+        if (0 > n)
+        {
+            /* the bad bytes end where the next valid frame starts */
+            n = sniff_resync(mbsniff_ctx);
+        }
+
+        if (0 >= n)
+        {
+            /* a full cache holds no frame */
+            if (!silence && MBSNIFF_BUF_SIZE > mbsniff_ctx->len)
+            {
+                break;
+            }
+            n = mbsniff_ctx->len;
+        }
+
+        sniff_frame(mbsniff_ctx, mbsniff_ctx->buf, n, mbsniff_ctx->first);
+        frames++;
+
+        /* frames of one read came back to back */
+        mbsniff_ctx->first += (UINT64_T)n * char_time;
+        mbsniff_ctx->len   -= n;
+        memmove(mbsniff_ctx->buf, mbsniff_ctx->buf + n, mbsniff_ctx->len);
+    }
+
+    return frames;
+}
+
+/*
+ * Function  : the line went silent, the bytes left end there unless they are the head 
+ *             of a frame, which is kept until the next bytes come in once
+ * return    : number of frames
+ */
+static int sniff_silence(MBSNIFF_CTX_T *mbsniff_ctx)
+{
+    if (!mbsniff_ctx->held && 0 == sniff_frame_len(mbsniff_ctx, mbsniff_ctx->buf, mbsniff_ctx->len))
+    {
+        mbsniff_ctx->held = 1;
+        return 0;
+    }
+
+    mbsniff_ctx->held = 0;
+
+    return sniff_split(mbsniff_ctx, 1);
+}
+
+MBSNIFF_CTX_T *mb_rtu_sniff_create(MBRTU_CTX_T *mbrtu_ctx, const char *log_path)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(mbrtu_ctx);
+
+    MBSNIFF_CTX_T    *mbsniff_ctx = NULL;
+    MBSNIFF_LOG_HDR_T hdr;
+    struct timespec   ts;
+
+    mbsniff_ctx = (MBSNIFF_CTX_T *)malloc(sizeof(MBSNIFF_CTX_T));
+    if (!mbsniff_ctx)
+    {
+        printf("Can not create a modbus sniffer\n");
+        return NULL;
+    }
+    memset(mbsniff_ctx, 0, sizeof(MBSNIFF_CTX_T));
+
+    mbsniff_ctx->mb_data = mb_data_create(MBRTU_FRAME_SIZE);
+    if (!mbsniff_ctx->mb_data)
+    {
+        printf("Can not create a modbus sniffer\n");
+        free(mbsniff_ctx);
+        return NULL;
+    }
+
+    if (log_path)
+    {
+        mbsniff_ctx->log     = fopen(log_path, "wb");
+        mbsniff_ctx->log_buf = (char *)malloc(MBSNIFF_LOG_BUF);
+        if (!mbsniff_ctx->log || !mbsniff_ctx->log_buf)
+        {
+            perror("sniffer log error");
+            mb_rtu_sniff_destory(mbsniff_ctx);
+            return NULL;
+        }
+
+        /* records are written in large blocks, the line is never waited on for the disk */
+        setvbuf(mbsniff_ctx->log, mbsniff_ctx->log_buf, _IOFBF, MBSNIFF_LOG_BUF);
+
+        hdr.magic     = MBSNIFF_MAGIC;
+        hdr.version   = MBSNIFF_VERSION;
+        hdr.rec_size  = sizeof(MBSNIFF_REC_T);
+        hdr.char_time = mbrtu_ctx->mb_rtu_desc.char_time;
+        hdr.t35       = mbrtu_ctx->mb_rtu_desc.t35;
+        fwrite(&hdr, sizeof(hdr), 1, mbsniff_ctx->log);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    mbsniff_ctx->clock_offset = ((INT64_T)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000) - mb_time_us();
+
+    mbsniff_ctx->mbrtu_ctx    = mbrtu_ctx;
+    mbsniff_ctx->overrun_base = sniff_overrun(mbrtu_ctx->mb_rtu_desc.com_fd);
+    mbrtu_ctx->mb_rtu_desc.listen = 1;
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbsniff_ctx;
+}
+
+void mb_rtu_sniff_destory(MBSNIFF_CTX_T *mbsniff_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mbsniff_ctx);
+
+    if (mbsniff_ctx->mbrtu_ctx)
+    {
+        sniff_split(mbsniff_ctx, 1);
+        sniff_timeout(mbsniff_ctx);
+    }
+
+    if (mbsniff_ctx->log)
+    {
+        fclose(mbsniff_ctx->log);
+    }
+
+    free(mbsniff_ctx->log_buf);
+    mb_data_destory(mbsniff_ctx->mb_data);
+    free(mbsniff_ctx);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+int mb_rtu_sniff_run(MBSNIFF_CTX_T *mbsniff_ctx, int timeout)
+{
+    PTR_CHECK_N1(mbsniff_ctx);
+
+    MBRTU_DESC_T  *desc   = &mbsniff_ctx->mbrtu_ctx->mb_rtu_desc;
+    struct timeval tv;
+    fd_set   rset;
+    UINT64_T now    = mb_time_us();
+    UINT64_T begin  = 0;
+    int      frames = 0;
+    int      ready  = 0;
+    int      length = 0;
+
+    /* the frame in progress ends once the line is silent for t3.5 */
+    if (mbsniff_ctx->len && !mbsniff_ctx->held)
+    {
+        if (now >= mbsniff_ctx->last + desc->t35)
+        {
+            return sniff_silence(mbsniff_ctx);
+        }
+
+        tv.tv_sec  = 0;
+        tv.tv_usec = mbsniff_ctx->last + desc->t35 - now;
+    }
+    else
+    {
+        tv.tv_sec  = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+    }
+
+    FD_ZERO(&rset);
+    FD_SET(desc->com_fd, &rset);
+
+    ready = select(desc->com_fd + 1, &rset, NULL, NULL, 
+        (0 > timeout && (!mbsniff_ctx->len || mbsniff_ctx->held)) ? NULL : &tv);
+    if (0 > ready)
+    {
+        if (EINTR == errno)
+        {
+            return 0;
+        }
+
+        perror("select error");
+        return -1;
+    }
+    else if (0 == ready)
+    {
+        /* nothing came to finish a held frame either */
+        return mbsniff_ctx->len ? sniff_silence(mbsniff_ctx) : 0;
+    }
+
+    length = read(desc->com_fd, mbsniff_ctx->buf + mbsniff_ctx->len, MBSNIFF_BUF_SIZE - mbsniff_ctx->len);
+    if (0 >= length)
+    {
+        if (0 == length || EAGAIN == errno || EINTR == errno)
+        {
+            return 0;
+        }
+
+        perror("read error");
+        return -1;
+    }
+
+    /* the bytes were on the line one after another until now */
+    now   = mb_time_us();
+    begin = now - (UINT64_T)length * desc->char_time;
+
+    /* a held frame CRC-confirmed over the silence was only delayed, by a USB adapter or a pty */
+    if (mbsniff_ctx->held && sniff_frame_len(mbsniff_ctx, mbsniff_ctx->buf, mbsniff_ctx->len + length) > mbsniff_ctx->len)
+    {
+        mbsniff_ctx->held = 0;
+    }
+    else if (mbsniff_ctx->len && (mbsniff_ctx->held || begin >= mbsniff_ctx->last + desc->t35))
+    {
+        /* a silence before them, the bytes before it are one frame */
+        mbsniff_ctx->held = 0;
+        memmove(mbsniff_ctx->buf + MBSNIFF_BUF_SIZE - length, mbsniff_ctx->buf + mbsniff_ctx->len, length);
+        frames += sniff_split(mbsniff_ctx, 1);
+        memmove(mbsniff_ctx->buf, mbsniff_ctx->buf + MBSNIFF_BUF_SIZE - length, length);
+    }
+
+    if (!mbsniff_ctx->len)
+    {
+        mbsniff_ctx->first = (begin > mbsniff_ctx->last) ? begin : mbsniff_ctx->last;
+    }
+
+    mbsniff_ctx->len  += length;
+    mbsniff_ctx->last  = now;
+    mbsniff_ctx->stat.bytes += length;
+
+    return frames + sniff_split(mbsniff_ctx, 0);
+}
+
+void mb_rtu_sniff_stat(MBSNIFF_CTX_T *mbsniff_ctx, MBSNIFF_STAT_T *stat)
+{
+    PTR_CHECK_VOID(mbsniff_ctx);
+    PTR_CHECK_VOID(stat);
+
+    *stat = mbsniff_ctx->stat;
+    stat->overrun = sniff_overrun(mbsniff_ctx->mbrtu_ctx->mb_rtu_desc.com_fd) - mbsniff_ctx->overrun_base;
+}
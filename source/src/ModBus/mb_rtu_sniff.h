@@ -0,0 +1,119 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Passive ModBus RTU bus sniffer, frames split by silence and predicted length
+ *            2. Pair requests with responses, log them in a compact binary file
+ */
+
+#ifndef MB_RTU_SNIFF
+#define MB_RTU_SNIFF
+
+#include <stdio.h>
+
+#include "mb_rtu.h"
+
+#define MBSNIFF_MAGIC    0x4e53424d     /* "MBSN" */
+#define MBSNIFF_VERSION  1
+#define MBSNIFF_BUF_SIZE (MBRTU_FRAME_SIZE * 16)
+#define MBSNIFF_LOG_BUF  (1 << 20)
+
+typedef enum
+{
+    MBSNIFF_REC_REQUEST = 0,    /* a response to it is expected */
+    MBSNIFF_REC_RESPONSE,       /* answers the request before it */
+    MBSNIFF_REC_BROADCAST,      /* request to MBRTU_BROADCAST */
+    MBSNIFF_REC_TIMEOUT,        /* the request before it got no response, no raw bytes */
+    MBSNIFF_REC_BAD             /* CRC error or no frame at all, raw bytes only */
+} MBSNIFF_REC_TYPE_T;
+
+/* head of the log file */
+typedef struct
+{
+    UINT32_T magic;
+    UINT16_T version;
+    UINT16_T rec_size;          /* sizeof(MBSNIFF_REC_T) */
+    UINT32_T char_time;         /* us */
+    UINT32_T t35;               /* us */
+} __attribute__((packed)) MBSNIFF_LOG_HDR_T;
+
+/* one frame in the log, len raw bytes with CRC follow it */
+typedef struct
+{
+    UINT64_T time;              /* us since the epoch, first byte of the frame */
+    UINT32_T latency;           /* RESPONSE : us from the end of the request to its first byte */
+    UINT8_T  type;              /* MBSNIFF_REC_TYPE_T */
+    UINT8_T  slaver_addr;
+    UINT8_T  code;              /* | 0x80 for an exception response */
+    UINT8_T  err;               /* exception code */
+    UINT16_T reg;               /* of the request */
+    UINT16_T n_reg;
+    UINT16_T len;
+} __attribute__((packed)) MBSNIFF_REC_T;
+
+typedef struct
+{
+    UINT64_T bytes;
+    UINT64_T request;
+    UINT64_T response;
+    UINT64_T broadcast;
+    UINT64_T timeout;           /* requests without response */
+    UINT64_T crc_err;           /* bad frames */
+    UINT64_T overrun;           /* bytes the serial driver lost, 0 when it can not tell */
+} MBSNIFF_STAT_T;
+
+typedef struct
+{
+    MBRTU_CTX_T *mbrtu_ctx;
+    MB_DATA_T   *mb_data;       /* decap cache */
+    FILE        *log;
+    char        *log_buf;
+    INT64_T      clock_offset;  /* epoch - monotonic time(us) */
+    UINT32_T     overrun_base;  /* driver counters when the sniffer started */
+
+    /* bytes not split into frames yet */
+    UINT8_T      buf[MBSNIFF_BUF_SIZE];
+    UINT32_T     len;
+    UINT64_T     first;         /* time the first of them was on the line */
+    UINT64_T     last;          /* time the last of them came in */
+    UINT8_T      held;          /* an incomplete frame kept over a silence, the next bytes may finish it */
+
+    /* request waiting for its response */
+    UINT8_T      pending;
+    UINT16_T     resp_len;      /* frame length of a normal response, 0=UNKNOWN */
+    UINT64_T     req_end;
+    MBSNIFF_REC_T req;
+
+    MBSNIFF_STAT_T stat;
+} MBSNIFF_CTX_T;
+
+/*
+ * Function  : Create a sniffer on a ModBus RTU line, the context never transmits from now on
+ * mbrtu_ctx : ModBus RTU context of the line, better opened with rtu_ctl.listen, owned by caller
+ * log_path  : binary log file, NULL=NO LOG
+ * return    : (MBSNIFF_CTX_T *)=SUCCESS NULL=ERROR
+ */
+MBSNIFF_CTX_T *mb_rtu_sniff_create(MBRTU_CTX_T *mbrtu_ctx, const char *log_path);
+
+/*
+ * Function  : log the frame in progress, close the log and destory the sniffer
+ * mbsniff_ctx : sniffer
+ * return    : void
+ */
+void mb_rtu_sniff_destory(MBSNIFF_CTX_T *mbsniff_ctx);
+
+/*
+ * Function  : read the line once and log every complete frame
+ * mbsniff_ctx : sniffer
+ * timeout   : max wait time(ms) for the first byte, -1=until a byte
+ * return    : number of frames, -1=ERROR
+ */
+int mb_rtu_sniff_run(MBSNIFF_CTX_T *mbsniff_ctx, int timeout);
+
+/*
+ * Function  : frame counters of the sniffer
+ * mbsniff_ctx : sniffer
+ * stat      : filled with the counters
+ * return    : void
+ */
+void mb_rtu_sniff_stat(MBSNIFF_CTX_T *mbsniff_ctx, MBSNIFF_STAT_T *stat);
+
+#endif
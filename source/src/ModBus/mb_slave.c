@@ -0,0 +1,231 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. In-memory coil/register store of a ModBus slaver
+ *            2. Serve request PDUs from it, independent of the transport
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mb_slave.h"
+
+/*
+ * Function  : check the register range of a request
+ * mb_info   : decapped request
+ * max_num   : max register number of the function code
+ * size      : register number of the store
+ * return    : 0=VALID exception code=INVALID
+ */
+static MB_ERR_T slave_range_check(MB_INFO_T *mb_info, UINT16_T max_num, UINT32_T size)
+{
+    if (!mb_info->n_reg || mb_info->n_reg > max_num)
+    {
+        return MB_ERR_DATA;
+    }
+
+    if ((UINT32_T)mb_info->reg + mb_info->n_reg > size)
+    {
+        return MB_ERR_ADDR;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : pack bits of the store into response bytes, LSB first
+ * return    : void
+ */
+static void slave_bits_read(MB_INFO_T *mb_info, UINT8_T *bits)
+{
+    UINT64_T bitmap[MBCOIL_WORDS(MBSLV_MAX_READ_BIT)];
+
+    mb_coil_pack(bitmap, bits + mb_info->reg, mb_info->n_reg);
+
+    mb_info->n_byte = ALIGNED(mb_info->n_reg, 8);
+    mb_coil_store(mb_info->value, bitmap, mb_info->n_reg);
+}
+
+/*
+ * Function  : registers of the store into big endian response bytes
+ * return    : void
+ */
+static void slave_regs_read(MB_INFO_T *mb_info, UINT16_T *regs)
+{
+    mb_info->n_byte = mb_info->n_reg * 2;
+    mb_reg_encode(mb_info->value, regs + mb_info->reg, mb_info->n_reg);
+}
+
+/*
+ * Function  : apply a request to the store, mb_info becomes the response
+ * return    : 0=SUCCESS exception code=ERROR
+ */
+static MB_ERR_T slave_serve(MBSLV_STORE_T *store, MB_INFO_T *mb_info)
+{
+    UINT64_T bitmap[MBCOIL_WORDS(MB_WRITE_COIL_MAX_NUM)];
+    MB_ERR_T err  = 0;
+    UINT16_T word = 0;
+
+    switch (mb_info->code)
+    {
+        case MB_FUNC_01 :
+            if (!(err = slave_range_check(mb_info, MBSLV_MAX_READ_BIT, store->n_coil)))
+            {
+                slave_bits_read(mb_info, store->coil);
+            }
+            break;
+
+        case MB_FUNC_02 :
+            if (!(err = slave_range_check(mb_info, MBSLV_MAX_READ_BIT, store->n_discrete)))
+            {
+                slave_bits_read(mb_info, store->discrete);
+            }
+            break;
+
+        case MB_FUNC_03 :
+            if (!(err = slave_range_check(mb_info, MBSLV_MAX_READ_REG, store->n_holding)))
+            {
+                slave_regs_read(mb_info, store->holding);
+            }
+            break;
+
+        case MB_FUNC_04 :
+            if (!(err = slave_range_check(mb_info, MBSLV_MAX_READ_REG, store->n_input)))
+            {
+                slave_regs_read(mb_info, store->input);
+            }
+            break;
+
+        case MB_FUNC_05 :
+            word = (mb_info->value[0] << 8) | mb_info->value[1];
+            if (MBSLV_COIL_ON != word && 0 != word)
+            {
+                err = MB_ERR_DATA;
+            }
+            else if (!(err = slave_range_check(mb_info, 1, store->n_coil)))
+            {
+                store->coil[mb_info->reg] = !!word;
+            }
+            break;
+
+        case MB_FUNC_06 :
+            if (!(err = slave_range_check(mb_info, 1, store->n_holding)))
+            {
+                store->holding[mb_info->reg] = (mb_info->value[0] << 8) | mb_info->value[1];
+            }
+            break;
+
+        case MB_FUNC_0f :
+            if (mb_info->n_byte != ALIGNED(mb_info->n_reg, 8))
+            {
+                err = MB_ERR_DATA;
+            }
+            else if (!(err = slave_range_check(mb_info, MB_WRITE_COIL_MAX_NUM, store->n_coil)))
+            {
+                mb_coil_load(bitmap, mb_info->value, mb_info->n_reg);
+                mb_coil_unpack(store->coil + mb_info->reg, bitmap, mb_info->n_reg);
+            }
+            break;
+
+        case MB_FUNC_10 :
+            if (mb_info->n_byte != mb_info->n_reg * 2)
+            {
+                err = MB_ERR_DATA;
+            }
+            else if (!(err = slave_range_check(mb_info, MB_WRITE_REG_MAX_NUM, store->n_holding)))
+            {
+                mb_reg_decode(store->holding + mb_info->reg, mb_info->value, mb_info->n_reg);
+            }
+            break;
+
+        default :
+            err = MB_ERR_FUNC;
+            break;
+    }
+
+    return err;
+}
+
+MBSLV_STORE_T *mb_slave_store_create(MBSLV_CTL_T *slv_ctl)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(slv_ctl);
+
+    MBSLV_STORE_T *store = NULL;
+
+    if (0x10000 < slv_ctl->n_coil || 0x10000 < slv_ctl->n_discrete ||
+        0x10000 < slv_ctl->n_holding || 0x10000 < slv_ctl->n_input)
+    {
+        printf("Invalid register number of modbus slaver store\n");
+        return NULL;
+    }
+
+    store = (MBSLV_STORE_T *)malloc(sizeof(MBSLV_STORE_T));
+    if (!store)
+    {
+        printf("Can not create a modbus slaver store\n");
+        return NULL;
+    }
+    memset(store, 0, sizeof(MBSLV_STORE_T));
+
+    store->n_coil     = slv_ctl->n_coil;
+    store->n_discrete = slv_ctl->n_discrete;
+    store->n_holding  = slv_ctl->n_holding;
+    store->n_input    = slv_ctl->n_input;
+
+    /* one extra element, calloc(0) may return NULL */
+    store->coil     = (UINT8_T *)calloc(store->n_coil + 1, sizeof(UINT8_T));
+    store->discrete = (UINT8_T *)calloc(store->n_discrete + 1, sizeof(UINT8_T));
+    store->holding  = (UINT16_T *)calloc(store->n_holding + 1, sizeof(UINT16_T));
+    store->input    = (UINT16_T *)calloc(store->n_input + 1, sizeof(UINT16_T));
+
+    if (!store->coil || !store->discrete || !store->holding || !store->input)
+    {
+        printf("Can not create a modbus slaver store\n");
+        mb_slave_store_destory(store);
+        return NULL;
+    }
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return store;
+}
+
+void mb_slave_store_destory(MBSLV_STORE_T *store)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(store);
+
+    free(store->coil);
+    free(store->discrete);
+    free(store->holding);
+    free(store->input);
+
+    free(store);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+int mb_slave_handle(MBSLV_STORE_T *store, MB_DATA_T *mb_data)
+{
+    PTR_CHECK_N1(store);
+    PTR_CHECK_N1(mb_data);
+
+    UINT16_T   pdu     = mb_data->offset;
+    MB_INFO_T *mb_info = &mb_data->mb_info;
+
+    /* decap request PDU */
+    if (0 == mb_request_decap(mb_data))
+    {
+        mb_info->err = slave_serve(store, mb_info);
+    }
+
+    /* encap response PDU in place of the request */
+    mb_data->data_len         = pdu;
+    mb_data->operate_data_len = pdu;
+    mb_response_encap(mb_data);
+
+    return !!mb_info->err;
+}
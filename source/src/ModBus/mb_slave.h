@@ -0,0 +1,61 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. In-memory coil/register store of a ModBus slaver
+ *            2. Serve request PDUs from it, independent of the transport
+ */
+
+#ifndef MB_SLAVE
+#define MB_SLAVE
+
+#include "mb_common.h"
+#include "mb_coil.h"
+
+#define MBSLV_MAX_READ_BIT   2000
+#define MBSLV_MAX_READ_REG   125
+#define MBSLV_COIL_ON        0xff00
+
+typedef struct
+{
+    UINT32_T n_coil;            /* FC01/05/0F */
+    UINT32_T n_discrete;        /* FC02 */
+    UINT32_T n_holding;         /* FC03/06/10 */
+    UINT32_T n_input;           /* FC04 */
+} MBSLV_CTL_T;
+
+/* flat arrays indexed by register address, owned by one thread */
+typedef struct
+{
+    UINT32_T  n_coil;
+    UINT32_T  n_discrete;
+    UINT32_T  n_holding;
+    UINT32_T  n_input;
+    UINT8_T  *coil;             /* one byte per coil, 0/1 */
+    UINT8_T  *discrete;         /* one byte per input, 0/1 */
+    UINT16_T *holding;          /* host order */
+    UINT16_T *input;            /* host order */
+} MBSLV_STORE_T;
+
+/*
+ * Function  : Create a zeroed coil/register store
+ * slv_ctl   : number of every register type, up to 65536
+ * return    : (MBSLV_STORE_T *)=SUCCESS NULL=ERROR
+ */
+MBSLV_STORE_T *mb_slave_store_create(MBSLV_CTL_T *slv_ctl);
+
+/*
+ * Function  : destory a coil/register store
+ * store     : the store you want to destory
+ * return    : void
+ */
+void mb_slave_store_destory(MBSLV_STORE_T *store);
+
+/*
+ * Function  : serve one request, its PDU is decapped from offset and the response PDU
+ *             replaces it, data_len is the new frame length
+ * store     : coil/register store
+ * mb_data   : ModBus cache holding the request frame
+ * return    : 0=RESPONSE 1=EXCEPTION RESPONSE
+ */
+int mb_slave_handle(MBSLV_STORE_T *store, MB_DATA_T *mb_data);
+
+#endif
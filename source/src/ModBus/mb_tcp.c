@@ -12,33 +12,33 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <arpa/inet.h> 
 #include <net/if.h>
 #include <netinet/tcp.h>
+#include <fcntl.h>
 
 #include "mb_tcp.h"
 
 /*
  * Function : encap the Modbus TCP MBAP(ModBus Application Protocol),will updata cache offset for write
+ * tx_mbap_head : MBAP of the request
  * mb_data  : ModBus cache
  * return   : void
  */
-static void mbap_head_encap(MBTCP_DATA_T *mb_tcp_data)
+static void mbap_head_encap(const MBAP_HEAD_T *tx_mbap_head, MB_DATA_T *mb_data)
 {
-    PTR_CHECK_VOID(mb_tcp_data);
-    
-    mb_tcp_data->mbap_head[MB_TX].transaction_code++;
+    PTR_CHECK_VOID(tx_mbap_head);
+    PTR_CHECK_VOID(mb_data);
 
-    MBAP_HEAD_T mbap_head = mb_tcp_data->mbap_head[MB_TX];
+    MBAP_HEAD_T mbap_head = *tx_mbap_head;
     
-    if (!mb_tcp_data->mb_data->is_big_endian)
-    {
-        mbap_head.transaction_code = b2l_endian(mbap_head.transaction_code);
-    }
+    mbap_head.transaction_code = MB_HTOLE16(mbap_head.transaction_code);
 
-    *((MBAP_HEAD_T *)mb_tcp_data->mb_data->data) = mbap_head;
-    mb_tcp_data->mb_data->data_len += sizeof(MBAP_HEAD_T);
+    *((MBAP_HEAD_T *)mb_data->data) = mbap_head;
+    mb_data->data_len += sizeof(MBAP_HEAD_T);
 }
 
 /*
@@ -46,45 +46,180 @@ static void mbap_head_encap(MBTCP_DATA_T *mb_tcp_data)
  * mb_data  : ModBus cache
  * return   : void
  */
-static void mbap_head_re_encap(MBTCP_DATA_T *mb_tcp_data)
+static void mbap_head_re_encap(MB_DATA_T *mb_data)
 {
-    PTR_CHECK_VOID(mb_tcp_data);
+    PTR_CHECK_VOID(mb_data);
+
+    UINT16_T data_len = mb_data->data_len - (sizeof(MBAP_HEAD_T) - 1);
+
+    data_len = MB_HTOBE16(data_len);
+
+    ((MBAP_HEAD_T *)mb_data->data)->data_length = data_len;
+}
 
-    MB_DATA_T *mb_data  = mb_tcp_data->mb_data;
-    UINT16_T   data_len = mb_data->data_len - (sizeof(MBAP_HEAD_T) - 1);
+/*
+ * Function  : drop outstanding transactions whose response deadline has passed
+ * mbtcp_ctx : ModBus TCP context
+ * now       : current time(us)
+ * cb        : called for every dropped transaction, NULL=report on console
+ * return    : void
+ */
+static void mbtcp_trans_expire(MBTCP_CTX_T *mbtcp_ctx, UINT64_T now, mbtcp_trans_cb_t cb, void *arg)
+{
+    int i = 0;
+    MBTCP_DATA_T *mb_tcp_data = &mbtcp_ctx->mb_tcp_data;
 
-    if (mb_data->is_big_endian)
+    for (i = 0; i < mb_tcp_data->window && mb_tcp_data->pending; ++i)
     {
-        data_len = b2l_endian(data_len);
+        if (mb_tcp_data->trans[i].used && now >= mb_tcp_data->trans[i].deadline)
+        {
+            mb_tcp_data->trans[i].used = 0;
+            mb_tcp_data->pending--;
+
+            if (cb)
+            {
+                cb(mbtcp_ctx, mb_tcp_data->trans[i].transaction_code, arg);
+            }
+            else
+            {
+                printf("MBAP transaction(0x%02x) timeout\n", mb_tcp_data->trans[i].transaction_code);
+            }
+        }
     }
+}
 
-    ((MBAP_HEAD_T *)mb_data->data)->data_length = data_len;
+/*
+ * Function  : drop every outstanding transaction, their responses can not arrive any more
+ * mbtcp_ctx : ModBus TCP context
+ * cb        : called for every dropped transaction, NULL=silently
+ * return    : void
+ */
+static void mbtcp_trans_flush(MBTCP_CTX_T *mbtcp_ctx, mbtcp_trans_cb_t cb, void *arg)
+{
+    int i = 0;
+    MBTCP_DATA_T *mb_tcp_data = &mbtcp_ctx->mb_tcp_data;
+
+    for (i = 0; i < mb_tcp_data->window; ++i)
+    {
+        if (mb_tcp_data->trans[i].used)
+        {
+            mb_tcp_data->trans[i].used = 0;
+
+            if (cb)
+            {
+                cb(mbtcp_ctx, mb_tcp_data->trans[i].transaction_code, arg);
+            }
+        }
+    }
+    mb_tcp_data->pending = 0;
 }
 
 /*
- * Function  : decap the Modbus TCP PDU(Protocol Data Unit)
- * mb_data   : ModBus cache
- * mbap_head : ModBus TCP MBAP(ModBus Application Protocol)
+ * Function  : record the request just encapped as outstanding
+ * mb_tcp_data : ModBus TCP data
+ * deadline  : response deadline(us)
+ * return    : 0=SUCCESS -1=WINDOW FULL
+ */
+static int mbtcp_trans_add(MBTCP_DATA_T *mb_tcp_data, UINT64_T deadline)
+{
+    int i = 0;
+    MB_INFO_T *mb_info = &mb_tcp_data->mb_data->mb_info;
+
+    for (i = 0; i < mb_tcp_data->window; ++i)
+    {
+        if (!mb_tcp_data->trans[i].used)
+        {
+            mb_tcp_data->trans[i].used             = 1;
+            mb_tcp_data->trans[i].deadline         = deadline;
+            mb_tcp_data->trans[i].transaction_code = mb_tcp_data->mbap_head[MB_TX].transaction_code;
+            mb_tcp_data->trans[i].code             = mb_info->code;
+            mb_tcp_data->trans[i].reg              = mb_info->reg;
+            mb_tcp_data->trans[i].n_reg            = mb_info->n_reg;
+            mb_tcp_data->pending++;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Function  : take back the transaction of the request that could not be sent
+ * mb_tcp_data : ModBus TCP data
  * return    : void
  */
+static void mbtcp_trans_cancel(MBTCP_DATA_T *mb_tcp_data)
+{
+    int i = 0;
+
+    for (i = 0; i < mb_tcp_data->window; ++i)
+    {
+        if (mb_tcp_data->trans[i].used && 
+            mb_tcp_data->trans[i].transaction_code == mb_tcp_data->mbap_head[MB_TX].transaction_code)
+        {
+            mb_tcp_data->trans[i].used = 0;
+            mb_tcp_data->pending--;
+            return;
+        }
+    }
+}
+
+/*
+ * Function  : find the outstanding transaction of a response
+ * mb_tcp_data : ModBus TCP data
+ * transaction_code : transaction code of the response
+ * return    : (MBTCP_TRANS_T *)=SUCCESS NULL=NOT FOUND
+ */
+static MBTCP_TRANS_T *mbtcp_trans_find(MBTCP_DATA_T *mb_tcp_data, UINT16_T transaction_code)
+{
+    int i = 0;
+
+    for (i = 0; i < mb_tcp_data->window; ++i)
+    {
+        if (mb_tcp_data->trans[i].used && 
+            mb_tcp_data->trans[i].transaction_code == transaction_code)
+        {
+            return &mb_tcp_data->trans[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Function  : decap the Modbus TCP MBAP and match it with an outstanding request,
+ *             responses may arrive in any order inside the transaction window, 
+ *             mb_info gets start and quantity of the request matched, not the last one sent
+ * mb_tcp_data : ModBus TCP data
+ * return    : 0=SUCCESS -1=ERROR
+ */
 static int mbap_head_decap_check(MBTCP_DATA_T *mb_tcp_data)
 {
     PTR_CHECK_N1(mb_tcp_data);
 
     int ret = 0;
-    MB_DATA_T   *mb_data      = mb_tcp_data->mb_data;
-    MBAP_HEAD_T *tx_mbap_head = &mb_tcp_data->mbap_head[MB_TX];
-    MBAP_HEAD_T  rx_mbap_head = *((MBAP_HEAD_T *)mb_data->data);
+    MB_DATA_T     *mb_data      = mb_tcp_data->mb_data;
+    MBAP_HEAD_T   *tx_mbap_head = &mb_tcp_data->mbap_head[MB_TX];
+    MBAP_HEAD_T    rx_mbap_head = *((MBAP_HEAD_T *)mb_data->data);
+    MBTCP_TRANS_T *trans        = NULL;
+    UINT8_T        code         = 0;
+
+    rx_mbap_head.transaction_code = MB_LE16TOH(rx_mbap_head.transaction_code);
 
     do 
     {
-        if (rx_mbap_head.transaction_code != tx_mbap_head->transaction_code)
+        trans = mbtcp_trans_find(mb_tcp_data, rx_mbap_head.transaction_code);
+        if (!trans)
         {
             printf("Invalid MBAP trasaction code(0x%02x)\n", rx_mbap_head.transaction_code);
             ret = -1;
             break;
         }
 
+        /* the transaction is answered whatever the rest of the header holds */
+        trans->used = 0;
+        mb_tcp_data->pending--;
+
         if (rx_mbap_head.protocol_code != tx_mbap_head->protocol_code)
         {
             printf("Invalid MBAP protocol code(0x%02x)\n", rx_mbap_head.protocol_code);
@@ -98,6 +233,19 @@ static int mbap_head_decap_check(MBTCP_DATA_T *mb_tcp_data)
             ret = -1;
             break;
         }
+
+        /* the function of the request answered, or its exception */
+        code = (sizeof(MBAP_HEAD_T) < mb_data->data_len) ? mb_data->data[sizeof(MBAP_HEAD_T)] : 0;
+        if ((code & 0x7f) != trans->code)
+        {
+            printf("Invalid function code(0x%02x), should be 0x%02x\n", code, trans->code);
+            ret = -1;
+            break;
+        }
+
+        /* a read response or its view is read against these */
+        mb_data->mb_info.reg   = trans->reg;
+        mb_data->mb_info.n_reg = trans->n_reg;
     } while (0);
 
     mb_tcp_data->mbap_head[MB_RX] = rx_mbap_head;
@@ -106,6 +254,130 @@ static int mbap_head_decap_check(MBTCP_DATA_T *mb_tcp_data)
     return ret;
 }
 
+/*
+ * Function  : cancel io_uring operations and drop received bytes of a closing socket
+ * mb_tcp_uring : io_uring backend
+ * return    : void
+ */
+static void tcp_uring_reset(MBTCP_URING_T *mb_tcp_uring)
+{
+    mb_uring_cancel(mb_tcp_uring->ring, &mb_tcp_uring->tx);
+    mb_uring_cancel(mb_tcp_uring->ring, &mb_tcp_uring->rx);
+
+    mb_tcp_uring->tx_len   = 0;
+    mb_tcp_uring->tx_off   = 0;
+    mb_tcp_uring->rx_head  = 0;
+    mb_tcp_uring->rx_tail  = 0;
+    mb_tcp_uring->rx_armed = 0;
+}
+
+/*
+ * Function  : close the socket and schedule the next connect after a jittered exponential backoff,
+ *             so that many masters losing one switch do not re-connect in lockstep
+ * mb_tcp_desc : ModBus TCP descriptor
+ * return    : void
+ */
+static void tcp_link_down(MBTCP_DESC_T *mb_tcp_desc)
+{
+    UINT32_T delay = 0;
+
+    /* io_uring operations must not outlive the socket */
+    if (mb_tcp_desc->uring)
+    {
+        tcp_uring_reset(mb_tcp_desc->uring);
+    }
+
+    if (0 <= mb_tcp_desc->socket)
+    {
+        close(mb_tcp_desc->socket);
+        mb_tcp_desc->socket = -1;
+    }
+    mb_tcp_desc->rx_stash_len = 0;
+
+    if (!mb_tcp_desc->backoff)
+    {
+        mb_tcp_desc->backoff = MBTCP_BACKOFF_MIN;
+    }
+
+    /* random delay in [backoff/2, backoff] */
+    delay = (mb_tcp_desc->backoff / 2) + (rand_r(&mb_tcp_desc->seed) % (mb_tcp_desc->backoff / 2 + 1));
+
+    mb_tcp_desc->link       = MBTCP_LINK_DOWN;
+    mb_tcp_desc->retry_time = mb_time_us() + ((UINT64_T)delay * 1000);
+    mb_tcp_desc->backoff    = (mb_tcp_desc->backoff >= (MBTCP_BACKOFF_MAX / 2)) ? 
+                              MBTCP_BACKOFF_MAX : (mb_tcp_desc->backoff * 2);
+}
+
+/*
+ * Function  : let the kernel find dead peers, send/recv then fail and the link goes down,
+ *             so the transaction path needs no socket state check of its own
+ * mb_tcp_desc : ModBus TCP descriptor
+ * sock      : socket
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int tcp_keepalive_config(MBTCP_DESC_T *mb_tcp_desc, int sock)
+{
+    int on        = 1;
+    int keepidle  = mb_tcp_desc->keepidle;
+    int keepintvl = mb_tcp_desc->keepintvl;
+    int keepcnt   = mb_tcp_desc->keepcnt;
+    unsigned int user_timeout = mb_tcp_desc->user_timeout;
+
+    if (0 > setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) ||
+        0 > setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepidle, sizeof(keepidle)) ||
+        0 > setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepintvl, sizeof(keepintvl)) ||
+        0 > setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepcnt, sizeof(keepcnt)) ||
+        0 > setsockopt(sock, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, sizeof(user_timeout)))
+    {
+        perror("keepalive setsockopt error");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : connect a local slaver on an AF_UNIX stream socket, it is done or refused at once,
+ *             no device binding or keepalive, the peer closing the socket is seen by recv
+ * mb_tcp_desc : ModBus TCP descriptor
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int unix_connect(MBTCP_DESC_T *mb_tcp_desc)
+{
+    int sock = 0;
+    struct sockaddr_un server_addr = {0};
+
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (0 > sock) 
+    {
+        perror("socket error");
+        return -1;
+    }
+
+    server_addr.sun_family = AF_UNIX;
+    snprintf(server_addr.sun_path, sizeof(server_addr.sun_path), "%s", mb_tcp_desc->path);
+
+    mb_tcp_desc->socket    = sock;
+    mb_tcp_desc->link_seq += 1;
+
+    /* EAGAIN : backlog of the slaver is full, retried after the backoff */
+    if (0 > connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)))
+    {
+        printf("connect %s error : %s\n", mb_tcp_desc->path, strerror(errno));
+        return -1;
+    }
+
+    mb_tcp_desc->link    = MBTCP_LINK_UP;
+    mb_tcp_desc->backoff = 0;
+
+    return 0;
+}
+
+/*
+ * Function  : start a non-blocking connect
+ * mb_tcp_desc : ModBus TCP descriptor
+ * return    : 0=SUCCESS(connected or in progress) -1=ERROR
+ */
 static int tcp_connect(MBTCP_DESC_T *mb_tcp_desc)
 {
     PTR_CHECK_N1(mb_tcp_desc);
@@ -115,8 +387,19 @@ static int tcp_connect(MBTCP_DESC_T *mb_tcp_desc)
     struct sockaddr_in server_addr = {0};
     struct ifreq ifrq = {0};
 
+    /* nobody to call for the peer of an attached socket */
+    if (mb_tcp_desc->attached)
+    {
+        return -1;
+    }
+
+    if (mb_tcp_desc->path[0])
+    {
+        return unix_connect(mb_tcp_desc);
+    }
+
     /* create socket */
-    sock = socket(AF_INET, SOCK_STREAM, 0);
+    sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (0 > sock) 
     {
         perror("socket error");
@@ -133,342 +416,1488 @@ static int tcp_connect(MBTCP_DESC_T *mb_tcp_desc)
         return -1;
     }
 
+    /* dead peer detection */
+    if (0 > tcp_keepalive_config(mb_tcp_desc, sock))
+    {
+        close(sock);
+        return -1;
+    }
+
     /* server ip & server port */
     server_addr.sin_family = AF_INET;
     server_addr.sin_port   = htons(mb_tcp_desc->port);  
     inet_pton(AF_INET, mb_tcp_desc->ip, &server_addr.sin_addr);
 
+    mb_tcp_desc->socket        = sock;
+    mb_tcp_desc->link_seq     += 1;
+    mb_tcp_desc->link          = MBTCP_LINK_CONNECTING;
+    mb_tcp_desc->conn_deadline = mb_time_us() + ((UINT64_T)mb_tcp_desc->conn_timeout * 1000);
+
     /* connect server */
     ret = connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr));
-    if (ret < 0) {
+    if (0 == ret)
+    {
+        mb_tcp_desc->link    = MBTCP_LINK_UP;
+        mb_tcp_desc->backoff = 0;
+    }
+    else if (EINPROGRESS != errno)
+    {
         perror("connect error");
-        close(sock);
         return -1;
     }
 
-    mb_tcp_desc->socket = sock;
-
     return 0;
 }
 
-static int tcp_re_connect(MBTCP_DESC_T *mb_tcp_desc)
+/*
+ * Function  : check a connect in progress without blocking
+ * mb_tcp_desc : ModBus TCP descriptor
+ * wait      : max wait time(ms)
+ * return    : 1=CONNECTED 0=IN PROGRESS -1=ERROR
+ */
+static int tcp_connect_check(MBTCP_DESC_T *mb_tcp_desc, int wait)
 {
-    struct tcp_info info;
-    int ret    = 0;
-    int conntm = 0;
-    int len    = sizeof(info);
-    int sock   = mb_tcp_desc->socket;
-
-    ret = getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, (socklen_t *)(&len));
-    if (0 > ret)
+    int ret   = 0;
+    int err   = 0;
+    int ready = 0;
+    socklen_t len = sizeof(err);
+    struct pollfd pfd = {
+        .fd     = mb_tcp_desc->socket,
+        .events = POLLOUT
+    };
+
+    ready = poll(&pfd, 1, wait);
+    if (0 > ready)
     {
-        perror("getsockopt error");
-        return -1;
+        return (EINTR == errno) ? 0 : -1;
     }
 
-    if (TCP_ESTABLISHED != info.tcpi_state)
+    if (0 == ready)
     {
-        while (conntm++ <= MBTCP_CONN_TIMEOUT)
+        if (mb_time_us() >= mb_tcp_desc->conn_deadline)
         {
-            printf("try to re-connect times(%d)\n", conntm);
-
-            close(mb_tcp_desc->socket);
-
-            if (0 > tcp_connect(mb_tcp_desc))
-            {
-                usleep(MBTCP_CONN_DELAY);
-            }
-            else
-            {
-                return 1;
-            }
+            printf("connect %s:%d timeout\n", mb_tcp_desc->ip, mb_tcp_desc->port);
+            return -1;
         }
+        return 0;
     }
-    else
+
+    ret = getsockopt(mb_tcp_desc->socket, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (0 > ret || err)
     {
-        return 0;
+        printf("connect %s:%d error : %s\n", mb_tcp_desc->ip, mb_tcp_desc->port, strerror(err));
+        return -1;
     }
 
-    return -1;
+    mb_tcp_desc->link    = MBTCP_LINK_UP;
+    mb_tcp_desc->backoff = 0;
+
+    return 1;
 }
 
-static int tcp_recv(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
+/*
+ * Function  : drive the link state machine, never waits for the connection,
+ *             an established link costs nothing, errors of send/recv take it down
+ * mb_tcp_desc : ModBus TCP descriptor
+ * return    : 0=UP 1=RE-CONNECTED -1=LINK DOWN(errno ENOTCONN)
+ */
+static int tcp_re_connect(MBTCP_DESC_T *mb_tcp_desc)
 {
-    PTR_CHECK_N1(mb_tcp_desc);
-    PTR_CHECK_N1(mb_data);
-
-    int ret     = 0;
-    int ready   = 0;
-    int recvtm  = 0;
-    int length  = 0;
-    int socket  = mb_tcp_desc->socket;
+    int ret = 0;
 
-    fd_set rcvset;
-    struct timeval tv;
+    if (MBTCP_LINK_UP == mb_tcp_desc->link)
+    {
+        return 0;
+    }
 
-    tv.tv_sec  = 3;
-    tv.tv_usec = 0;
+    if (MBTCP_LINK_DOWN == mb_tcp_desc->link)
+    {
+        /* still backing off */
+        if (mb_time_us() < mb_tcp_desc->retry_time)
+        {
+            errno = ENOTCONN;
+            return -1;
+        }
 
-    FD_ZERO(&rcvset);
-    FD_SET(socket, &rcvset);
+        if (0 > tcp_connect(mb_tcp_desc))
+        {
+            tcp_link_down(mb_tcp_desc);
+            errno = ENOTCONN;
+            return -1;
+        }
+    }
 
-    if ((ret = tcp_re_connect(mb_tcp_desc)))
+    if (MBTCP_LINK_CONNECTING == mb_tcp_desc->link)
     {
-        if (-1 == ret)
+        ret = tcp_connect_check(mb_tcp_desc, 0);
+        if (0 > ret)
         {
-            printf("tcp re-connect before recv error\n");
-            return -1;
+            tcp_link_down(mb_tcp_desc);
         }
-        else
+
+        if (0 >= ret)
         {
-            printf("tcp re-connect before recv success\n");
+            errno = ENOTCONN;
+            return -1;
         }
     }
-    
-    ready = select(socket + 1, &rcvset, NULL, NULL, &tv);
-    if (0 > ready)
+
+    return 1;
+}
+
+/*
+ * Function  : a new frame starts with the bytes read behind the last one
+ * mb_data   : ModBus cache, empty
+ * return    : void
+ */
+static void tcp_stash_takeout(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
+{
+    if (!mb_data->data_len && mb_tcp_desc->rx_stash_len)
     {
-        perror("select error");
-        return -1;
+        memcpy(mb_data->data, mb_tcp_desc->rx_stash, mb_tcp_desc->rx_stash_len);
+        mb_data->data_len = mb_tcp_desc->rx_stash_len;
+        mb_tcp_desc->rx_stash_len = 0;
     }
-    else if (0 == ready)
+}
+
+/*
+ * Function  : keep the bytes behind a complete frame for the next one
+ * mb_data   : ModBus cache
+ * total     : frame length, never more than one predicted frame is read so the rest fits
+ * return    : void
+ */
+static void tcp_stash_keep(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data, UINT16_T total)
+{
+    if (mb_data->data_len > total)
     {
-        printf("Select timeout\n");
-        return -1;
+        mb_tcp_desc->rx_stash_len = mb_data->data_len - total;
+        memcpy(mb_tcp_desc->rx_stash, mb_data->data + total, mb_tcp_desc->rx_stash_len);
+        mb_data->data_len = total;
     }
+}
 
-    mb_data->data_len = 0;
+/*
+ * Function  : recv what the socket holds without blocking
+ * return    : 1=SOME READ 0=NOTHING -1=ERROR
+ */
+static int tcp_frame_read(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data, UINT16_T want)
+{
+    int length = 0;
 
-    while ((recvtm++ <= MBTCP_RECV_TIMEOUT))
+    while (1)
     {
-        length = recv(socket, (mb_data->data + mb_data->data_len), (mb_data->max_data_len - mb_data->data_len), MSG_DONTWAIT);
-        if(0 > length)
+        length = recv(mb_tcp_desc->socket, (mb_data->data + mb_data->data_len), (want - mb_data->data_len), MSG_DONTWAIT);
+        if (0 > length)
         {
-            if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
+            if (EINTR == errno)
             {
-                usleep(MBTCP_RECV_DELAY);
                 continue;
             }
-            else
-            {
-                perror("recv error");
-                return -1;
-            }
-        }
-        else if(length == 0)
-        {
-            if ((ret = tcp_re_connect(mb_tcp_desc)))
+
+            if ((EAGAIN == errno) || (EWOULDBLOCK == errno))
             {
-                if (-1 == ret)
-                {
-                    printf("tcp re-connect after recv error\n");
-                    return -1;
-                }
-                else
-                {
-                    printf("tcp re-connect after recv success\n");
-                    recvtm = 0;
-                    continue;
-                }
+                return 0;
             }
+
+            perror("recv error");
+            return -1;
         }
-        else
+        else if (0 == length)
         {
-            mb_data->data_len += length;
-            recvtm = 0;
-            continue;
+            printf("tcp connection closed by peer\n");
+            errno = ECONNRESET;
+            return -1;
         }
-    }
 
-    return mb_data->data_len;
+        mb_data->data_len += length;
+
+        return 1;
+    }
 }
 
-static int tcp_send(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
+/*
+ * Function  : read as much of one RTU frame as the socket holds, it is complete once the length
+ *             predicted from the request or a whole exception frame is in, tcp_recv ends a frame
+ *             of unknown length after rtu_gap of silence, what follows the frame is kept
+ * mb_data   : ModBus cache, data_len is the number of frame bytes already read
+ * return    : 1=FRAME COMPLETE 0=NEED MORE -1=ERROR
+ */
+static int tcp_rtu_frame_recv(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
 {
-    PTR_CHECK_N1(mb_tcp_desc);
-    PTR_CHECK_N1(mb_data);
+    int      ret    = 0;
+    UINT16_T expect = 0;
+    UINT16_T want   = 0;
+
+    /* the predicted frame is read with one recv, an unknown one takes what the cache holds */
+    expect = mb_rtu_frame_len(&mb_data->mb_info);
+    want   = (mb_data->max_data_len < MBTCP_FRAME_SIZE) ? mb_data->max_data_len : MBTCP_FRAME_SIZE;
+    if (expect > want)
+    {
+        expect = 0;
+    }
+    else if (expect)
+    {
+        want = expect;
+    }
 
-    int ret    = 0;
-    int length = 0;
-    int socket = mb_tcp_desc->socket;
+    tcp_stash_takeout(mb_tcp_desc, mb_data);
 
-    /* re-connect */
-    if ((ret = tcp_re_connect(mb_tcp_desc)))
+    while (1)
     {
-        if (-1 == ret)
+        if (mb_rtu_frame_done(mb_data, expect))
         {
-            printf("tcp re-connect error\n");
-            return -1;
+            tcp_stash_keep(mb_tcp_desc, mb_data, (mb_data->data[1] & 0x80) ? MBRTU_EXCEPTION_LEN : expect);
+            return 1;
         }
-        else
+
+        /* cache full, the CRC check tells */
+        if (mb_data->data_len >= want)
         {
-            printf("tcp re-connect success\n");
+            return 1;
         }
+
+        ret = tcp_frame_read(mb_tcp_desc, mb_data, want);
+        if (0 >= ret)
+        {
+            return ret;
+        }
+    }
+}
+
+/*
+ * Function  : read as much of one MBAP frame as the socket holds, the predicted response
+ *             length is asked for before the header is in, what follows the frame is kept
+ * mb_data   : ModBus cache, data_len is the number of frame bytes already read
+ * return    : 1=FRAME COMPLETE 0=NEED MORE -1=ERROR
+ */
+static int tcp_frame_recv(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
+{
+    int      ret    = 0;
+    UINT16_T total  = sizeof(MBAP_HEAD_T);
+    UINT16_T data_len = 0;
+    UINT16_T want   = 0;
+
+    /* a normal response to the request in mb_info is read with one recv, 
+     * bytes of a shorter(exception) or unrelated frame read with it are kept for later */
+    want = mb_response_pdu_len(&mb_data->mb_info);
+    want = want ? (want + sizeof(MBAP_HEAD_T)) : sizeof(MBAP_HEAD_T);
+    if (want > mb_data->max_data_len || want > MBTCP_FRAME_SIZE)
+    {
+        want = sizeof(MBAP_HEAD_T);
+    }
+
+    if (mb_tcp_desc->rtu)
+    {
+        return tcp_rtu_frame_recv(mb_tcp_desc, mb_data);
+    }
+
+    /* start of a frame, the bytes already read go first */
+    tcp_stash_takeout(mb_tcp_desc, mb_data);
+
+    while (1)
+    {
+        /* header complete, the frame length is known */
+        if (mb_data->data_len >= sizeof(MBAP_HEAD_T))
+        {
+            data_len = ((MBAP_HEAD_T *)mb_data->data)->data_length;
+            data_len = MB_BE16TOH(data_len);
+
+            if (!data_len || (sizeof(MBAP_HEAD_T) - 1 + data_len) > mb_data->max_data_len)
+            {
+                printf("Invalid MBAP data length(%d)\n", data_len);
+                errno = EPROTO;
+                return -1;
+            }
+
+            total = sizeof(MBAP_HEAD_T) - 1 + data_len;
+            want  = total;
+        }
+
+        if (mb_data->data_len >= total)
+        {
+            tcp_stash_keep(mb_tcp_desc, mb_data, total);
+            return 1;
+        }
+
+        ret = tcp_frame_read(mb_tcp_desc, mb_data, want);
+        if (0 >= ret)
+        {
+            return ret;
+        }
+    }
+}
+
+static int tcp_recv(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
+{
+    PTR_CHECK_N1(mb_tcp_desc);
+    PTR_CHECK_N1(mb_data);
+
+    int ret   = 0;
+    int ready = 0;
+    INT64_T  wait     = 0;
+    UINT64_T deadline = 0;
+    struct pollfd pfd;
+
+    deadline = mb_time_us() + ((UINT64_T)mb_tcp_desc->timeout * 1000);
+
+    pfd.fd     = mb_tcp_desc->socket;
+    pfd.events = POLLIN;
+
+    mb_data->data_len = 0;
+
+    /* return as soon as the frame announced by the MBAP header or predicted for RTU is complete */
+    while (0 == (ret = tcp_frame_recv(mb_tcp_desc, mb_data)))
+    {
+        wait = (INT64_T)(deadline - mb_time_us());
+        if (0 >= wait)
+        {
+            printf("recv timeout\n");
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        /* an RTU frame of unknown length ends with a silence */
+        if (mb_tcp_desc->rtu && mb_data->data_len && wait > mb_tcp_desc->rtu_gap)
+        {
+            wait = mb_tcp_desc->rtu_gap;
+        }
+
+        ready = poll(&pfd, 1, ALIGNED(wait, 1000));
+        if (0 > ready && EINTR != errno)
+        {
+            perror("poll error");
+            return -1;
+        }
+
+        if (0 == ready && mb_tcp_desc->rtu && mb_data->data_len)
+        {
+            ret = 1;
+            break;
+        }
+    }
+
+    if (0 > ret)
+    {
+        return -1;
+    }
+
+    return mb_data->data_len;
+}
+
+/*
+ * Function  : drop what the slaver sent after its deadline, an RTU frame has no transaction
+ *             code and a late response would be taken for the next one
+ * mb_tcp_desc : ModBus TCP descriptor
+ * return    : void
+ */
+static void tcp_rtu_drain(MBTCP_DESC_T *mb_tcp_desc)
+{
+    UINT8_T buf[MBTCP_FRAME_SIZE];
+
+    mb_tcp_desc->rx_stash_len = 0;
+    mb_tcp_desc->rtu_stale    = 0;
+
+    while (0 < recv(mb_tcp_desc->socket, buf, sizeof(buf), MSG_DONTWAIT));
+}
+
+/*
+ * Function  : send a gather list completely, short writes resume where they stopped
+ *             and a full socket buffer is waited for until the response deadline
+ * mb_tcp_desc : ModBus TCP descriptor
+ * iov       : gather list, modified while sending
+ * iovcnt    : gather list length
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int tcp_sendv(MBTCP_DESC_T *mb_tcp_desc, struct iovec *iov, int iovcnt)
+{
+    int      length   = 0;
+    int      total    = 0;
+    int      ready    = 0;
+    INT64_T  wait     = 0;
+    UINT64_T deadline = 0;
+    struct msghdr msg = {0};
+    struct pollfd pfd = {
+        .fd     = mb_tcp_desc->socket,
+        .events = POLLOUT
+    };
+
+    while (iovcnt)
+    {
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = iovcnt;
+
+        length = sendmsg(mb_tcp_desc->socket, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (0 > length)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+            {
+                perror("write error");
+                tcp_link_down(mb_tcp_desc);
+                return -1;
+            }
+
+            /* socket buffer full */
+            if (!deadline)
+            {
+                deadline = mb_time_us() + ((UINT64_T)mb_tcp_desc->timeout * 1000);
+            }
+
+            wait = (INT64_T)(deadline - mb_time_us());
+            if (0 >= wait)
+            {
+                printf("send timeout\n");
+                errno = ETIMEDOUT;
+                break;
+            }
+
+            ready = poll(&pfd, 1, ALIGNED(wait, 1000));
+            if (0 > ready && EINTR != errno)
+            {
+                perror("poll error");
+                break;
+            }
+            continue;
+        }
+
+        total += length;
+
+        /* skip what has been sent */
+        while (iovcnt && length >= iov->iov_len)
+        {
+            length -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt)
+        {
+            iov->iov_base  = (UINT8_T *)iov->iov_base + length;
+            iov->iov_len  -= length;
+        }
+    }
+
+    if (iovcnt)
+    {
+        /* the peer would take the rest of a frame for the head of the next one */
+        if (total)
+        {
+            tcp_link_down(mb_tcp_desc);
+        }
+        return -1;
+    }
+
+    return total;
+}
+
+/*
+ * Function  : bytes of a gather list
+ * iov       : gather list
+ * iovcnt    : gather list length
+ * return    : length
+ */
+static UINT32_T tcp_iov_len(const struct iovec *iov, int iovcnt)
+{
+    UINT32_T len = 0;
+    int      i   = 0;
+
+    for (i = 0; i < iovcnt; ++i)
+    {
+        len += iov[i].iov_len;
+    }
+
+    return len;
+}
+
+/*
+ * Function  : copy a gather list into one buffer
+ * buf       : buffer, tcp_iov_len() bytes
+ * iov       : gather list
+ * iovcnt    : gather list length
+ * return    : length
+ */
+static UINT32_T tcp_iov_copy(UINT8_T *buf, const struct iovec *iov, int iovcnt)
+{
+    UINT32_T len = 0;
+    int      i   = 0;
+
+    for (i = 0; i < iovcnt; ++i)
+    {
+        memcpy(buf + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+
+    return len;
+}
+
+/*
+ * Function  : look at a send completion reaped by any wait on the ring,
+ *             the rest of a short send is queued again
+ * mb_tcp_desc : ModBus TCP descriptor
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int tcp_uring_tx_done(MBTCP_DESC_T *mb_tcp_desc)
+{
+    MBTCP_URING_T *uring = mb_tcp_desc->uring;
+
+    if (MBURING_OP_IDLE != uring->tx.state || !uring->tx_len)
+    {
+        return 0;
+    }
+
+    if (0 > uring->tx.res)
+    {
+        errno = -uring->tx.res;
+        perror("write error");
+        tcp_link_down(mb_tcp_desc);
+        return -1;
+    }
+
+    uring->tx_off += uring->tx.res;
+    if (uring->tx_off < uring->tx_len)
+    {
+        return mb_uring_prep(uring->ring, &uring->tx, MBURING_IO_SEND, mb_tcp_desc->socket,
+            uring->tx_buf + uring->tx_off, uring->tx_len - uring->tx_off);
+    }
+
+    uring->tx_len = 0;
+    uring->tx_off = 0;
+
+    return 0;
+}
+
+/*
+ * Function  : queue a frame on the io_uring backend without a syscall, frames queued 
+ *             before the next wait on the ring go out with one send
+ * mb_tcp_desc : ModBus TCP descriptor
+ * iov       : the frame
+ * iovcnt    : gather list length
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int tcp_uring_send(MBTCP_DESC_T *mb_tcp_desc, const struct iovec *iov, int iovcnt)
+{
+    MBTCP_URING_T *uring    = mb_tcp_desc->uring;
+    UINT64_T       deadline = mb_time_us() + ((UINT64_T)mb_tcp_desc->timeout * 1000);
+    UINT32_T       len      = tcp_iov_len(iov, iovcnt);
+
+    if (MBTCP_URING_TX_SIZE < len)
+    {
+        return -1;
+    }
+
+    while (MBURING_OP_IDLE != uring->tx.state || uring->tx_len)
+    {
+        /* not submitted yet, the frame joins it */
+        if (MBURING_OP_QUEUED == uring->tx.state && 
+            uring->tx_len + len <= MBTCP_URING_TX_SIZE)
+        {
+            uring->tx_len += tcp_iov_copy(uring->tx_buf + uring->tx_len, iov, iovcnt);
+            mb_uring_append(&uring->tx, len);
+            return len;
+        }
+
+        /* the send in flight owns the buffer */
+        if (0 > mb_uring_wait(uring->ring, &uring->tx, deadline) ||
+            0 > tcp_uring_tx_done(mb_tcp_desc))
+        {
+            if (ETIMEDOUT == errno)
+            {
+                printf("send timeout\n");
+            }
+            return -1;
+        }
+    }
+
+    uring->tx_len = tcp_iov_copy(uring->tx_buf, iov, iovcnt);
+    uring->tx_off = 0;
+
+    if (0 > mb_uring_prep(uring->ring, &uring->tx, MBURING_IO_SEND, mb_tcp_desc->socket,
+        uring->tx_buf, uring->tx_len))
+    {
+        uring->tx_len = 0;
+        return -1;
+    }
+
+    return len;
+}
+
+/*
+ * Function  : recv one MBAP frame on the io_uring backend, queued sends are submitted
+ *             with the recv and frames already received need no syscall
+ * mb_tcp_desc : ModBus TCP descriptor
+ * mb_data   : ModBus cache
+ * return    : length=SUCCESS -1=ERROR(errno ETIMEDOUT=TIMEOUT)
+ */
+static int tcp_uring_recv(MBTCP_DESC_T *mb_tcp_desc, MB_DATA_T *mb_data)
+{
+    MBTCP_URING_T *uring    = mb_tcp_desc->uring;
+    UINT64_T       deadline = mb_time_us() + ((UINT64_T)mb_tcp_desc->timeout * 1000);
+    UINT32_T       avail    = 0;
+    UINT16_T       data_len = 0;
+
+    while (1)
+    {
+        /* a recv completion reaped by any wait on the ring */
+        if (MBURING_OP_IDLE == uring->rx.state && uring->rx_armed)
+        {
+            uring->rx_armed = 0;
+
+            if (0 > uring->rx.res)
+            {
+                errno = -uring->rx.res;
+                perror("recv error");
+                return -1;
+            }
+            else if (0 == uring->rx.res)
+            {
+                printf("tcp connection closed by peer\n");
+                errno = ECONNRESET;
+                return -1;
+            }
+
+            uring->rx_tail += uring->rx.res;
+        }
+
+        /* header complete, the frame length is known */
+        avail = uring->rx_tail - uring->rx_head;
+        if (avail >= sizeof(MBAP_HEAD_T))
+        {
+            data_len = ((MBAP_HEAD_T *)(uring->rx_buf + uring->rx_head))->data_length;
+            data_len = MB_BE16TOH(data_len);
+
+            if (!data_len || (sizeof(MBAP_HEAD_T) - 1 + data_len) > mb_data->max_data_len)
+            {
+                printf("Invalid MBAP data length(%d)\n", data_len);
+                errno = EPROTO;
+                return -1;
+            }
+
+            if (avail >= (sizeof(MBAP_HEAD_T) - 1 + data_len))
+            {
+                mb_data->data_len = sizeof(MBAP_HEAD_T) - 1 + data_len;
+                memcpy(mb_data->data, uring->rx_buf + uring->rx_head, mb_data->data_len);
+
+                uring->rx_head += mb_data->data_len;
+                if (uring->rx_head == uring->rx_tail)
+                {
+                    uring->rx_head = 0;
+                    uring->rx_tail = 0;
+                }
+
+                return mb_data->data_len;
+            }
+        }
+
+        if (0 > tcp_uring_tx_done(mb_tcp_desc))
+        {
+            return -1;
+        }
+
+        /* recv into the free space after the partial frame */
+        if (MBURING_OP_IDLE == uring->rx.state)
+        {
+            if (uring->rx_head)
+            {
+                memmove(uring->rx_buf, uring->rx_buf + uring->rx_head, avail);
+                uring->rx_head = 0;
+                uring->rx_tail = avail;
+            }
+
+            if (0 > mb_uring_prep(uring->ring, &uring->rx, MBURING_IO_RECV, mb_tcp_desc->socket,
+                uring->rx_buf + uring->rx_tail, MBTCP_URING_RX_SIZE - uring->rx_tail))
+            {
+                return -1;
+            }
+            uring->rx_armed = 1;
+        }
+
+        if (0 > mb_uring_wait(uring->ring, &uring->rx, deadline))
+        {
+            if (ETIMEDOUT == errno)
+            {
+                printf("recv timeout\n");
+            }
+            return -1;
+        }
+    }
+}
+
+/*
+ * Function  : queue a frame, it goes out with the next flush
+ * mbtcp_ctx : ModBus TCP context
+ * iov       : the frame
+ * iovcnt    : gather list length
+ * return    : 1=FLUSH NOW 0=QUEUED -1=ERROR
+ */
+static int mbtcp_txq_add(MBTCP_CTX_T *mbtcp_ctx, const struct iovec *iov, int iovcnt)
+{
+    MBTCP_TXQ_T *txq     = mbtcp_ctx->mb_tcp_data.txq;
+    UINT32_T     len     = tcp_iov_len(iov, iovcnt);
+    UINT64_T     now     = mb_time_us();
+
+    if (MBTCP_TXQ_SIZE <= txq->num || MBTCP_FRAME_SIZE < len)
+    {
+        return -1;
+    }
+
+    if (!txq->num)
+    {
+        txq->first_time = now;
+    }
+
+    tcp_iov_copy(txq->frame[txq->num], iov, iovcnt);
+    txq->len[txq->num] = len;
+    txq->bytes += len;
+    txq->num++;
+
+    /* size or time threshold */
+    return (txq->num >= txq->batch || txq->bytes >= MBTCP_TXQ_BYTES || 
+            (now - txq->first_time) >= MBTCP_TXQ_DELAY);
+}
+
+/*
+ * Function  : send every queued frame with one gather write
+ * mbtcp_ctx : ModBus TCP context
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int mbtcp_txq_flush(MBTCP_CTX_T *mbtcp_ctx)
+{
+    MBTCP_TXQ_T *txq = mbtcp_ctx->mb_tcp_data.txq;
+    struct iovec iov[MBTCP_TXQ_SIZE];
+    int length = 0;
+    int i      = 0;
+
+    if (!txq || !txq->num)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < txq->num; ++i)
+    {
+        iov[i].iov_base = txq->frame[i];
+        iov[i].iov_len  = txq->len[i];
+    }
+
+    length = tcp_sendv(&mbtcp_ctx->mb_tcp_desc, iov, txq->num);
+
+    txq->num   = 0;
+    txq->bytes = 0;
+
+    return length;
+}
+
+/*
+ * Function  : Create a ModBus TCP context without socket
+ * tcp_ctl   : configure parameters of ModBus TCP
+ * return    : (MBTCP_CTX_T *)=SUCCESS NULL=ERRROR
+ */
+static MBTCP_CTX_T *mbtcp_ctx_create(MBTCP_CTL_T *tcp_ctl)
+{
+    MBTCP_CTX_T *mbtcp_ctx = NULL;
+
+    /* create mbtcp context */
+    mbtcp_ctx = (MBTCP_CTX_T *)malloc(sizeof(MBTCP_CTX_T));
+    if (!mbtcp_ctx)
+    {
+        printf("Can not create a modbus tcp context\n");
+        return NULL;
+    }
+    memset(mbtcp_ctx, 0, sizeof(MBTCP_CTX_T));
+    mbtcp_ctx->mb_tcp_desc.socket = -1;
+
+    /* Create mbtcp data */
+    mbtcp_ctx->mb_tcp_data.mb_data = mb_data_create(tcp_ctl->max_data_size);
+    if (!mbtcp_ctx->mb_tcp_data.mb_data)
+    {
+        printf("Can not create a modbus tcp data\n");
+        free(mbtcp_ctx);
+        return NULL;
+    }
+    mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].transaction_code = 0x0;
+    mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].protocol_code    = 0x0;
+    mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].unit_code        = tcp_ctl->unitid;
+    mbtcp_ctx->mb_tcp_data.window = tcp_ctl->window ? tcp_ctl->window : 1;
+    mbtcp_ctx->mb_tcp_data.rtu_data.mb_data = mbtcp_ctx->mb_tcp_data.mb_data;
+    mbtcp_ctx->mb_tcp_data.rtu_data.rtu_info[MB_TX].slaver_addr = tcp_ctl->unitid;
+    if (tcp_ctl->rtu)
+    {
+        /* responses are matched by order only */
+        if (tcp_ctl->uring)
+        {
+            printf("RTU over TCP has no io_uring backend\n");
+            mb_tcp_close(mbtcp_ctx);
+            return NULL;
+        }
+        mbtcp_ctx->mb_tcp_desc.rtu     = 1;
+        mbtcp_ctx->mb_tcp_desc.rtu_gap = tcp_ctl->rtu_gap ? tcp_ctl->rtu_gap : MBTCP_RTU_GAP;
+        mbtcp_ctx->mb_tcp_data.window  = 1;
+    }
+    else if (tcp_ctl->uring)
+    {
+        mbtcp_ctx->mb_tcp_desc.uring = (MBTCP_URING_T *)malloc(sizeof(MBTCP_URING_T));
+        if (!mbtcp_ctx->mb_tcp_desc.uring)
+        {
+            printf("Can not create a modbus tcp io_uring backend\n");
+            mb_tcp_close(mbtcp_ctx);
+            return NULL;
+        }
+        memset(mbtcp_ctx->mb_tcp_desc.uring, 0, sizeof(MBTCP_URING_T));
+        mbtcp_ctx->mb_tcp_desc.uring->ring = tcp_ctl->uring;
+    }
+    else if (1 < tcp_ctl->batch)
+    {
+        mbtcp_ctx->mb_tcp_data.txq = (MBTCP_TXQ_T *)malloc(sizeof(MBTCP_TXQ_T));
+        if (!mbtcp_ctx->mb_tcp_data.txq)
+        {
+            printf("Can not create a modbus tcp send queue\n");
+            mb_tcp_close(mbtcp_ctx);
+            return NULL;
+        }
+        memset(mbtcp_ctx->mb_tcp_data.txq, 0, sizeof(MBTCP_TXQ_T));
+        mbtcp_ctx->mb_tcp_data.txq->batch = (MBTCP_TXQ_SIZE < tcp_ctl->batch) ? MBTCP_TXQ_SIZE : tcp_ctl->batch;
+    }
+    if (MBTCP_MAX_WINDOW < mbtcp_ctx->mb_tcp_data.window)
+    {
+        mbtcp_ctx->mb_tcp_data.window = MBTCP_MAX_WINDOW;
+    }
+
+    mbtcp_ctx->mb_tcp_desc.port    = tcp_ctl->port;
+    mbtcp_ctx->mb_tcp_desc.timeout = tcp_ctl->timeout ? tcp_ctl->timeout : MBTCP_RECV_TIMEOUT;
+    mbtcp_ctx->mb_tcp_desc.conn_timeout = tcp_ctl->conn_timeout ? tcp_ctl->conn_timeout : MBTCP_CONN_TIMEOUT;
+    mbtcp_ctx->mb_tcp_desc.seed    = (UINT32_T)mb_time_us() ^ (UINT32_T)getpid() ^ (UINT32_T)(long)mbtcp_ctx;
+    mbtcp_ctx->mb_tcp_desc.keepidle     = tcp_ctl->keepidle ? tcp_ctl->keepidle : MBTCP_KEEPIDLE;
+    mbtcp_ctx->mb_tcp_desc.keepintvl    = tcp_ctl->keepintvl ? tcp_ctl->keepintvl : MBTCP_KEEPINTVL;
+    mbtcp_ctx->mb_tcp_desc.keepcnt      = tcp_ctl->keepcnt ? tcp_ctl->keepcnt : MBTCP_KEEPCNT;
+    mbtcp_ctx->mb_tcp_desc.user_timeout = tcp_ctl->user_timeout ? tcp_ctl->user_timeout : MBTCP_USER_TIMEOUT;
+    snprintf(mbtcp_ctx->mb_tcp_desc.ip, sizeof(mbtcp_ctx->mb_tcp_desc.ip), "%s", tcp_ctl->ip);
+    snprintf(mbtcp_ctx->mb_tcp_desc.ethdev, sizeof(mbtcp_ctx->mb_tcp_desc.ethdev), "%s", tcp_ctl->ethdev);
+    snprintf(mbtcp_ctx->mb_tcp_desc.path, sizeof(mbtcp_ctx->mb_tcp_desc.path), "%s", tcp_ctl->path);
+
+    return mbtcp_ctx;
+}
+
+/*
+ * Function  : Create a ModBus TCP context
+ * rtu_ctl   : configure parameters of ModBus TCP
+ * return    : (MBTCP_CTX_T *)=SUCCESS NULL=ERRROR
+ */
+MBTCP_CTX_T *mb_tcp_init(MBTCP_CTL_T *tcp_ctl)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(tcp_ctl);
+
+    MBTCP_CTX_T *mbtcp_ctx = NULL;
+    int ret = 0;
+    int ms  = 0;
+
+    mbtcp_ctx = mbtcp_ctx_create(tcp_ctl);
+    if (!mbtcp_ctx)
+    {
+        return NULL;
+    }
+
+    /* tcp connect, the first one waits until the connect deadline */
+    ret = tcp_connect(&mbtcp_ctx->mb_tcp_desc);
+    while (0 <= ret && MBTCP_LINK_CONNECTING == mbtcp_ctx->mb_tcp_desc.link)
+    {
+        ms  = ALIGNED((INT64_T)(mbtcp_ctx->mb_tcp_desc.conn_deadline - mb_time_us()), 1000);
+        ret = tcp_connect_check(&mbtcp_ctx->mb_tcp_desc, (0 < ms) ? ms : 0);
+    }
+
+    if (0 > ret)
+    {
+        printf("tcp connect failed\n");
+        mb_tcp_close(mbtcp_ctx);
+        return NULL;
+    }
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbtcp_ctx;
+}
+
+/*
+ * Function  : Create a ModBus TCP context on a connected stream socket
+ * tcp_ctl   : configure parameters of ModBus TCP
+ * sock      : connected stream socket, owned by the context once created
+ * return    : (MBTCP_CTX_T *)=SUCCESS NULL=ERRROR
+ */
+MBTCP_CTX_T *mb_tcp_attach(MBTCP_CTL_T *tcp_ctl, int sock)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(tcp_ctl);
+
+    MBTCP_CTX_T *mbtcp_ctx = NULL;
+    int flags = 0;
+
+    /* send/recv expect a non-blocking socket */
+    flags = fcntl(sock, F_GETFL);
+    if (0 > flags || 0 > fcntl(sock, F_SETFL, flags | O_NONBLOCK))
+    {
+        perror("fcntl error");
+        return NULL;
+    }
+
+    mbtcp_ctx = mbtcp_ctx_create(tcp_ctl);
+    if (!mbtcp_ctx)
+    {
+        return NULL;
+    }
+
+    mbtcp_ctx->mb_tcp_desc.socket   = sock;
+    mbtcp_ctx->mb_tcp_desc.attached = 1;
+    mbtcp_ctx->mb_tcp_desc.link     = MBTCP_LINK_UP;
+    mbtcp_ctx->mb_tcp_desc.link_seq = 1;
+    mbtcp_ctx->mb_tcp_desc.path[0]  = 0;
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbtcp_ctx;
+}
+
+/*
+ * Function  : close a ModBus TCP context
+ * mbtcp_ctx   : the ModBus TCP context you want to close
+ * return    : void
+ */
+void mb_tcp_close(MBTCP_CTX_T *mbtcp_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mbtcp_ctx);
+    
+    if (mbtcp_ctx->mb_tcp_desc.uring)
+    {
+        tcp_uring_reset(mbtcp_ctx->mb_tcp_desc.uring);
+    }
+
+    if (0 <= mbtcp_ctx->mb_tcp_desc.socket)
+    {
+        close(mbtcp_ctx->mb_tcp_desc.socket);
+    }
+
+    free(mbtcp_ctx->mb_tcp_desc.uring);
+    free(mbtcp_ctx->mb_tcp_data.txq);
+    mb_data_destory(mbtcp_ctx->mb_tcp_data.mb_data);
+
+    free(mbtcp_ctx);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+/*
+ * Function  : get the link and the transaction window ready for a request
+ * mbtcp_ctx : ModBus TCP context
+ * now       : current time(us)
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int mbtcp_send_ready(MBTCP_CTX_T *mbtcp_ctx, UINT64_T now)
+{
+    MBTCP_DATA_T *mbtcp_data = &mbtcp_ctx->mb_tcp_data;
+    MBTCP_DESC_T *mbtcp_desc = &(mbtcp_ctx->mb_tcp_desc); 
+    int           ret        = 0;
+
+    /* link state, a link being re-connected fails right away */
+    ret = tcp_re_connect(mbtcp_desc);
+    if (0 > ret)
+    {
+        return -1;
+    }
+    else if (0 < ret)
+    {
+        printf("tcp re-connect %s:%d success\n", mbtcp_desc->ip, mbtcp_desc->port);
+
+        /* requests and responses of the old connection are lost */
+        mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+        if (mbtcp_data->txq)
+        {
+            mbtcp_data->txq->num   = 0;
+            mbtcp_data->txq->bytes = 0;
+        }
+    }
+
+    /* transaction window */
+    mbtcp_trans_expire(mbtcp_ctx, now, NULL, NULL);
+    if (mbtcp_data->pending >= mbtcp_data->window)
+    {
+        printf("MBAP transaction window(%d) full\n", mbtcp_data->window);
+        return -1;
+    }
+
+    if (mbtcp_desc->rtu && mbtcp_desc->rtu_stale)
+    {
+        tcp_rtu_drain(mbtcp_desc);
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : encap the request in mb_info of a cache, a new transaction code is not taken
+ * mbtcp_ctx : ModBus TCP context
+ * rtu_data  : RTU framing over the cache of the frame, only the cache is used for MBAP
+ * return    : void
+ */
+static void mbtcp_frame_encap(MBTCP_CTX_T *mbtcp_ctx, MBRTU_DATA_T *rtu_data)
+{
+    MB_DATA_T *mb_data = rtu_data->mb_data;
+
+    if (mbtcp_ctx->mb_tcp_desc.rtu)
+    {
+        /* encap slaver address + PDU + CRC */
+        mb_rtu_frame_encap(rtu_data);
+        return;
+    }
+
+    /* encap modbus head */
+    mbap_head_encap(&mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX], mb_data);
+
+    /* encap modbus data */
+    mb_data_encap(mb_data);
+
+    /* re-encap modbus head */
+    mbap_head_re_encap(mb_data);
+}
+
+/*
+ * Function  : send a frame, or queue it, and open its transaction,
+ *             the request header is in mb_info of the cache
+ * mbtcp_ctx : ModBus TCP context
+ * now       : current time(us)
+ * iov       : the frame, in cache or prepared with its transaction code apart
+ * iovcnt    : gather list length
+ * return    : length=SUCCESS -1=ERROR
+ */
+static int mbtcp_send_frame(MBTCP_CTX_T *mbtcp_ctx, UINT64_T now, struct iovec *iov, int iovcnt)
+{
+    MBTCP_DATA_T *mbtcp_data = &mbtcp_ctx->mb_tcp_data;
+    MBTCP_DESC_T *mbtcp_desc = &(mbtcp_ctx->mb_tcp_desc); 
+    int           length     = 0;
+    int           ret        = 0;
+
+#ifdef MB_DEBUG
+    MB_PRINT("SEND %u bytes\n", tcp_iov_len(iov, iovcnt));
+#endif
+
+    /* no request goes out without a transaction to match its response */
+    if (0 > mbtcp_trans_add(mbtcp_data, now + ((UINT64_T)mbtcp_desc->timeout * 1000)))
+    {
+        printf("MBAP transaction window(%d) full\n", mbtcp_data->window);
+        return -1;
     }
 
-    length = send(socket, mb_data->data, mb_data->data_len, MSG_DONTWAIT);
-    if (0 > length)
+    /* queue tcp data, sent when a threshold is hit or on mb_tcp_flush */
+    if (mbtcp_data->txq)
     {
-        perror("write error");
+        ret = mbtcp_txq_add(mbtcp_ctx, iov, iovcnt);
+        if (0 > ret)
+        {
+            printf("modbus tcp send queue full\n");
+            mbtcp_trans_cancel(mbtcp_data);
+            return -1;
+        }
+
+        length = tcp_iov_len(iov, iovcnt);
+
+        if (ret && 0 > mbtcp_txq_flush(mbtcp_ctx))
+        {
+            /* queued requests are lost */
+            mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+            return -1;
+        }
+
+        MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+        return length;
+    }
+
+    /* send tcp data */
+    length = mbtcp_desc->uring ? tcp_uring_send(mbtcp_desc, iov, iovcnt) : 
+                                 tcp_sendv(mbtcp_desc, iov, iovcnt);
+    if (0 >= length)
+    {
+        mbtcp_trans_cancel(mbtcp_data);
     }
 
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
     return length;
 }
 
 /*
- * Function  : Create a ModBus TCP context
- * rtu_ctl   : configure parameters of ModBus TCP
- * return    : (MBTCP_CTX_T *)=SUCCESS NULL=ERRROR
+ * Function  : send ModBus TCP data from ModBus cache to slaver
+ * mbtcp_ctx : ModBus TCP context
+ * return    : 0=CLOSE length=SUCCESS -1=ERROR
  */
-MBTCP_CTX_T *mb_tcp_init(MBTCP_CTL_T *tcp_ctl)
+int mb_tcp_send(MBTCP_CTX_T *mbtcp_ctx)
 {
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
-    PTR_CHECK_NULL(tcp_ctl);
-
-    MBTCP_CTX_T *mbtcp_ctx = NULL;
-    int ret = 0;
+    PTR_CHECK_N1(mbtcp_ctx);
 
-    /* create mbtcp context */
-    mbtcp_ctx = (MBTCP_CTX_T *)malloc(sizeof(MBTCP_CTX_T));
-    if (!mbtcp_ctx)
-    {
-        printf("Can not create a modbus tcp context\n");
-        return NULL;
-    }
-    memset(mbtcp_ctx, 0, sizeof(MBTCP_CTX_T));
+    MB_DATA_T   *mb_data = mbtcp_ctx->mb_tcp_data.mb_data;
+    UINT64_T     now     = mb_time_us();
+    struct iovec iov;
 
-    /* Create mbtcp data */
-    mbtcp_ctx->mb_tcp_data.mb_data = mb_data_create(tcp_ctl->max_data_size);
-    if (!mbtcp_ctx->mb_tcp_data.mb_data)
+    if (0 > mbtcp_send_ready(mbtcp_ctx, now))
     {
-        printf("Can not create a modbus tcp data\n");
-        free(mbtcp_ctx);
-        return NULL;
+        return -1;
     }
-    mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].transaction_code = 0x0;
-    mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].protocol_code    = 0x0;
-    mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].unit_code        = tcp_ctl->unitid;
 
-    mbtcp_ctx->mb_tcp_desc.port = tcp_ctl->port;
-    snprintf(mbtcp_ctx->mb_tcp_desc.ip, sizeof(mbtcp_ctx->mb_tcp_desc.ip), "%s", tcp_ctl->ip);
-    snprintf(mbtcp_ctx->mb_tcp_desc.ethdev, sizeof(mbtcp_ctx->mb_tcp_desc.ethdev), "%s", tcp_ctl->ethdev);
+    mb_data_clear(mb_data);
 
-    /* tcp connect */
-    ret = tcp_connect(&mbtcp_ctx->mb_tcp_desc);
-    if (0 > ret)
+    /* a new transaction code for every MBAP request */
+    if (!mbtcp_ctx->mb_tcp_desc.rtu)
     {
-        printf("tcp connect failed\n");
-        mb_data_destory(mbtcp_ctx->mb_tcp_data.mb_data);
-        free(mbtcp_ctx);
-        return NULL;
+        mbtcp_ctx->mb_tcp_data.mbap_head[MB_TX].transaction_code++;
     }
 
-    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+    mbtcp_frame_encap(mbtcp_ctx, &mbtcp_ctx->mb_tcp_data.rtu_data);
 
-    return mbtcp_ctx;
+    iov.iov_base = mb_data->data;
+    iov.iov_len  = mb_data->data_len;
+
+    return mbtcp_send_frame(mbtcp_ctx, now, &iov, 1);
 }
 
 /*
- * Function  : close a ModBus TCP context
- * mbtcp_ctx   : the ModBus TCP context you want to close
- * return    : void
+ * Function  : encode a request once for mb_tcp_send_prepared
+ * mbtcp_ctx : ModBus TCP context
+ * mb_info   : the request
+ * prep      : prepared request
+ * return    : 0=SUCCESS -1=ERROR
  */
-void mb_tcp_close(MBTCP_CTX_T *mbtcp_ctx)
+int mb_tcp_prepare(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep)
 {
-    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+    PTR_CHECK_N1(mbtcp_ctx);
+    PTR_CHECK_N1(mb_info);
+    PTR_CHECK_N1(prep);
 
-    PTR_CHECK_VOID(mbtcp_ctx);
-    
-    close(mbtcp_ctx->mb_tcp_desc.socket);
+    MBRTU_DATA_T rtu_data = mbtcp_ctx->mb_tcp_data.rtu_data;
+    UINT8_T      scratch[MB_DATA_BUF_SIZE(MBTCP_FRAME_SIZE)];
+    UINT16_T     size     = 0;
 
-    mb_data_destory(mbtcp_ctx->mb_tcp_data.mb_data);
+    /* pipelined responses and mb_tcp_recv_nb keep using the cache of the context, a scratch one on the stack */
+    size = (rtu_data.mb_data->max_data_len < MBTCP_FRAME_SIZE) ? rtu_data.mb_data->max_data_len : MBTCP_FRAME_SIZE;
+    rtu_data.mb_data = mb_data_init(scratch, size);
 
-    free(mbtcp_ctx);
+    mb_info_copy(&rtu_data.mb_data->mb_info, mb_info);
+    mbtcp_frame_encap(mbtcp_ctx, &rtu_data);
 
-    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+    prep->slaver_addr = rtu_data.rtu_info[MB_TX].slaver_addr;
+    prep->check       = rtu_data.rtu_info[MB_TX].crc_checksum;
+
+    return mb_prep_save(prep, mbtcp_ctx, &rtu_data.mb_data->mb_info, rtu_data.mb_data->data, rtu_data.mb_data->data_len);
 }
 
 /*
- * Function  : send ModBus TCP data from ModBus cache to slaver
+ * Function  : send a prepared request, only the MBAP transaction code is patched
  * mbtcp_ctx : ModBus TCP context
+ * prep      : prepared request
  * return    : 0=CLOSE length=SUCCESS -1=ERROR
  */
-int mb_tcp_send(MBTCP_CTX_T *mbtcp_ctx)
+int mb_tcp_send_prepared(MBTCP_CTX_T *mbtcp_ctx, const MB_PREP_T *prep)
 {
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
     PTR_CHECK_N1(mbtcp_ctx);
 
     MBTCP_DATA_T *mbtcp_data = &mbtcp_ctx->mb_tcp_data;
-    MB_DATA_T    *mb_data    = mbtcp_ctx->mb_tcp_data.mb_data;
-    MBTCP_DESC_T *mbtcp_desc = &(mbtcp_ctx->mb_tcp_desc); 
+    UINT64_T      now        = mb_time_us();
+    UINT16_T      tid        = 0;
+    struct iovec  iov[2];
 
-    mb_data_clear(mb_data);
+    if (0 > mb_prep_check(prep, mbtcp_ctx) || 0 > mbtcp_send_ready(mbtcp_ctx, now) ||
+        0 > mb_prep_load(prep, mbtcp_ctx, mbtcp_data->mb_data))
+    {
+        return -1;
+    }
 
-    /* encap modbus head */
-    mbap_head_encap(mbtcp_data);
+    if (mbtcp_ctx->mb_tcp_desc.rtu)
+    {
+        mbtcp_data->rtu_data.rtu_info[MB_TX].crc_checksum = prep->check;
 
-    /* encap modbus data */
-    mb_data_encap(mb_data);
+        iov[0].iov_base = (UINT8_T *)prep->frame;
+        iov[0].iov_len  = prep->len;
 
-    /* re-encap modbus head */
-    mbap_head_re_encap(mbtcp_data);
+        return mbtcp_send_frame(mbtcp_ctx, now, iov, 1);
+    }
+
+    /* nothing but the transaction code changes from one send to the next, the rest goes from prep */
+    tid = MB_HTOLE16(++mbtcp_data->mbap_head[MB_TX].transaction_code);
+
+    iov[0].iov_base = &tid;
+    iov[0].iov_len  = sizeof(tid);
+    iov[1].iov_base = (UINT8_T *)prep->frame + sizeof(tid);
+    iov[1].iov_len  = prep->len - sizeof(tid);
+
+    return mbtcp_send_frame(mbtcp_ctx, now, iov, 2);
+}
+
+/*
+ * Function  : decap a complete ModBus TCP frame in cache
+ * mbtcp_ctx : ModBus TCP context
+ * view      : the response, NULL=into mb_info
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int mbtcp_frame_decap(MBTCP_CTX_T *mbtcp_ctx, MB_VIEW_T *view)
+{
+    MBTCP_DATA_T *mbtcp_data = &mbtcp_ctx->mb_tcp_data;
+    MB_DATA_T    *mb_data    = mbtcp_ctx->mb_tcp_data.mb_data;
 
 #ifdef MB_DEBUG
-    MB_PRINT("SEND\n");
+    MB_PRINT("RECV %d bytes\n", mb_data->data_len);
     mb_cache_show(mb_data);
 #endif
 
+    /* the only request outstanding is answered */
+    if (mbtcp_ctx->mb_tcp_desc.rtu)
+    {
+        mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+
+        if (0 > mb_rtu_frame_decap(&mbtcp_data->rtu_data, view))
+        {
+            mbtcp_ctx->mb_tcp_desc.rtu_stale = 1;
+            errno = EBADMSG;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    /* decap modbus head */
+    if (0 > mbap_head_decap_check(mbtcp_data))
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    /* dacap modbus data */
+    if (0 > mb_response_decap(mb_data, view))
+    {
+        printf("Invalid ModBus TCP response PDU\n");
+        errno = EBADMSG;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : recv a response, decapped into mb_info or in place
+ * mbtcp_ctx : ModBus TCP context
+ * view      : the response, NULL=into mb_info
+ * return    : 0=CLOSE/NO RESPONSE(RTU broadcast) length=SUCCESS -1=ERROR
+ */
+static int mbtcp_recv(MBTCP_CTX_T *mbtcp_ctx, MB_VIEW_T *view)
+{
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
-    /* send tcp data */
-    return tcp_send(mbtcp_desc, mb_data);
+    int length = 0;
+    MB_DATA_T    *mb_data    = mbtcp_ctx->mb_tcp_data.mb_data;
+    MBTCP_DESC_T *mbtcp_desc = &(mbtcp_ctx->mb_tcp_desc); 
+    
+    /* responses are wanted, queued requests must go out first */
+    if (0 > mbtcp_txq_flush(mbtcp_ctx))
+    {
+        mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+        return -1;
+    }
+
+    /* a broadcast of RTU over TCP is not answered, mb_info still holds the request */
+    if (mbtcp_desc->rtu && MBRTU_BROADCAST == mbtcp_ctx->mb_tcp_data.rtu_data.rtu_info[MB_TX].slaver_addr)
+    {
+        mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+        return 0;
+    }
+
+    mb_data_clear(mb_data);
+    mbtcp_ctx->mb_tcp_data.rx_len = 0;
+
+    if (MBTCP_LINK_UP != mbtcp_desc->link)
+    {
+        mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    /* recv tcp data */
+    length = mbtcp_desc->uring ? tcp_uring_recv(mbtcp_desc, mb_data) : 
+                                 tcp_recv(mbtcp_desc, mb_data);
+    if (0 > length)
+    {
+        /* a broken stream loses every response still in flight */
+        if (ETIMEDOUT == errno)
+        {
+            mbtcp_trans_expire(mbtcp_ctx, mb_time_us(), NULL, NULL);
+            mbtcp_desc->rtu_stale = mbtcp_desc->rtu;
+        }
+        else
+        {
+            tcp_link_down(mbtcp_desc);
+            mbtcp_trans_flush(mbtcp_ctx, NULL, NULL);
+            errno = ENOTCONN;
+        }
+        return -1;
+    }
+
+    if (0 > mbtcp_frame_decap(mbtcp_ctx, view))
+    {
+        return -1;
+    }
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return length;
 }
 
 /*
  * Function  : recv ModBus TCP data from slaver to ModBus cache
  * mbtcp_ctx   : ModBus TCP context
  * mb_data   : ModBus cache
- * return    : 0=CLOSE length=SUCCESS -1=ERROR
+ * return    : 0=CLOSE/NO RESPONSE(RTU broadcast) length=SUCCESS -1=ERROR
  */
 int mb_tcp_recv(MBTCP_CTX_T *mbtcp_ctx)
 {
-    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+    PTR_CHECK_N1(mbtcp_ctx);
 
+    return mbtcp_recv(mbtcp_ctx, NULL);
+}
+
+/*
+ * Function  : recv ModBus TCP data from slaver, the response is decapped in place
+ * mbtcp_ctx : ModBus TCP context
+ * view      : the response, valid until the next send/recv
+ * return    : 0=CLOSE/NO RESPONSE(RTU broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_tcp_recv_view(MBTCP_CTX_T *mbtcp_ctx, MB_VIEW_T *view)
+{
     PTR_CHECK_N1(mbtcp_ctx);
+    PTR_CHECK_N1(view);
 
-    int length = 0;
+    return mbtcp_recv(mbtcp_ctx, view);
+}
+
+/*
+ * Function  : recv ModBus TCP data without blocking, a partial frame is kept in cache
+ *             and completed by later calls, for callers driving many sockets from one event loop
+ * mbtcp_ctx : ModBus TCP context
+ * return    : length=FRAME DECAPPED 0=INCOMPLETE -1=ERROR(errno EBADMSG=BAD FRAME DROPPED)
+ */
+int mb_tcp_recv_nb(MBTCP_CTX_T *mbtcp_ctx)
+{
+    PTR_CHECK_N1(mbtcp_ctx);
+
+    int ret = 0;
     MBTCP_DATA_T *mbtcp_data = &mbtcp_ctx->mb_tcp_data;
     MB_DATA_T    *mb_data    = mbtcp_ctx->mb_tcp_data.mb_data;
-    MBTCP_DESC_T *mbtcp_desc = &(mbtcp_ctx->mb_tcp_desc); 
-    
-    mb_data_clear(mb_data);
 
-    /* recv tcp data */
-    length = tcp_recv(mbtcp_desc, mb_data);
-    if (0 > length)
+    if (MBTCP_LINK_UP != mbtcp_ctx->mb_tcp_desc.link)
     {
+        errno = ENOTCONN;
         return -1;
     }
 
-#ifdef MB_DEBUG
-    MB_PRINT("RECV %d bytes\n", length);
-    mb_cache_show(mb_data);
-#endif
+    /* the io_uring backend owns the socket reads */
+    if (mbtcp_ctx->mb_tcp_desc.uring)
+    {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
 
-    /* decap modbus head */
-    if (0 > mbap_head_decap_check(mbtcp_data))
+    /* start of a new frame */
+    if (!mbtcp_data->rx_len)
+    {
+        mb_data_clear(mb_data);
+    }
+
+    ret = tcp_frame_recv(&mbtcp_ctx->mb_tcp_desc, mb_data);
+    if (0 > ret)
     {
+        mbtcp_data->rx_len = 0;
+        tcp_link_down(&mbtcp_ctx->mb_tcp_desc);
+        errno = ENOTCONN;
         return -1;
     }
+    else if (0 == ret)
+    {
+        mbtcp_data->rx_len = mb_data->data_len;
+        return 0;
+    }
 
-    /* dacap modbus data */
-    mb_data_decap(mb_data);
+    mbtcp_data->rx_len = 0;
 
-    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+    if (0 > mbtcp_frame_decap(mbtcp_ctx, NULL))
+    {
+        return -1;
+    }
 
-    return length;
+    return mb_data->data_len;
+}
+
+/*
+ * Function  : send the queued requests now, e.g. at the end of a scan cycle,
+ *             on error their transactions stay pending until mb_tcp_expire
+ * mbtcp_ctx : ModBus TCP context
+ * return    : length=SUCCESS 0=NOTHING QUEUED -1=ERROR
+ */
+int mb_tcp_flush(MBTCP_CTX_T *mbtcp_ctx)
+{
+    PTR_CHECK_N1(mbtcp_ctx);
+
+    return mbtcp_txq_flush(mbtcp_ctx);
+}
+
+/*
+ * Function  : drop outstanding transactions whose deadline has passed
+ * mbtcp_ctx : ModBus TCP context
+ * now       : current time(us), MBTCP_TIME_ALL=drop all of them
+ * cb        : called for every dropped transaction
+ * return    : void
+ */
+void mb_tcp_expire(MBTCP_CTX_T *mbtcp_ctx, UINT64_T now, mbtcp_trans_cb_t cb, void *arg)
+{
+    PTR_CHECK_VOID(mbtcp_ctx);
+
+    if (MBTCP_TIME_ALL == now)
+    {
+        mbtcp_trans_flush(mbtcp_ctx, cb, arg);
+    }
+    else
+    {
+        mbtcp_trans_expire(mbtcp_ctx, now, cb, arg);
+    }
+}
+
+/*
+ * Function  : transaction code of the last request sent(MB_TX) or response received(MB_RX),
+ *             used to match pipelined responses with their requests
+ * mbtcp_ctx : ModBus TCP context
+ * return    : transaction code
+ */
+UINT16_T mbtcpctx_tid_get(MBTCP_CTX_T *mbtcp_ctx, MB_DIRECT_T direct)
+{
+    PTR_CHECK_0(mbtcp_ctx);
+
+    return mbtcp_ctx->mb_tcp_data.mbap_head[(MB_TX == direct) ? MB_TX : MB_RX].transaction_code;
+}
+
+/*
+ * Function  : number of requests waiting for a response
+ * mbtcp_ctx : ModBus TCP context
+ * return    : outstanding transaction number
+ */
+int mb_tcp_pending(MBTCP_CTX_T *mbtcp_ctx)
+{
+    PTR_CHECK_N1(mbtcp_ctx);
+
+    return mbtcp_ctx->mb_tcp_data.pending;
 }
 
 void mbtcpctx_info_updata(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info)
@@ -477,7 +1906,7 @@ void mbtcpctx_info_updata(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info)
 
     PTR_CHECK_VOID(mbtcp_ctx);
     
-    mbtcp_ctx->mb_tcp_data.mb_data->mb_info = *mb_info;
+    mb_info_copy(&mbtcp_ctx->mb_tcp_data.mb_data->mb_info, mb_info);
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 }
@@ -489,7 +1918,7 @@ void mbtcpctx_info_takeout(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info)
     PTR_CHECK_VOID(mbtcp_ctx);
     PTR_CHECK_VOID(mb_info);
     
-    *mb_info = mbtcp_ctx->mb_tcp_data.mb_data->mb_info;
+    mb_info_copy(mb_info, &mbtcp_ctx->mb_tcp_data.mb_data->mb_info);
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 }
@@ -8,29 +8,111 @@
 #define MB_TCP
 
 #include "mb_common.h"
+#include "mb_uring.h"
+#include "mb_rtu.h"
 
 #define MBTCP_ETHDEV_LEN    32
 #define MBTCP_IPADDR_LEN    32
-#define MBTCP_RECV_DELAY    200
-#define MBTCP_CONN_DELAY    200
-#define MBTCP_RECV_TIMEOUT  100
-#define MBTCP_CONN_TIMEOUT  10
+#define MBTCP_PATH_LEN      108   /* sun_path of AF_UNIX */
+#define MBTCP_RECV_TIMEOUT  3000  /* ms, default response deadline */
+#define MBTCP_CONN_TIMEOUT  1000  /* ms, default connect deadline */
+#define MBTCP_BACKOFF_MIN   100   /* ms, first re-connect delay */
+#define MBTCP_BACKOFF_MAX   30000 /* ms, re-connect delay limit */
+#define MBTCP_KEEPIDLE      10    /* s, idle time before the first keepalive probe */
+#define MBTCP_KEEPINTVL     2     /* s, interval between keepalive probes */
+#define MBTCP_KEEPCNT       3     /* unanswered probes before the peer is dead */
+#define MBTCP_USER_TIMEOUT  10000 /* ms, max time sent data may stay unacknowledged */
+#define MBTCP_MAX_WINDOW    64    /* max outstanding transactions per context */
+#define MBTCP_TIME_ALL      (~0ULL)
+#define MBTCP_FRAME_SIZE    260   /* max MBAP + PDU */
+#define MBTCP_TXQ_SIZE      64    /* max frames of one gather write */
+#define MBTCP_TXQ_BYTES     1460  /* flush once a segment is full */
+#define MBTCP_TXQ_DELAY     1000  /* us, max time a queued frame waits */
+#define MBTCP_URING_TX_SIZE (MBTCP_FRAME_SIZE * MBTCP_MAX_WINDOW)
+#define MBTCP_URING_RX_SIZE 4096
+#define MBTCP_RTU_GAP       20000 /* us, silence ending an RTU frame of unknown length */
 
 typedef struct 
 {
     UINT8_T  unitid;
     UINT16_T max_data_size;
     UINT16_T port;
+    UINT32_T timeout;           /* response deadline(ms), 0=MBTCP_RECV_TIMEOUT */
+    UINT16_T window;            /* outstanding transactions, 0=1(no pipelining) */
+    UINT32_T conn_timeout;      /* connect deadline(ms), 0=MBTCP_CONN_TIMEOUT */
+    UINT16_T batch;             /* requests gathered in one write, 0/1=send at once */
+    MBURING_T *uring;           /* io_uring backend(batch unused), NULL=poll backend */
+
+    /* RTU over TCP of serial device servers, slaver address + PDU + CRC instead of MBAP,
+     * unitid is the slaver address, one request at a time(window/batch unused), no io_uring */
+    UINT8_T  rtu;
+    UINT32_T rtu_gap;           /* us, 0=MBTCP_RTU_GAP */
+
+    /* dead peer detection, 0=default */
+    UINT32_T keepidle;          /* s */
+    UINT32_T keepintvl;         /* s */
+    UINT32_T keepcnt;
+    UINT32_T user_timeout;      /* ms */
+
     char     ip[MBTCP_IPADDR_LEN];
     char     ethdev[MBTCP_ETHDEV_LEN];
+    char     path[MBTCP_PATH_LEN]; /* AF_UNIX stream socket of a local slaver, ""=TCP */
 } MBTCP_CTL_T;
 
+typedef enum
+{
+    MBTCP_LINK_DOWN = 0,
+    MBTCP_LINK_CONNECTING,
+    MBTCP_LINK_UP
+} MBTCP_LINK_T;
+
+/* io_uring backend, requests are gathered until the next wait submits them */
+typedef struct 
+{
+    MBURING_T   *ring;
+    MBURING_OP_T tx;
+    MBURING_OP_T rx;
+    UINT32_T     tx_len;        /* bytes of the send, 0=NO SEND */
+    UINT32_T     tx_off;        /* bytes already sent */
+    UINT32_T     rx_head;       /* first byte not decapped */
+    UINT32_T     rx_tail;       /* end of received bytes */
+    UINT8_T      rx_armed;      /* a recv completion not looked at yet */
+    UINT8_T      tx_buf[MBTCP_URING_TX_SIZE];
+    UINT8_T      rx_buf[MBTCP_URING_RX_SIZE];
+} MBTCP_URING_T;
+
 typedef struct 
 {
     int      socket;
     UINT16_T port;
+    UINT32_T timeout;
+
+    /* link state machine, re-connect never blocks the caller */
+    MBTCP_LINK_T link;
+    UINT32_T link_seq;          /* incremented for every new socket */
+    UINT32_T conn_timeout;      /* ms */
+    UINT32_T backoff;           /* ms, doubled after every failed connect */
+    UINT32_T seed;              /* backoff jitter */
+    UINT64_T conn_deadline;     /* us, of the connect in progress */
+    UINT64_T retry_time;        /* us, earliest next connect */
+
+    /* dead peer detection */
+    UINT32_T keepidle;
+    UINT32_T keepintvl;
+    UINT32_T keepcnt;
+    UINT32_T user_timeout;
+
+    MBTCP_URING_T *uring;       /* NULL=poll backend */
+    UINT8_T  rtu;               /* RTU frames instead of MBAP */
+    UINT8_T  rtu_stale;         /* a late response may still come, dropped before the next request */
+    UINT32_T rtu_gap;           /* us */
+    UINT8_T  attached;          /* socket given by mb_tcp_attach, never re-connected */
+    UINT16_T rx_stash_len;      /* bytes of the next frame read with the predicted one */
+    UINT8_T  rx_stash[MBTCP_FRAME_SIZE]; /* those bytes, taken before the next read */
+
     char     ip[MBTCP_IPADDR_LEN];
     char     ethdev[MBTCP_ETHDEV_LEN];
+    char     path[MBTCP_PATH_LEN];
 } MBTCP_DESC_T;
 
 typedef struct 
@@ -43,8 +125,34 @@ typedef struct
 
 typedef struct 
 {
-    MBAP_HEAD_T mbap_head[MB_DIRECT_NUM];
-    MB_DATA_T  *mb_data;
+    UINT64_T deadline;          /* response deadline(us) */
+    UINT16_T transaction_code;
+    UINT16_T reg;               /* start and quantity of the request, reads are answered without them */
+    UINT16_T n_reg;
+    UINT8_T  code;
+    UINT8_T  used;
+} __attribute__((packed)) MBTCP_TRANS_T;
+
+typedef struct 
+{
+    UINT8_T  frame[MBTCP_TXQ_SIZE][MBTCP_FRAME_SIZE];
+    UINT16_T len[MBTCP_TXQ_SIZE];
+    UINT16_T num;
+    UINT16_T batch;             /* frame threshold */
+    UINT32_T bytes;             /* byte threshold */
+    UINT64_T first_time;        /* time threshold(us) */
+} MBTCP_TXQ_T;
+
+typedef struct 
+{
+    MBAP_HEAD_T   mbap_head[MB_DIRECT_NUM];
+    UINT16_T      window;
+    UINT16_T      pending;
+    UINT16_T      rx_len;       /* bytes of a partial frame held by mb_tcp_recv_nb */
+    MBTCP_TRANS_T trans[MBTCP_MAX_WINDOW];
+    MBTCP_TXQ_T  *txq;          /* send queue, NULL=send at once */
+    MBRTU_DATA_T  rtu_data;     /* RTU framing, shares mb_data */
+    MB_DATA_T    *mb_data;
 } __attribute__((packed)) MBTCP_DATA_T;
 
 typedef struct
@@ -53,6 +161,8 @@ typedef struct
     MBTCP_DATA_T mb_tcp_data;
 } MBTCP_CTX_T;
 
+typedef void (*mbtcp_trans_cb_t)(MBTCP_CTX_T *mbtcp_ctx, UINT16_T transaction_code, void *arg);
+
 /*
  * Function  : Create a ModBus TCP context
  * rtu_ctl   : configure parameters of ModBus TCP
@@ -60,6 +170,15 @@ typedef struct
  */
 MBTCP_CTX_T *mb_tcp_init(MBTCP_CTL_T *tcp_ctl);
 
+/*
+ * Function  : Create a ModBus TCP context on a connected stream socket, such as one end of
+ *             socketpair(AF_UNIX), the context owns it once created and never re-connects
+ * tcp_ctl   : configure parameters of ModBus TCP, ip/port/ethdev/path unused
+ * sock      : connected stream socket
+ * return    : (MBTCP_CTX_T *)=SUCCESS NULL=ERRROR
+ */
+MBTCP_CTX_T *mb_tcp_attach(MBTCP_CTL_T *tcp_ctl, int sock);
+
 /*
  * Function  : close a ModBus TCP context
  * mbtcp_ctx   : the ModBus TCP context you want to close
@@ -74,14 +193,83 @@ void mb_tcp_close(MBTCP_CTX_T *mbtcp_ctx);
  */
 int mb_tcp_send(MBTCP_CTX_T *mbtcp_ctx);
 
+/*
+ * Function  : encode a request once for mb_tcp_send_prepared, the MBAP and PDU, or for RTU
+ *             over TCP the slaver address, PDU and CRC, the context itself is left alone
+ * mbtcp_ctx : ModBus TCP context the request is sent on
+ * mb_info   : the request
+ * prep      : prepared request
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_tcp_prepare(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep);
+
+/*
+ * Function  : send a prepared request like mb_tcp_send, nothing is encoded, a new MBAP
+ *             transaction code is patched in and the frame is copied to the cache as it is
+ * mbtcp_ctx : ModBus TCP context of mb_tcp_prepare
+ * prep      : prepared request
+ * return    : 0=CLOSE length=SUCCESS -1=ERROR
+ */
+int mb_tcp_send_prepared(MBTCP_CTX_T *mbtcp_ctx, const MB_PREP_T *prep);
+
 /*
  * Function  : recv ModBus TCP data from slaver to ModBus cache
  * mbtcp_ctx   : ModBus TCP context
  * mb_data   : ModBus cache
- * return    : 0=CLOSE length=SUCCESS -1=ERROR
+ * return    : 0=CLOSE/NO RESPONSE(RTU broadcast) length=SUCCESS -1=ERROR
  */
 int mb_tcp_recv(MBTCP_CTX_T *mbtcp_ctx);
 
+/*
+ * Function  : recv ModBus TCP data from slaver, the response is decapped in place,
+ *             no value byte is copied and mb_info keeps the request
+ * mbtcp_ctx : ModBus TCP context
+ * view      : the response, valid until the next send/recv
+ * return    : 0=CLOSE/NO RESPONSE(RTU broadcast) length=SUCCESS -1=ERROR
+ */
+int mb_tcp_recv_view(MBTCP_CTX_T *mbtcp_ctx, MB_VIEW_T *view);
+
+/*
+ * Function  : recv ModBus TCP data without blocking, a partial frame is kept in cache
+ *             and completed by later calls, for callers driving many sockets from one event loop,
+ *             an RTU frame completes by its predicted length only, there is no silence timer
+ * mbtcp_ctx : ModBus TCP context
+ * return    : length=FRAME DECAPPED 0=INCOMPLETE -1=ERROR(errno EBADMSG=BAD FRAME DROPPED)
+ */
+int mb_tcp_recv_nb(MBTCP_CTX_T *mbtcp_ctx);
+
+/*
+ * Function  : send the queued requests now, e.g. at the end of a scan cycle,
+ *             on error their transactions stay pending until mb_tcp_expire
+ * mbtcp_ctx : ModBus TCP context
+ * return    : length=SUCCESS 0=NOTHING QUEUED -1=ERROR
+ */
+int mb_tcp_flush(MBTCP_CTX_T *mbtcp_ctx);
+
+/*
+ * Function  : drop outstanding transactions whose deadline has passed
+ * mbtcp_ctx : ModBus TCP context
+ * now       : current time(us), MBTCP_TIME_ALL=drop all of them
+ * cb        : called for every dropped transaction
+ * return    : void
+ */
+void mb_tcp_expire(MBTCP_CTX_T *mbtcp_ctx, UINT64_T now, mbtcp_trans_cb_t cb, void *arg);
+
+/*
+ * Function  : transaction code of the last request sent(MB_TX) or response received(MB_RX),
+ *             used to match pipelined responses with their requests
+ * mbtcp_ctx : ModBus TCP context
+ * return    : transaction code
+ */
+UINT16_T mbtcpctx_tid_get(MBTCP_CTX_T *mbtcp_ctx, MB_DIRECT_T direct);
+
+/*
+ * Function  : number of requests waiting for a response
+ * mbtcp_ctx : ModBus TCP context
+ * return    : outstanding transaction number
+ */
+int mb_tcp_pending(MBTCP_CTX_T *mbtcp_ctx);
+
 void mbtcpctx_info_updata(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info);
 
 void mbtcpctx_info_takeout(MBTCP_CTX_T *mbtcp_ctx, MB_INFO_T *mb_info);
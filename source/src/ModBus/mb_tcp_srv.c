@@ -0,0 +1,519 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus TCP server(slaver), many clients on one epoll loop
+ *            2. Serve requests from a coil/register store
+ */
+
+#define _GNU_SOURCE /* accept4 */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "mb_tcp_srv.h"
+
+/*
+ * Function  : close a client and give its id back
+ * mbsrv_ctx : ModBus TCP server
+ * id        : client id
+ * return    : void
+ */
+static void srv_client_close(MBSRV_CTX_T *mbsrv_ctx, int id)
+{
+    MBSRV_CLIENT_T *client = mbsrv_ctx->client[id];
+
+    if (!client)
+    {
+        return ;
+    }
+
+    epoll_ctl(mbsrv_ctx->epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    free(client);
+
+    mbsrv_ctx->client[id] = NULL;
+    mbsrv_ctx->free_id[mbsrv_ctx->n_free++] = id;
+    mbsrv_ctx->n_client--;
+}
+
+/*
+ * Function  : watch a non-blocking socket as a new client
+ * mbsrv_ctx : ModBus TCP server
+ * sock      : connected socket, closed on error
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int srv_client_add(MBSRV_CTX_T *mbsrv_ctx, int sock)
+{
+    MBSRV_CLIENT_T    *client = NULL;
+    struct epoll_event event  = {0};
+    int one = 1;
+    int id  = 0;
+
+    if (!mbsrv_ctx->n_free)
+    {
+        printf("modbus tcp server is full(%d)\n", mbsrv_ctx->max_client);
+        close(sock);
+        return -1;
+    }
+
+    client = (MBSRV_CLIENT_T *)malloc(sizeof(MBSRV_CLIENT_T));
+    if (!client)
+    {
+        printf("Can not create a modbus tcp server client\n");
+        close(sock);
+        return -1;
+    }
+    client->fd     = sock;
+    client->rx_len = 0;
+    client->tx_off = 0;
+    client->tx_len = 0;
+    client->wait_out = 0;
+
+    /* responses go out as soon as they are built, fails harmlessly on AF_UNIX */
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    id = mbsrv_ctx->free_id[--mbsrv_ctx->n_free];
+
+    event.events   = EPOLLIN;
+    event.data.u32 = id;
+    if (0 > epoll_ctl(mbsrv_ctx->epfd, EPOLL_CTL_ADD, sock, &event))
+    {
+        perror("epoll_ctl error");
+        mbsrv_ctx->free_id[mbsrv_ctx->n_free++] = id;
+        close(sock);
+        free(client);
+        return -1;
+    }
+
+    mbsrv_ctx->client[id] = client;
+    mbsrv_ctx->n_client++;
+
+    return 0;
+}
+
+/*
+ * Function  : accept every pending client
+ * mbsrv_ctx : ModBus TCP server
+ * return    : void
+ */
+static void srv_client_accept(MBSRV_CTX_T *mbsrv_ctx)
+{
+    int sock = 0;
+
+    while (0 <= (sock = accept4(mbsrv_ctx->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)))
+    {
+        srv_client_add(mbsrv_ctx, sock);
+    }
+
+    if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)
+    {
+        perror("accept error");
+    }
+}
+
+/*
+ * Function  : serve one request frame, the response is appended to the send buffer
+ * mbsrv_ctx : ModBus TCP server
+ * client    : client
+ * frame     : request frame(MBAP + PDU)
+ * len       : request frame length
+ * return    : void
+ */
+static void srv_frame_serve(MBSRV_CTX_T *mbsrv_ctx, MBSRV_CLIENT_T *client, UINT8_T *frame, UINT16_T len)
+{
+    MB_DATA_T *mb_data = mbsrv_ctx->mb_data;
+    UINT16_T   pdu_len = 0;
+
+    /* another unit behind this address, not ours to answer */
+    if (mbsrv_ctx->unitid && mbsrv_ctx->unitid != frame[sizeof(MBAP_HEAD_T) - 1])
+    {
+        return ;
+    }
+
+    memcpy(mb_data->data, frame, len);
+    mb_data->data_len = len;
+    mb_data->offset   = sizeof(MBAP_HEAD_T);
+
+    mb_slave_handle(mbsrv_ctx->store, mb_data);
+
+    /* transaction, protocol and unit are echoed, length covers unit + PDU */
+    pdu_len = mb_data->data_len - sizeof(MBAP_HEAD_T);
+    mb_data->data[4] = (UINT8_T)((pdu_len + 1) >> 8);
+    mb_data->data[5] = (UINT8_T)(pdu_len + 1);
+
+    memcpy(client->tx_buf + client->tx_len, mb_data->data, mb_data->data_len);
+    client->tx_len += mb_data->data_len;
+}
+
+/*
+ * Function  : send buffered responses, the client is watched for EPOLLOUT while some are left
+ * mbsrv_ctx : ModBus TCP server
+ * id        : client id
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int srv_client_send(MBSRV_CTX_T *mbsrv_ctx, int id)
+{
+    MBSRV_CLIENT_T    *client = mbsrv_ctx->client[id];
+    struct epoll_event event  = {0};
+    int length = 0;
+
+    while (client->tx_off < client->tx_len)
+    {
+        length = send(client->fd, client->tx_buf + client->tx_off, client->tx_len - client->tx_off,
+                      MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (0 > length)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            if (EAGAIN != errno && EWOULDBLOCK != errno)
+            {
+                return -1;
+            }
+            break;
+        }
+
+        client->tx_off += length;
+    }
+
+    if (client->tx_off == client->tx_len)
+    {
+        client->tx_off = 0;
+        client->tx_len = 0;
+    }
+
+    /* a client not reading its responses is not read either */
+    if (client->wait_out != !!client->tx_len)
+    {
+        client->wait_out = !!client->tx_len;
+
+        event.events   = client->wait_out ? EPOLLOUT : EPOLLIN;
+        event.data.u32 = id;
+        if (0 > epoll_ctl(mbsrv_ctx->epfd, EPOLL_CTL_MOD, client->fd, &event))
+        {
+            perror("epoll_ctl error");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Function  : serve every complete request received from a client
+ * mbsrv_ctx : ModBus TCP server
+ * id        : client id
+ * return    : number of requests served, -1=ERROR(client must be closed)
+ */
+static int srv_client_serve(MBSRV_CTX_T *mbsrv_ctx, int id)
+{
+    MBSRV_CLIENT_T *client = mbsrv_ctx->client[id];
+    UINT32_T off   = 0;
+    UINT16_T len   = 0;
+    int      count = 0;
+
+    while ((client->rx_len - off) >= sizeof(MBAP_HEAD_T))
+    {
+        /* protocol must be ModBus, length covers unit + PDU */
+        len = (client->rx_buf[off + 4] << 8) | client->rx_buf[off + 5];
+        if (client->rx_buf[off + 2] || client->rx_buf[off + 3] ||
+            2 > len || (len + 6) > MBTCP_FRAME_SIZE)
+        {
+            printf("Invalid MBAP header from client %d\n", id);
+            return -1;
+        }
+
+        len += 6;
+        if ((client->rx_len - off) < len)
+        {
+            break;
+        }
+
+        /* the rest waits until responses are sent */
+        if ((client->tx_len + MBTCP_FRAME_SIZE) > MBSRV_BUF_SIZE)
+        {
+            break;
+        }
+
+        srv_frame_serve(mbsrv_ctx, client, client->rx_buf + off, len);
+        off += len;
+        count++;
+    }
+
+    if (off)
+    {
+        memmove(client->rx_buf, client->rx_buf + off, client->rx_len - off);
+        client->rx_len -= off;
+    }
+
+    return count;
+}
+
+/*
+ * Function  : a client is readable or writable
+ * mbsrv_ctx : ModBus TCP server
+ * id        : client id
+ * events    : epoll events
+ * return    : number of requests served
+ */
+static int srv_client_event(MBSRV_CTX_T *mbsrv_ctx, int id, UINT32_T events)
+{
+    MBSRV_CLIENT_T *client = mbsrv_ctx->client[id];
+    int length = 0;
+    int count  = 0;
+    int ret    = 0;
+
+    if (!client)
+    {
+        return 0;
+    }
+
+    if ((events & EPOLLIN) && client->rx_len < MBSRV_BUF_SIZE)
+    {
+        length = recv(client->fd, client->rx_buf + client->rx_len, MBSRV_BUF_SIZE - client->rx_len, MSG_DONTWAIT);
+        if (0 == length || (0 > length && EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno))
+        {
+            srv_client_close(mbsrv_ctx, id);
+            return 0;
+        }
+
+        if (0 < length)
+        {
+            client->rx_len += length;
+        }
+    }
+    else if (events & EPOLLOUT)
+    {
+        if (0 > srv_client_send(mbsrv_ctx, id))
+        {
+            srv_client_close(mbsrv_ctx, id);
+            return 0;
+        }
+
+        if (client->tx_len)
+        {
+            return 0;
+        }
+    }
+    else if (events & (EPOLLERR | EPOLLHUP))
+    {
+        srv_client_close(mbsrv_ctx, id);
+        return 0;
+    }
+
+    /* requests left behind by a full send buffer are served once it is sent */
+    do
+    {
+        ret = srv_client_serve(mbsrv_ctx, id);
+        if (0 > ret || 0 > srv_client_send(mbsrv_ctx, id))
+        {
+            srv_client_close(mbsrv_ctx, id);
+            return count;
+        }
+
+        count += ret;
+    } while (ret && !client->tx_len);
+
+    return count;
+}
+
+MBSRV_CTX_T *mb_tcp_srv_create(MBSRV_CTL_T *srv_ctl)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_NULL(srv_ctl);
+    PTR_CHECK_NULL(srv_ctl->store);
+
+    MBSRV_CTX_T       *mbsrv_ctx = NULL;
+    struct sockaddr_in addr      = {0};
+    struct sockaddr_un unix_addr = {0};
+    struct epoll_event event     = {0};
+    int ret = 0;
+    int one = 1;
+    int i   = 0;
+
+    mbsrv_ctx = (MBSRV_CTX_T *)malloc(sizeof(MBSRV_CTX_T));
+    if (!mbsrv_ctx)
+    {
+        printf("Can not create a modbus tcp server\n");
+        return NULL;
+    }
+    memset(mbsrv_ctx, 0, sizeof(MBSRV_CTX_T));
+
+    mbsrv_ctx->listen_fd  = -1;
+    mbsrv_ctx->unitid     = srv_ctl->unitid;
+    mbsrv_ctx->store      = srv_ctl->store;
+    mbsrv_ctx->max_client = srv_ctl->max_client ? srv_ctl->max_client : MBSRV_MAX_CLIENT;
+
+    mbsrv_ctx->client  = (MBSRV_CLIENT_T **)calloc(mbsrv_ctx->max_client, sizeof(MBSRV_CLIENT_T *));
+    mbsrv_ctx->free_id = (int *)calloc(mbsrv_ctx->max_client, sizeof(int));
+    mbsrv_ctx->events  = (struct epoll_event *)calloc(MBSRV_EVENT_NUM, sizeof(struct epoll_event));
+    mbsrv_ctx->mb_data = mb_data_create(MBTCP_FRAME_SIZE);
+    mbsrv_ctx->epfd    = epoll_create1(EPOLL_CLOEXEC);
+
+    if (!mbsrv_ctx->client || !mbsrv_ctx->free_id || !mbsrv_ctx->events ||
+        !mbsrv_ctx->mb_data || 0 > mbsrv_ctx->epfd)
+    {
+        printf("Can not create a modbus tcp server\n");
+        mb_tcp_srv_destory(mbsrv_ctx);
+        return NULL;
+    }
+
+    /* lower ids first */
+    for (i = mbsrv_ctx->max_client - 1; i >= 0; --i)
+    {
+        mbsrv_ctx->free_id[mbsrv_ctx->n_free++] = i;
+    }
+
+    mbsrv_ctx->listen_fd = socket(srv_ctl->path[0] ? AF_UNIX : AF_INET, 
+                                  SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (0 > mbsrv_ctx->listen_fd)
+    {
+        perror("socket error");
+        mb_tcp_srv_destory(mbsrv_ctx);
+        return NULL;
+    }
+
+    if (srv_ctl->path[0])
+    {
+        /* a socket file left by a previous server refuses the bind */
+        unix_addr.sun_family = AF_UNIX;
+        snprintf(unix_addr.sun_path, sizeof(unix_addr.sun_path), "%s", srv_ctl->path);
+        unlink(unix_addr.sun_path);
+
+        ret = bind(mbsrv_ctx->listen_fd, (struct sockaddr *)&unix_addr, sizeof(unix_addr));
+        if (0 == ret)
+        {
+            snprintf(mbsrv_ctx->path, sizeof(mbsrv_ctx->path), "%s", unix_addr.sun_path);
+        }
+    }
+    else
+    {
+        setsockopt(mbsrv_ctx->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        addr.sin_family      = AF_INET;
+        addr.sin_port        = htons(srv_ctl->port);
+        addr.sin_addr.s_addr = srv_ctl->ip[0] ? inet_addr(srv_ctl->ip) : htonl(INADDR_ANY);
+
+        ret = bind(mbsrv_ctx->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+
+    if (0 > ret || 0 > listen(mbsrv_ctx->listen_fd, MBSRV_BACKLOG))
+    {
+        perror("bind/listen error");
+        mb_tcp_srv_destory(mbsrv_ctx);
+        return NULL;
+    }
+
+    event.events   = EPOLLIN;
+    event.data.u32 = MBSRV_LISTEN_ID;
+    if (0 > epoll_ctl(mbsrv_ctx->epfd, EPOLL_CTL_ADD, mbsrv_ctx->listen_fd, &event))
+    {
+        perror("epoll_ctl error");
+        mb_tcp_srv_destory(mbsrv_ctx);
+        return NULL;
+    }
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mbsrv_ctx;
+}
+
+void mb_tcp_srv_destory(MBSRV_CTX_T *mbsrv_ctx)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mbsrv_ctx);
+
+    int i = 0;
+
+    for (i = 0; mbsrv_ctx->client && i < mbsrv_ctx->max_client; ++i)
+    {
+        srv_client_close(mbsrv_ctx, i);
+    }
+
+    if (0 <= mbsrv_ctx->listen_fd)
+    {
+        close(mbsrv_ctx->listen_fd);
+    }
+
+    if (mbsrv_ctx->path[0])
+    {
+        unlink(mbsrv_ctx->path);
+    }
+
+    if (0 <= mbsrv_ctx->epfd)
+    {
+        close(mbsrv_ctx->epfd);
+    }
+
+    mb_data_destory(mbsrv_ctx->mb_data);
+    free(mbsrv_ctx->events);
+    free(mbsrv_ctx->free_id);
+    free(mbsrv_ctx->client);
+    free(mbsrv_ctx);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+int mb_tcp_srv_attach(MBSRV_CTX_T *mbsrv_ctx, int sock)
+{
+    PTR_CHECK_N1(mbsrv_ctx);
+
+    int flags = 0;
+
+    flags = fcntl(sock, F_GETFL);
+    if (0 > flags || 0 > fcntl(sock, F_SETFL, flags | O_NONBLOCK))
+    {
+        perror("fcntl error");
+        close(sock);
+        return -1;
+    }
+
+    return srv_client_add(mbsrv_ctx, sock);
+}
+
+int mb_tcp_srv_run(MBSRV_CTX_T *mbsrv_ctx, int timeout)
+{
+    PTR_CHECK_N1(mbsrv_ctx);
+
+    int i     = 0;
+    int ready = 0;
+    int count = 0;
+
+    ready = epoll_wait(mbsrv_ctx->epfd, mbsrv_ctx->events, MBSRV_EVENT_NUM, timeout);
+    if (0 > ready)
+    {
+        if (EINTR == errno)
+        {
+            return 0;
+        }
+
+        perror("epoll_wait error");
+        return -1;
+    }
+
+    for (i = 0; i < ready; ++i)
+    {
+        if (MBSRV_LISTEN_ID == mbsrv_ctx->events[i].data.u32)
+        {
+            srv_client_accept(mbsrv_ctx);
+            continue;
+        }
+
+        count += srv_client_event(mbsrv_ctx, mbsrv_ctx->events[i].data.u32, mbsrv_ctx->events[i].events);
+    }
+
+    return count;
+}
@@ -0,0 +1,89 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. ModBus TCP server(slaver), many clients on one epoll loop
+ *            2. Serve requests from a coil/register store
+ */
+
+#ifndef MB_TCP_SRV
+#define MB_TCP_SRV
+
+#include <sys/epoll.h>
+
+#include "mb_tcp.h"
+#include "mb_slave.h"
+
+#define MBSRV_EVENT_NUM    256
+#define MBSRV_MAX_CLIENT   1024
+#define MBSRV_BACKLOG      1024
+#define MBSRV_BUF_SIZE     (MBTCP_FRAME_SIZE * 16)  /* pipelined requests of one client */
+#define MBSRV_LISTEN_ID    0xffffffff
+
+typedef struct
+{
+    UINT16_T port;
+    UINT8_T  unitid;            /* 0=answer every unit */
+    int      max_client;        /* 0=MBSRV_MAX_CLIENT */
+    MBSLV_STORE_T *store;       /* owned by caller */
+    char     ip[MBTCP_IPADDR_LEN]; /* listen address, ""=any */
+    char     path[MBTCP_PATH_LEN]; /* listen on this AF_UNIX path instead of ip:port */
+} MBSRV_CTL_T;
+
+typedef struct
+{
+    int      fd;
+    UINT32_T rx_len;            /* received bytes not served yet */
+    UINT32_T tx_off;            /* response bytes already sent */
+    UINT32_T tx_len;            /* response bytes */
+    UINT8_T  wait_out;          /* watched for EPOLLOUT instead of EPOLLIN */
+    UINT8_T  rx_buf[MBSRV_BUF_SIZE];
+    UINT8_T  tx_buf[MBSRV_BUF_SIZE];
+} MBSRV_CLIENT_T;
+
+typedef struct
+{
+    int              listen_fd;
+    int              epfd;
+    UINT8_T          unitid;
+    int              max_client;
+    int              n_client;
+    int              n_free;
+    int             *free_id;   /* stack of free client ids */
+    MBSRV_CLIENT_T **client;
+    MBSLV_STORE_T   *store;
+    MB_DATA_T       *mb_data;
+    struct epoll_event *events;
+    char             path[MBTCP_PATH_LEN]; /* unlinked on destory */
+} MBSRV_CTX_T;
+
+/*
+ * Function  : Create a ModBus TCP server listening for clients
+ * srv_ctl   : configure parameters of ModBus TCP server
+ * return    : (MBSRV_CTX_T *)=SUCCESS NULL=ERROR
+ */
+MBSRV_CTX_T *mb_tcp_srv_create(MBSRV_CTL_T *srv_ctl);
+
+/*
+ * Function  : close every client and the listener, the store is not destoried
+ * mbsrv_ctx : ModBus TCP server
+ * return    : void
+ */
+void mb_tcp_srv_destory(MBSRV_CTX_T *mbsrv_ctx);
+
+/*
+ * Function  : serve a connected stream socket as one more client, such as one end of
+ *             socketpair(AF_UNIX)
+ * mbsrv_ctx : ModBus TCP server
+ * sock      : connected stream socket, owned by the server from now on, closed on error
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_tcp_srv_attach(MBSRV_CTX_T *mbsrv_ctx, int sock);
+
+/*
+ * Function  : wait for clients once, accept them and serve every complete request
+ * mbsrv_ctx : ModBus TCP server
+ * timeout   : max wait time(ms), -1=until an event
+ * return    : number of requests served, -1=ERROR
+ */
+int mb_tcp_srv_run(MBSRV_CTX_T *mbsrv_ctx, int timeout);
+
+#endif
@@ -0,0 +1,456 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Minimal io_uring ring shared by ModBus TCP and RTU contexts
+ *            2. Queue operations without a syscall, submit and reap them with one
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "mb_uring.h"
+
+#ifdef MB_IO_URING
+
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define MBURING_CANCEL_TIMEOUT  1000000 /* us */
+
+struct mburing
+{
+    int       fd;
+
+    /* submission queue */
+    UINT32_T *sq_head;
+    UINT32_T *sq_tail;
+    UINT32_T *sq_mask;
+    UINT32_T *sq_array;
+    UINT32_T  sq_entries;
+    UINT32_T  sq_local;         /* tail of queued entries, not yet published */
+    struct io_uring_sqe *sqes;
+
+    /* completion queue */
+    UINT32_T *cq_head;
+    UINT32_T *cq_tail;
+    UINT32_T *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void     *sq_ring;
+    void     *cq_ring;
+    size_t    sq_ring_size;
+    size_t    cq_ring_size;
+    size_t    sqes_size;
+};
+
+static const UINT8_T uring_opcode[MBURING_IO_NUM] = {
+    [MBURING_IO_SEND]  = IORING_OP_SEND,
+    [MBURING_IO_RECV]  = IORING_OP_RECV,
+    [MBURING_IO_WRITE] = IORING_OP_WRITE,
+    [MBURING_IO_READ]  = IORING_OP_READ,
+};
+
+static int uring_enter(MBURING_T *mburing, UINT32_T to_submit, UINT32_T min_complete,
+    UINT32_T flags, void *arg, size_t arg_size)
+{
+    return syscall(__NR_io_uring_enter, mburing->fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+/*
+ * Function  : take a free submission entry, the queue is submitted when it is full
+ * mburing   : io_uring ring
+ * return    : (struct io_uring_sqe *)=SUCCESS NULL=ERROR
+ */
+static struct io_uring_sqe *uring_sqe_get(MBURING_T *mburing)
+{
+    struct io_uring_sqe *sqe = NULL;
+    UINT32_T idx = 0;
+
+    if (mburing->sq_local - __atomic_load_n(mburing->sq_head, __ATOMIC_ACQUIRE) >= mburing->sq_entries)
+    {
+        if (0 > mb_uring_wait(mburing, NULL, 0))
+        {
+            return NULL;
+        }
+    }
+
+    idx = mburing->sq_local & *mburing->sq_mask;
+    sqe = &mburing->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    mburing->sq_array[idx] = idx;
+    mburing->sq_local++;
+
+    return sqe;
+}
+
+/*
+ * Function  : publish queued entries, their operations become busy
+ * mburing   : io_uring ring
+ * return    : void
+ */
+static void uring_publish(MBURING_T *mburing)
+{
+    UINT32_T      tail = *mburing->sq_tail;
+    MBURING_OP_T *op   = NULL;
+
+    for (; tail != mburing->sq_local; ++tail)
+    {
+        op = (MBURING_OP_T *)(unsigned long)mburing->sqes[tail & *mburing->sq_mask].user_data;
+        if (op)
+        {
+            op->state = MBURING_OP_BUSY;
+            op->sqe   = NULL;
+        }
+    }
+
+    __atomic_store_n(mburing->sq_tail, mburing->sq_local, __ATOMIC_RELEASE);
+}
+
+/*
+ * Function  : reap every completion in the ring, no syscall
+ * mburing   : io_uring ring
+ * return    : void
+ */
+static void uring_reap(MBURING_T *mburing)
+{
+    UINT32_T head = *mburing->cq_head;
+    UINT32_T tail = __atomic_load_n(mburing->cq_tail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe *cqe = NULL;
+    MBURING_OP_T *op = NULL;
+
+    for (; head != tail; ++head)
+    {
+        cqe = &mburing->cqes[head & *mburing->cq_mask];
+        op  = (MBURING_OP_T *)(unsigned long)cqe->user_data;
+        if (op)
+        {
+            op->res   = cqe->res;
+            op->state = MBURING_OP_IDLE;
+        }
+    }
+
+    __atomic_store_n(mburing->cq_head, head, __ATOMIC_RELEASE);
+}
+
+MBURING_T *mb_uring_create(UINT32_T entries)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    MBURING_T *mburing = NULL;
+    struct io_uring_params params;
+
+    mburing = (MBURING_T *)malloc(sizeof(MBURING_T));
+    if (!mburing)
+    {
+        printf("Can not create an io_uring ring\n");
+        return NULL;
+    }
+    memset(mburing, 0, sizeof(MBURING_T));
+    memset(&params, 0, sizeof(params));
+
+    mburing->fd = syscall(__NR_io_uring_setup, entries ? entries : MBURING_ENTRIES, &params);
+    if (0 > mburing->fd)
+    {
+        perror("io_uring_setup error");
+        free(mburing);
+        return NULL;
+    }
+
+    /* timeout of a wait is handed to io_uring_enter(5.11) */
+    if (!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        printf("io_uring of this kernel is too old\n");
+        close(mburing->fd);
+        free(mburing);
+        return NULL;
+    }
+
+    mburing->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(UINT32_T);
+    mburing->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    mburing->sqes_size    = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    mburing->sq_ring = mmap(NULL, mburing->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, mburing->fd, IORING_OFF_SQ_RING);
+    mburing->cq_ring = mmap(NULL, mburing->cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, mburing->fd, IORING_OFF_CQ_RING);
+    mburing->sqes    = mmap(NULL, mburing->sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, mburing->fd, IORING_OFF_SQES);
+
+    if (MAP_FAILED == mburing->sq_ring || MAP_FAILED == mburing->cq_ring || MAP_FAILED == mburing->sqes)
+    {
+        perror("io_uring mmap error");
+        mburing->sq_ring = (MAP_FAILED == mburing->sq_ring) ? NULL : mburing->sq_ring;
+        mburing->cq_ring = (MAP_FAILED == mburing->cq_ring) ? NULL : mburing->cq_ring;
+        mburing->sqes    = (MAP_FAILED == mburing->sqes) ? NULL : mburing->sqes;
+        mb_uring_destory(mburing);
+        return NULL;
+    }
+
+    mburing->sq_head    = (UINT32_T *)((UINT8_T *)mburing->sq_ring + params.sq_off.head);
+    mburing->sq_tail    = (UINT32_T *)((UINT8_T *)mburing->sq_ring + params.sq_off.tail);
+    mburing->sq_mask    = (UINT32_T *)((UINT8_T *)mburing->sq_ring + params.sq_off.ring_mask);
+    mburing->sq_array   = (UINT32_T *)((UINT8_T *)mburing->sq_ring + params.sq_off.array);
+    mburing->sq_entries = params.sq_entries;
+    mburing->sq_local   = *mburing->sq_tail;
+
+    mburing->cq_head    = (UINT32_T *)((UINT8_T *)mburing->cq_ring + params.cq_off.head);
+    mburing->cq_tail    = (UINT32_T *)((UINT8_T *)mburing->cq_ring + params.cq_off.tail);
+    mburing->cq_mask    = (UINT32_T *)((UINT8_T *)mburing->cq_ring + params.cq_off.ring_mask);
+    mburing->cqes       = (struct io_uring_cqe *)((UINT8_T *)mburing->cq_ring + params.cq_off.cqes);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    return mburing;
+}
+
+void mb_uring_destory(MBURING_T *mburing)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_VOID(mburing);
+
+    if (mburing->sqes)
+    {
+        munmap(mburing->sqes, mburing->sqes_size);
+    }
+
+    if (mburing->cq_ring)
+    {
+        munmap(mburing->cq_ring, mburing->cq_ring_size);
+    }
+
+    if (mburing->sq_ring)
+    {
+        munmap(mburing->sq_ring, mburing->sq_ring_size);
+    }
+
+    close(mburing->fd);
+
+    free(mburing);
+
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+}
+
+int mb_uring_prep(MBURING_T *mburing, MBURING_OP_T *op, MBURING_IO_T io,
+    int fd, void *buf, UINT32_T len)
+{
+    PTR_CHECK_N1(mburing);
+    PTR_CHECK_N1(op);
+
+    struct io_uring_sqe *sqe = NULL;
+
+    if (MBURING_IO_NUM <= io || MBURING_OP_IDLE != op->state)
+    {
+        return -1;
+    }
+
+    sqe = uring_sqe_get(mburing);
+    if (!sqe)
+    {
+        return -1;
+    }
+
+    sqe->opcode    = uring_opcode[io];
+    sqe->fd        = fd;
+    sqe->addr      = (unsigned long)buf;
+    sqe->len       = len;
+    sqe->user_data = (unsigned long)op;
+
+    /* MSG_NOSIGNAL, a reset peer must not kill the process */
+    if (MBURING_IO_SEND == io)
+    {
+        sqe->msg_flags = MSG_NOSIGNAL;
+    }
+
+    /* streams and ttys have no offset */
+    if (MBURING_IO_WRITE == io || MBURING_IO_READ == io)
+    {
+        sqe->off = -1;
+    }
+
+    op->sqe   = sqe;
+    op->res   = 0;
+    op->state = MBURING_OP_QUEUED;
+
+    return 0;
+}
+
+int mb_uring_append(MBURING_OP_T *op, UINT32_T len)
+{
+    PTR_CHECK_N1(op);
+
+    if (MBURING_OP_QUEUED != op->state)
+    {
+        return -1;
+    }
+
+    ((struct io_uring_sqe *)op->sqe)->len += len;
+
+    return 0;
+}
+
+int mb_uring_link(MBURING_T *mburing, MBURING_OP_T *op)
+{
+    PTR_CHECK_N1(mburing);
+    PTR_CHECK_N1(op);
+
+    /* a link chains with the next entry, which belongs to the caller only if this is the last */
+    if (MBURING_OP_QUEUED != op->state || 
+        op->sqe != &mburing->sqes[(mburing->sq_local - 1) & *mburing->sq_mask])
+    {
+        return -1;
+    }
+
+    ((struct io_uring_sqe *)op->sqe)->flags |= IOSQE_IO_LINK;
+
+    return 0;
+}
+
+int mb_uring_wait(MBURING_T *mburing, MBURING_OP_T *op, UINT64_T deadline)
+{
+    PTR_CHECK_N1(mburing);
+
+    int      ret    = 0;
+    int      done   = 0;
+    UINT32_T submit = 0;
+    INT64_T  wait   = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+
+    uring_publish(mburing);
+
+    while (1)
+    {
+        /* published entries the kernel has not taken yet */
+        submit = *mburing->sq_tail - __atomic_load_n(mburing->sq_head, __ATOMIC_ACQUIRE);
+
+        uring_reap(mburing);
+        done = (!op || MBURING_OP_IDLE == op->state);
+
+        if (done)
+        {
+            if (!submit)
+            {
+                return 0;
+            }
+
+            ret = uring_enter(mburing, submit, 0, 0, NULL, 0);
+        }
+        else
+        {
+            wait = (INT64_T)(deadline - mb_time_us());
+            if (0 >= wait)
+            {
+                if (submit)
+                {
+                    uring_enter(mburing, submit, 0, 0, NULL, 0);
+                }
+                errno = ETIMEDOUT;
+                return -1;
+            }
+
+            memset(&arg, 0, sizeof(arg));
+            ts.tv_sec  = wait / 1000000;
+            ts.tv_nsec = (wait % 1000000) * 1000;
+            arg.ts     = (unsigned long)&ts;
+
+            /* submit and wait with one syscall, what is submitted now completes in 
+             * the same call(sends complete at once), not one call per completion */
+            ret = uring_enter(mburing, submit, submit ? submit : 1, 
+                IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        }
+
+        if (0 > ret && ETIME != errno && EINTR != errno && EBUSY != errno)
+        {
+            perror("io_uring_enter error");
+            return -1;
+        }
+    }
+}
+
+void mb_uring_cancel(MBURING_T *mburing, MBURING_OP_T *op)
+{
+    PTR_CHECK_VOID(mburing);
+    PTR_CHECK_VOID(op);
+
+    struct io_uring_sqe *sqe = NULL;
+
+    if (MBURING_OP_QUEUED == op->state)
+    {
+        /* not seen by the kernel, turn it into a no-op */
+        sqe = (struct io_uring_sqe *)op->sqe;
+        sqe->opcode    = IORING_OP_NOP;
+        sqe->flags     = 0;
+        sqe->user_data = 0;
+
+        op->sqe   = NULL;
+        op->res   = -ECANCELED;
+        op->state = MBURING_OP_IDLE;
+        return ;
+    }
+
+    if (MBURING_OP_BUSY != op->state)
+    {
+        return ;
+    }
+
+    sqe = uring_sqe_get(mburing);
+    if (sqe)
+    {
+        sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+        sqe->addr      = (unsigned long)op;
+        sqe->user_data = 0;
+    }
+
+    if (0 > mb_uring_wait(mburing, op, mb_time_us() + MBURING_CANCEL_TIMEOUT))
+    {
+        printf("io_uring operation can not be canceled\n");
+    }
+}
+
+#else
+
+MBURING_T *mb_uring_create(UINT32_T entries)
+{
+    printf("io_uring backend is not built, make uring=yes\n");
+    return NULL;
+}
+
+void mb_uring_destory(MBURING_T *mburing)
+{
+}
+
+int mb_uring_prep(MBURING_T *mburing, MBURING_OP_T *op, MBURING_IO_T io,
+    int fd, void *buf, UINT32_T len)
+{
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+int mb_uring_append(MBURING_OP_T *op, UINT32_T len)
+{
+    return -1;
+}
+
+int mb_uring_link(MBURING_T *mburing, MBURING_OP_T *op)
+{
+    return -1;
+}
+
+int mb_uring_wait(MBURING_T *mburing, MBURING_OP_T *op, UINT64_T deadline)
+{
+    errno = EOPNOTSUPP;
+    return -1;
+}
+
+void mb_uring_cancel(MBURING_T *mburing, MBURING_OP_T *op)
+{
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Minimal io_uring ring shared by ModBus TCP and RTU contexts
+ *            2. Queue operations without a syscall, submit and reap them with one
+ */
+
+#ifndef MB_URING
+#define MB_URING
+
+#include "mb_common.h"
+
+#define MBURING_ENTRIES 64
+
+typedef struct mburing MBURING_T;
+
+typedef enum
+{
+    MBURING_IO_SEND = 0,
+    MBURING_IO_RECV,
+    MBURING_IO_WRITE,
+    MBURING_IO_READ,
+    MBURING_IO_NUM
+} MBURING_IO_T;
+
+typedef enum
+{
+    MBURING_OP_IDLE = 0,        /* done, res holds the result */
+    MBURING_OP_QUEUED,          /* in the submission queue, not seen by the kernel */
+    MBURING_OP_BUSY             /* submitted */
+} MBURING_STATE_T;
+
+/* one operation, it must stay valid until it is idle again */
+typedef struct
+{
+    void    *sqe;               /* submission entry while queued */
+    int      res;               /* result of the last completion, -errno=ERROR */
+    UINT8_T  state;
+} MBURING_OP_T;
+
+/*
+ * Function  : Create an io_uring ring, one ring belongs to one thread
+ * entries   : submission queue size, 0=MBURING_ENTRIES
+ * return    : (MBURING_T *)=SUCCESS NULL=ERROR(or built without uring=yes)
+ */
+MBURING_T *mb_uring_create(UINT32_T entries);
+
+/*
+ * Function  : destory an io_uring ring, every operation must be idle
+ * mburing   : io_uring ring
+ * return    : void
+ */
+void mb_uring_destory(MBURING_T *mburing);
+
+/*
+ * Function  : queue an operation, nothing is submitted until a wait
+ * mburing   : io_uring ring
+ * op        : operation to track
+ * io        : operation type
+ * fd        : socket or tty
+ * buf       : data buffer, valid until the operation is idle
+ * len       : data length
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_uring_prep(MBURING_T *mburing, MBURING_OP_T *op, MBURING_IO_T io,
+    int fd, void *buf, UINT32_T len);
+
+/*
+ * Function  : grow a queued operation by len bytes, they follow its buffer
+ * op        : operation
+ * return    : 0=SUCCESS -1=NOT QUEUED
+ */
+int mb_uring_append(MBURING_OP_T *op, UINT32_T len);
+
+/*
+ * Function  : start the operation queued next only after this one succeeds,
+ *             it must be the last queued entry of the ring
+ * mburing   : io_uring ring
+ * op        : operation
+ * return    : 0=SUCCESS -1=NOT THE LAST QUEUED ENTRY
+ */
+int mb_uring_link(MBURING_T *mburing, MBURING_OP_T *op);
+
+/*
+ * Function  : submit everything queued and reap completions until op is idle,
+ *             completions of other operations on the ring are reaped on the way
+ * mburing   : io_uring ring
+ * op        : operation waited for
+ * deadline  : time(us) to give up
+ * return    : 0=SUCCESS -1=ERROR(errno ETIMEDOUT=DEADLINE PASSED, op not idle)
+ */
+int mb_uring_wait(MBURING_T *mburing, MBURING_OP_T *op, UINT64_T deadline);
+
+/*
+ * Function  : cancel an operation and wait until it is idle
+ * mburing   : io_uring ring
+ * op        : operation
+ * return    : void
+ */
+void mb_uring_cancel(MBURING_T *mburing, MBURING_OP_T *op);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Typed values over 1, 2 or 4 holding/input registers and strings,
+ *               in the word and byte order of the device
+ *            2. A block of registers decoded into or encoded from caller memory in one pass
+ *               by an array of descriptors, runs of one type are converted 16 bytes per step
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mb_value.h"
+
+/* bytes of a value, a string is counted in characters */
+static const UINT8_T value_width[MBVAL_TYPE_NUM] = {
+    [MBVAL_UINT16]  = 2,
+    [MBVAL_INT16]   = 2,
+    [MBVAL_UINT32]  = 4,
+    [MBVAL_INT32]   = 4,
+    [MBVAL_FLOAT32] = 4,
+    [MBVAL_UINT64]  = 8,
+    [MBVAL_INT64]   = 8,
+    [MBVAL_FLOAT64] = 8,
+    [MBVAL_STRING]  = 1,
+};
+
+/*
+ * Function  : n values of width bytes between wire and host order, the same steps both ways,
+ *             bytes swapped in every register and registers reversed in every value,
+ *             16 bytes per SSE2 step(every x86_64 has it), dst must not be src
+ * return    : void
+ */
+static void value_permute(UINT8_T *dst, const UINT8_T *src, int width, int n, int bswap, int wswap)
+{
+    int len = width * n;
+    int i   = 0;
+    int k   = 0;
+
+#if defined(__SSE2__)
+    UINT8_T rest[16];
+    __m128i v;
+
+    /* 16 bytes hold whole values of every width, the last few go through rest */
+    for (; i < len; i += 16)
+    {
+        if (i + 16 <= len)
+        {
+            v = _mm_loadu_si128((const __m128i *)(src + i));
+        }
+        else
+        {
+            memcpy(rest, src + i, len - i);
+            v = _mm_loadu_si128((const __m128i *)rest);
+        }
+
+        if (bswap)
+        {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        }
+
+        if (wswap && 4 == width)
+        {
+            v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+        }
+        else if (wswap && 8 == width)
+        {
+            v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0x1b), 0x1b);
+        }
+
+        if (i + 16 <= len)
+        {
+            _mm_storeu_si128((__m128i *)(dst + i), v);
+        }
+        else
+        {
+            _mm_storeu_si128((__m128i *)rest, v);
+            memcpy(dst + i, rest, len - i);
+        }
+    }
+#endif
+
+    /* register k of a value goes to width - 2 - k when reversed */
+    for (; i < len; i += 2)
+    {
+        k = i % width;
+        k = (i - k) + (wswap ? (width - 2 - k) : k);
+
+        dst[k]     = src[i + bswap];
+        dst[k + 1] = src[i + !bswap];
+    }
+}
+
+/*
+ * Function  : steps turning a value of an order into host order
+ * return    : void
+ */
+static void value_steps(const MBVAL_DESC_T *desc, int *bswap, int *wswap)
+{
+    *bswap = (!!(desc->order & MBVAL_BYTE_SWAP)) == MB_HOST_BIG_ENDIAN;
+    *wswap = (!!(desc->order & MBVAL_WORD_SWAP)) == MB_HOST_BIG_ENDIAN;
+}
+
+/*
+ * Function  : check a descriptor against the block
+ * return    : 0=SUCCESS -1=ERROR
+ */
+static int value_desc_check(const MBVAL_DESC_T *desc, int idx, UINT16_T n_reg)
+{
+    if (MBVAL_TYPE_NUM <= desc->type)
+    {
+        printf("Invalid value type(%d) of descriptor %d\n", desc->type, idx);
+        return -1;
+    }
+
+    if (desc->reg + mb_value_regs(desc) > n_reg)
+    {
+        printf("Value descriptor %d goes past the %d registers\n", idx, n_reg);
+        return -1;
+    }
+
+    return 0;
+}
+
+int mb_value_regs(const MBVAL_DESC_T *desc)
+{
+    PTR_CHECK_0(desc);
+
+    if (MBVAL_TYPE_NUM <= desc->type)
+    {
+        return 0;
+    }
+
+    if (MBVAL_STRING == desc->type)
+    {
+        return ALIGNED(desc->count, 2);
+    }
+
+    return (value_width[desc->type] / 2) * desc->count;
+}
+
+int mb_value_block_regs(const MBVAL_DESC_T *desc, int n_desc)
+{
+    PTR_CHECK_N1(desc);
+
+    int regs = 0;
+    int i    = 0;
+
+    for (i = 0; i < n_desc; ++i)
+    {
+        if (MBVAL_TYPE_NUM <= desc[i].type)
+        {
+            printf("Invalid value type(%d) of descriptor %d\n", desc[i].type, i);
+            return -1;
+        }
+
+        if (regs < desc[i].reg + mb_value_regs(&desc[i]))
+        {
+            regs = desc[i].reg + mb_value_regs(&desc[i]);
+        }
+    }
+
+    return regs;
+}
+
+int mb_value_decode(const MBVAL_DESC_T *desc, int n_desc, const UINT8_T *wire, UINT16_T n_reg, void *out)
+{
+    PTR_CHECK_N1(desc);
+    PTR_CHECK_N1(wire);
+    PTR_CHECK_N1(out);
+
+    const UINT8_T *src = NULL;
+    UINT8_T *dst   = NULL;
+    int      bswap = 0;
+    int      wswap = 0;
+    int      i     = 0;
+    int      c     = 0;
+
+    for (i = 0; i < n_desc; ++i)
+    {
+        if (0 > value_desc_check(&desc[i], i, n_reg))
+        {
+            return -1;
+        }
+
+        src = wire + (desc[i].reg * 2);
+        dst = (UINT8_T *)out + desc[i].offset;
+
+        if (MBVAL_STRING == desc[i].type)
+        {
+            /* character c is in byte c, or its neighbour in the register when bytes are swapped */
+            bswap = !!(desc[i].order & MBVAL_BYTE_SWAP);
+            for (c = 0; c < desc[i].count; ++c)
+            {
+                dst[c] = src[c ^ bswap];
+            }
+            dst[c] = '\0';
+            continue;
+        }
+
+        value_steps(&desc[i], &bswap, &wswap);
+        value_permute(dst, src, value_width[desc[i].type], desc[i].count, bswap, wswap);
+    }
+
+    return 0;
+}
+
+int mb_value_encode(const MBVAL_DESC_T *desc, int n_desc, const void *in, UINT8_T *wire, UINT16_T n_reg)
+{
+    PTR_CHECK_N1(desc);
+    PTR_CHECK_N1(in);
+    PTR_CHECK_N1(wire);
+
+    const UINT8_T *src = NULL;
+    UINT8_T *dst   = NULL;
+    int      bswap = 0;
+    int      wswap = 0;
+    int      end   = 0;
+    int      i     = 0;
+    int      c     = 0;
+
+    for (i = 0; i < n_desc; ++i)
+    {
+        if (0 > value_desc_check(&desc[i], i, n_reg))
+        {
+            return -1;
+        }
+
+        src = (const UINT8_T *)in + desc[i].offset;
+        dst = wire + (desc[i].reg * 2);
+
+        if (MBVAL_STRING == desc[i].type)
+        {
+            bswap = !!(desc[i].order & MBVAL_BYTE_SWAP);
+            end   = 0;
+            for (c = 0; c < ALIGNED(desc[i].count, 2) * 2; ++c)
+            {
+                end = end || (c >= desc[i].count) || !src[c];
+                dst[c ^ bswap] = end ? '\0' : src[c];
+            }
+            continue;
+        }
+
+        value_steps(&desc[i], &bswap, &wswap);
+        value_permute(dst, src, value_width[desc[i].type], desc[i].count, bswap, wswap);
+    }
+
+    return 0;
+}
+
+int mb_info_value_get(const MB_INFO_T *mb_info, const MBVAL_DESC_T *desc, int n_desc, void *out)
+{
+    PTR_CHECK_N1(mb_info);
+
+    UINT16_T n_reg = ((MAX_MBVALUE_SIZE < mb_info->n_byte) ? MAX_MBVALUE_SIZE : mb_info->n_byte) / 2;
+
+    return mb_value_decode(desc, n_desc, mb_info->value, n_reg, out);
+}
+
+int mb_info_value_set(MB_INFO_T *mb_info, const MBVAL_DESC_T *desc, int n_desc, const void *in)
+{
+    PTR_CHECK_N1(mb_info);
+
+    int regs = mb_value_block_regs(desc, n_desc);
+
+    if (0 > regs)
+    {
+        return -1;
+    }
+
+    if ((MAX_MBVALUE_SIZE / 2) < regs)
+    {
+        printf("Too many registers(%d) for a ModBus request\n", regs);
+        return -1;
+    }
+
+    memset(mb_info->value, 0, regs * 2);
+    mb_info->n_reg  = regs;
+    mb_info->n_byte = regs * 2;
+
+    return mb_value_encode(desc, n_desc, in, mb_info->value, regs);
+}
+
+int mb_view_value_get(const MB_VIEW_T *view, const MBVAL_DESC_T *desc, int n_desc, void *out)
+{
+    PTR_CHECK_N1(view);
+
+    return mb_value_decode(desc, n_desc, view->payload, MB_VIEW_REG_NUM(view), out);
+}
@@ -0,0 +1,114 @@
+/*
+ * Author   : shawn-tany
+ * Function : 1. Typed values over 1, 2 or 4 holding/input registers and strings,
+ *               in the word and byte order of the device
+ *            2. A block of registers decoded into or encoded from caller memory in one pass
+ *               by an array of descriptors, runs of one type are converted 16 bytes per step
+ */
+
+#ifndef MB_VALUE
+#define MB_VALUE
+
+#include "mb_common.h"
+
+#define MBVAL_WORD_SWAP 0x01    /* low word first */
+#define MBVAL_BYTE_SWAP 0x02    /* low byte first in every register */
+
+/* order of 0xAABBCCDD on the wire, longer values alike */
+typedef enum
+{
+    MBVAL_ORDER_ABCD = 0,                                   /* big endian, the ModBus default */
+    MBVAL_ORDER_CDAB = MBVAL_WORD_SWAP,                     /* low word first */
+    MBVAL_ORDER_BADC = MBVAL_BYTE_SWAP,                     /* byte swapped registers */
+    MBVAL_ORDER_DCBA = MBVAL_WORD_SWAP | MBVAL_BYTE_SWAP,   /* little endian */
+} MBVAL_ORDER_T;
+
+typedef enum
+{
+    MBVAL_UINT16 = 0,
+    MBVAL_INT16,
+    MBVAL_UINT32,
+    MBVAL_INT32,
+    MBVAL_FLOAT32,
+    MBVAL_UINT64,
+    MBVAL_INT64,
+    MBVAL_FLOAT64,
+    MBVAL_STRING,               /* 2 characters per register, the first in the high byte */
+    MBVAL_TYPE_NUM
+} MBVAL_TYPE_T;
+
+/* a run of values of one type */
+typedef struct
+{
+    UINT16_T reg;               /* first register, from the start of the block */
+    UINT16_T count;             /* values, characters of a string */
+    UINT16_T offset;            /* byte offset of the first value in caller memory, offsetof() of a field */
+    UINT8_T  type;              /* MBVAL_TYPE_T */
+    UINT8_T  order;             /* MBVAL_ORDER_T, only MBVAL_BYTE_SWAP matters to a string */
+} MBVAL_DESC_T;
+
+#define MBVAL_DESC(reg, type, order, count, offset) { (reg), (count), (offset), (type), (order) }
+
+/*
+ * Function  : registers a descriptor covers
+ * desc      : descriptor
+ * return    : register number, 0=UNKNOWN TYPE
+ */
+int mb_value_regs(const MBVAL_DESC_T *desc);
+
+/*
+ * Function  : registers a block of descriptors covers, from register 0 of the block
+ * desc      : descriptors
+ * n_desc    : descriptor number
+ * return    : register number, -1=UNKNOWN TYPE
+ */
+int mb_value_block_regs(const MBVAL_DESC_T *desc, int n_desc);
+
+/*
+ * Function  : decode registers into caller memory, a value goes to out + offset as its
+ *             host type(UINT16_T, short, UINT32_T, int, float, UINT64_T, INT64_T, double),
+ *             a string to count + 1 bytes ended by '\0'
+ * desc      : descriptors
+ * n_desc    : descriptor number
+ * wire      : register bytes as on the wire
+ * n_reg     : registers in wire
+ * out       : caller memory
+ * return    : 0=SUCCESS -1=ERROR(a descriptor past n_reg or of unknown type)
+ */
+int mb_value_decode(const MBVAL_DESC_T *desc, int n_desc, const UINT8_T *wire, UINT16_T n_reg, void *out);
+
+/*
+ * Function  : encode caller memory into registers, the reverse of mb_value_decode,
+ *             a string ends at '\0' or count characters, the rest is padded with '\0'
+ * desc      : descriptors
+ * n_desc    : descriptor number
+ * in        : caller memory
+ * wire      : register bytes as on the wire
+ * n_reg     : registers in wire
+ * return    : 0=SUCCESS -1=ERROR(a descriptor past n_reg or of unknown type)
+ */
+int mb_value_encode(const MBVAL_DESC_T *desc, int n_desc, const void *in, UINT8_T *wire, UINT16_T n_reg);
+
+/*
+ * Function  : decode the registers of an FC03/04 response
+ * mb_info   : response
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_info_value_get(const MB_INFO_T *mb_info, const MBVAL_DESC_T *desc, int n_desc, void *out);
+
+/*
+ * Function  : encode the registers of an FC10 request, sets n_reg, n_byte and value,
+ *             registers no descriptor covers are 0
+ * mb_info   : request
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_info_value_set(MB_INFO_T *mb_info, const MBVAL_DESC_T *desc, int n_desc, const void *in);
+
+/*
+ * Function  : decode the registers of an FC03/04 view
+ * view      : response view
+ * return    : 0=SUCCESS -1=ERROR
+ */
+int mb_view_value_get(const MB_VIEW_T *view, const MBVAL_DESC_T *desc, int n_desc, void *out);
+
+#endif
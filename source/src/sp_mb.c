@@ -12,6 +12,55 @@
 
 #define DFT_MBIO_CONFIG_FILE "/usr/local/etc/mb_io.conf"
 
+/*
+ * Function : check a ModBus master request
+ * mb_info  : the request
+ * return   : 0=SUCCESS -1=ERROR
+ */
+static int sp_mb_info_check(MB_INFO_T *mb_info)
+{
+    PTR_CHECK_N1(mb_info);
+
+    int ret = 0;
+
+    switch (mb_info->code)
+    {
+        case MB_FUNC_01 : 
+        case MB_FUNC_02 : 
+        case MB_FUNC_03 :
+        case MB_FUNC_04 :
+            if (!mb_info->n_reg)
+            {
+                ret = -1;
+            }
+            break;
+            
+        case MB_FUNC_05 :
+        case MB_FUNC_06 : 
+            break;
+            
+        /* the quantity goes on the wire as given, above these it says more than the PDU holds */
+        case MB_FUNC_0f : 
+            if (!mb_info->n_reg || MB_WRITE_COIL_MAX_NUM < mb_info->n_reg)
+            {
+                ret = -1;
+            }
+            break;
+
+        case MB_FUNC_10 : 
+            if (!mb_info->n_reg || MB_WRITE_REG_MAX_NUM < mb_info->n_reg)
+            {
+                ret = -1;
+            }
+            break;
+            
+        default :
+            ret = -1;
+    }
+
+    return ret;
+}
+
 /*
  * Function : updata ModBus master information to ModBus context
  * mb_ctx   : ModBus context
@@ -29,33 +78,7 @@ static int sp_mbctx_info_updata(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info)
 
     do 
     {
-        switch (mb_info->code)
-        {
-            case MB_FUNC_01 : 
-            case MB_FUNC_02 : 
-            case MB_FUNC_03 :
-            case MB_FUNC_04 :
-                if (!mb_info->n_reg)
-                {
-                    ret = -1;
-                }
-                break;
-                
-            case MB_FUNC_05 :
-            case MB_FUNC_06 : 
-                break;
-                
-            case MB_FUNC_0f : 
-            case MB_FUNC_10 : 
-                if (!mb_info->n_reg)
-                {
-                    ret = -1;
-                }
-                break;
-                
-            default :
-                ret = -1;
-        }
+        ret = sp_mb_info_check(mb_info);
 
         /* failed */
         if (0 > ret)
@@ -72,6 +95,10 @@ static int sp_mbctx_info_updata(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info)
         {
             mbrtuctx_info_updata(mb_ctx->ctx.mb_rtu_ctx, mb_info);
         }
+        else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+        {
+            mbasciictx_info_updata(mb_ctx->ctx.mb_ascii_ctx, mb_info);
+        }
         
     } while (0);
 
@@ -103,6 +130,10 @@ static int sp_mbctx_info_takeout(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info)
     {
         mbrtuctx_info_takeout(mb_ctx->ctx.mb_rtu_ctx, mb_info);
     }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        mbasciictx_info_takeout(mb_ctx->ctx.mb_ascii_ctx, mb_info);
+    }
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
@@ -224,6 +255,7 @@ SPMB_CTX_T *sp_mb_init(SPMB_CTL_T *mb_ctl)
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
     SPMB_CTX_T *mb_ctx = NULL;
+    MBTCP_CTL_T tcp_ctrl;
     char *ioconf = strlen(mb_ctl->mb_conf) ? mb_ctl->mb_conf : DFT_MBIO_CONFIG_FILE;
 
     /* create sp modbus context */
@@ -235,11 +267,27 @@ SPMB_CTX_T *sp_mb_init(SPMB_CTL_T *mb_ctl)
     memset(mb_ctx, 0, sizeof(SPMB_CTX_T));
 
     /* create a modbus descriptor */
-    if (MB_TYPE_TCP == mb_ctl->mb_type)
+    if (MB_TYPE_TCP == mb_ctl->mb_type || MB_TYPE_UNIX == mb_ctl->mb_type || MB_TYPE_RTU_TCP == mb_ctl->mb_type)
     {
+        tcp_ctrl = mb_ctl->tcp_ctrl;
+        tcp_ctrl.rtu = (MB_TYPE_RTU_TCP == mb_ctl->mb_type);
+
+        /* path selects AF_UNIX in mb_tcp */
+        if (MB_TYPE_UNIX != mb_ctl->mb_type)
+        {
+            tcp_ctrl.path[0] = 0;
+        }
+        else if (!tcp_ctrl.path[0])
+        {
+            printf("Invalid ModBus unix socket path\n");
+            free(mb_ctx);
+            return NULL;
+        }
+
+        /* all are ModBus TCP contexts from now on */
         mb_ctx->mb_type = MB_TYPE_TCP;
 
-        mb_ctx->ctx.mb_tcp_ctx = mb_tcp_init(&mb_ctl->tcp_ctrl);
+        mb_ctx->ctx.mb_tcp_ctx = mb_tcp_init(&tcp_ctrl);
         /* check descriptor */
         if (!mb_ctx->ctx.mb_tcp_ctx)
         {
@@ -259,6 +307,18 @@ SPMB_CTX_T *sp_mb_init(SPMB_CTL_T *mb_ctl)
             return NULL;
         }
     }
+    else if (MB_TYPE_ASCII == mb_ctl->mb_type)
+    {
+        mb_ctx->mb_type = MB_TYPE_ASCII;
+
+        mb_ctx->ctx.mb_ascii_ctx = mb_ascii_init(&mb_ctl->rtu_ctrl);
+        /* check descriptor */
+        if (!mb_ctx->ctx.mb_ascii_ctx)
+        {
+            free(mb_ctx);
+            return NULL;
+        }
+    }
     else
     {
         printf("Invalid ModBus protocol type(0x%02x)\n", mb_ctl->mb_type);
@@ -293,6 +353,10 @@ void sp_mb_close(SPMB_CTX_T *mb_ctx)
     {
         mb_rtu_close(mb_ctx->ctx.mb_rtu_ctx);
     }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        mb_ascii_close(mb_ctx->ctx.mb_ascii_ctx);
+    }
 
     free(mb_ctx);
 
@@ -322,6 +386,10 @@ int sp_mb_recv(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info)
     {
         length = mb_rtu_recv(mb_ctx->ctx.mb_rtu_ctx);
     }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        length = mb_ascii_recv(mb_ctx->ctx.mb_ascii_ctx);
+    }
 
     if (0 > sp_mbctx_info_takeout(mb_ctx, mb_info))
     {
@@ -333,6 +401,34 @@ int sp_mb_recv(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info)
     return length;
 }
 
+/*
+ * Function : recv ModBus data from slaver, the response is decapped in place,
+ *            no value byte is copied, mb_info passed to sp_mb_send is left alone
+ * mb_ctx   : ModBus context
+ * view     : the response, valid until the next send/recv on mb_ctx
+ * return   : 0=CLOSE/NO RESPONSE length=SUCCESS -1=ERROR
+ */
+int sp_mb_recv_view(SPMB_CTX_T *mb_ctx, MB_VIEW_T *view)
+{
+    PTR_CHECK_N1(mb_ctx);
+    PTR_CHECK_N1(view);
+
+    if (MB_TYPE_TCP == mb_ctx->mb_type)
+    {
+        return mb_tcp_recv_view(mb_ctx->ctx.mb_tcp_ctx, view);
+    }
+    else if (MB_TYPE_RTU == mb_ctx->mb_type)
+    {
+        return mb_rtu_recv_view(mb_ctx->ctx.mb_rtu_ctx, view);
+    }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        return mb_ascii_recv_view(mb_ctx->ctx.mb_ascii_ctx, view);
+    }
+
+    return -1;
+}
+
 /*
  * Function : send ModBus data to slaver
  * mb_ctx   : ModBus context
@@ -360,12 +456,114 @@ int sp_mb_send(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info)
     {
         length = mb_rtu_send(mb_ctx->ctx.mb_rtu_ctx);
     }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        length = mb_ascii_send(mb_ctx->ctx.mb_ascii_ctx);
+    }
 
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
     return length;
 }
 
+/*
+ * Function : encode a request once for sp_mb_send_prepared, such as a poll of every scan cycle,
+ *            the request is checked like sp_mb_send does and mb_ctx is left alone
+ * mb_ctx   : ModBus context the request is sent on
+ * mb_info  : the request
+ * prep     : prepared request
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int sp_mb_prepare(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep)
+{
+    PTR_CHECK_N1(mb_ctx);
+
+    if (0 > sp_mb_info_check(mb_info))
+    {
+        return -1;
+    }
+
+    if (MB_TYPE_TCP == mb_ctx->mb_type)
+    {
+        return mb_tcp_prepare(mb_ctx->ctx.mb_tcp_ctx, mb_info, prep);
+    }
+    else if (MB_TYPE_RTU == mb_ctx->mb_type)
+    {
+        return mb_rtu_prepare(mb_ctx->ctx.mb_rtu_ctx, mb_info, prep);
+    }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        return mb_ascii_prepare(mb_ctx->ctx.mb_ascii_ctx, mb_info, prep);
+    }
+
+    return -1;
+}
+
+/*
+ * Function : send a prepared request like sp_mb_send without encoding it, responses are
+ *            received with sp_mb_recv/sp_mb_recv_view as usual
+ * mb_ctx   : ModBus context of sp_mb_prepare
+ * prep     : prepared request
+ * return   : 0=CLOSE length=SUCCESS -1=ERROR
+ */
+int sp_mb_send_prepared(SPMB_CTX_T *mb_ctx, const MB_PREP_T *prep)
+{
+    MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
+
+    PTR_CHECK_N1(mb_ctx);
+
+    if (MB_TYPE_TCP == mb_ctx->mb_type)
+    {
+        return mb_tcp_send_prepared(mb_ctx->ctx.mb_tcp_ctx, prep);
+    }
+    else if (MB_TYPE_RTU == mb_ctx->mb_type)
+    {
+        return mb_rtu_send_prepared(mb_ctx->ctx.mb_rtu_ctx, prep);
+    }
+    else if (MB_TYPE_ASCII == mb_ctx->mb_type)
+    {
+        return mb_ascii_send_prepared(mb_ctx->ctx.mb_ascii_ctx, prep);
+    }
+
+    return -1;
+}
+
+/*
+ * Function : transaction code of the last request sent(MB_TX) or response received(MB_RX),
+ *            pipelined ModBus TCP responses are matched with it, 0 for other protocols
+ * mb_ctx   : ModBus context
+ * return   : transaction code
+ */
+UINT16_T sp_mb_tid_get(SPMB_CTX_T *mb_ctx, MB_DIRECT_T direct)
+{
+    PTR_CHECK_0(mb_ctx);
+
+    if (MB_TYPE_TCP == mb_ctx->mb_type)
+    {
+        return mbtcpctx_tid_get(mb_ctx->ctx.mb_tcp_ctx, direct);
+    }
+
+    return 0;
+}
+
+/*
+ * Function : send the requests gathered by a ModBus TCP send queue(tcp_ctrl.batch),
+ *            call it at the end of each scan cycle, nothing to do for other protocols
+ * mb_ctx   : ModBus context
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int sp_mb_flush(SPMB_CTX_T *mb_ctx)
+{
+    PTR_CHECK_N1(mb_ctx);
+
+    if (MB_TYPE_TCP == mb_ctx->mb_type)
+    {
+        return (0 > mb_tcp_flush(mb_ctx->ctx.mb_tcp_ctx)) ? -1 : 0;
+    }
+
+    return 0;
+}
+
 int sp_mbio_get(SPMB_CTX_T *mb_ctx, IO_DIRECTION_T direction, 
     UINT16_T ioidx, IO_STATUS_T *status)
 {
@@ -424,7 +622,9 @@ int sp_mbio_set(SPMB_CTX_T *mb_ctx, UINT16_T ioidx, IO_STATUS_T statu)
         .reg   = ioidx + mb_ctx->mb_ioconf.o_addr_start,
         .n_reg = 1
     };
-    *((UINT16_T *)(&set_mb_info.value[0])) = (IO_ON == statu) ? 0xff : 0x00;
+    UINT16_T  word = (IO_ON == statu) ? 0xff00 : 0x0000;
+
+    mb_reg_encode(set_mb_info.value, &word, 1);
 
     if (ioidx >= mb_ctx->mb_ioconf.o_number)
     {
@@ -456,36 +656,38 @@ int sp_mbio_set(SPMB_CTX_T *mb_ctx, UINT16_T ioidx, IO_STATUS_T statu)
  * mb_info   : ModBus master info
  * return    : void
  */
-void sp_mb_status_show(MB_INFO_T mb_info)
+void sp_mb_status_show(MB_INFO_T *mb_info)
 {
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
-    if (!(mb_info.err))
+    PTR_CHECK_VOID(mb_info);
+
+    if (!(mb_info->err))
     {
         printf("MB SUCCESS\n");
         return ;
     }
 
-    UINT8_T code = mb_info.code & (~0x80);
+    UINT8_T code = mb_info->code & (~0x80);
     int i = 0;
 
-    printf("MB ERROR CODE(0x%02x) : ", mb_info.err);
+    printf("MB ERROR CODE(0x%02x) : ", mb_info->err);
 
-    switch (mb_info.err)
+    switch (mb_info->err)
     {
         case MB_ERR_FUNC :
             printf("Invalid function code(0x%02x)\n", code);
             break;
 
         case MB_ERR_ADDR :
-            printf("Invalid register address(0x%02x)\n", mb_info.reg);
+            printf("Invalid register address(0x%02x)\n", mb_info->reg);
             break;
 
         case MB_ERR_DATA :
             printf("Invalid data\n");
-            for (i = 0; i < mb_info.n_byte; ++i)
+            for (i = 0; i < mb_info->n_byte; ++i)
             {
-                printf("Data[%d] : 0x%02x\n", i, mb_info.value[i]);
+                printf("Data[%d] : 0x%02x\n", i, mb_info->value[i]);
             }
             break;
 
@@ -522,48 +724,50 @@ void sp_mb_status_show(MB_INFO_T mb_info)
  * mb_info   : ModBus master info
  * return    : void
  */
-void sp_mb_data_show(MB_INFO_T mb_info)
+void sp_mb_data_show(MB_INFO_T *mb_info)
 {
     MB_PRINT("%s : %d\n", __FUNCTION__, __LINE__);
 
+    PTR_CHECK_VOID(mb_info);
+
     int i = 0;
 
-    if (mb_info.err)
+    if (mb_info->err)
     {
         return ;
     }
 
-    switch (mb_info.code)
+    switch (mb_info->code)
     {
         case MB_FUNC_01 : 
         case MB_FUNC_02 : 
         case MB_FUNC_03 : 
         case MB_FUNC_04 : 
-            printf("mb_info.code = 0x%02x\n", mb_info.code);
-            printf("mb_info.n_byte = %d\n", mb_info.n_byte);
+            printf("mb_info.code = 0x%02x\n", mb_info->code);
+            printf("mb_info.n_byte = %d\n", mb_info->n_byte);
             /* value */
-            for (i = 0; i < mb_info.n_byte; i++)
+            for (i = 0; i < mb_info->n_byte; i++)
             {
-                printf("mb_info.value[%d] = 0x%02x\n", i + 1, mb_info.value[i]);
+                printf("mb_info.value[%d] = 0x%02x\n", i + 1, mb_info->value[i]);
             }
             break;
             
         case MB_FUNC_05 : 
         case MB_FUNC_06 : 
-            printf("mb_info.code = 0x%02x\n", mb_info.code);
-            printf("mb_info.reg = 0x%04x\n", mb_info.reg);
-            printf("mb_info.value = 0x%04x\n", *(UINT16_T *)(&mb_info.value[0]));
+            printf("mb_info.code = 0x%02x\n", mb_info->code);
+            printf("mb_info.reg = 0x%04x\n", mb_info->reg);
+            printf("mb_info.value = 0x%04x\n", (mb_info->value[0] << 8) | mb_info->value[1]);
             break;
             
         case MB_FUNC_0f : 
         case MB_FUNC_10 : 
-            printf("mb_info.code = 0x%02x\n", mb_info.code);
-            printf("mb_info.reg = 0x%04x\n", mb_info.reg);
-            printf("mb_info.n_reg = 0x%04x\n", mb_info.n_reg);
+            printf("mb_info.code = 0x%02x\n", mb_info->code);
+            printf("mb_info.reg = 0x%04x\n", mb_info->reg);
+            printf("mb_info.n_reg = 0x%04x\n", mb_info->n_reg);
             break;
             
         default :
-            printf("Unkown function code 0x%02x\n", mb_info.code);
+            printf("Unkown function code 0x%02x\n", mb_info->code);
             break;
     }
 
@@ -11,6 +11,9 @@
 
 #include "mb_tcp.h"
 #include "mb_rtu.h"
+#include "mb_ascii.h"
+#include "mb_coil.h"
+#include "mb_value.h"
 
 typedef enum
 {
@@ -51,6 +54,7 @@ typedef union
 {
     MBTCP_DATA_T tcp_data;
     MBRTU_DATA_T rtu_data;
+    MBASCII_DATA_T ascii_data;
 } SPMB_DATA_T;
 
 typedef struct 
@@ -63,6 +67,7 @@ typedef struct
     {
         MBTCP_CTX_T *mb_tcp_ctx;
         MBRTU_CTX_T *mb_rtu_ctx;
+        MBASCII_CTX_T *mb_ascii_ctx;
     } ctx;
 } SPMB_CTX_T;
 
@@ -87,6 +92,15 @@ void sp_mb_close(SPMB_CTX_T *mb_ctx);
  */
 int sp_mb_recv(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info);
 
+/*
+ * Function : recv ModBus data from slaver, the response is decapped in place,
+ *            no value byte is copied, mb_info passed to sp_mb_send is left alone
+ * mb_ctx   : ModBus context
+ * view     : the response, valid until the next send/recv on mb_ctx
+ * return   : 0=CLOSE/NO RESPONSE length=SUCCESS -1=ERROR
+ */
+int sp_mb_recv_view(SPMB_CTX_T *mb_ctx, MB_VIEW_T *view);
+
 /*
  * Function : send ModBus data to slaver
  * mb_ctx   : ModBus context
@@ -94,6 +108,41 @@ int sp_mb_recv(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info);
  */
 int sp_mb_send(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info);
 
+/*
+ * Function : encode a request once for sp_mb_send_prepared, such as a poll of every scan cycle,
+ *            the request is checked like sp_mb_send does and mb_ctx is left alone
+ * mb_ctx   : ModBus context the request is sent on
+ * mb_info  : the request
+ * prep     : prepared request
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int sp_mb_prepare(SPMB_CTX_T *mb_ctx, MB_INFO_T *mb_info, MB_PREP_T *prep);
+
+/*
+ * Function : send a prepared request like sp_mb_send without encoding it, responses are
+ *            received with sp_mb_recv/sp_mb_recv_view as usual
+ * mb_ctx   : ModBus context of sp_mb_prepare
+ * prep     : prepared request
+ * return   : 0=CLOSE length=SUCCESS -1=ERROR
+ */
+int sp_mb_send_prepared(SPMB_CTX_T *mb_ctx, const MB_PREP_T *prep);
+
+/*
+ * Function : transaction code of the last request sent(MB_TX) or response received(MB_RX),
+ *            pipelined ModBus TCP responses are matched with it, 0 for other protocols
+ * mb_ctx   : ModBus context
+ * return   : transaction code
+ */
+UINT16_T sp_mb_tid_get(SPMB_CTX_T *mb_ctx, MB_DIRECT_T direct);
+
+/*
+ * Function : send the requests gathered by a ModBus TCP send queue(tcp_ctrl.batch),
+ *            call it at the end of each scan cycle, nothing to do for other protocols
+ * mb_ctx   : ModBus context
+ * return   : 0=SUCCESS -1=ERROR
+ */
+int sp_mb_flush(SPMB_CTX_T *mb_ctx);
+
 int sp_mbio_get(SPMB_CTX_T *mb_ctx, IO_DIRECTION_T direction, 
     UINT16_T ioidx, IO_STATUS_T *status);
 
@@ -104,13 +153,13 @@ int sp_mbio_set(SPMB_CTX_T *mb_ctx, UINT16_T ioidx, IO_STATUS_T statu);
  * mb_info   : ModBus master info
  * return    : void
  */
-void sp_mb_status_show(MB_INFO_T mb_info);
+void sp_mb_status_show(MB_INFO_T *mb_info);
 
 /*
  * Function  : show ModBus data after decap
  * mb_info   : ModBus master info
  * return    : void
  */
-void sp_mb_data_show(MB_INFO_T mb_info);
+void sp_mb_data_show(MB_INFO_T *mb_info);
 
 #endif